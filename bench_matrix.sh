@@ -0,0 +1,98 @@
+#!/bin/bash
+
+# Throughput matrix for the transfer tuning settings (DFS_IO_BUFFER, DFS_CORK,
+# DFS_NODELAY, DFS_SNDBUF/DFS_RCVBUF). Restarts S1-S4 with every combination,
+# runs the same w25bench workload against them and prints one row per combination.
+# Expects S1, S2, S3, S4 and w25bench built in the script's directory.
+#
+# Usage: ./bench_matrix.sh [seconds per run] [clients]
+# The value lists can be overridden from the environment, e.g.
+#   IO_BUFFERS="1K 64K" SOCKBUFS="auto" ./bench_matrix.sh 5 4
+
+# Get the absolute path of the script's directory
+SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+
+DURATION=${1:-10}
+CLIENTS=${2:-8}
+IO_BUFFERS=${IO_BUFFERS:-"1K 64K 1M"}
+CORKS=${CORKS:-"0 1"}
+NODELAYS=${NODELAYS:-"0 1"}
+SOCKBUFS=${SOCKBUFS:-"auto 4M"}
+MIX=${MIX:-"uploadf=40,downlf=60"}
+SIZES=${SIZES:-"4k=50,1m=40,16m=10"}
+
+# Function to stop all servers and wait for their ports to be released
+stop_servers() {
+    for port in 4307 4308 4309 4310; do
+        lsof -ti:$port | xargs kill -9 2>/dev/null
+        while lsof -ti:$port >/dev/null; do
+            sleep 0.2
+        done
+    done
+}
+
+# Function to start all servers with the tuning settings currently exported
+start_servers() {
+    local port=4307
+    for server in S1 S2 S3 S4; do
+        (cd "$SCRIPT_DIR" && exec "./$server" > /dev/null &)
+        local attempts=0
+        while ! lsof -ti:$port >/dev/null && [ $attempts -lt 50 ]; do
+            sleep 0.2
+            attempts=$((attempts + 1))
+        done
+        port=$((port + 1))
+    done
+}
+
+# Function to pull one number out of w25bench's JSON report
+json_field() {
+    echo "$1" | grep -o "\"$2\":[0-9.]*" | head -1 | cut -d: -f2
+}
+
+# Function to turn bytes per second into MB per second
+to_mb() {
+    awk -v bytes="${1:-0}" 'BEGIN { printf "%.1f", bytes / 1048576 }'
+}
+
+for binary in S1 S2 S3 S4 w25bench; do
+    if [ ! -x "$SCRIPT_DIR/$binary" ]; then
+        echo "Error: $binary is not built in $SCRIPT_DIR"
+        exit 1
+    fi
+done
+
+mkdir -p ~/S1 ~/S2 ~/S3 ~/S4
+trap stop_servers EXIT
+
+printf "%-9s %-5s %-8s %-8s %10s %12s %12s %12s %12s\n" \
+    io_buffer cork nodelay sockbuf ops/s recv_MB/s sent_MB/s downlf_p99 uploadf_p99
+for io_buffer in $IO_BUFFERS; do
+    for cork in $CORKS; do
+        for nodelay in $NODELAYS; do
+            for sockbuf in $SOCKBUFS; do
+                export DFS_IO_BUFFER=$io_buffer DFS_CORK=$cork DFS_NODELAY=$nodelay
+                if [ "$sockbuf" = "auto" ]; then
+                    unset DFS_SNDBUF DFS_RCVBUF
+                else
+                    export DFS_SNDBUF=$sockbuf DFS_RCVBUF=$sockbuf
+                fi
+
+                stop_servers
+                rm -rf ~/S1/matrix ~/S2/matrix ~/S3/matrix ~/S4/matrix
+                start_servers
+
+                report=$("$SCRIPT_DIR/w25bench" -c "$CLIENTS" -d "$DURATION" -m "$MIX" -s "$SIZES" -r "~S1/matrix" -j)
+                ops=$(json_field "$report" ops_per_s)
+                received=$(json_field "$report" received_bytes_per_s)
+                sent=$(json_field "$report" sent_bytes_per_s)
+                downlf_p99=$(echo "$report" | grep -o '"downlf":{[^}]*}' | grep -o '"p99_us":[0-9]*' | cut -d: -f2)
+                uploadf_p99=$(echo "$report" | grep -o '"uploadf":{[^}]*}' | grep -o '"p99_us":[0-9]*' | cut -d: -f2)
+
+                printf "%-9s %-5s %-8s %-8s %10s %12s %12s %10sus %10sus\n" \
+                    "$io_buffer" "$cork" "$nodelay" "$sockbuf" "${ops:--}" \
+                    "$(to_mb "$received")" "$(to_mb "$sent")" "${downlf_p99:--}" "${uploadf_p99:--}"
+            done
+        done
+    done
+done
@@ -0,0 +1,1296 @@
+// Distributed File System - Shared server helpers
+// These used to be copied into every server; they live here so the servers and
+// the micro-benchmarks run the same code.
+
+#define _GNU_SOURCE // for copy_file_range()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/wait.h> // for WEXITSTATUS()
+#include <linux/fs.h> // for FICLONE
+#include "dfs_core.h"
+#include "dfs_net.h"
+#include "dfs_match.h"
+#include "dfs_meta.h"
+#include "dfs_pack.h"
+#include "dfs_peer.h"
+#include "dfs_stats.h"
+#include "dfs_trace.h"
+#include "dfs_watch.h"
+
+// Function to create a directory tree for a given path
+// Ensures that all intermediate directories in the path exist.
+// Uploads almost always go to a directory that is already there, so the full path
+// is tried first and the components are only walked when a parent is missing.
+int create_directory_tree(const char *path)
+{
+    if (mkdir(path, 0755) == 0 || errno == EEXIST)
+    {
+        return 0;
+    }
+    if (errno != ENOENT)
+    {
+        return -1;
+    }
+
+    char *p;
+    char tmp[DFS_PATH_MAX];
+    snprintf(tmp, DFS_PATH_MAX, "%s", path);
+
+    // Skip leading slash if present
+    p = (tmp[0] == '/') ? tmp + 1 : tmp;
+
+    // Create each directory in the path
+    while ((p = strchr(p, '/')))
+    {
+        *p = '\0';
+        if (mkdir(tmp, 0755) && errno != EEXIST)
+        {
+            return -1;
+        }
+        *p = '/';
+        p++;
+    }
+
+    // Create the final directory
+    if (mkdir(tmp, 0755) && errno != EEXIST)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Output buffer and path being walked by dfs_list_files()
+struct list_state
+{
+    char path[DFS_PATH_MAX]; // base_path/relative path of the current directory
+    size_t base_len; // Length of base_path including its trailing '/'
+    const char *ext;
+    char *out;
+    size_t out_size;
+    size_t out_len;
+};
+
+// Function to append text to the listing, truncating once the buffer is full
+static void list_append(struct list_state *state, const char *text, size_t len)
+{
+    if (state->out_len + 1 >= state->out_size)
+    {
+        return;
+    }
+    size_t room = state->out_size - state->out_len - 1;
+    if (len > room)
+    {
+        len = room;
+    }
+    memcpy(state->out + state->out_len, text, len);
+    state->out_len += len;
+    state->out[state->out_len] = '\0';
+}
+
+// Function to list one directory and recurse into its subdirectories
+// The path is extended in place, so no per-entry path copies are made.
+static void list_directory(struct list_state *state, size_t path_len)
+{
+    DIR *dir = opendir(state->path);
+    if (!dir) return;
+
+    size_t ext_len = strlen(state->ext);
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        // Skip . and .. directories
+        if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' || (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+        {
+            continue;
+        }
+
+        size_t name_len = strlen(ent->d_name);
+        if (path_len + 1 + name_len >= DFS_PATH_MAX)
+        {
+            continue;
+        }
+
+        if (ent->d_type == DT_REG)
+        {
+            // Match on the last extension only, like strrchr()
+            const char *dot = strrchr(ent->d_name, '.');
+            if (dot && (size_t)(ent->d_name + name_len - dot) == ext_len && memcmp(dot, state->ext, ext_len) == 0)
+            {
+                // Emit ~S1/<path relative to the listed directory>
+                list_append(state, "~S1/", 4);
+                if (path_len > state->base_len)
+                {
+                    list_append(state, state->path + state->base_len, path_len - state->base_len);
+                    list_append(state, "/", 1);
+                }
+                list_append(state, ent->d_name, name_len);
+                list_append(state, "\n", 1);
+            }
+        }
+        else if (ent->d_type == DT_DIR)
+        {
+            // Recursively process subdirectory
+            size_t len = path_len;
+            if (len > 0 && state->path[len - 1] != '/')
+            {
+                state->path[len++] = '/';
+            }
+            memcpy(state->path + len, ent->d_name, name_len + 1);
+            list_directory(state, len + name_len);
+            state->path[path_len] = '\0';
+        }
+    }
+    closedir(dir);
+}
+
+// Function to recursively list files with the given extension below base_path
+// Writes "~S1/<relative path>" lines into out (always NUL-terminated, truncated when full)
+// and returns the number of bytes written.
+size_t dfs_list_files(const char *base_path, const char *ext, char *out, size_t out_size)
+{
+    struct list_state state;
+    state.ext = ext;
+    state.out = out;
+    state.out_size = out_size;
+    state.out_len = 0;
+    if (out_size > 0)
+    {
+        out[0] = '\0';
+    }
+
+    size_t len = strlen(base_path);
+    if (len + 1 >= DFS_PATH_MAX)
+    {
+        return 0;
+    }
+    memcpy(state.path, base_path, len + 1);
+    state.base_len = (len > 0 && base_path[len - 1] == '/') ? len : len + 1;
+    list_directory(&state, len);
+    return state.out_len;
+}
+
+// Function to copy length bytes between descriptors in chunk_size pieces
+// Returns 0 on success and -1 if either side fails or the input ends early.
+int dfs_copy_fd(int in_fd, int out_fd, off_t length, size_t chunk_size)
+{
+    char stack_buffer[1024];
+    char *buffer = stack_buffer;
+    if (chunk_size > sizeof(stack_buffer))
+    {
+        buffer = malloc(chunk_size);
+        if (buffer == NULL)
+        {
+            buffer = stack_buffer;
+            chunk_size = sizeof(stack_buffer);
+        }
+    }
+
+    int rc = 0;
+    off_t remaining = length;
+    while (remaining > 0)
+    {
+        ssize_t n = read(in_fd, buffer, ((size_t)remaining < chunk_size) ? (size_t)remaining : chunk_size);
+        if (n <= 0)
+        {
+            rc = -1;
+            break;
+        }
+        ssize_t done = 0;
+        while (done < n)
+        {
+            ssize_t w = write(out_fd, buffer + done, n - done);
+            if (w <= 0)
+            {
+                rc = -1;
+                break;
+            }
+            done += w;
+        }
+        if (rc < 0)
+        {
+            break;
+        }
+        remaining -= n;
+    }
+
+    if (buffer != stack_buffer)
+    {
+        free(buffer);
+    }
+    return rc;
+}
+
+// Function to copy one file to another path on the same server without reading it into user space
+// Shares the source's extents with FICLONE where the file system supports reflinks, otherwise
+// lets the kernel copy with copy_file_range() and only falls back to read()/write() across
+// file systems. The copy is written next to dst and renamed over it, so readers never see
+// a partial file. Returns 0 on success and -1 on failure with errno set.
+int dfs_copy_file(const char *src, const char *dst)
+{
+    int in_fd = open(src, O_RDONLY);
+    if (in_fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(in_fd, &st) < 0)
+    {
+        close(in_fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        close(in_fd);
+        errno = EISDIR;
+        return -1;
+    }
+
+    // Hidden temporary name in the destination directory, as uploads use
+    char temp_path[DFS_PATH_MAX];
+    const char *slash = strrchr(dst, '/');
+    int dir_len = (slash != NULL) ? (int)(slash - dst + 1) : 0;
+    snprintf(temp_path, sizeof(temp_path), "%.*s.%s.%d.tmp", dir_len, dst, dst + dir_len, (int)getpid());
+    int out_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if (out_fd < 0)
+    {
+        close(in_fd);
+        return -1;
+    }
+
+    int rc = 0;
+    if (ioctl(out_fd, FICLONE, in_fd) < 0)
+    {
+        off_t remaining = st.st_size;
+        while (remaining > 0)
+        {
+            ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL, (size_t)remaining, 0);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                break;
+            }
+            remaining -= n;
+        }
+
+        // EXDEV, ENOSYS and friends: finish whatever is left the old way
+        if (remaining > 0)
+        {
+            off_t done = st.st_size - remaining;
+            if (lseek(in_fd, done, SEEK_SET) != done || lseek(out_fd, done, SEEK_SET) != done)
+            {
+                rc = -1;
+            }
+            else
+            {
+                rc = dfs_copy_fd(in_fd, out_fd, remaining, 64 * 1024);
+            }
+        }
+    }
+    close(in_fd);
+
+    if (close(out_fd) < 0)
+    {
+        rc = -1;
+    }
+    if (rc == 0 && rename(temp_path, dst) < 0)
+    {
+        rc = -1;
+    }
+    if (rc < 0)
+    {
+        int saved = errno;
+        unlink(temp_path);
+        errno = saved;
+    }
+    return rc;
+}
+
+// Function to map a file name to the type that decides which server stores it
+// Returns DFS_TYPE_NONE without an extension and DFS_TYPE_UNSUPPORTED for other extensions.
+int dfs_file_type(const char *filename)
+{
+    const char *ext = strrchr(filename, '.');
+    if (ext == NULL)
+    {
+        return DFS_TYPE_NONE;
+    }
+
+    // Dispatch on the first letter, then confirm the whole extension
+    switch (ext[1])
+    {
+        case 'c': return (ext[2] == '\0') ? DFS_TYPE_C : DFS_TYPE_UNSUPPORTED;
+        case 'p': return (strcmp(ext, ".pdf") == 0) ? DFS_TYPE_PDF : DFS_TYPE_UNSUPPORTED;
+        case 't': return (strcmp(ext, ".txt") == 0) ? DFS_TYPE_TXT : DFS_TYPE_UNSUPPORTED;
+        case 'z': return (strcmp(ext, ".zip") == 0) ? DFS_TYPE_ZIP : DFS_TYPE_UNSUPPORTED;
+        default: return DFS_TYPE_UNSUPPORTED;
+    }
+}
+
+// Function to split a newline-separated list in place, as sent by batch requests
+// Sets *lines to a new array the caller frees (the strings stay inside text) and returns
+// the number of lines. A trailing newline does not start another line.
+size_t dfs_split_lines(char *text, size_t len, char ***lines)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] == '\n' || i == len - 1)
+        {
+            count++;
+        }
+    }
+
+    *lines = malloc((count + 1) * sizeof(char *));
+    if (*lines == NULL)
+    {
+        return 0;
+    }
+
+    size_t n = 0;
+    char *start = text;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] == '\n')
+        {
+            text[i] = '\0';
+            (*lines)[n++] = start;
+            start = text + i + 1;
+        }
+    }
+    if (start < text + len)
+    {
+        (*lines)[n++] = start; // Last line without a newline; text is NUL-terminated after len
+    }
+    (*lines)[n] = NULL;
+    return n;
+}
+
+// Function to write a file from several pieces and rename it over path
+// The data goes to a hidden temporary file in the same directory first, so readers
+// see either the old file or the complete new one. Returns 0 on success and -1 on failure.
+int dfs_replace_file(const char *path, const struct iovec *parts, int count)
+{
+    char temp_path[DFS_PATH_MAX + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, (int)getpid());
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        size_t done = 0;
+        while (done < parts[i].iov_len)
+        {
+            ssize_t n = write(fd, (const char *)parts[i].iov_base + done, parts[i].iov_len - done);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                close(fd);
+                unlink(temp_path);
+                return -1;
+            }
+            done += n;
+        }
+    }
+    if (close(fd) < 0 || rename(temp_path, path) < 0)
+    {
+        unlink(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to build the path of a file's sidecar: "<dir>/.<name><suffix>"
+// Sidecars hold indexes that can be rebuilt from the file; the leading dot keeps them out of
+// listings, archives and searches. Returns -1 if the path does not fit in out.
+int dfs_sidecar_path(const char *path, const char *suffix, char *out, size_t out_size)
+{
+    const char *slash = strrchr(path, '/');
+    int dir_len = (slash != NULL) ? (int)(slash - path) + 1 : 0;
+    int n = snprintf(out, out_size, "%.*s.%s%s", dir_len, path, path + dir_len, suffix);
+    return (n < 0 || (size_t)n >= out_size) ? -1 : 0;
+}
+
+// Function to delete the sidecar of a file that was removed
+void dfs_sidecar_remove(const char *path, const char *suffix)
+{
+    char sidecar[DFS_PATH_MAX];
+    if (dfs_sidecar_path(path, suffix, sidecar, sizeof(sidecar)) == 0)
+    {
+        unlink(sidecar);
+    }
+}
+
+// Function to move a file's sidecar along with the file after rename()
+// Whatever sidecar the new name had described another file and is deleted.
+void dfs_sidecar_rename(const char *old_path, const char *new_path, const char *suffix)
+{
+    char old_sidecar[DFS_PATH_MAX];
+    char new_sidecar[DFS_PATH_MAX];
+    if (dfs_sidecar_path(old_path, suffix, old_sidecar, sizeof(old_sidecar)) == 0 &&
+        dfs_sidecar_path(new_path, suffix, new_sidecar, sizeof(new_sidecar)) == 0 &&
+        rename(old_sidecar, new_sidecar) < 0)
+    {
+        unlink(new_sidecar);
+    }
+}
+
+// Function to set up a server's shared tar archive cache state
+// Must run in the parent before any fork so uploads in one child invalidate archives for all.
+void dfs_tar_cache_init(struct dfs_store *store)
+{
+    struct dfs_tar_cache *cache = mmap(NULL, sizeof(struct dfs_tar_cache), PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (cache == MAP_FAILED)
+    {
+        perror("ERROR mapping tar cache state, archives will be rebuilt on every request");
+        store->tar_cache = NULL;
+        return;
+    }
+
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&cache->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    cache->generation = 1; // Nothing built yet, so built_generation (0) never matches
+    cache->built_generation = 0;
+    store->tar_cache = cache;
+}
+
+// Function to mark a server's cached archive stale after its file tree changed
+void dfs_tar_cache_invalidate(struct dfs_store *store)
+{
+    struct dfs_tar_cache *cache = store->tar_cache;
+    if (cache == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    cache->generation++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Function to quote a path for the shell, as one single-quoted word
+// Returns -1 if the quoted path does not fit.
+static int shell_quote(const char *path, char *out, size_t out_size)
+{
+    size_t len = 0;
+    out[len++] = '\'';
+    for (const char *p = path; *p != '\0'; p++)
+    {
+        if (len + 5 >= out_size)
+        {
+            return -1;
+        }
+        if (*p == '\'')
+        {
+            memcpy(out + len, "'\\''", 4); // Close the quote, add an escaped quote, reopen
+            len += 4;
+        }
+        else
+        {
+            out[len++] = *p;
+        }
+    }
+    out[len++] = '\'';
+    out[len] = '\0';
+    return 0;
+}
+
+// Function to open an up-to-date tar archive of the server's files under base_path
+// Serves the cached archive when nothing changed; otherwise rebuilds it from the metadata table
+// (or find) and, if use_cache is set, publishes it for later requests. Returns an open descriptor
+// and fills st. Archives use 512-byte records so they end in exactly two zero blocks and can be
+// concatenated.
+int dfs_open_tar_archive(struct dfs_store *store, const char *base_path, int use_cache, struct stat *st)
+{
+    struct dfs_tar_cache *cache = use_cache ? store->tar_cache : NULL;
+    int fd;
+    unsigned long generation = 0;
+
+    if (cache != NULL)
+    {
+        pthread_mutex_lock(&cache->lock);
+        generation = cache->generation;
+        if (cache->built_generation == generation && time(NULL) - cache->built_at < TAR_CACHE_TTL_SEC)
+        {
+            fd = open(store->tar_path, O_RDONLY);
+            if (fd >= 0 && fstat(fd, st) == 0)
+            {
+                pthread_mutex_unlock(&cache->lock);
+                return fd; // Cache hit: the caller just sendfile()s it
+            }
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    // Build into a private file so concurrent requests never see a partial archive
+    char temp_path[DFS_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", store->tar_path, (int)getpid());
+
+    // The file list comes from the metadata table; find walks the tree only without one
+    char list_path[DFS_PATH_MAX + 8];
+    snprintf(list_path, sizeof(list_path), "%s.list", temp_path);
+    FILE *list = fopen(list_path, "w");
+    long listed = (list != NULL) ? dfs_meta_write_paths(store->meta, base_path, list) : -1;
+    if (list != NULL && fclose(list) != 0)
+    {
+        listed = -1;
+    }
+    // A file removed or renamed after it was listed is left out instead of failing the archive
+    char tar_cmd[DFS_PATH_MAX * 6];
+    if (listed >= 0)
+    {
+        snprintf(tar_cmd, sizeof(tar_cmd), "tar -b 1 --ignore-failed-read -cf %s -T %s", temp_path, list_path);
+    }
+    else
+    {
+        char quoted[DFS_PATH_MAX * 4];
+        if (shell_quote(base_path, quoted, sizeof(quoted)) < 0)
+        {
+            return -1;
+        }
+        snprintf(tar_cmd, sizeof(tar_cmd),
+                 "find %s -type f -name \"*%s\" | tar -b 1 --ignore-failed-read -cf %s -T -",
+                 quoted, store->ext, temp_path);
+    }
+    int tar_rc = system(tar_cmd);
+    unlink(list_path);
+
+    // Exit status 1 only means a file changed while it was read; the archive is still whole.
+    // Packed files are not in the tree, so they are appended from their segments
+    if (tar_rc == -1 || !WIFEXITED(tar_rc) || WEXITSTATUS(tar_rc) > 1 ||
+        (listed >= 0 && store->pack != NULL && dfs_pack_append_tar(store->pack, base_path, temp_path) < 0))
+    {
+        unlink(temp_path);
+        return -1;
+    }
+
+    fd = open(temp_path, O_RDONLY);
+    if (fd < 0 || fstat(fd, st) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        unlink(temp_path);
+        return -1;
+    }
+
+    // Publish only if no upload or removal raced with the build
+    int published = 0;
+    if (cache != NULL)
+    {
+        pthread_mutex_lock(&cache->lock);
+        if (cache->generation == generation && rename(temp_path, store->tar_path) == 0)
+        {
+            cache->built_generation = generation;
+            cache->built_at = time(NULL);
+            published = 1;
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+    if (!published)
+    {
+        unlink(temp_path); // Still readable through fd for this request
+    }
+    return fd;
+}
+
+// Function to validate a downltar codec and level
+// Returns the file suffix for the codec, or NULL if the codec is not supported.
+const char *dfs_compression_suffix(const char *codec, int *level)
+{
+    if (strcmp(codec, "gzip") == 0)
+    {
+        if (*level < 1 || *level > 9)
+        {
+            *level = 6;
+        }
+        return "gz";
+    }
+    if (strcmp(codec, "zstd") == 0)
+    {
+        if (*level < 1 || *level > 19)
+        {
+            *level = 3;
+        }
+        return "zst";
+    }
+    return NULL;
+}
+
+// Function to open a compressed copy of an archive, reusing a cached one if it is current
+// The cached copy carries the source archive's mtime, so it is only reused for that exact build.
+int dfs_open_compressed_archive(struct dfs_store *store, int tar_fd, const char *codec, int level, struct stat *st)
+{
+    const char *suffix = dfs_compression_suffix(codec, &level);
+    struct stat tar_st;
+    if (suffix == NULL || fstat(tar_fd, &tar_st) != 0)
+    {
+        return -1;
+    }
+
+    char comp_path[DFS_PATH_MAX];
+    snprintf(comp_path, sizeof(comp_path), "%s.%d.%s", store->tar_path, level, suffix);
+
+    int fd = open(comp_path, O_RDONLY);
+    if (fd >= 0)
+    {
+        if (fstat(fd, st) == 0 && st->st_mtim.tv_sec == tar_st.st_mtim.tv_sec &&
+            st->st_mtim.tv_nsec == tar_st.st_mtim.tv_nsec)
+        {
+            return fd;
+        }
+        close(fd);
+    }
+
+    // Split the archive into one block per worker and compress the blocks concurrently
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+    {
+        workers = 1;
+    }
+    if (workers > COMPRESS_MAX_WORKERS)
+    {
+        workers = COMPRESS_MAX_WORKERS;
+    }
+    off_t block = (tar_st.st_size + workers - 1) / workers;
+    if (block < COMPRESS_MIN_BLOCK)
+    {
+        block = COMPRESS_MIN_BLOCK;
+    }
+    workers = (tar_st.st_size + block - 1) / block;
+    if (workers < 1)
+    {
+        workers = 1;
+    }
+
+    // Each worker reopens the archive through /proc so it gets its own file offset
+    char source[64];
+    snprintf(source, sizeof(source), "/proc/%d/fd/%d", (int)getpid(), tar_fd);
+    char temp_path[DFS_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", comp_path, (int)getpid());
+
+    char command[DFS_PATH_MAX * COMPRESS_MAX_WORKERS * 2];
+    int len = 0;
+    for (long i = 0; i < workers; i++)
+    {
+        len += snprintf(command + len, sizeof(command) - len,
+                        "(tail -c +%lld %s | head -c %lld | %s -%d -c > %s.%ld || rm -f %s.%ld) & ",
+                        (long long)(i * block + 1), source, (long long)block, codec, level,
+                        temp_path, i, temp_path, i);
+    }
+    len += snprintf(command + len, sizeof(command) - len, "wait");
+    system(command);
+
+    // Concatenate the blocks in order; a missing block means its compressor failed
+    int out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int failed = (out < 0);
+    for (long i = 0; i < workers; i++)
+    {
+        char part_path[DFS_PATH_MAX + 32];
+        snprintf(part_path, sizeof(part_path), "%s.%ld", temp_path, i);
+        int part = open(part_path, O_RDONLY);
+        struct stat part_st;
+        if (part < 0 || fstat(part, &part_st) != 0)
+        {
+            failed = 1;
+        }
+        else if (!failed)
+        {
+            off_t remaining = part_st.st_size;
+            while (remaining > 0)
+            {
+                ssize_t copied = sendfile(out, part, NULL, remaining);
+                if (copied <= 0)
+                {
+                    failed = 1;
+                    break;
+                }
+                remaining -= copied;
+            }
+        }
+        if (part >= 0)
+        {
+            close(part);
+        }
+        unlink(part_path);
+    }
+
+    if (failed)
+    {
+        if (out >= 0)
+        {
+            close(out);
+        }
+        unlink(temp_path);
+        return -1;
+    }
+
+    // Stamp the copy with its source's mtime and publish it
+    struct timespec times[2] = { tar_st.st_mtim, tar_st.st_mtim };
+    futimens(out, times);
+    close(out);
+
+    fd = open(temp_path, O_RDONLY);
+    if (fd < 0 || fstat(fd, st) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        unlink(temp_path);
+        return -1;
+    }
+    if (rename(temp_path, comp_path) < 0)
+    {
+        unlink(temp_path);
+    }
+    return fd;
+}
+
+// Function to build the local path of a DFS path ("~S1/...") under the server's root
+int dfs_store_path(const struct dfs_store *store, const char *path, char *out, size_t out_size)
+{
+    int n = snprintf(out, out_size, "%s/%s%s", getenv("HOME"), store->name, path + 3); // +3 to skip "~S1"
+    return (n < 0 || (size_t)n >= out_size) ? -1 : 0;
+}
+
+// Function to make sure the directory a file is stored in exists
+static int create_parent_directory(const char *path)
+{
+    char dir_path[DFS_PATH_MAX];
+    snprintf(dir_path, DFS_PATH_MAX, "%s", path);
+    char *slash = strrchr(dir_path, '/');
+    if (slash != NULL)
+    {
+        *slash = '\0';
+    }
+    return create_directory_tree(dir_path);
+}
+
+// Function to send a reply naming the server's file type and the server, e.g. "PDF" and "S2"
+static void store_reply(int client_sock, const struct dfs_store *store, const char *format)
+{
+    char reply[128];
+    int len = snprintf(reply, sizeof(reply), format, store->label, store->name);
+    write(client_sock, reply, len);
+}
+
+// Function to refuse a file of another type, e.g. "ERROR: S2 only handles PDF files"
+static int store_accepts(int client_sock, const struct dfs_store *store, const char *path)
+{
+    if (dfs_file_type(path) == store->type)
+    {
+        return 1;
+    }
+    char reply[128];
+    int len = snprintf(reply, sizeof(reply), "ERROR: %s only handles %s files", store->name, store->label);
+    write(client_sock, reply, len);
+    return 0;
+}
+
+// Function to copy or rename a file within the server
+// Copies share extents or use copy_file_range() through dfs_copy_file, so nothing is sent to S1.
+int dfs_copy_move_file(struct dfs_store *store, int client_sock, char *src, char *dst, int move)
+{
+    if (!store_accepts(client_sock, store, dst))
+    {
+        return -1;
+    }
+
+    char src_path[DFS_PATH_MAX];
+    char dst_path[DFS_PATH_MAX];
+    dfs_store_path(store, src, src_path, DFS_PATH_MAX);
+    dfs_store_path(store, dst, dst_path, DFS_PATH_MAX);
+
+    // A packed file is copied or renamed in the table alone
+    if (store->pack != NULL && dfs_pack_link(store->pack, src_path, dst_path, move) == 0)
+    {
+        if (store->index_remove != NULL)
+        {
+            store->index_remove(dst_path);
+        }
+        dfs_tar_cache_invalidate(store);
+        store_reply(client_sock, store, move ? "SUCCESS: %s file moved in %s" : "SUCCESS: %s file copied in %s");
+        return 0;
+    }
+
+    // Create the destination directory if needed
+    if (create_parent_directory(dst_path) < 0)
+    {
+        write(client_sock, "ERROR: Failed to create directory", 33);
+        return -1;
+    }
+
+    int rc = move ? rename(src_path, dst_path) : dfs_copy_file(src_path, dst_path);
+    if (rc < 0)
+    {
+        if (errno == ENOENT)
+        {
+            store_reply(client_sock, store, "ERROR: %s file not found in %s");
+        }
+        else
+        {
+            store_reply(client_sock, store, "ERROR: Failed to copy %s file in %s");
+        }
+        return -1;
+    }
+
+    if (move)
+    {
+        if (store->index_rename != NULL)
+        {
+            store->index_rename(src_path, dst_path);
+        }
+        dfs_meta_rename(store->meta, src_path, dst_path);
+    }
+    else
+    {
+        dfs_meta_copy(store->meta, src_path, dst_path);
+    }
+    dfs_tar_cache_invalidate(store);
+    store_reply(client_sock, store, move ? "SUCCESS: %s file moved in %s" : "SUCCESS: %s file copied in %s");
+    return 0;
+}
+
+// Function to pull a file from another server into this one
+// Used when a copy or move changes the extension to this server's type: the file comes
+// straight from the server on port instead of through S1.
+int dfs_fetch_file(struct dfs_store *store, int client_sock, int port, char *src, char *dst)
+{
+    if (!store_accepts(client_sock, store, dst))
+    {
+        return -1;
+    }
+
+    char dst_path[DFS_PATH_MAX];
+    dfs_store_path(store, dst, dst_path, DFS_PATH_MAX);
+    if (create_parent_directory(dst_path) < 0)
+    {
+        write(client_sock, "ERROR: Failed to create directory", 33);
+        return -1;
+    }
+
+    off_t size = 0;
+    int rc = peer_fetch_file(port, src, dst_path, &size);
+    if (rc == PEER_NOT_FOUND)
+    {
+        write(client_sock, "ERROR: File not found", 21);
+        return -1;
+    }
+    if (rc < 0)
+    {
+        store_reply(client_sock, store, "ERROR: Failed to fetch %s file into %s");
+        return -1;
+    }
+    stats_add_bytes(size, 0);
+
+    dfs_meta_add(store->meta, dst_path);
+    dfs_tar_cache_invalidate(store);
+    store_reply(client_sock, store, "SUCCESS: %s file fetched into %s");
+    if (store->index_build != NULL)
+    {
+        store->index_build(dst_path);
+    }
+    dfs_meta_hash(store->meta, dst_path);
+    return 0;
+}
+
+// Function to remove a batch of files sent by S1
+// Replies with one NET_BATCH_* character per path, in order.
+int dfs_remove_batch(struct dfs_store *store, int client_sock)
+{
+    write(client_sock, "READY", 5);
+
+    size_t list_len;
+    char *list = net_read_frame(client_sock, NET_FRAME_MAX, &list_len);
+    if (list == NULL || list_len == NET_FRAME_ERROR)
+    {
+        free(list);
+        write(client_sock, "ERROR: Failed to read file list", 31);
+        return -1;
+    }
+    char **items;
+    size_t count = dfs_split_lines(list, list_len, &items);
+    char *status = malloc(count + 1);
+    if (items == NULL || status == NULL)
+    {
+        free(items);
+        free(status);
+        free(list);
+        write(client_sock, "ERROR: Out of memory", 20);
+        return -1;
+    }
+
+    int removed = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        char path[DFS_PATH_MAX];
+        dfs_store_path(store, items[i], path, DFS_PATH_MAX);
+        if (unlink(path) == 0)
+        {
+            if (store->index_remove != NULL)
+            {
+                store->index_remove(path);
+            }
+            dfs_meta_remove(store->meta, path);
+            status[i] = NET_BATCH_OK;
+            removed++;
+        }
+        else if (errno == ENOENT && store->pack != NULL && dfs_pack_remove(store->pack, path) == 0)
+        {
+            status[i] = NET_BATCH_OK;
+            removed++;
+        }
+        else
+        {
+            status[i] = (errno == ENOENT) ? NET_BATCH_NOT_FOUND : NET_BATCH_FAILED;
+        }
+    }
+    if (removed > 0)
+    {
+        dfs_tar_cache_invalidate(store);
+    }
+
+    int rc = net_write_frame(client_sock, status, count);
+    free(status);
+    free(items);
+    free(list);
+    return (rc == 0 && removed == (int)count) ? 0 : -1;
+}
+
+// Function to store a batch of files that S1 staged for dest_path
+// Each line is "<staged path> <file name>"; the files are renamed into the server's tree (or
+// packed) and the reply has one NET_BATCH_* character per line.
+int dfs_upload_batch(struct dfs_store *store, int client_sock, char *dest_path)
+{
+    write(client_sock, "READY", 5);
+
+    size_t list_len;
+    char *list = net_read_frame(client_sock, NET_FRAME_MAX, &list_len);
+    if (list == NULL || list_len == NET_FRAME_ERROR)
+    {
+        free(list);
+        write(client_sock, "ERROR: Failed to read file list", 31);
+        return -1;
+    }
+    char **items;
+    size_t count = dfs_split_lines(list, list_len, &items);
+    char *status = malloc(count + 1);
+    if (items == NULL || status == NULL)
+    {
+        free(items);
+        free(status);
+        free(list);
+        write(client_sock, "ERROR: Out of memory", 20);
+        return -1;
+    }
+
+    // Create the destination path, once a file needs it
+    char dir_path[DFS_PATH_MAX];
+    dfs_store_path(store, dest_path, dir_path, DFS_PATH_MAX);
+    int dir_ok = -1;
+
+    int stored = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        char *name = strrchr(items[i], ' ');
+        if (name == NULL || dfs_file_type(name + 1) != store->type)
+        {
+            status[i] = NET_BATCH_UNSUPPORTED;
+            continue;
+        }
+        *name++ = '\0';
+
+        char full_path[DFS_PATH_MAX * 2];
+        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, name);
+        int packed = (store->pack != NULL) ? dfs_pack_take(store->pack, items[i], full_path, NULL) : 0;
+        if (packed > 0)
+        {
+            if (store->index_remove != NULL)
+            {
+                store->index_remove(full_path);
+            }
+            status[i] = NET_BATCH_OK;
+            items[i] = NULL; // Nothing to index
+            stored++;
+            continue;
+        }
+        if (packed == 0 && dir_ok < 0)
+        {
+            dir_ok = (create_directory_tree(dir_path) == 0);
+        }
+        if (packed == 0 && dir_ok && rename(items[i], full_path) == 0)
+        {
+            dfs_meta_add(store->meta, full_path);
+            status[i] = NET_BATCH_OK;
+            items[i] = name; // Kept for indexing after the reply
+            stored++;
+        }
+        else
+        {
+            status[i] = NET_BATCH_FAILED;
+        }
+    }
+    if (stored > 0)
+    {
+        dfs_tar_cache_invalidate(store);
+    }
+
+    int rc = net_write_frame(client_sock, status, count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (status[i] == NET_BATCH_OK && items[i] != NULL)
+        {
+            char full_path[DFS_PATH_MAX * 2];
+            snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, items[i]);
+            if (store->index_build != NULL)
+            {
+                store->index_build(full_path);
+            }
+            dfs_meta_hash(store->meta, full_path);
+        }
+    }
+    free(status);
+    free(items);
+    free(list);
+    return (rc == 0 && stored == (int)count) ? 0 : -1;
+}
+
+// Function to send S1 the paths of the server's files below pathname whose name matches pattern
+// The matches are streamed until the connection is closed.
+int dfs_find_store_files(struct dfs_store *store, int client_sock, char *pattern, char *pathname)
+{
+    struct dfs_matcher matcher;
+    if (strncmp(pathname, "~S1", 3) != 0 || dfs_matcher_init(&matcher, pattern) < 0)
+    {
+        return -1;
+    }
+
+    char path[DFS_PATH_MAX];
+    dfs_store_path(store, pathname, path, DFS_PATH_MAX);
+    long found = dfs_find_files(path, store->ext, &matcher, pathname, client_sock);
+    if (found >= 0 && store->pack != NULL)
+    {
+        found = dfs_pack_find(store->pack, path, &matcher, pathname, client_sock);
+    }
+    return (found < 0) ? -1 : 0;
+}
+
+// Function to send S1 the path of every file in the server, relative to its root
+// The reply is the number of paths, the length of the list and the server's generation
+// (three off_t values), then the list with one path per line. It is written to a temporary file first and sent with
+// sendfile, so even a very large tree is not held in memory.
+int dfs_send_inventory(struct dfs_store *store, int client_sock)
+{
+    // Read before the table is listed: the watcher journals a change before advancing the
+    // generation, so the list holds at least what the generation says
+    uint64_t generation = dfs_read_generation(store->name);
+    FILE *list = tmpfile();
+    long count = (list != NULL) ? dfs_meta_write_keys(store->meta, list) : -1;
+    if (count < 0 || fflush(list) != 0)
+    {
+        if (list != NULL)
+        {
+            fclose(list);
+        }
+        write(client_sock, "ERROR: Inventory unavailable", 28);
+        return -1;
+    }
+    off_t header[3] = { count, ftello(list), (off_t)generation };
+    int fd = fileno(list);
+    lseek(fd, 0, SEEK_SET);
+    net_cork(client_sock);
+    int rc = net_write_full(client_sock, header, sizeof(header));
+    if (rc == 0)
+    {
+        rc = net_sendfile(client_sock, fd, header[1]);
+    }
+    net_uncork(client_sock);
+    fclose(list);
+    if (rc == 0)
+    {
+        stats_add_bytes(0, header[1]);
+    }
+    return rc;
+}
+
+// Function to read the generation a server last wrote to its root (DFS_GENERATION_FILE)
+// Returns 0 if the server never wrote one.
+uint64_t dfs_read_generation(const char *name)
+{
+    char path[DFS_PATH_MAX];
+    uint64_t generation = 0;
+    snprintf(path, DFS_PATH_MAX, "%s/%s/%s", getenv("HOME"), name, DFS_GENERATION_FILE);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        if (pread(fd, &generation, sizeof(generation), 0) != (ssize_t)sizeof(generation))
+        {
+            generation = 0;
+        }
+        close(fd);
+    }
+    return generation;
+}
+
+// Function to advance the server's generation, recording watcher as the process keeping it
+// Only one process writes it at a time: the server before its watcher starts, then the watcher.
+static void store_advance_generation(struct dfs_store *store, pid_t watcher)
+{
+    char path[DFS_PATH_MAX];
+    uint64_t generation = dfs_read_generation(store->name);
+    generation = ((uint64_t)watcher << 32) | (uint32_t)(generation + 1);
+    snprintf(path, DFS_PATH_MAX, "%s/%s/%s", getenv("HOME"), store->name, DFS_GENERATION_FILE);
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || pwrite(fd, &generation, sizeof(generation), 0) != (ssize_t)sizeof(generation))
+    {
+        perror("ERROR writing the storage generation");
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+// Function run by the watcher once it is watching, and after files changed outside the DFS
+static void store_changed(void *arg)
+{
+    dfs_tar_cache_invalidate(arg);
+    store_advance_generation(arg, getpid());
+}
+
+// Function to load the metadata table of the server's files before any fork
+// Children inherit the table and catch up from the journal, so listings and archives
+// do not walk the root. The load time is printed to compare with a walk (DFS_META_RESCAN=1).
+void dfs_store_open(struct dfs_store *store)
+{
+    char root[DFS_PATH_MAX];
+    dfs_store_path(store, "~S1", root, DFS_PATH_MAX); // The DFS path of the root itself
+    create_directory_tree(root);
+    store_advance_generation(store, 0); // Nothing watches the root until the watcher says so
+    uint64_t start_us = stats_now_us();
+    if (dfs_meta_open(store->meta, root, store->type) < 0)
+    {
+        perror("ERROR loading metadata journal, listings will walk the tree");
+        return;
+    }
+    printf("Metadata: %llu files, %llu journal records%s, loaded in %.1f ms\n",
+           (unsigned long long)store->meta->live_count, (unsigned long long)store->meta->replayed,
+           store->meta->walked ? " (tree walked)" : "", (stats_now_us() - start_us) / 1000.0);
+
+    // Small uploads are packed once the table can say where they are
+    if (store->pack != NULL && dfs_pack_open(store->pack, store->meta) < 0)
+    {
+        perror("ERROR opening pack segments, small files will be stored on their own");
+    }
+    else if (store->pack != NULL && store->pack->max_file > 0)
+    {
+        printf("Packing %s files up to %lld bytes into segments\n", store->ext, (long long)store->pack->max_file);
+    }
+
+    // Files dropped into the tree by hand reach the table, and the archives, through the watcher
+    if (dfs_watch_start(store->meta, store_changed, store) < 0)
+    {
+        perror("ERROR starting the storage watcher");
+    }
+}
+
+// Function to send S1 a tar file of all the server's files, or of those below subtree
+// A codec ("gzip" or "zstd") and level may be given to receive a compressed archive.
+int dfs_download_tar(struct dfs_store *store, int client_sock, char *subtree, char *codec, int level)
+{
+    if (codec != NULL && dfs_compression_suffix(codec, &level) == NULL)
+    {
+        write(client_sock, "ERROR: Unsupported compression codec", 36);
+        return -1;
+    }
+
+    // Archive the whole tree, or only the part below a ~S1 subtree for a federated request
+    int whole_tree = (subtree == NULL || strcmp(subtree, "~S1") == 0 || strcmp(subtree, "~S1/") == 0);
+    char dir_path[DFS_PATH_MAX];
+    dfs_store_path(store, whole_tree ? "~S1" : subtree, dir_path, DFS_PATH_MAX);
+
+    // Reuse the cached archive unless the tree changed since it was built
+    uint64_t span_start_us = trace_now_us();
+    struct stat st;
+    int fd = dfs_open_tar_archive(store, dir_path, whole_tree, &st);
+    if (fd < 0)
+    {
+        write(client_sock, "ERROR: Failed to create tar file", 32);
+        return -1;
+    }
+
+    // Swap in the compressed archive if one was requested
+    if (codec != NULL)
+    {
+        int comp_fd = dfs_open_compressed_archive(store, fd, codec, level, &st);
+        close(fd);
+        if (comp_fd < 0)
+        {
+            write(client_sock, "ERROR: Failed to compress tar file", 34);
+            return -1;
+        }
+        fd = comp_fd;
+    }
+
+    trace_span("archive", span_start_us, trace_now_us());
+
+    // Send the tar file size
+    span_start_us = trace_now_us();
+    net_cork(client_sock);
+    if (net_write_full(client_sock, &st.st_size, sizeof(off_t)) < 0)
+    {
+        net_uncork(client_sock);
+        close(fd);
+        return -1;
+    }
+
+    trace_span("first_byte", span_start_us, trace_now_us());
+
+    // Send the tar file data
+    span_start_us = trace_now_us();
+    off_t remaining = st.st_size;
+    while (remaining > 0)
+    {
+        ssize_t sent = sendfile(client_sock, fd, NULL, remaining);
+        if (sent <= 0)
+        {
+            net_uncork(client_sock);
+            close(fd);
+            write(client_sock, "ERROR: File transfer failed", 27);
+            return -1;
+        }
+        remaining -= sent;
+    }
+    net_uncork(client_sock);
+    close(fd);
+    trace_span("last_byte", span_start_us, trace_now_us());
+    stats_add_bytes(0, st.st_size);
+
+    return 0;
+}
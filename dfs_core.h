@@ -0,0 +1,99 @@
+// Distributed File System - Shared server helpers
+// Directory creation, file listing, file copying, file type dispatch, the hidden
+// per-file index files (sidecars) and the tar archive cache used by S1-S4.
+// Kept free of globals: server state is passed in through struct dfs_store, so
+// dfs_microbench can time the helpers on their own.
+
+#ifndef DFS_CORE_H
+#define DFS_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h> // for struct iovec
+
+#define DFS_PATH_MAX 1024
+
+// Cached tar archive of a server's whole tree, rebuilt only after an upload or removal
+#define TAR_CACHE_TTL_SEC 300 // Also rebuild after this age to pick up files changed outside the DFS
+
+// Optional downltar compression: the archive is split into blocks that are compressed
+// in parallel as independent gzip members / zstd frames and concatenated
+#define COMPRESS_MAX_WORKERS 8 // Parallel compressor processes per archive
+#define COMPRESS_MIN_BLOCK (1024 * 1024) // Smaller archives use fewer workers
+
+// Generation of a server's files, kept in its root so S1 can tell whether a lookup filter
+// built from the inventory still lists every file: the high 32 bits are the pid of the
+// watcher that wrote it (0 while none runs), the low 32 bits count the server's starts and
+// the batches of changes its watcher picked up outside the DFS
+#define DFS_GENERATION_FILE ".dfs_generation"
+
+// File types and the server that stores each of them
+#define DFS_TYPE_C 0 // S1
+#define DFS_TYPE_PDF 1 // S2
+#define DFS_TYPE_TXT 2 // S3
+#define DFS_TYPE_ZIP 3 // S4
+#define DFS_TYPE_COUNT 4
+#define DFS_TYPE_NONE -1 // No extension
+#define DFS_TYPE_UNSUPPORTED -2
+
+struct dfs_meta;
+struct dfs_pack;
+
+// Tar cache state shared by a server and its children
+struct dfs_tar_cache
+{
+    pthread_mutex_t lock;
+    unsigned long generation; // Bumped by every upload/removal
+    unsigned long built_generation; // Generation the cached archive reflects (0 = none)
+    time_t built_at;
+};
+
+// What the shared helpers need to know about the server calling them
+struct dfs_store
+{
+    const char *name; // "S1" ... "S4", also the name of its root under $HOME
+    int type; // DFS_TYPE_* of the files the server stores
+    const char *label; // That type in replies, e.g. "PDF"
+    const char *ext; // Extension of those files, e.g. ".pdf"
+    const char *tar_path; // Where the cached archive of the whole tree is kept
+    struct dfs_tar_cache *tar_cache; // NULL until dfs_tar_cache_init(), or if it failed
+    struct dfs_meta *meta;
+    struct dfs_pack *pack; // NULL on servers that do not pack small files
+    // Sidecar index of each file (dfs_pdf, dfs_lines, dfs_zip), NULL if the server keeps none
+    int (*index_build)(const char *path);
+    void (*index_remove)(const char *path);
+    void (*index_rename)(const char *old_path, const char *new_path);
+};
+
+// Function prototypes
+int create_directory_tree(const char *path);
+size_t dfs_list_files(const char *base_path, const char *ext, char *out, size_t out_size);
+int dfs_copy_fd(int in_fd, int out_fd, off_t length, size_t chunk_size);
+int dfs_copy_file(const char *src, const char *dst);
+int dfs_file_type(const char *filename);
+size_t dfs_split_lines(char *text, size_t len, char ***lines);
+int dfs_replace_file(const char *path, const struct iovec *parts, int count);
+int dfs_sidecar_path(const char *path, const char *suffix, char *out, size_t out_size);
+void dfs_sidecar_remove(const char *path, const char *suffix);
+void dfs_sidecar_rename(const char *old_path, const char *new_path, const char *suffix);
+void dfs_tar_cache_init(struct dfs_store *store);
+void dfs_tar_cache_invalidate(struct dfs_store *store);
+int dfs_open_tar_archive(struct dfs_store *store, const char *base_path, int use_cache, struct stat *st);
+const char *dfs_compression_suffix(const char *codec, int *level);
+int dfs_open_compressed_archive(struct dfs_store *store, int tar_fd, const char *codec, int level, struct stat *st);
+int dfs_download_tar(struct dfs_store *store, int client_sock, char *subtree, char *codec, int level);
+int dfs_store_path(const struct dfs_store *store, const char *path, char *out, size_t out_size);
+int dfs_copy_move_file(struct dfs_store *store, int client_sock, char *src, char *dst, int move);
+int dfs_fetch_file(struct dfs_store *store, int client_sock, int port, char *src, char *dst);
+int dfs_remove_batch(struct dfs_store *store, int client_sock);
+int dfs_upload_batch(struct dfs_store *store, int client_sock, char *dest_path);
+int dfs_find_store_files(struct dfs_store *store, int client_sock, char *pattern, char *pathname);
+uint64_t dfs_read_generation(const char *name);
+int dfs_send_inventory(struct dfs_store *store, int client_sock);
+void dfs_store_open(struct dfs_store *store);
+
+#endif
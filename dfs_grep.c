@@ -0,0 +1,384 @@
+// Distributed File System - Content search
+// The file list is collected first, then worker threads take files from it one at a time,
+// mmap them and scan the whole mapping: literals with the SIMD search from dfs_match,
+// regular expressions with one regexec() per match over the mapping (REG_STARTEND).
+// Line numbers come from counting newlines between matches, also vectorized, so lines
+// that do not match are never looked at one by one. Each thread queues its output lines
+// and sends them under a lock, so lines from different files never interleave mid-line.
+
+#define _GNU_SOURCE // for memrchr()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dfs_grep.h"
+#include "dfs_match.h"
+#include "dfs_core.h"
+#include "dfs_net.h"
+
+// Files to search and the shared state of the threads searching them
+struct grep_job
+{
+    const struct dfs_grep *grep;
+    const char *ext;
+    char base[DFS_PATH_MAX];
+    char prefix[DFS_PATH_MAX];
+    char **files; // Paths relative to base
+    size_t count;
+    size_t next; // Index of the next file to take, advanced atomically
+    int out_fd;
+    pthread_mutex_t out_lock;
+    long matches;
+    int failed;
+};
+
+// Output lines one thread has queued
+struct grep_out
+{
+    struct grep_job *job;
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+// Function to compile a grepf pattern; returns -1 if it is empty, too long or not a valid regex
+int dfs_grep_init(struct dfs_grep *grep, const char *pattern, int regex)
+{
+    size_t len = strlen(pattern);
+    if (len == 0 || len >= GREP_PATTERN_MAX)
+    {
+        return -1;
+    }
+    memcpy(grep->pattern, pattern, len + 1);
+    grep->regex = regex;
+    if (regex && regcomp(&grep->compiled, pattern, REG_EXTENDED | REG_NEWLINE) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Function to release a compiled pattern
+void dfs_grep_free(struct dfs_grep *grep)
+{
+    if (grep->regex)
+    {
+        regfree(&grep->compiled);
+    }
+}
+
+// Function to choose the number of search threads
+// DFS_GREP_THREADS overrides the default of one per online CPU, up to GREP_MAX_THREADS.
+int dfs_grep_threads(void)
+{
+    const char *env = getenv("DFS_GREP_THREADS");
+    long threads = (env != NULL) ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    return (threads > GREP_MAX_THREADS) ? GREP_MAX_THREADS : (int)threads;
+}
+
+// Function to send a thread's queued lines; the lock keeps whole batches of lines together
+static void grep_flush(struct grep_out *out)
+{
+    if (out->len == 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&out->job->out_lock);
+    if (!out->job->failed && net_write_full(out->job->out_fd, out->buf, out->len) < 0)
+    {
+        out->job->failed = 1;
+    }
+    pthread_mutex_unlock(&out->job->out_lock);
+    out->len = 0;
+}
+
+// Function to queue "<label>:<line number>:<line>\n"
+static void grep_emit(struct grep_out *out, const char *label, size_t line_no, const char *line, size_t line_len)
+{
+    if (line_len > GREP_LINE_MAX)
+    {
+        line_len = GREP_LINE_MAX;
+    }
+    size_t need = strlen(label) + 24 + line_len + 2;
+    if (out->len + need > out->cap)
+    {
+        size_t cap = (out->cap > 0) ? out->cap * 2 : GREP_FLUSH_BYTES + GREP_LINE_MAX * 2;
+        while (out->len + need > cap)
+        {
+            cap *= 2;
+        }
+        char *buf = realloc(out->buf, cap);
+        if (buf == NULL)
+        {
+            return;
+        }
+        out->buf = buf;
+        out->cap = cap;
+    }
+    out->len += sprintf(out->buf + out->len, "%s:%zu:", label, line_no);
+    memcpy(out->buf + out->len, line, line_len);
+    out->len += line_len;
+    out->buf[out->len++] = '\n';
+    if (out->len >= GREP_FLUSH_BYTES)
+    {
+        grep_flush(out);
+    }
+}
+
+// Function to find every line of one mapped file that matches and queue it
+// Returns the number of matching lines.
+static long grep_buffer(const struct dfs_grep *grep, const char *data, size_t len, const char *label,
+                        struct grep_out *out)
+{
+    size_t literal_len = strlen(grep->pattern);
+    size_t pos = 0; // Always the start of a line
+    size_t counted = 0; // Newlines before this offset have been counted
+    size_t line_no = 1;
+    long matches = 0;
+    while (pos < len && !out->job->failed)
+    {
+        size_t hit;
+        if (grep->regex)
+        {
+            regmatch_t match;
+            match.rm_so = pos;
+            match.rm_eo = len;
+            if (regexec(&grep->compiled, data, 1, &match, REG_STARTEND) != 0)
+            {
+                break;
+            }
+            hit = match.rm_so;
+        }
+        else
+        {
+            const char *found = dfs_match_find(data + pos, len - pos, grep->pattern, literal_len);
+            if (found == NULL)
+            {
+                break;
+            }
+            hit = found - data;
+        }
+
+        const char *newline = memrchr(data + pos, '\n', hit - pos);
+        size_t line_start = (newline != NULL) ? (size_t)(newline - data) + 1 : pos;
+        newline = memchr(data + hit, '\n', len - hit);
+        size_t line_end = (newline != NULL) ? (size_t)(newline - data) : len;
+
+        line_no += dfs_match_count_byte(data + counted, line_start - counted, '\n');
+        counted = line_start;
+        grep_emit(out, label, line_no, data + line_start, line_end - line_start);
+        matches++;
+        pos = line_end + 1;
+    }
+    return matches;
+}
+
+// Function run by every search thread: take the next file until none are left
+static void *grep_worker(void *arg)
+{
+    struct grep_job *job = arg;
+    struct grep_out out = { job, NULL, 0, 0 };
+
+    // glibc serializes regexec() calls on one compiled pattern, so each thread has its own
+    struct dfs_grep local;
+    const struct dfs_grep *grep = job->grep;
+    if (job->grep->regex)
+    {
+        if (dfs_grep_init(&local, job->grep->pattern, 1) < 0)
+        {
+            return NULL;
+        }
+        grep = &local;
+    }
+
+    long matches = 0;
+    while (!job->failed)
+    {
+        size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count)
+        {
+            break;
+        }
+
+        char path[DFS_PATH_MAX * 2];
+        char label[DFS_PATH_MAX * 2];
+        snprintf(path, sizeof(path), "%s/%s", job->base, job->files[i]);
+        snprintf(label, sizeof(label), "%s/%s", job->prefix, job->files[i]);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            continue;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                madvise(data, st.st_size, MADV_SEQUENTIAL);
+                matches += grep_buffer(grep, data, st.st_size, label, &out);
+                munmap(data, st.st_size);
+            }
+        }
+        close(fd);
+    }
+    grep_flush(&out);
+    free(out.buf);
+    if (grep == &local)
+    {
+        dfs_grep_free(&local);
+    }
+    __atomic_fetch_add(&job->matches, matches, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// Function to search data held in memory, such as a packed file, and send its matching lines
+// Lines are written to out_fd as "<label>:<line number>:<line>\n". Returns the number of
+// matching lines, or -1 if sending them failed.
+long dfs_grep_data(const struct dfs_grep *grep, const char *data, size_t len, const char *label, int out_fd)
+{
+    struct grep_job *job = calloc(1, sizeof(struct grep_job));
+    if (job == NULL)
+    {
+        return -1;
+    }
+    job->grep = grep;
+    job->out_fd = out_fd;
+    pthread_mutex_init(&job->out_lock, NULL);
+    struct grep_out out = { job, NULL, 0, 0 };
+    long matches = grep_buffer(grep, data, len, label, &out);
+    grep_flush(&out);
+    free(out.buf);
+    if (job->failed)
+    {
+        matches = -1;
+    }
+    pthread_mutex_destroy(&job->out_lock);
+    free(job);
+    return matches;
+}
+
+// Function to add the files with the job's extension below base/rel to the job's list
+// rel is "" for the base directory itself.
+static void grep_collect(struct grep_job *job, const char *rel, size_t *cap)
+{
+    char path[DFS_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s%s%s", job->base, (rel[0] != '\0') ? "/" : "", rel);
+    DIR *dir = opendir(path);
+    if (!dir) return;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        // Skip ., .. and hidden files such as staged uploads
+        if (ent->d_name[0] == '.')
+        {
+            continue;
+        }
+        char child[DFS_PATH_MAX];
+        if (snprintf(child, sizeof(child), "%s%s%s", rel, (rel[0] != '\0') ? "/" : "", ent->d_name) >= (int)sizeof(child))
+        {
+            continue;
+        }
+
+        if (ent->d_type == DT_DIR)
+        {
+            grep_collect(job, child, cap);
+            continue;
+        }
+        const char *dot = strrchr(ent->d_name, '.');
+        if (ent->d_type != DT_REG || dot == NULL || strcmp(dot, job->ext) != 0)
+        {
+            continue;
+        }
+        if (job->count == *cap)
+        {
+            size_t new_cap = (*cap > 0) ? *cap * 2 : 256;
+            char **files = realloc(job->files, new_cap * sizeof(char *));
+            if (files == NULL)
+            {
+                continue;
+            }
+            job->files = files;
+            *cap = new_cap;
+        }
+        if ((job->files[job->count] = strdup(child)) != NULL)
+        {
+            job->count++;
+        }
+    }
+    closedir(dir);
+}
+
+// Function to search every file with extension ext below base_path and send the matching lines
+// Lines are written to out_fd as "<prefix>/<relative path>:<line number>:<line>\n".
+// Returns the number of matching lines, or -1 if sending them failed.
+long dfs_grep_tree(const struct dfs_grep *grep, const char *base_path, const char *ext,
+                   const char *prefix, int out_fd, int threads)
+{
+    struct grep_job *job = calloc(1, sizeof(struct grep_job));
+    if (job == NULL)
+    {
+        return -1;
+    }
+    job->grep = grep;
+    job->ext = ext;
+    job->out_fd = out_fd;
+    snprintf(job->base, sizeof(job->base), "%s", base_path);
+    snprintf(job->prefix, sizeof(job->prefix), "%s", prefix);
+    for (size_t len = strlen(job->base); len > 1 && job->base[len - 1] == '/'; len--)
+    {
+        job->base[len - 1] = '\0';
+    }
+    for (size_t len = strlen(job->prefix); len > 0 && job->prefix[len - 1] == '/'; len--)
+    {
+        job->prefix[len - 1] = '\0';
+    }
+    pthread_mutex_init(&job->out_lock, NULL);
+
+    size_t cap = 0;
+    grep_collect(job, "", &cap);
+
+    // No point in starting more threads than there are files
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if ((size_t)threads > job->count)
+    {
+        threads = (job->count > 0) ? (int)job->count : 1;
+    }
+    pthread_t workers[GREP_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads && i < GREP_MAX_THREADS; i++)
+    {
+        if (pthread_create(&workers[started], NULL, grep_worker, job) == 0)
+        {
+            started++;
+        }
+    }
+    grep_worker(job);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    long matches = job->failed ? -1 : job->matches;
+    for (size_t i = 0; i < job->count; i++)
+    {
+        free(job->files[i]);
+    }
+    free(job->files);
+    pthread_mutex_destroy(&job->out_lock);
+    free(job);
+    return matches;
+}
@@ -0,0 +1,31 @@
+// Distributed File System - Content search
+// grepf runs on the server that stores the files: S1 for .c and S3 for .txt. Files are
+// mmapped and scanned by a pool of threads, and only the matching lines are sent back.
+
+#ifndef DFS_GREP_H
+#define DFS_GREP_H
+
+#include <stddef.h>
+#include <regex.h>
+
+#define GREP_PATTERN_MAX 256
+#define GREP_MAX_THREADS 16
+#define GREP_LINE_MAX 4096 // Longer matching lines are cut to this many bytes
+#define GREP_FLUSH_BYTES (256 * 1024) // A thread sends its matches once this many are queued
+
+struct dfs_grep
+{
+    char pattern[GREP_PATTERN_MAX];
+    int regex; // 0: literal search, 1: POSIX extended regular expression
+    regex_t compiled;
+};
+
+// Function prototypes
+int dfs_grep_init(struct dfs_grep *grep, const char *pattern, int regex);
+void dfs_grep_free(struct dfs_grep *grep);
+int dfs_grep_threads(void);
+long dfs_grep_tree(const struct dfs_grep *grep, const char *base_path, const char *ext,
+                   const char *prefix, int out_fd, int threads);
+long dfs_grep_data(const struct dfs_grep *grep, const char *data, size_t len, const char *label, int out_fd);
+
+#endif
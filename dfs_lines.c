@@ -0,0 +1,300 @@
+// Distributed File System - Line offset index
+// An index is a fixed header followed by one 64-bit offset per LINES_STRIDE lines, so a
+// 1 GB log of 100-byte lines needs under 1 MB. A lookup reads the nearest stored offset
+// and skips at most LINES_STRIDE - 1 lines from there with memchr(). Indexes are built
+// when S3 stores a file, or on the first request when that did not happen, and are
+// replaced atomically with rename(); they are a cache, so a bad one is just rebuilt.
+
+#include <stdio.h>
+#include <stddef.h> // for offsetof()
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dfs_lines.h"
+#include "dfs_core.h"
+
+#define LINES_MAGIC "DFSLIDX1"
+#define LINES_SUFFIX ".lidx"
+
+// On-disk header; the offsets follow it
+struct lines_header
+{
+    char magic[8];
+    uint32_t stride;
+    uint32_t reserved;
+    uint64_t size; // Size, modification time and inode of the indexed file
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t ino;
+    uint64_t lines; // Number of lines; a last line without '\n' counts
+};
+
+// Function to fill in the identity of the indexed file
+static void lines_identify(struct lines_header *header, const struct stat *st)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, LINES_MAGIC, sizeof(header->magic));
+    header->stride = LINES_STRIDE;
+    header->size = st->st_size;
+    header->mtime_sec = st->st_mtim.tv_sec;
+    header->mtime_nsec = st->st_mtim.tv_nsec;
+    header->ino = st->st_ino;
+}
+
+// Function to move past n newlines starting at pos; stops at len if the data ends first
+static size_t lines_skip(const char *data, size_t len, size_t pos, uint64_t n)
+{
+    while (n > 0 && pos < len)
+    {
+        const char *newline = memchr(data + pos, '\n', len - pos);
+        pos = (newline != NULL) ? (size_t)(newline - data) + 1 : len;
+        n--;
+    }
+    return pos;
+}
+
+// Function to collect the offset of every LINES_STRIDE-th line of a mapped file
+// Returns a malloc'd array of *count offsets and sets *lines, or NULL if memory runs out.
+static uint64_t *lines_scan(const char *data, size_t len, uint64_t *count, uint64_t *lines)
+{
+    size_t cap = 1024;
+    uint64_t *offsets = malloc(cap * sizeof(uint64_t));
+    if (offsets == NULL)
+    {
+        return NULL;
+    }
+    uint64_t n = 0;
+    uint64_t line = 0;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        if (line % LINES_STRIDE == 0)
+        {
+            if (n == cap)
+            {
+                uint64_t *grown = realloc(offsets, cap * 2 * sizeof(uint64_t));
+                if (grown == NULL)
+                {
+                    free(offsets);
+                    return NULL;
+                }
+                offsets = grown;
+                cap *= 2;
+            }
+            offsets[n++] = pos;
+        }
+        pos = lines_skip(data, len, pos, 1);
+        line++;
+    }
+    *count = n;
+    *lines = line;
+    return offsets;
+}
+
+// Function to write an index, replacing the old one atomically
+static int lines_save(const char *index_path, const struct lines_header *header, const uint64_t *offsets, uint64_t count)
+{
+    struct iovec parts[2] = { { (void *)header, sizeof(*header) }, { (void *)offsets, count * sizeof(uint64_t) } };
+    return dfs_replace_file(index_path, parts, 2);
+}
+
+// Function to map a file's index if it exists and still describes the file
+// Returns the mapping and sets *map_len, or NULL if there is no usable index.
+static const struct lines_header *lines_load(const char *index_path, const struct stat *st, size_t *map_len)
+{
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat index_st;
+    if (fstat(fd, &index_st) < 0 || (size_t)index_st.st_size < sizeof(struct lines_header))
+    {
+        close(fd);
+        return NULL;
+    }
+    const struct lines_header *header = mmap(NULL, index_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    struct lines_header expected;
+    lines_identify(&expected, st);
+    uint64_t count = (header->lines + LINES_STRIDE - 1) / LINES_STRIDE;
+    if (memcmp(header, &expected, offsetof(struct lines_header, lines)) != 0 ||
+        (size_t)index_st.st_size != sizeof(struct lines_header) + count * sizeof(uint64_t))
+    {
+        munmap((void *)header, index_st.st_size);
+        return NULL;
+    }
+    *map_len = index_st.st_size;
+    return header;
+}
+
+// Function to build and store the index of a file, replacing any older one
+// Files under LINES_INDEX_MIN are not indexed. Returns 0 on success and -1 on failure.
+int dfs_lines_build(const char *path)
+{
+    char index_path[DFS_PATH_MAX];
+    if (dfs_sidecar_path(path, LINES_SUFFIX, index_path, sizeof(index_path)) < 0)
+    {
+        return -1;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size < LINES_INDEX_MIN)
+    {
+        close(fd);
+        return 0;
+    }
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    struct lines_header header;
+    lines_identify(&header, &st);
+    uint64_t count;
+    uint64_t *offsets = lines_scan(data, st.st_size, &count, &header.lines);
+    munmap(data, st.st_size);
+    if (offsets == NULL)
+    {
+        return -1;
+    }
+    int rc = lines_save(index_path, &header, offsets, count);
+    free(offsets);
+    return rc;
+}
+
+// Function to find the byte range of count lines starting at line first (0-based)
+// fd is the open file and path its name, used to find the index. Files from LINES_INDEX_MIN
+// up use the stored index, which is built first if it is missing or stale. A range running
+// past the end is cut at the end of the file. Returns 0, -1 on failure, or
+// LINES_OUT_OF_RANGE if the file has no line first.
+int dfs_lines_slice(int fd, const char *path, uint64_t first, uint64_t count, off_t *offset, off_t *length)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        return -1;
+    }
+    if (st.st_size == 0)
+    {
+        return LINES_OUT_OF_RANGE;
+    }
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+    size_t len = st.st_size;
+    uint64_t last = (count > UINT64_MAX - first) ? UINT64_MAX : first + count;
+    int rc = 0;
+    size_t start;
+    size_t end;
+
+    const struct lines_header *header = NULL;
+    size_t map_len = 0;
+    uint64_t *built = NULL;
+    const uint64_t *offsets = NULL;
+    uint64_t lines = 0;
+    char index_path[DFS_PATH_MAX];
+    if (len >= LINES_INDEX_MIN && dfs_sidecar_path(path, LINES_SUFFIX, index_path, sizeof(index_path)) == 0)
+    {
+        header = lines_load(index_path, &st, &map_len);
+        if (header != NULL)
+        {
+            offsets = (const uint64_t *)(header + 1);
+            lines = header->lines;
+        }
+        else
+        {
+            // Build the index from this mapping and keep it for the next request
+            struct lines_header fresh;
+            lines_identify(&fresh, &st);
+            uint64_t n;
+            built = lines_scan(data, len, &n, &fresh.lines);
+            if (built != NULL)
+            {
+                lines_save(index_path, &fresh, built, n);
+                offsets = built;
+                lines = fresh.lines;
+            }
+        }
+    }
+
+    if (offsets != NULL)
+    {
+        if (first >= lines)
+        {
+            rc = LINES_OUT_OF_RANGE;
+            start = end = len;
+        }
+        else
+        {
+            start = lines_skip(data, len, offsets[first / LINES_STRIDE], first % LINES_STRIDE);
+            end = (last >= lines) ? len : lines_skip(data, len, offsets[last / LINES_STRIDE], last % LINES_STRIDE);
+        }
+    }
+    else
+    {
+        // Small or unindexable file: count the lines from the top
+        off_t slice_offset;
+        off_t slice_length;
+        rc = dfs_lines_slice_data(data, len, first, count, &slice_offset, &slice_length);
+        start = slice_offset;
+        end = start + slice_length;
+    }
+
+    if (header != NULL)
+    {
+        munmap((void *)header, map_len);
+    }
+    free(built);
+    munmap(data, len);
+    *offset = start;
+    *length = end - start;
+    return rc;
+}
+
+// Function to find count lines starting at line first (0-based) in data held in memory
+// Used for small files, such as packed ones, which are scanned from the top every time.
+int dfs_lines_slice_data(const char *data, size_t len, uint64_t first, uint64_t count, off_t *offset, off_t *length)
+{
+    uint64_t last = (count > UINT64_MAX - first) ? UINT64_MAX : first + count;
+    size_t start = lines_skip(data, len, 0, first);
+    size_t end = lines_skip(data, len, start, last - first);
+    *offset = start;
+    *length = end - start;
+    return (start == len) ? LINES_OUT_OF_RANGE : 0;
+}
+
+// Function to drop the index of a file that was removed
+void dfs_lines_remove(const char *path)
+{
+    dfs_sidecar_remove(path, LINES_SUFFIX);
+}
+
+// Function to carry a file's index over to its new name after a rename
+// The inode, size and mtime do not change with rename(), so the index stays valid.
+void dfs_lines_rename(const char *old_path, const char *new_path)
+{
+    dfs_sidecar_rename(old_path, new_path, LINES_SUFFIX);
+}
@@ -0,0 +1,24 @@
+// Distributed File System - Line offset index
+// Lets S3 serve "lines N..M" of a large TXT file without reading the lines before them.
+// The index keeps the byte offset of every LINES_STRIDE-th line in a hidden ".<name>.lidx"
+// file next to the data, tagged with the file's size, mtime and inode so a replaced or
+// changed file is re-indexed instead of trusted.
+
+#ifndef DFS_LINES_H
+#define DFS_LINES_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LINES_STRIDE 128 // Lines between two stored offsets
+#define LINES_INDEX_MIN (1 << 20) // Smaller files are scanned on every request instead
+#define LINES_OUT_OF_RANGE -2 // The first requested line is past the end of the file
+
+// Function prototypes
+int dfs_lines_build(const char *path);
+int dfs_lines_slice(int fd, const char *path, uint64_t first, uint64_t count, off_t *offset, off_t *length);
+int dfs_lines_slice_data(const char *data, size_t len, uint64_t first, uint64_t count, off_t *offset, off_t *length);
+void dfs_lines_remove(const char *path);
+void dfs_lines_rename(const char *old_path, const char *new_path);
+
+#endif
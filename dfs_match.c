@@ -0,0 +1,559 @@
+// Distributed File System - Filename search
+// findf checks every name below a directory, so the common case is a name that does not
+// match. Every match must contain the pattern's longest literal run, so names are first
+// searched for that literal with SSE2/AVX2 compares (the first and last byte of the literal
+// at 16 or 32 positions per step), and only names containing it reach fnmatch().
+
+#define _GNU_SOURCE // for memmem()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include "dfs_match.h"
+#include "dfs_core.h"
+#include "dfs_net.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATCH_HAVE_X86 1
+#endif
+
+#define FIND_OUT_BUFFER (64 * 1024) // Matches are sent in pieces of this size
+
+typedef const char *(*find_fn)(const char *, size_t, const char *, size_t);
+typedef size_t (*count_fn)(const char *, size_t, char);
+
+static find_fn find_impl = NULL;
+static count_fn count_impl = NULL;
+static int simd_level = -1;
+
+// Function to search with the C library, used for short tails and without SIMD
+static const char *find_scalar(const char *haystack, size_t len, const char *needle, size_t needle_len)
+{
+    return memmem(haystack, len, needle, needle_len);
+}
+
+// Function to count one byte value without SIMD
+static size_t count_scalar(const char *buf, size_t len, char byte)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        count += (buf[i] == byte);
+    }
+    return count;
+}
+
+#ifdef MATCH_HAVE_X86
+// Function to count one byte value 16 bytes at a time
+static size_t count_sse2(const char *buf, size_t len, char byte)
+{
+    const __m128i target = _mm_set1_epi8(byte);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(buf + i));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(block, target)));
+    }
+    return count + count_scalar(buf + i, len - i, byte);
+}
+
+// Function to count one byte value 32 bytes at a time, on CPUs with AVX2
+__attribute__((target("avx2,popcnt")))
+static size_t count_avx2(const char *buf, size_t len, char byte)
+{
+    const __m256i target = _mm256_set1_epi8(byte);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(buf + i));
+        count += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, target)));
+    }
+    return count + count_scalar(buf + i, len - i, byte);
+}
+
+// Function to search 16 start positions at a time
+// A position is a candidate when both the first and the last byte of the needle match;
+// only candidates are compared in full.
+static const char *find_sse2(const char *haystack, size_t len, const char *needle, size_t needle_len)
+{
+    if (needle_len == 0)
+    {
+        return haystack;
+    }
+    if (len < needle_len)
+    {
+        return NULL;
+    }
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 16 <= len; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(haystack + i + needle_len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                        _mm_cmpeq_epi8(block_last, last)));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit, needle, needle_len) == 0)
+            {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(haystack + i, len - i, needle, needle_len);
+}
+
+// Function to search 32 start positions at a time, on CPUs with AVX2
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *haystack, size_t len, const char *needle, size_t needle_len)
+{
+    if (needle_len == 0)
+    {
+        return haystack;
+    }
+    if (len < needle_len)
+    {
+        return NULL;
+    }
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 32 <= len; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(haystack + i + needle_len - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                                        _mm256_cmpeq_epi8(block_last, last)));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit, needle, needle_len) == 0)
+            {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return find_sse2(haystack + i, len - i, needle, needle_len);
+}
+#endif
+
+// Function to choose the literal search; level is a MATCH_SIMD_* value, -1 for the best available
+// DFS_MATCH_SIMD=none|sse2|avx2 in the environment overrides the automatic choice.
+void dfs_match_set_simd_level(int level)
+{
+    int best = MATCH_SIMD_NONE;
+#ifdef MATCH_HAVE_X86
+    best = __builtin_cpu_supports("avx2") ? MATCH_SIMD_AVX2 : MATCH_SIMD_SSE2;
+#endif
+    if (level < 0)
+    {
+        const char *env = getenv("DFS_MATCH_SIMD");
+        level = best;
+        if (env != NULL)
+        {
+            level = (strcmp(env, "none") == 0) ? MATCH_SIMD_NONE : (strcmp(env, "sse2") == 0) ? MATCH_SIMD_SSE2 : best;
+        }
+    }
+    if (level > best)
+    {
+        level = best;
+    }
+
+    simd_level = level;
+    find_impl = find_scalar;
+    count_impl = count_scalar;
+#ifdef MATCH_HAVE_X86
+    if (level == MATCH_SIMD_SSE2)
+    {
+        find_impl = find_sse2;
+        count_impl = count_sse2;
+    }
+    else if (level == MATCH_SIMD_AVX2)
+    {
+        find_impl = find_avx2;
+        count_impl = count_avx2;
+    }
+#endif
+}
+
+// Function to report which MATCH_SIMD_* search is in use
+int dfs_match_simd_level(void)
+{
+    if (find_impl == NULL)
+    {
+        dfs_match_set_simd_level(-1);
+    }
+    return simd_level;
+}
+
+// Function to find needle in the first len bytes of haystack with the selected search
+// Returns a pointer to the first occurrence, or NULL.
+const char *dfs_match_find(const char *haystack, size_t len, const char *needle, size_t needle_len)
+{
+    if (find_impl == NULL)
+    {
+        dfs_match_set_simd_level(-1);
+    }
+    return find_impl(haystack, len, needle, needle_len);
+}
+
+// Function to count how often byte occurs in the first len bytes of buf, e.g. newlines
+size_t dfs_match_count_byte(const char *buf, size_t len, char byte)
+{
+    if (count_impl == NULL)
+    {
+        dfs_match_set_simd_level(-1);
+    }
+    return count_impl(buf, len, byte);
+}
+
+// Function to prepare a findf pattern
+// Without *, ? or [ the pattern is a substring; with them it is a glob whose longest literal
+// run is used as the prefilter. Returns -1 if the pattern is empty or too long.
+int dfs_matcher_init(struct dfs_matcher *matcher, const char *pattern)
+{
+    size_t len = strlen(pattern);
+    if (len == 0 || len >= MATCH_PATTERN_MAX)
+    {
+        return -1;
+    }
+    memcpy(matcher->pattern, pattern, len + 1);
+    matcher->is_glob = (strpbrk(pattern, "*?[") != NULL);
+    matcher->full_path = (strchr(pattern, '/') != NULL);
+    if (!matcher->is_glob)
+    {
+        memcpy(matcher->literal, pattern, len + 1);
+        matcher->literal_len = len;
+        return 0;
+    }
+
+    // Longest run outside wildcards, bracket expressions and escapes
+    size_t best_start = 0;
+    size_t best_len = 0;
+    size_t run_start = 0;
+    for (size_t i = 0; i <= len; i++)
+    {
+        char c = pattern[i];
+        if (c == '\0' || c == '*' || c == '?' || c == '[' || c == '\\')
+        {
+            if (i - run_start > best_len)
+            {
+                best_start = run_start;
+                best_len = i - run_start;
+            }
+            if (c == '[')
+            {
+                // Skip to the closing bracket; a ']' right after '[' or '[!' is part of the set
+                size_t j = i + 1;
+                if (pattern[j] == '!' || pattern[j] == '^')
+                {
+                    j++;
+                }
+                if (pattern[j] == ']')
+                {
+                    j++;
+                }
+                while (pattern[j] != '\0' && pattern[j] != ']')
+                {
+                    j++;
+                }
+                i = (pattern[j] == ']') ? j : len - 1;
+            }
+            else if (c == '\\' && pattern[i + 1] != '\0')
+            {
+                i++; // The escaped character is left out rather than tracked
+            }
+            run_start = i + 1;
+        }
+    }
+    memcpy(matcher->literal, pattern + best_start, best_len);
+    matcher->literal[best_len] = '\0';
+    matcher->literal_len = best_len;
+    return 0;
+}
+
+// Function to check one name (or path below the search root) against a prepared pattern
+int dfs_match_name(const struct dfs_matcher *matcher, const char *name, size_t len)
+{
+    if (matcher->literal_len > 0 && dfs_match_find(name, len, matcher->literal, matcher->literal_len) == NULL)
+    {
+        return 0;
+    }
+    if (!matcher->is_glob)
+    {
+        return 1;
+    }
+    return fnmatch(matcher->pattern, name, 0) == 0;
+}
+
+// Function to report every name in a NUL-separated list that matches
+// The literal is searched across the whole list at once, so the vector loop runs over long
+// stretches instead of restarting on every short name; a literal never contains NUL and so
+// never matches across two names. Returns the number of matches.
+long dfs_match_names(const struct dfs_matcher *matcher, const char *names, size_t len,
+                     dfs_match_fn fn, void *ctx)
+{
+    long matches = 0;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        const char *name = names + pos;
+        if (matcher->literal_len > 0)
+        {
+            const char *hit = dfs_match_find(name, len - pos, matcher->literal, matcher->literal_len);
+            if (hit == NULL)
+            {
+                break;
+            }
+            // Back up to the start of the name containing the hit
+            name = hit;
+            while (name > names + pos && name[-1] != '\0')
+            {
+                name--;
+            }
+        }
+        size_t name_len = strlen(name);
+        if (!matcher->is_glob || fnmatch(matcher->pattern, name, 0) == 0)
+        {
+            matches++;
+            if (fn != NULL)
+            {
+                fn(ctx, name, name_len);
+            }
+        }
+        pos = (size_t)(name - names) + name_len + 1;
+    }
+    return matches;
+}
+
+// State of one dfs_find_files walk
+struct find_state
+{
+    char path[DFS_PATH_MAX]; // base_path/relative path of the current directory
+    size_t path_len;
+    size_t base_len; // Length of base_path including its trailing '/'
+    const char *ext;
+    size_t ext_len;
+    const struct dfs_matcher *matcher;
+    const char *prefix;
+    size_t prefix_len;
+    int out_fd;
+    char out[FIND_OUT_BUFFER];
+    size_t out_len;
+    long matches;
+    int failed;
+};
+
+// Growable NUL-separated list of names read from one directory
+struct name_list
+{
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+// Function to add a name to a list; returns -1 if memory runs out
+static int name_list_add(struct name_list *list, const char *name, size_t len)
+{
+    if (list->len + len + 1 > list->cap)
+    {
+        size_t cap = (list->cap > 0) ? list->cap * 2 : 4096;
+        while (list->len + len + 1 > cap)
+        {
+            cap *= 2;
+        }
+        char *data = realloc(list->data, cap);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        list->data = data;
+        list->cap = cap;
+    }
+    memcpy(list->data + list->len, name, len + 1);
+    list->len += len + 1;
+    return 0;
+}
+
+// Function to queue one output line, "<prefix>/<rel>/<name>", sending the buffer when it is full
+static void find_emit(struct find_state *state, const char *rel, size_t rel_len, const char *name, size_t name_len)
+{
+    size_t need = state->prefix_len + 1 + rel_len + 1 + name_len + 1;
+    if (state->out_len + need > sizeof(state->out))
+    {
+        if (net_write_full(state->out_fd, state->out, state->out_len) < 0)
+        {
+            state->failed = 1;
+        }
+        state->out_len = 0;
+        if (need > sizeof(state->out))
+        {
+            return;
+        }
+    }
+    char *out = state->out + state->out_len;
+    memcpy(out, state->prefix, state->prefix_len);
+    out += state->prefix_len;
+    *out++ = '/';
+    if (rel_len > 0)
+    {
+        memcpy(out, rel, rel_len);
+        out += rel_len;
+        *out++ = '/';
+    }
+    memcpy(out, name, name_len);
+    out += name_len;
+    *out++ = '\n';
+    state->out_len = (size_t)(out - state->out);
+    state->matches++;
+}
+
+// Function called by dfs_match_names for each matching file of the current directory
+static void find_hit(void *ctx, const char *name, size_t name_len)
+{
+    struct find_state *state = ctx;
+    size_t rel_len = (state->path_len > state->base_len) ? state->path_len - state->base_len : 0;
+    find_emit(state, state->path + state->base_len, rel_len, name, name_len);
+}
+
+// Function to search one directory and everything below it
+// The directory is read in full and closed before descending, and its file names are
+// matched in one dfs_match_names pass.
+static void find_directory(struct find_state *state, size_t path_len)
+{
+    DIR *dir = opendir(state->path);
+    if (!dir) return;
+
+    struct name_list files = { NULL, 0, 0 };
+    struct name_list dirs = { NULL, 0, 0 };
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        // Skip ., .. and hidden files such as staged uploads
+        if (ent->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        size_t name_len = strlen(ent->d_name);
+        if (path_len + 1 + name_len >= DFS_PATH_MAX)
+        {
+            continue;
+        }
+
+        if (ent->d_type == DT_REG)
+        {
+            // Only the extension this server stores, matched on the last dot like dispfnames
+            const char *dot = strrchr(ent->d_name, '.');
+            if (dot && (size_t)(ent->d_name + name_len - dot) == state->ext_len &&
+                memcmp(dot, state->ext, state->ext_len) == 0 && name_list_add(&files, ent->d_name, name_len) < 0)
+            {
+                state->failed = 1;
+            }
+        }
+        else if (ent->d_type == DT_DIR && name_list_add(&dirs, ent->d_name, name_len) < 0)
+        {
+            state->failed = 1;
+        }
+    }
+    closedir(dir);
+
+    size_t len = path_len;
+    if (len > 0 && state->path[len - 1] != '/')
+    {
+        state->path[len++] = '/';
+    }
+    state->path[path_len] = '\0';
+    state->path_len = path_len;
+
+    if (!state->matcher->full_path)
+    {
+        dfs_match_names(state->matcher, files.data, files.len, find_hit, state);
+    }
+    else
+    {
+        // Patterns with '/' see the path below the search root
+        for (size_t pos = 0; pos < files.len; )
+        {
+            const char *name = files.data + pos;
+            size_t name_len = strlen(name);
+            state->path[len - 1] = '/';
+            memcpy(state->path + len, name, name_len + 1);
+            if (dfs_match_name(state->matcher, state->path + state->base_len, len + name_len - state->base_len))
+            {
+                state->path[path_len] = '\0';
+                find_hit(state, name, name_len);
+            }
+            pos += name_len + 1;
+        }
+        state->path[path_len] = '\0';
+    }
+
+    for (size_t pos = 0; pos < dirs.len && !state->failed; )
+    {
+        const char *name = dirs.data + pos;
+        size_t name_len = strlen(name);
+        state->path[len - 1] = '/';
+        memcpy(state->path + len, name, name_len + 1);
+        find_directory(state, len + name_len);
+        state->path[path_len] = '\0';
+        pos += name_len + 1;
+    }
+    free(files.data);
+    free(dirs.data);
+}
+
+// Function to send the path of every file with extension ext below base_path that matches
+// One line per match, "<prefix>/<path below base_path>", written to out_fd in large pieces.
+// Returns the number of matches, or -1 if writing failed.
+long dfs_find_files(const char *base_path, const char *ext, const struct dfs_matcher *matcher,
+                    const char *prefix, int out_fd)
+{
+    struct find_state *state = malloc(sizeof(struct find_state));
+    if (state == NULL)
+    {
+        return -1;
+    }
+    size_t len = strlen(base_path);
+    if (len + 1 >= DFS_PATH_MAX)
+    {
+        free(state);
+        return 0;
+    }
+    memcpy(state->path, base_path, len + 1);
+    state->path_len = len;
+    state->base_len = (len > 0 && base_path[len - 1] == '/') ? len : len + 1;
+    state->ext = ext;
+    state->ext_len = strlen(ext);
+    state->matcher = matcher;
+    state->prefix = prefix;
+    state->prefix_len = strlen(prefix);
+    while (state->prefix_len > 0 && prefix[state->prefix_len - 1] == '/')
+    {
+        state->prefix_len--;
+    }
+    state->out_fd = out_fd;
+    state->out_len = 0;
+    state->matches = 0;
+    state->failed = 0;
+
+    find_directory(state, len);
+    if (!state->failed && state->out_len > 0 && net_write_full(out_fd, state->out, state->out_len) < 0)
+    {
+        state->failed = 1;
+    }
+
+    long matches = state->failed ? -1 : state->matches;
+    free(state);
+    return matches;
+}
@@ -0,0 +1,40 @@
+// Distributed File System - Filename search
+// Glob and substring matching for findf, with a vectorized literal prefilter, and the
+// tree walk each server runs to stream its matching names.
+
+#ifndef DFS_MATCH_H
+#define DFS_MATCH_H
+
+#include <stddef.h>
+
+#define MATCH_PATTERN_MAX 256
+
+// Implementations of the literal search, fastest last
+#define MATCH_SIMD_NONE 0 // memmem()
+#define MATCH_SIMD_SSE2 1 // 16 candidate positions per step
+#define MATCH_SIMD_AVX2 2 // 32 candidate positions per step
+
+struct dfs_matcher
+{
+    char pattern[MATCH_PATTERN_MAX];
+    int is_glob; // Pattern has *, ? or [ and is checked with fnmatch()
+    int full_path; // Pattern has '/' and is matched against the path below the search root
+    char literal[MATCH_PATTERN_MAX]; // Longest run of plain characters every match must contain
+    size_t literal_len;
+};
+
+typedef void (*dfs_match_fn)(void *ctx, const char *name, size_t len);
+
+// Function prototypes
+int dfs_matcher_init(struct dfs_matcher *matcher, const char *pattern);
+int dfs_match_name(const struct dfs_matcher *matcher, const char *name, size_t len);
+long dfs_match_names(const struct dfs_matcher *matcher, const char *names, size_t len,
+                     dfs_match_fn fn, void *ctx);
+const char *dfs_match_find(const char *haystack, size_t len, const char *needle, size_t needle_len);
+size_t dfs_match_count_byte(const char *buf, size_t len, char byte);
+int dfs_match_simd_level(void);
+void dfs_match_set_simd_level(int level);
+long dfs_find_files(const char *base_path, const char *ext, const struct dfs_matcher *matcher,
+                    const char *prefix, int out_fd);
+
+#endif
@@ -0,0 +1,1385 @@
+// Distributed File System - Metadata journal
+// The table is an array of entries with their paths in one arena and an open-addressing
+// hash over the paths. Journal records carry a checksum, so a record cut short by a crash
+// or still being written by another process ends the replay instead of corrupting the table.
+// A snapshot is written by a forked copy of the server, holding the lock exclusively; the
+// journal it replaces is kept as .dfs_meta.log.prev so readers that were behind can finish it.
+
+#define _GNU_SOURCE // for memrchr() and strchrnul()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "dfs_meta.h"
+#include "dfs_core.h"
+
+#define META_SNAPSHOT ".dfs_meta.snap"
+#define META_JOURNAL ".dfs_meta.log"
+#define META_JOURNAL_PREV ".dfs_meta.log.prev"
+#define META_LOCK ".dfs_meta.lock"
+#define META_SNAPSHOT_MAGIC "DFSMSNP2"
+#define META_JOURNAL_MAGIC "DFSMLOG2"
+#define META_READ_CHUNK (1024 * 1024)
+
+#define META_OP_ADD 1 // Add a file or replace what is known about it
+#define META_OP_REMOVE 2
+#define META_OP_RELOCATE 3 // Point a packed file at the compactor's copy, if it still uses the old one
+#define META_OP_LINK 4 // Copy a packed file: the copy shares the source's contents
+#define META_OP_MOVE 5 // Rename a packed file
+
+// Snapshot file: this header, the live entries, then their paths
+struct meta_snapshot_header
+{
+    char magic[8];
+    uint64_t generation; // Generation of the journal that continues from this snapshot
+    uint64_t count;
+    uint64_t paths_len;
+};
+
+// Journal file: this header, then records
+struct meta_journal_header
+{
+    char magic[8];
+    uint64_t generation;
+};
+
+// One journal record, followed by path_len bytes of path relative to the root
+struct meta_record
+{
+    uint32_t length; // Whole record, path included
+    uint32_t check; // Low half of the XXH64 of everything after this field
+    uint8_t op;
+    uint8_t location;
+    uint16_t path_len;
+    uint32_t mtime_nsec;
+    uint64_t size;
+    int64_t mtime_sec;
+    uint64_t hash;
+    uint32_t segment; // Where a packed file's contents are, 0 for a file of its own
+    uint32_t segment_offset;
+    uint32_t from_segment; // RELOCATE only: where they were
+    uint32_t from_offset;
+    uint32_t source_len; // LINK and MOVE: length of the source path that follows the path
+    uint32_t reserved;
+};
+
+static const char *type_exts[DFS_TYPE_COUNT] = { ".c", ".pdf", ".txt", ".zip" };
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+// Functions implementing XXH64, used for file contents, paths and record checksums
+static uint64_t xxh_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t xxh_read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME2;
+    return xxh_rotl(acc, 31) * XXH_PRIME1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= xxh_round(0, v);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+static uint64_t xxh64(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+    if (len >= 32)
+    {
+        uint64_t v1 = XXH_PRIME1 + XXH_PRIME2;
+        uint64_t v2 = XXH_PRIME2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -XXH_PRIME1;
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+        }
+        h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+        h = xxh_merge(xxh_merge(xxh_merge(xxh_merge(h, v1), v2), v3), v4);
+    }
+    else
+    {
+        h = XXH_PRIME5;
+    }
+    h += len;
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = xxh_rotl(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+    if (p + 4 <= end)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        h ^= (uint64_t)v * XXH_PRIME1;
+        h = xxh_rotl(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= *p * XXH_PRIME5;
+        h = xxh_rotl(h, 11) * XXH_PRIME1;
+    }
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Function to hash bytes with XXH64, for callers that key on the table's paths
+uint64_t dfs_meta_xxh64(const void *data, size_t len)
+{
+    return xxh64(data, len);
+}
+
+// Function to build the path of one of the table's files in the root
+static void meta_file(const struct dfs_meta *meta, const char *name, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%s/%s", meta->root, name);
+}
+
+// Function to turn a path relative to a server's root into the table's key
+// Repeated slashes and "." components are dropped, so S1 can find the key a backend
+// stores a ~S1 path under. Returns the key length, or -1 if the path contains ".." or
+// does not fit.
+int dfs_meta_key(const char *path, char *out)
+{
+    int len = 0;
+    const char *p = path;
+    while (*p != '\0')
+    {
+        while (*p == '/')
+        {
+            p++;
+        }
+        const char *end = strchrnul(p, '/');
+        int part = end - p;
+        if (part == 2 && p[0] == '.' && p[1] == '.')
+        {
+            return -1;
+        }
+        if (part > 0 && !(part == 1 && p[0] == '.'))
+        {
+            if (len + part + 1 >= DFS_PATH_MAX)
+            {
+                return -1;
+            }
+            if (len > 0)
+            {
+                out[len++] = '/';
+            }
+            memcpy(out + len, p, part);
+            len += part;
+        }
+        p = end;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Function to turn an absolute path below the root into the table's key
+// Returns the key length, or -1 if the path is outside the root or dfs_meta_key() rejects it.
+static int relative_path(const struct dfs_meta *meta, const char *path, char *out)
+{
+    if (strncmp(path, meta->root, meta->root_len) != 0 || path[meta->root_len] != '/')
+    {
+        return -1;
+    }
+    return dfs_meta_key(path + meta->root_len, out);
+}
+
+// Function to check that a key names a file of the server's type, like strrchr() would
+static int has_ext(const struct dfs_meta *meta, const char *key, size_t len)
+{
+    size_t ext_len = strlen(meta->ext);
+    const char *dot = memrchr(key, '.', len);
+    return dot != NULL && (size_t)(key + len - dot) == ext_len && memcmp(dot, meta->ext, ext_len) == 0;
+}
+
+// Function to find the entry for a key; returns its index or -1 and sets *slot to where
+// it is or would go
+static int64_t meta_find(const struct dfs_meta *meta, const char *key, size_t len, uint64_t *slot)
+{
+    uint64_t mask = meta->slot_count - 1;
+    uint64_t i = xxh64(key, len) & mask;
+    while (meta->slots[i] != 0)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[meta->slots[i] - 1];
+        if (entry->path_len == len && memcmp(meta->paths + entry->path_offset, key, len) == 0)
+        {
+            *slot = i;
+            return meta->slots[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+    *slot = i;
+    return -1;
+}
+
+// Function to size the hash for count entries (at most half full) and insert them all
+static int meta_rehash(struct dfs_meta *meta, uint64_t count)
+{
+    uint64_t slot_count = 1024;
+    while (slot_count < count * 2)
+    {
+        slot_count *= 2;
+    }
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL)
+    {
+        return -1;
+    }
+    free(meta->slots);
+    meta->slots = slots;
+    meta->slot_count = slot_count;
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        uint64_t slot;
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        meta_find(meta, meta->paths + entry->path_offset, entry->path_len, &slot);
+        meta->slots[slot] = e + 1;
+    }
+    return 0;
+}
+
+static int meta_apply(struct dfs_meta *meta, const struct meta_record *record, const char *key);
+
+// Function to apply a copy or rename of a packed file
+// The source is looked up as the record is applied, so a copy made while the compactor
+// moves the source still ends up with the contents' new place.
+static int meta_apply_link(struct dfs_meta *meta, const struct meta_record *record, const char *key)
+{
+    const char *source = key + record->path_len;
+    uint64_t slot;
+    int64_t found = meta_find(meta, source, record->source_len, &slot);
+    if (found < 0 || !meta->entries[found].live || meta->entries[found].segment == 0 ||
+        (record->source_len == record->path_len && memcmp(source, key, record->path_len) == 0))
+    {
+        return 0;
+    }
+    const struct dfs_meta_entry *entry = &meta->entries[found];
+    struct meta_record add;
+    memset(&add, 0, sizeof(add));
+    add.op = META_OP_ADD;
+    add.location = entry->location;
+    add.path_len = record->path_len;
+    add.size = entry->size;
+    add.hash = entry->hash;
+    add.segment = entry->segment;
+    add.segment_offset = entry->segment_offset;
+    add.mtime_sec = (record->op == META_OP_MOVE) ? entry->mtime_sec : record->mtime_sec;
+    add.mtime_nsec = (record->op == META_OP_MOVE) ? entry->mtime_nsec : record->mtime_nsec;
+    if (meta_apply(meta, &add, key) < 0)
+    {
+        return -1;
+    }
+    if (record->op == META_OP_MOVE)
+    {
+        struct meta_record remove;
+        memset(&remove, 0, sizeof(remove));
+        remove.op = META_OP_REMOVE;
+        remove.path_len = record->source_len;
+        return meta_apply(meta, &remove, source);
+    }
+    return 0;
+}
+
+// Function to apply one change to the table
+static int meta_apply(struct dfs_meta *meta, const struct meta_record *record, const char *key)
+{
+    if (record->op == META_OP_LINK || record->op == META_OP_MOVE)
+    {
+        return meta_apply_link(meta, record, key);
+    }
+    uint64_t slot;
+    int64_t found = meta_find(meta, key, record->path_len, &slot);
+    if (found < 0 && record->op != META_OP_ADD)
+    {
+        return 0;
+    }
+    if (found < 0)
+    {
+        if ((meta->count + 1) * 2 > meta->slot_count)
+        {
+            if (meta_rehash(meta, meta->count + 1) < 0)
+            {
+                return -1;
+            }
+            meta_find(meta, key, record->path_len, &slot);
+        }
+        if (meta->count == meta->capacity)
+        {
+            uint64_t capacity = meta->capacity ? meta->capacity * 2 : 1024;
+            struct dfs_meta_entry *entries = realloc(meta->entries, capacity * sizeof(*entries));
+            if (entries == NULL)
+            {
+                return -1;
+            }
+            meta->entries = entries;
+            meta->capacity = capacity;
+        }
+        if (meta->paths_len + record->path_len > meta->paths_capacity)
+        {
+            uint64_t capacity = meta->paths_capacity ? meta->paths_capacity * 2 : 64 * 1024;
+            while (capacity < meta->paths_len + record->path_len)
+            {
+                capacity *= 2;
+            }
+            char *paths = realloc(meta->paths, capacity);
+            if (paths == NULL)
+            {
+                return -1;
+            }
+            meta->paths = paths;
+            meta->paths_capacity = capacity;
+        }
+        found = meta->count++;
+        meta->entries[found].path_offset = meta->paths_len;
+        meta->entries[found].path_len = record->path_len;
+        meta->entries[found].live = 0;
+        memcpy(meta->paths + meta->paths_len, key, record->path_len);
+        meta->paths_len += record->path_len;
+        meta->slots[slot] = found + 1;
+    }
+
+    struct dfs_meta_entry *entry = &meta->entries[found];
+    if (record->op == META_OP_REMOVE)
+    {
+        meta->live_count -= entry->live;
+        entry->live = 0;
+        return 0;
+    }
+    if (record->op == META_OP_RELOCATE)
+    {
+        // Removed or replaced since the compactor copied it: the copy is garbage
+        if (entry->live && entry->segment == record->from_segment && entry->segment_offset == record->from_offset)
+        {
+            entry->segment = record->segment;
+            entry->segment_offset = record->segment_offset;
+        }
+        return 0;
+    }
+    meta->live_count += !entry->live;
+    entry->live = 1;
+    entry->size = record->size;
+    entry->mtime_sec = record->mtime_sec;
+    entry->mtime_nsec = record->mtime_nsec;
+    entry->hash = record->hash;
+    entry->location = record->location;
+    entry->segment = record->segment;
+    entry->segment_offset = record->segment_offset;
+    return 0;
+}
+
+// Function to drop everything in the table
+static void meta_clear(struct dfs_meta *meta)
+{
+    free(meta->entries);
+    free(meta->paths);
+    free(meta->slots);
+    meta->entries = NULL;
+    meta->paths = NULL;
+    meta->slots = NULL;
+    meta->count = meta->capacity = meta->live_count = 0;
+    meta->paths_len = meta->paths_capacity = 0;
+    meta->slot_count = 0;
+}
+
+// Function to take or release the lock (LOCK_SH, LOCK_EX, LOCK_UN, optionally | LOCK_NB)
+// Each process opens the lock file itself, since children share their parent's descriptors.
+static int meta_lock(struct dfs_meta *meta, int how)
+{
+    if (meta->lock_pid != getpid())
+    {
+        if (meta->lock_fd >= 0)
+        {
+            close(meta->lock_fd);
+        }
+        char path[DFS_PATH_MAX];
+        meta_file(meta, META_LOCK, path, sizeof(path));
+        meta->lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        meta->lock_pid = getpid();
+    }
+    if (meta->lock_fd < 0)
+    {
+        return -1;
+    }
+    int rc;
+    while ((rc = flock(meta->lock_fd, how)) < 0 && errno == EINTR)
+    {
+    }
+    return rc;
+}
+
+// Function to fill in a record describing a file as it is now
+static void meta_describe(const struct dfs_meta *meta, struct meta_record *record, const struct stat *st, uint64_t hash)
+{
+    memset(record, 0, sizeof(*record));
+    record->op = META_OP_ADD;
+    record->location = meta->location;
+    record->size = st->st_size;
+    record->mtime_sec = st->st_mtim.tv_sec;
+    record->mtime_nsec = st->st_mtim.tv_nsec;
+    record->hash = hash;
+}
+
+// Function to finish a record with its key and checksum, appending it to buffer
+// For LINK and MOVE records the source key follows the key in key. Returns the number of
+// bytes added.
+static size_t meta_encode(struct meta_record *record, const char *key, size_t len, char *buffer)
+{
+    record->path_len = len;
+    record->length = sizeof(*record) + len + record->source_len;
+    memcpy(buffer, record, sizeof(*record));
+    memcpy(buffer + sizeof(*record), key, len + record->source_len);
+    uint32_t check = xxh64(buffer + 8, record->length - 8);
+    memcpy(buffer + 4, &check, sizeof(check));
+    return record->length;
+}
+
+// Function to apply the records of an open journal from offset on
+// Stops at the end or at the first record that is incomplete or damaged, and leaves
+// meta->offset after the last record applied.
+static int meta_replay(struct dfs_meta *meta, int fd, uint64_t offset)
+{
+    char *buffer = malloc(META_READ_CHUNK);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+    size_t have = 0;
+    int rc = 0;
+    for (;;)
+    {
+        ssize_t n = pread(fd, buffer + have, META_READ_CHUNK - have, offset + have);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            rc = (n < 0) ? -1 : 0;
+            break;
+        }
+        have += n;
+
+        size_t pos = 0;
+        while (have - pos >= sizeof(struct meta_record))
+        {
+            struct meta_record record;
+            memcpy(&record, buffer + pos, sizeof(record));
+            if (record.length != sizeof(record) + record.path_len + record.source_len || record.path_len == 0 ||
+                record.length > have - pos)
+            {
+                break;
+            }
+            uint32_t check = xxh64(buffer + pos + 8, record.length - 8);
+            if (check != record.check || meta_apply(meta, &record, buffer + pos + sizeof(record)) < 0)
+            {
+                rc = -1; // Damaged, or out of memory
+                break;
+            }
+            pos += record.length;
+            meta->replayed++;
+        }
+        offset += pos;
+        memmove(buffer, buffer + pos, have - pos);
+        have -= pos;
+        // A record longer than the buffer cannot exist; anything else left is incomplete
+        if (rc < 0 || pos == 0)
+        {
+            break;
+        }
+    }
+    free(buffer);
+    meta->offset = offset;
+    return rc;
+}
+
+// Function to open a journal and check its generation
+// Returns the descriptor, or -1 if it is missing or belongs to another generation.
+static int meta_open_journal(const struct dfs_meta *meta, const char *name, uint64_t *generation)
+{
+    char path[DFS_PATH_MAX];
+    meta_file(meta, name, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct meta_journal_header header;
+    if (fd >= 0 && (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                    memcmp(header.magic, META_JOURNAL_MAGIC, sizeof(header.magic)) != 0))
+    {
+        close(fd);
+        fd = -1;
+    }
+    if (fd >= 0)
+    {
+        *generation = header.generation;
+    }
+    return fd;
+}
+
+// Function to read exactly len bytes from the current offset
+static int meta_read_all(int fd, void *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = read(fd, (char *)buf + done, len - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// Function to load the snapshot into an empty table
+static int meta_read_snapshot(struct dfs_meta *meta)
+{
+    char path[DFS_PATH_MAX];
+    meta_file(meta, META_SNAPSHOT, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct meta_snapshot_header header;
+    struct stat st;
+    int rc = -1;
+    if (read(fd, &header, sizeof(header)) == sizeof(header) && fstat(fd, &st) == 0 &&
+        memcmp(header.magic, META_SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+        header.count < UINT32_MAX &&
+        (uint64_t)st.st_size == sizeof(header) + header.count * sizeof(struct dfs_meta_entry) + header.paths_len)
+    {
+        meta->entries = malloc((header.count ? header.count : 1) * sizeof(struct dfs_meta_entry));
+        meta->paths = malloc(header.paths_len ? header.paths_len : 1);
+        size_t entries_len = header.count * sizeof(struct dfs_meta_entry);
+        if (meta->entries != NULL && meta->paths != NULL &&
+            meta_read_all(fd, meta->entries, entries_len) == 0 && meta_read_all(fd, meta->paths, header.paths_len) == 0)
+        {
+            rc = 0;
+            for (uint64_t e = 0; e < header.count; e++)
+            {
+                const struct dfs_meta_entry *entry = &meta->entries[e];
+                if (entry->path_len == 0 || entry->path_offset > header.paths_len ||
+                    entry->path_len > header.paths_len - entry->path_offset)
+                {
+                    rc = -1;
+                    break;
+                }
+            }
+        }
+    }
+    close(fd);
+    if (rc == 0)
+    {
+        meta->count = meta->capacity = meta->live_count = header.count;
+        meta->paths_len = meta->paths_capacity = header.paths_len;
+        meta->generation = header.generation;
+        rc = meta_rehash(meta, meta->count);
+    }
+    if (rc < 0)
+    {
+        meta_clear(meta);
+    }
+    return rc;
+}
+
+// Function to add the files of one directory and its subdirectories to the table
+// The path is extended in place, like dfs_list_files() does.
+static void meta_walk(struct dfs_meta *meta, char *path, size_t path_len)
+{
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' || (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+        {
+            continue;
+        }
+        size_t name_len = strlen(ent->d_name);
+        if (path_len + 1 + name_len >= DFS_PATH_MAX)
+        {
+            continue;
+        }
+        path[path_len] = '/';
+        memcpy(path + path_len + 1, ent->d_name, name_len + 1);
+        if (ent->d_type == DT_REG && has_ext(meta, ent->d_name, name_len))
+        {
+            struct stat st;
+            if (fstatat(dirfd(dir), ent->d_name, &st, 0) == 0)
+            {
+                struct meta_record record;
+                const char *key = path + meta->root_len + 1;
+                meta_describe(meta, &record, &st, 0);
+                record.path_len = strlen(key);
+                meta_apply(meta, &record, key);
+            }
+        }
+        else if (ent->d_type == DT_DIR)
+        {
+            meta_walk(meta, path, path_len + 1 + name_len);
+        }
+        path[path_len] = '\0';
+    }
+    closedir(dir);
+}
+
+// Function to write the table as a new snapshot and start a new, empty journal
+// The caller holds the lock exclusively and the table includes the whole current journal,
+// which is kept as the previous journal for readers that have not finished it.
+static int meta_rotate(struct dfs_meta *meta)
+{
+    uint64_t generation = meta->generation;
+    uint64_t journal_generation;
+    int fd = meta_open_journal(meta, META_JOURNAL, &journal_generation);
+    if (fd >= 0)
+    {
+        close(fd);
+        generation = (journal_generation > generation) ? journal_generation : generation;
+    }
+    generation++;
+
+    // Only live entries go into the snapshot
+    struct dfs_meta_entry *entries = malloc((meta->live_count ? meta->live_count : 1) * sizeof(*entries));
+    char *paths = malloc(meta->paths_len ? meta->paths_len : 1);
+    if (entries == NULL || paths == NULL)
+    {
+        free(entries);
+        free(paths);
+        return -1;
+    }
+    uint64_t count = 0;
+    uint64_t paths_len = 0;
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        if (meta->entries[e].live)
+        {
+            entries[count] = meta->entries[e];
+            entries[count].path_offset = paths_len;
+            memcpy(paths + paths_len, meta->paths + meta->entries[e].path_offset, meta->entries[e].path_len);
+            paths_len += meta->entries[e].path_len;
+            count++;
+        }
+    }
+    struct meta_snapshot_header header;
+    memcpy(header.magic, META_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.generation = generation;
+    header.count = count;
+    header.paths_len = paths_len;
+    struct iovec parts[3] = { { &header, sizeof(header) }, { entries, count * sizeof(*entries) }, { paths, paths_len } };
+    char path[DFS_PATH_MAX];
+    meta_file(meta, META_SNAPSHOT, path, sizeof(path));
+    int rc = dfs_replace_file(path, parts, 3);
+    if (rc == 0)
+    {
+        // The table now matches the snapshot exactly
+        free(meta->entries);
+        free(meta->paths);
+        meta->entries = entries;
+        meta->paths = paths;
+        meta->count = meta->capacity = meta->live_count = count;
+        meta->paths_len = meta->paths_capacity = paths_len;
+        rc = meta_rehash(meta, count);
+    }
+    else
+    {
+        free(entries);
+        free(paths);
+    }
+    if (rc < 0)
+    {
+        return -1;
+    }
+
+    char journal[DFS_PATH_MAX];
+    char prev[DFS_PATH_MAX];
+    meta_file(meta, META_JOURNAL, journal, sizeof(journal));
+    meta_file(meta, META_JOURNAL_PREV, prev, sizeof(prev));
+    unlink(prev);
+    link(journal, prev);
+    struct meta_journal_header journal_header;
+    memcpy(journal_header.magic, META_JOURNAL_MAGIC, sizeof(journal_header.magic));
+    journal_header.generation = generation;
+    struct iovec part = { &journal_header, sizeof(journal_header) };
+    if (dfs_replace_file(journal, &part, 1) < 0)
+    {
+        return -1;
+    }
+    meta->generation = generation;
+    meta->offset = sizeof(journal_header);
+    return 0;
+}
+
+// Function to bring the table up to the end of the journal; the caller holds the lock
+// Follows one journal rotation through the previous journal; after more than one the
+// snapshot is loaded again.
+static int meta_catch_up(struct dfs_meta *meta)
+{
+    uint64_t generation;
+    int fd = meta_open_journal(meta, META_JOURNAL, &generation);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (generation == meta->generation + 1)
+    {
+        uint64_t prev_generation;
+        int prev_fd = meta_open_journal(meta, META_JOURNAL_PREV, &prev_generation);
+        if (prev_fd >= 0 && prev_generation == meta->generation && meta_replay(meta, prev_fd, meta->offset) == 0)
+        {
+            meta->generation = generation;
+            meta->offset = sizeof(struct meta_journal_header);
+        }
+        if (prev_fd >= 0)
+        {
+            close(prev_fd);
+        }
+    }
+    if (generation != meta->generation)
+    {
+        meta_clear(meta);
+        if (meta_read_snapshot(meta) < 0 || meta->generation != generation)
+        {
+            close(fd);
+            meta->loaded = 0;
+            return -1;
+        }
+        meta->offset = sizeof(struct meta_journal_header);
+    }
+    int rc = meta_replay(meta, fd, meta->offset);
+    close(fd);
+    return rc;
+}
+
+// Function to forget the files that have a file of their own before the tree is walked again
+// Packed files are kept: the table is the only record of them.
+static void meta_forget_files(struct dfs_meta *meta)
+{
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        struct dfs_meta_entry *entry = &meta->entries[e];
+        if (entry->live && entry->segment == 0)
+        {
+            entry->live = 0;
+            meta->live_count--;
+        }
+    }
+}
+
+// Function to load a server's table from its snapshot and journal
+// Walks the tree instead when there is no usable snapshot or DFS_META_RESCAN=1, and then
+// writes a snapshot so the next start does not have to. Returns 0 or -1.
+int dfs_meta_open(struct dfs_meta *meta, const char *root, int type)
+{
+    memset(meta, 0, sizeof(*meta));
+    meta->lock_fd = -1;
+    meta->root = strdup(root);
+    if (meta->root == NULL || type < 0 || type >= DFS_TYPE_COUNT || strlen(root) + 32 >= DFS_PATH_MAX)
+    {
+        return -1;
+    }
+    meta->root_len = strlen(root);
+    while (meta->root_len > 1 && meta->root[meta->root_len - 1] == '/')
+    {
+        meta->root[--meta->root_len] = '\0';
+    }
+    meta->ext = type_exts[type];
+    meta->location = type + 1;
+    if (meta_lock(meta, LOCK_EX) < 0)
+    {
+        return -1;
+    }
+
+    const char *rescan = getenv("DFS_META_RESCAN");
+    int rc = meta_read_snapshot(meta);
+    if (rc == 0)
+    {
+        uint64_t generation;
+        int fd = meta_open_journal(meta, META_JOURNAL, &generation);
+        if (fd >= 0 && generation == meta->generation)
+        {
+            rc = meta_replay(meta, fd, sizeof(struct meta_journal_header));
+        }
+        else
+        {
+            // Stopped between writing the snapshot and restarting the journal: the
+            // snapshot already has everything, so only the journal needs starting over
+            rc = (fd < 0 || generation < meta->generation) ? meta_rotate(meta) : -1;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    if (rc == 0 && rescan != NULL && strcmp(rescan, "1") == 0)
+    {
+        char path[DFS_PATH_MAX];
+        memcpy(path, meta->root, meta->root_len + 1);
+        meta_forget_files(meta);
+        meta_walk(meta, path, meta->root_len);
+        meta->walked = 1;
+        rc = meta_rotate(meta);
+    }
+    if (rc < 0)
+    {
+        meta_clear(meta);
+        meta->generation = 0;
+        meta->replayed = 0;
+        char path[DFS_PATH_MAX];
+        memcpy(path, meta->root, meta->root_len + 1);
+        if (meta_rehash(meta, 0) == 0)
+        {
+            meta_walk(meta, path, meta->root_len);
+            meta->walked = 1;
+            rc = meta_rotate(meta);
+        }
+    }
+    meta_lock(meta, LOCK_UN);
+    meta->loaded = (rc == 0);
+    return rc;
+}
+
+// Function to free the table and close the lock file
+void dfs_meta_close(struct dfs_meta *meta)
+{
+    meta_clear(meta);
+    if (meta->lock_fd >= 0)
+    {
+        close(meta->lock_fd);
+    }
+    meta->lock_fd = -1;
+    free(meta->root);
+    meta->root = NULL;
+    meta->loaded = 0;
+}
+
+// Function to apply the changes other processes have made since the last call
+int dfs_meta_sync(struct dfs_meta *meta)
+{
+    if (!meta->loaded || meta_lock(meta, LOCK_SH) < 0)
+    {
+        return -1;
+    }
+    int rc = meta_catch_up(meta);
+    meta_lock(meta, LOCK_UN);
+    return rc;
+}
+
+// Function to append records to the journal and apply them with everything before them
+static void meta_append(struct dfs_meta *meta, const char *records, size_t len)
+{
+    if (meta_lock(meta, LOCK_SH) < 0)
+    {
+        return;
+    }
+    char path[DFS_PATH_MAX];
+    meta_file(meta, META_JOURNAL, path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        // One write() so records from concurrent requests never interleave
+        if (write(fd, records, len) != (ssize_t)len)
+        {
+            perror("ERROR appending to metadata journal");
+        }
+        close(fd);
+    }
+    meta_catch_up(meta);
+    meta_lock(meta, LOCK_UN);
+}
+
+// Function to look up the hash recorded for a file, 0 if there is none
+static uint64_t meta_known_hash(const struct dfs_meta *meta, const char *path)
+{
+    char key[DFS_PATH_MAX];
+    uint64_t slot;
+    int len = relative_path(meta, path, key);
+    int64_t found = (len > 0) ? meta_find(meta, key, len, &slot) : -1;
+    return (found >= 0 && meta->entries[found].live) ? meta->entries[found].hash : 0;
+}
+
+// Function to encode an "add" record for a file as it is now into buffer
+// Returns the record's length, or 0 if the file is not one the table keeps.
+static size_t meta_encode_add(const struct dfs_meta *meta, const char *path, uint64_t hash, char *buffer)
+{
+    char key[DFS_PATH_MAX];
+    struct stat st;
+    int len = relative_path(meta, path, key);
+    if (len <= 0 || !has_ext(meta, key, len) || stat(path, &st) < 0)
+    {
+        return 0;
+    }
+    struct meta_record record;
+    meta_describe(meta, &record, &st, hash);
+    return meta_encode(&record, key, len, buffer);
+}
+
+// Function to record that a file was stored or replaced
+// Its hash is unknown until dfs_meta_hash() runs, normally after the reply.
+void dfs_meta_add(struct dfs_meta *meta, const char *path)
+{
+    char buffer[sizeof(struct meta_record) + DFS_PATH_MAX];
+    size_t len = meta->loaded ? meta_encode_add(meta, path, 0, buffer) : 0;
+    if (len > 0)
+    {
+        meta_append(meta, buffer, len);
+    }
+}
+
+// Function to record a copy; the contents, and so the hash, are the source's
+void dfs_meta_copy(struct dfs_meta *meta, const char *src_path, const char *dst_path)
+{
+    char buffer[sizeof(struct meta_record) + DFS_PATH_MAX];
+    size_t len = meta->loaded ? meta_encode_add(meta, dst_path, meta_known_hash(meta, src_path), buffer) : 0;
+    if (len > 0)
+    {
+        meta_append(meta, buffer, len);
+    }
+}
+
+// Function to record that a file was removed
+void dfs_meta_remove(struct dfs_meta *meta, const char *path)
+{
+    char key[DFS_PATH_MAX];
+    char buffer[sizeof(struct meta_record) + DFS_PATH_MAX];
+    int len = meta->loaded ? relative_path(meta, path, key) : -1;
+    if (len <= 0 || !has_ext(meta, key, len))
+    {
+        return;
+    }
+    struct meta_record record;
+    memset(&record, 0, sizeof(record));
+    record.op = META_OP_REMOVE;
+    meta_append(meta, buffer, meta_encode(&record, key, len, buffer));
+}
+
+// Function to record that a file was renamed; the contents, and so the hash, carry over
+void dfs_meta_rename(struct dfs_meta *meta, const char *old_path, const char *new_path)
+{
+    char old_key[DFS_PATH_MAX];
+    char buffer[2 * (sizeof(struct meta_record) + DFS_PATH_MAX)];
+    int old_len = meta->loaded ? relative_path(meta, old_path, old_key) : -1;
+    if (old_len <= 0)
+    {
+        return;
+    }
+
+    // Both records in one write, so no reader sees the file under neither name
+    struct meta_record record;
+    memset(&record, 0, sizeof(record));
+    record.op = META_OP_REMOVE;
+    size_t len = meta_encode(&record, old_key, old_len, buffer);
+    len += meta_encode_add(meta, new_path, meta_known_hash(meta, old_path), buffer + len);
+    meta_append(meta, buffer, len);
+}
+
+// Function to hash a stored file and record the result
+// Reads the whole file, so servers call it after answering the request.
+void dfs_meta_hash(struct dfs_meta *meta, const char *path)
+{
+    char key[DFS_PATH_MAX];
+    char buffer[sizeof(struct meta_record) + DFS_PATH_MAX];
+    int len = meta->loaded ? relative_path(meta, path, key) : -1;
+    int fd = (len > 0 && has_ext(meta, key, len)) ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return;
+    }
+    void *data = (st.st_size > 0) ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    struct meta_record record;
+    meta_describe(meta, &record, &st, xxh64(data, st.st_size));
+    if (data != NULL)
+    {
+        munmap(data, st.st_size);
+    }
+    meta_append(meta, buffer, meta_encode(&record, key, len, buffer));
+}
+
+// Function to record that a file was packed into a segment, or replaced by a packed one
+// The hash is known up front, since the contents were in memory to be packed.
+void dfs_meta_add_packed(struct dfs_meta *meta, const char *path, uint64_t size, uint64_t hash,
+                         uint32_t segment, uint32_t segment_offset)
+{
+    char key[DFS_PATH_MAX];
+    char buffer[sizeof(struct meta_record) + DFS_PATH_MAX];
+    int len = meta->loaded ? relative_path(meta, path, key) : -1;
+    if (len <= 0 || !has_ext(meta, key, len))
+    {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    struct meta_record record;
+    memset(&record, 0, sizeof(record));
+    record.op = META_OP_ADD;
+    record.location = meta->location;
+    record.size = size;
+    record.mtime_sec = now.tv_sec;
+    record.mtime_nsec = now.tv_nsec;
+    record.hash = hash;
+    record.segment = segment;
+    record.segment_offset = segment_offset;
+    meta_append(meta, buffer, meta_encode(&record, key, len, buffer));
+}
+
+// Function to record a copy (move = 0) or rename of a packed file
+// Nothing is copied: the new name points at the same contents in the segment.
+void dfs_meta_link(struct dfs_meta *meta, const char *src_path, const char *dst_path, int move)
+{
+    char keys[2 * DFS_PATH_MAX];
+    char buffer[sizeof(struct meta_record) + 2 * DFS_PATH_MAX];
+    int len = meta->loaded ? relative_path(meta, dst_path, keys) : -1;
+    int source_len = (len > 0) ? relative_path(meta, src_path, keys + len) : -1;
+    if (len <= 0 || source_len <= 0 || !has_ext(meta, keys, len))
+    {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    struct meta_record record;
+    memset(&record, 0, sizeof(record));
+    record.op = move ? META_OP_MOVE : META_OP_LINK;
+    record.mtime_sec = now.tv_sec;
+    record.mtime_nsec = now.tv_nsec;
+    record.source_len = source_len;
+    meta_append(meta, buffer, meta_encode(&record, keys, len, buffer));
+}
+
+// Function to point every packed file in from_segment at the compactor's copy of its contents
+// from_offsets is sorted; the contents at from_offsets[i] were copied to to_offsets[i] in
+// to_segment. The records are built with the lock held exclusively, from a table that has
+// every change before them, so no file is left pointing into from_segment, and they are on
+// disk before it returns. Returns the number of files moved, or -1 if one had no copy.
+long dfs_meta_relocate(struct dfs_meta *meta, uint32_t from_segment, const uint32_t *from_offsets,
+                       const uint32_t *to_offsets, size_t count, uint32_t to_segment)
+{
+    if (!meta->loaded || meta_lock(meta, LOCK_EX) < 0)
+    {
+        return -1;
+    }
+    char *buffer = NULL;
+    size_t len = 0;
+    size_t capacity = 0;
+    long moved = (meta_catch_up(meta) == 0) ? 0 : -1;
+    struct meta_record record;
+    memset(&record, 0, sizeof(record));
+    record.op = META_OP_RELOCATE;
+    record.from_segment = from_segment;
+    record.segment = to_segment;
+    for (uint64_t e = 0; e < meta->count && moved >= 0; e++)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        if (!entry->live || entry->segment != from_segment)
+        {
+            continue;
+        }
+        size_t low = 0;
+        size_t high = count;
+        while (low < high)
+        {
+            size_t mid = (low + high) / 2;
+            if (from_offsets[mid] < entry->segment_offset)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+        if (low == count || from_offsets[low] != entry->segment_offset)
+        {
+            moved = -1;
+            break;
+        }
+        if (len + sizeof(record) + entry->path_len > capacity)
+        {
+            size_t new_capacity = capacity ? capacity * 2 : 64 * 1024;
+            char *grown = realloc(buffer, new_capacity);
+            if (grown == NULL)
+            {
+                moved = -1;
+                break;
+            }
+            buffer = grown;
+            capacity = new_capacity;
+        }
+        record.from_offset = entry->segment_offset;
+        record.segment_offset = to_offsets[low];
+        len += meta_encode(&record, meta->paths + entry->path_offset, entry->path_len, buffer + len);
+        moved++;
+    }
+    if (moved > 0)
+    {
+        // Appended like meta_append() does, but under the exclusive lock already held
+        char path[DFS_PATH_MAX];
+        meta_file(meta, META_JOURNAL, path, sizeof(path));
+        int fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd < 0 || write(fd, buffer, len) != (ssize_t)len || fdatasync(fd) < 0)
+        {
+            perror("ERROR appending to metadata journal");
+            moved = -1;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        meta_catch_up(meta);
+    }
+    meta_lock(meta, LOCK_UN);
+    free(buffer);
+    return moved;
+}
+
+// Function to turn an absolute directory into a key prefix ("" for the root)
+// Returns the prefix length, or -1 if the directory is outside the root.
+static int meta_prefix(const struct dfs_meta *meta, const char *base_path, char *prefix)
+{
+    if (strncmp(base_path, meta->root, meta->root_len) == 0 && base_path[meta->root_len] == '\0')
+    {
+        prefix[0] = '\0';
+        return 0;
+    }
+    return relative_path(meta, base_path, prefix);
+}
+
+// Function to look up a file in the table as of the last sync
+// Returns 1 and fills *entry if the file is stored, 0 if it is not.
+int dfs_meta_lookup(struct dfs_meta *meta, const char *path, struct dfs_meta_entry *entry)
+{
+    char key[DFS_PATH_MAX];
+    uint64_t slot;
+    int len = meta->loaded ? relative_path(meta, path, key) : -1;
+    int64_t found = (len > 0) ? meta_find(meta, key, len, &slot) : -1;
+    if (found < 0 || !meta->entries[found].live)
+    {
+        return 0;
+    }
+    *entry = meta->entries[found];
+    return 1;
+}
+
+// Function to record the removal of every file below base_path that no longer exists
+// Used when a directory disappears or change events were lost. Returns the number of
+// files removed, or -1 if the table is not loaded.
+long dfs_meta_prune(struct dfs_meta *meta, const char *base_path)
+{
+    char prefix[DFS_PATH_MAX];
+    int prefix_len;
+    if (dfs_meta_sync(meta) < 0 || (prefix_len = meta_prefix(meta, base_path, prefix)) < 0)
+    {
+        return -1;
+    }
+
+    // All removals go out in one append once the table has been checked
+    char *buffer = NULL;
+    size_t len = 0;
+    size_t capacity = 0;
+    long removed = 0;
+    struct meta_record record;
+    memset(&record, 0, sizeof(record));
+    record.op = META_OP_REMOVE;
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        const char *key = meta->paths + entry->path_offset;
+        if (!entry->live || entry->path_len <= prefix_len ||
+            (prefix_len > 0 && (memcmp(key, prefix, prefix_len) != 0 || key[prefix_len] != '/')))
+        {
+            continue;
+        }
+        char path[DFS_PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%.*s", meta->root, entry->path_len, key);
+        if (entry->segment != 0 || (stat(path, &st) == 0 && S_ISREG(st.st_mode)))
+        {
+            continue;
+        }
+        if (len + sizeof(record) + entry->path_len > capacity)
+        {
+            size_t new_capacity = capacity ? capacity * 2 : 64 * 1024;
+            char *grown = realloc(buffer, new_capacity);
+            if (grown == NULL)
+            {
+                break;
+            }
+            buffer = grown;
+            capacity = new_capacity;
+        }
+        len += meta_encode(&record, key, entry->path_len, buffer + len);
+        removed++;
+    }
+    if (len > 0)
+    {
+        meta_append(meta, buffer, len);
+    }
+    free(buffer);
+    return removed;
+}
+
+// Function to write a snapshot now and start a new journal
+// Returns 0, 1 if another process is already writing one, or -1.
+int dfs_meta_compact(struct dfs_meta *meta)
+{
+    if (!meta->loaded)
+    {
+        return -1;
+    }
+    if (meta_lock(meta, LOCK_EX | LOCK_NB) < 0)
+    {
+        return (errno == EWOULDBLOCK) ? 1 : -1;
+    }
+    int rc = meta_catch_up(meta);
+    if (rc == 0)
+    {
+        rc = meta_rotate(meta);
+    }
+    meta_lock(meta, LOCK_UN);
+    return rc;
+}
+
+// Function to start a snapshot in a child process once the journal has grown large
+// Called by the accepting parent after dfs_meta_sync(); the parent reaps the child with
+// the connection handlers.
+void dfs_meta_maybe_compact(struct dfs_meta *meta)
+{
+    if (!meta->loaded || meta->offset < META_COMPACT_BYTES || meta->compact_generation == meta->generation)
+    {
+        return;
+    }
+    meta->compact_generation = meta->generation;
+    if (fork() == 0)
+    {
+        _exit(dfs_meta_compact(meta) < 0);
+    }
+}
+
+// Function to list the stored files below base_path like dfs_list_files() does
+// Writes "~S1/<path relative to base_path>" lines from the table, falling back to walking
+// the tree if the table is not loaded. Returns the number of bytes written.
+size_t dfs_meta_list(struct dfs_meta *meta, const char *base_path, char *out, size_t out_size)
+{
+    char prefix[DFS_PATH_MAX];
+    int prefix_len;
+    if (dfs_meta_sync(meta) < 0 || (prefix_len = meta_prefix(meta, base_path, prefix)) < 0)
+    {
+        return dfs_list_files(base_path, meta->ext, out, out_size);
+    }
+    size_t out_len = 0;
+    if (out_size > 0)
+    {
+        out[0] = '\0';
+    }
+    for (uint64_t e = 0; e < meta->count && out_len + 1 < out_size; e++)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        const char *key = meta->paths + entry->path_offset;
+        if (!entry->live || entry->path_len <= prefix_len || !has_ext(meta, key, entry->path_len) ||
+            (prefix_len > 0 && (memcmp(key, prefix, prefix_len) != 0 || key[prefix_len] != '/')))
+        {
+            continue;
+        }
+        int skip = prefix_len ? prefix_len + 1 : 0;
+        int n = snprintf(out + out_len, out_size - out_len, "~S1/%.*s\n", entry->path_len - skip, key + skip);
+        out_len = (n < 0 || (size_t)n >= out_size - out_len) ? out_size - 1 : out_len + n;
+    }
+    return out_len;
+}
+
+// Function to write the absolute paths of the stored files below base_path, one per line
+// Used to feed tar without a find; packed files have no path to give and are left out.
+// Returns the number of paths, or -1 if the table is not loaded.
+long dfs_meta_write_paths(struct dfs_meta *meta, const char *base_path, FILE *out)
+{
+    char prefix[DFS_PATH_MAX];
+    int prefix_len;
+    if (dfs_meta_sync(meta) < 0 || (prefix_len = meta_prefix(meta, base_path, prefix)) < 0)
+    {
+        return -1;
+    }
+    long written = 0;
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        const char *key = meta->paths + entry->path_offset;
+        if (entry->live && entry->segment == 0 && entry->path_len > prefix_len &&
+            (prefix_len == 0 || (memcmp(key, prefix, prefix_len) == 0 && key[prefix_len] == '/')))
+        {
+            fprintf(out, "%s/%.*s\n", meta->root, entry->path_len, key);
+            written++;
+        }
+    }
+    return written;
+}
+
+// Function to write the key of every stored file, one per line
+// Used to answer S1's inventory request. Returns the number of keys, or -1 if the table
+// is not loaded.
+long dfs_meta_write_keys(struct dfs_meta *meta, FILE *out)
+{
+    if (dfs_meta_sync(meta) < 0)
+    {
+        return -1;
+    }
+    long written = 0;
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        if (entry->live)
+        {
+            fwrite(meta->paths + entry->path_offset, 1, entry->path_len, out);
+            putc('\n', out);
+            written++;
+        }
+    }
+    return written;
+}
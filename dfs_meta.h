@@ -0,0 +1,90 @@
+// Distributed File System - Metadata journal
+// Every server keeps path -> (size, mtime, hash, location) for the files it stores in an
+// in-memory table, so listings and archives do not walk the tree. The table lives in the
+// server's root directory as a snapshot plus a journal of the changes made since:
+//   .dfs_meta.snap  the whole table, written when the journal grows past META_COMPACT_BYTES
+//   .dfs_meta.log   one record per upload, removal, copy or move, appended before the reply
+//   .dfs_meta.lock  flock()ed shared while the journal is appended to or read, and
+//                   exclusively while a snapshot is written and the journal restarted
+// Starting up reads the snapshot and replays the journal; the tree is walked only when
+// there is no snapshot yet or DFS_META_RESCAN=1 (for files changed outside the DFS).
+// Children inherit the table through fork() and catch up on each other's changes by
+// reading the journal from where they left off, so staying current costs O(changes).
+// Files packed into segments (dfs_pack.h) exist only in the table, which records where
+// their contents are; a rescan walks the tree for the other files and keeps them.
+
+#ifndef DFS_META_H
+#define DFS_META_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define META_COMPACT_BYTES (16 * 1024 * 1024) // Journal size that triggers a new snapshot
+
+// What the table knows about one file
+struct dfs_meta_entry
+{
+    uint64_t size;
+    int64_t mtime_sec;
+    uint64_t hash; // XXH64 of the contents, 0 until the file is next written through the DFS
+    uint64_t path_offset; // Path relative to the root, in dfs_meta.paths
+    uint32_t segment; // Pack segment holding the contents, 0 for a file of its own
+    uint32_t segment_offset;
+    uint32_t mtime_nsec;
+    uint16_t path_len;
+    uint8_t location; // Server storing the file, 1-4
+    uint8_t live; // 0 once removed; dropped from the next snapshot
+};
+
+// One server's table and how far into the journal it has read
+struct dfs_meta
+{
+    char *root;
+    size_t root_len;
+    const char *ext; // Extension of the files the server stores
+    int location;
+    int loaded; // 0 if the table could not be loaded; listings then walk the tree
+    struct dfs_meta_entry *entries;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t live_count;
+    char *paths;
+    uint64_t paths_len;
+    uint64_t paths_capacity;
+    uint32_t *slots; // Open-addressing hash of paths: entry index + 1, 0 if empty
+    uint64_t slot_count;
+    uint64_t generation; // Journal generation the table follows
+    uint64_t offset; // Bytes of that journal applied
+    uint64_t replayed; // Records applied while loading
+    int walked; // The tree was walked while loading
+    int lock_fd; // Opened per process: flock() locks belong to the open file
+    pid_t lock_pid;
+    uint64_t compact_generation; // Generation a snapshot was last started for
+};
+
+// Function prototypes
+int dfs_meta_open(struct dfs_meta *meta, const char *root, int type);
+void dfs_meta_close(struct dfs_meta *meta);
+int dfs_meta_sync(struct dfs_meta *meta);
+void dfs_meta_add(struct dfs_meta *meta, const char *path);
+void dfs_meta_copy(struct dfs_meta *meta, const char *src_path, const char *dst_path);
+void dfs_meta_remove(struct dfs_meta *meta, const char *path);
+void dfs_meta_rename(struct dfs_meta *meta, const char *old_path, const char *new_path);
+void dfs_meta_hash(struct dfs_meta *meta, const char *path);
+void dfs_meta_add_packed(struct dfs_meta *meta, const char *path, uint64_t size, uint64_t hash,
+                         uint32_t segment, uint32_t segment_offset);
+void dfs_meta_link(struct dfs_meta *meta, const char *src_path, const char *dst_path, int move);
+long dfs_meta_relocate(struct dfs_meta *meta, uint32_t from_segment, const uint32_t *from_offsets,
+                       const uint32_t *to_offsets, size_t count, uint32_t to_segment);
+int dfs_meta_lookup(struct dfs_meta *meta, const char *path, struct dfs_meta_entry *entry);
+long dfs_meta_prune(struct dfs_meta *meta, const char *base_path);
+int dfs_meta_compact(struct dfs_meta *meta);
+void dfs_meta_maybe_compact(struct dfs_meta *meta);
+size_t dfs_meta_list(struct dfs_meta *meta, const char *base_path, char *out, size_t out_size);
+long dfs_meta_write_paths(struct dfs_meta *meta, const char *base_path, FILE *out);
+long dfs_meta_write_keys(struct dfs_meta *meta, FILE *out);
+int dfs_meta_key(const char *path, char *out);
+uint64_t dfs_meta_xxh64(const void *data, size_t len);
+
+#endif
@@ -0,0 +1,783 @@
+// Distributed File System - Micro-benchmarks for server hot paths (dfs_microbench.c)
+// Times the dfs_core helpers on synthetic directory trees and files and prints one
+// record per measurement as JSON lines or CSV, for comparing runs across changes.
+// The framing benchmark also checks the dfs_net size-header framing under forced
+// segmentation and exits with status 1 if a message arrives corrupted.
+// Compile: gcc -O2 dfs_microbench.c dfs_core.c dfs_net.c dfs_match.c dfs_grep.c dfs_meta.c -o dfs_microbench -lpthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h> // for open()
+#include <errno.h>
+#include <time.h> // for clock_gettime()
+#include <signal.h> // for kill()
+#include <sys/stat.h>
+#include <sys/socket.h> // for socketpair()
+#include <sys/wait.h> // for waitpid()
+#include <fnmatch.h> // for fnmatch()
+#include "dfs_core.h"
+#include "dfs_net.h"
+#include "dfs_match.h"
+#include "dfs_grep.h"
+#include "dfs_meta.h"
+
+#define FILES_PER_DIR 100 // Synthetic trees hold this many files per leaf directory
+#define DIRS_PER_DIR 100
+#define REAL_DATA_LIMIT (256L << 20) // Larger copy sources are sparse files
+#define MAX_LIST 16
+#define FRAMING_MESSAGES 2000 // Messages per framing measurement
+#define FRAMING_SEGMENTED_BYTES (256L << 10) // Cap for runs that move a byte or a few per call
+#define GREP_FILES 32 // Text files in the grep corpus
+#define GREP_FILE_BYTES (4L << 20)
+
+// Benchmark settings
+struct micro_config
+{
+    const char *scratch; // Directory the synthetic trees and files are created in
+    const char *benches;
+    long files; // Files in the walk tree
+    long iterations; // Calls per mkdir/dispatch measurement
+    long sizes[MAX_LIST];
+    int size_count;
+    long chunks[MAX_LIST];
+    int chunk_count;
+    int csv;
+};
+
+// Function prototypes
+long long now_ns(void);
+void emit(struct micro_config *cfg, const char *bench, const char *variant, long param,
+          long iterations, long long total_ns, double bytes);
+int parse_list(const char *spec, long *out);
+long parse_size(const char *text);
+void bench_mkdir(struct micro_config *cfg);
+void bench_walk(struct micro_config *cfg);
+void bench_copy(struct micro_config *cfg);
+void bench_dispatch(struct micro_config *cfg);
+void bench_framing(struct micro_config *cfg);
+void bench_match(struct micro_config *cfg);
+void bench_grep(struct micro_config *cfg);
+void bench_meta(struct micro_config *cfg);
+int build_tree(const char *root, long files);
+void usage(const char *prog);
+
+// Main function parses the options and runs the selected benchmarks
+int main(int argc, char *argv[])
+{
+    struct micro_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.scratch = "/tmp/dfs_microbench";
+    cfg.benches = "mkdir,walk,copy,dispatch,framing,match,grep,meta";
+    cfg.files = 1000;
+    cfg.iterations = 100000;
+    cfg.size_count = parse_list("1k,1m,64m", cfg.sizes);
+    cfg.chunk_count = parse_list("1k,64k,1m", cfg.chunks);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:n:i:s:c:d:f:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': cfg.benches = optarg; break;
+            case 'n': cfg.files = parse_size(optarg); break;
+            case 'i': cfg.iterations = parse_size(optarg); break;
+            case 's': cfg.size_count = parse_list(optarg, cfg.sizes); break;
+            case 'c': cfg.chunk_count = parse_list(optarg, cfg.chunks); break;
+            case 'd': cfg.scratch = optarg; break;
+            case 'f': cfg.csv = (strcmp(optarg, "csv") == 0); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (cfg.files <= 0 || cfg.iterations <= 0 || cfg.size_count <= 0 || cfg.chunk_count <= 0 ||
+        create_directory_tree(cfg.scratch) < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    if (cfg.csv)
+    {
+        printf("bench,variant,param,iterations,total_ns,ns_per_op,mb_per_s\n");
+    }
+    if (strstr(cfg.benches, "mkdir")) bench_mkdir(&cfg);
+    if (strstr(cfg.benches, "walk")) bench_walk(&cfg);
+    if (strstr(cfg.benches, "copy")) bench_copy(&cfg);
+    if (strstr(cfg.benches, "dispatch")) bench_dispatch(&cfg);
+    if (strstr(cfg.benches, "framing")) bench_framing(&cfg);
+    if (strstr(cfg.benches, "match")) bench_match(&cfg);
+    if (strstr(cfg.benches, "grep")) bench_grep(&cfg);
+    if (strstr(cfg.benches, "meta")) bench_meta(&cfg);
+    return 0;
+}
+
+// Function to read a monotonic clock in nanoseconds
+long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Function to print one measurement
+void emit(struct micro_config *cfg, const char *bench, const char *variant, long param,
+          long iterations, long long total_ns, double bytes)
+{
+    double ns_per_op = (iterations > 0) ? (double)total_ns / iterations : 0;
+    double mb_per_s = (total_ns > 0 && bytes > 0) ? bytes / (1 << 20) / (total_ns / 1e9) : 0;
+    if (cfg->csv)
+    {
+        printf("%s,%s,%ld,%ld,%lld,%.1f,%.1f\n", bench, variant, param, iterations, total_ns, ns_per_op, mb_per_s);
+    }
+    else
+    {
+        printf("{\"bench\":\"%s\",\"variant\":\"%s\",\"param\":%ld,\"iterations\":%ld,\"total_ns\":%lld,"
+               "\"ns_per_op\":%.1f,\"mb_per_s\":%.1f}\n",
+               bench, variant, param, iterations, total_ns, ns_per_op, mb_per_s);
+    }
+    fflush(stdout);
+}
+
+// Function to time create_directory_tree on a path that exists (the upload case)
+// and on fresh paths whose parents have to be created
+void bench_mkdir(struct micro_config *cfg)
+{
+    char path[DFS_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/mkdir/a/b/c/d", cfg->scratch);
+    create_directory_tree(path);
+
+    long long start = now_ns();
+    for (long i = 0; i < cfg->iterations; i++)
+    {
+        create_directory_tree(path);
+    }
+    emit(cfg, "create_directory_tree", "existing", 4, cfg->iterations, now_ns() - start, 0);
+
+    // Each fresh path needs two new directories below an existing parent
+    long fresh = cfg->iterations / 10 + 1;
+    char base[DFS_PATH_MAX];
+    snprintf(base, sizeof(base), "%s/mkdir/fresh%lld", cfg->scratch, now_ns());
+    start = now_ns();
+    for (long i = 0; i < fresh; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%ld/leaf", base, i);
+        if (create_directory_tree(path) < 0)
+        {
+            perror("ERROR creating directory");
+            break;
+        }
+    }
+    emit(cfg, "create_directory_tree", "fresh", 2, fresh, now_ns() - start, 0);
+}
+
+// Function to time the recursive listing used by dispfnames on a tree of cfg->files files
+void bench_walk(struct micro_config *cfg)
+{
+    char root[DFS_PATH_MAX];
+    snprintf(root, sizeof(root), "%s/tree%ld", cfg->scratch, cfg->files);
+    if (build_tree(root, cfg->files) < 0)
+    {
+        perror("ERROR building tree");
+        return;
+    }
+
+    // Large enough that the listing is never truncated
+    size_t out_size = (size_t)cfg->files * 64 + 1;
+    char *out = malloc(out_size);
+    if (out == NULL)
+    {
+        return;
+    }
+
+    const char *exts[] = { ".c", ".txt" };
+    for (int e = 0; e < 2; e++)
+    {
+        dfs_list_files(root, exts[e], out, out_size); // Warm the dentry cache
+        int rounds = (cfg->files >= 100000) ? 1 : 5;
+        long long start = now_ns();
+        for (int r = 0; r < rounds; r++)
+        {
+            dfs_list_files(root, exts[e], out, out_size);
+        }
+        // ns_per_op is per file visited
+        emit(cfg, "dfs_list_files", exts[e] + 1, cfg->files, cfg->files * rounds, now_ns() - start, 0);
+    }
+    free(out);
+}
+
+// Function to time dfs_copy_fd from a file into a socket, as download_file does,
+// for every chunk size, then net_sendfile as the client's send_file does
+// A child process drains the other end of the socket pair.
+void bench_copy(struct micro_config *cfg)
+{
+    for (int s = 0; s < cfg->size_count; s++)
+    {
+        long size = cfg->sizes[s];
+        char path[DFS_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/copy_%ld.bin", cfg->scratch, size);
+
+        struct stat st;
+        if (stat(path, &st) != 0 || st.st_size != size)
+        {
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                perror("ERROR creating copy source");
+                continue;
+            }
+            if (size <= REAL_DATA_LIMIT)
+            {
+                char block[65536];
+                for (size_t i = 0; i < sizeof(block); i++)
+                {
+                    block[i] = (char)(i * 131);
+                }
+                for (long done = 0; done < size; done += sizeof(block))
+                {
+                    write(fd, block, (size - done < (long)sizeof(block)) ? size - done : (long)sizeof(block));
+                }
+            }
+            else if (ftruncate(fd, size) < 0) // Sparse: measures the copy loop, not the disk
+            {
+                perror("ERROR sizing copy source");
+            }
+            close(fd);
+        }
+
+        for (int c = 0; c <= cfg->chunk_count; c++)
+        {
+            int use_sendfile = (c == cfg->chunk_count);
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+            {
+                perror("ERROR creating socket pair");
+                return;
+            }
+            pid_t drain = fork();
+            if (drain == 0)
+            {
+                close(pair[0]);
+                char sink[65536];
+                while (read(pair[1], sink, sizeof(sink)) > 0);
+                _exit(0);
+            }
+            close(pair[1]);
+
+            // Repeat small files so each measurement moves at least 64 MB
+            long rounds = (size >= (64L << 20)) ? 1 : (64L << 20) / size;
+            int fd = open(path, O_RDONLY);
+            long long start = now_ns();
+            for (long r = 0; r < rounds && fd >= 0; r++)
+            {
+                lseek(fd, 0, SEEK_SET);
+                int rc = use_sendfile ? net_sendfile(pair[0], fd, size) : dfs_copy_fd(fd, pair[0], size, cfg->chunks[c]);
+                if (rc < 0)
+                {
+                    perror("ERROR copying");
+                    break;
+                }
+            }
+            long long elapsed = now_ns() - start;
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            close(pair[0]);
+            waitpid(drain, NULL, 0);
+
+            if (use_sendfile)
+            {
+                emit(cfg, "net_sendfile", "sendfile", size, rounds, elapsed, (double)size * rounds);
+                continue;
+            }
+            char variant[32];
+            snprintf(variant, sizeof(variant), "chunk_%ld", cfg->chunks[c]);
+            emit(cfg, "dfs_copy_fd", variant, size, rounds, elapsed, (double)size * rounds);
+        }
+    }
+}
+
+// Function to fill a framing test body; every message gets different bytes
+static void framing_fill(char *body, long size, long message)
+{
+    for (long i = 0; i < size; i++)
+    {
+        body[i] = (char)(i * 131 + message * 7);
+    }
+}
+
+// Function to write messages as size header + body, max_piece bytes per write()
+// A max_piece of 0 writes each header and body whole; a negative one picks 1..-max_piece at random.
+static void framing_writer(int sock, long size, long messages, int max_piece)
+{
+    char *message = malloc(sizeof(off_t) + size);
+    unsigned int rng = 12345;
+    for (long m = 0; m < messages; m++)
+    {
+        off_t header = size;
+        memcpy(message, &header, sizeof(off_t));
+        framing_fill(message + sizeof(off_t), size, m);
+        size_t len = sizeof(off_t) + size;
+        size_t done = 0;
+        while (done < len)
+        {
+            size_t piece = len - done;
+            if (max_piece > 0 && piece > (size_t)max_piece)
+            {
+                piece = max_piece;
+            }
+            else if (max_piece < 0)
+            {
+                rng = rng * 1103515245 + 12345;
+                size_t pick = 1 + (rng >> 16) % (unsigned int)(-max_piece);
+                piece = (pick < piece) ? pick : piece;
+            }
+            ssize_t n = write(sock, message + done, piece);
+            if (n <= 0)
+            {
+                _exit(1);
+            }
+            done += n;
+        }
+    }
+    free(message);
+}
+
+// Function to time and verify size-header framing, the way every download is received
+// A child writes back-to-back messages in small pieces, or the reader is limited to
+// one-byte reads with DFS_IO_FUZZ; each message must arrive intact and none may be
+// swallowed by the previous one.
+void bench_framing(struct micro_config *cfg)
+{
+    static const long sizes[] = { 0, 1, 7, 512, 4099, 65536 + 3 };
+    static const struct
+    {
+        const char *name;
+        int writer_piece;
+        const char *reader_fuzz;
+    } variants[] = {
+        { "whole", 0, "0" },
+        { "writer_1byte", 1, "0" },
+        { "writer_random", -13, "0" },
+        { "reader_1byte", 0, "1" },
+    };
+
+    for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++)
+    {
+        setenv("DFS_IO_FUZZ", variants[v].reader_fuzz, 1);
+        net_tuning_init();
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            long size = sizes[s];
+            long messages = FRAMING_MESSAGES;
+            if (variants[v].writer_piece != 0 || strcmp(variants[v].reader_fuzz, "0") != 0)
+            {
+                long cap = FRAMING_SEGMENTED_BYTES / (long)(sizeof(off_t) + size);
+                messages = (cap < 16) ? 16 : (cap < messages) ? cap : messages;
+            }
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+            {
+                perror("ERROR creating socket pair");
+                return;
+            }
+            pid_t writer = fork();
+            if (writer == 0)
+            {
+                close(pair[0]);
+                framing_writer(pair[1], size, messages, variants[v].writer_piece);
+                _exit(0);
+            }
+            close(pair[1]);
+
+            char *expected = malloc(size + 1);
+            char *body = malloc(size + 1);
+            int failed = 0;
+            long long start = now_ns();
+            for (long m = 0; m < messages && !failed; m++)
+            {
+                off_t header;
+                if (net_read_full(pair[0], &header, sizeof(off_t)) < 0 || header != size)
+                {
+                    failed = 1;
+                    break;
+                }
+                off_t remaining = header;
+                char *p = body;
+                while (remaining > 0)
+                {
+                    ssize_t n = net_read_some(pair[0], p, remaining);
+                    if (n <= 0)
+                    {
+                        failed = 1;
+                        break;
+                    }
+                    p += n;
+                    remaining -= n;
+                }
+                framing_fill(expected, size, m);
+                failed = failed || memcmp(body, expected, size) != 0;
+            }
+            long long elapsed = now_ns() - start;
+
+            // Nothing may be left over once every message has been read
+            char extra;
+            failed = failed || read(pair[0], &extra, 1) != 0;
+            close(pair[0]);
+            waitpid(writer, NULL, 0);
+            free(expected);
+            free(body);
+
+            if (failed)
+            {
+                fprintf(stderr, "ERROR: framing %s lost sync with %ld byte bodies\n", variants[v].name, size);
+                exit(1);
+            }
+            emit(cfg, "framing", variants[v].name, size, messages, elapsed,
+                 (double)(sizeof(off_t) + size) * messages);
+        }
+    }
+    unsetenv("DFS_IO_FUZZ");
+    net_tuning_init();
+}
+
+// Function to map a file name to a server the way S1 did before dfs_file_type()
+// Kept as a baseline for the dispatch benchmark.
+static int strcmp_dispatch(const char *filename)
+{
+    char *ext = strrchr(filename, '.');
+    if (ext == NULL) return DFS_TYPE_NONE;
+    if (strcmp(ext, ".c") == 0) return DFS_TYPE_C;
+    if (strcmp(ext, ".pdf") == 0) return DFS_TYPE_PDF;
+    if (strcmp(ext, ".txt") == 0) return DFS_TYPE_TXT;
+    if (strcmp(ext, ".zip") == 0) return DFS_TYPE_ZIP;
+    return DFS_TYPE_UNSUPPORTED;
+}
+
+// Function to time the extension dispatch in upload_file
+void bench_dispatch(struct micro_config *cfg)
+{
+    const char *names[] = { "~S1/a/b/report.pdf", "~S1/notes.txt", "~S1/src/main.c", "~S1/x/archive.zip",
+                            "~S1/image.png", "~S1/a.b/README", "~S1/y/data.tar.zip", "~S1/z/lib.cpp" };
+    const int count = sizeof(names) / sizeof(names[0]);
+    volatile int sink = 0;
+
+    long long start = now_ns();
+    for (long i = 0; i < cfg->iterations * 10; i++)
+    {
+        sink += dfs_file_type(names[i % count]);
+    }
+    emit(cfg, "dispatch", "dfs_file_type", count, cfg->iterations * 10, now_ns() - start, 0);
+
+    start = now_ns();
+    for (long i = 0; i < cfg->iterations * 10; i++)
+    {
+        sink += strcmp_dispatch(names[i % count]);
+    }
+    emit(cfg, "dispatch", "strcmp_chain", count, cfg->iterations * 10, now_ns() - start, 0);
+}
+
+// Function to time the findf matcher on cfg->files synthetic names held in memory
+// The baseline checks every name with fnmatch (strstr for a substring); the other variants
+// run dfs_match_names over the NUL-separated list, as a findf directory scan does, with each
+// literal search. param is the number of names, ns_per_op is per name.
+void bench_match(struct micro_config *cfg)
+{
+    const char *words[] = { "report", "invoice", "notes", "main", "backup", "draft", "summary", "data" };
+    const char *exts[] = { "c", "pdf", "txt", "zip" };
+    long count = cfg->files;
+    char *arena = malloc((size_t)count * 48);
+    size_t *offsets = malloc((size_t)count * sizeof(size_t));
+    size_t *lengths = malloc((size_t)count * sizeof(size_t));
+    if (arena == NULL || offsets == NULL || lengths == NULL)
+    {
+        free(arena);
+        free(offsets);
+        free(lengths);
+        return;
+    }
+    size_t used = 0;
+    for (long i = 0; i < count; i++)
+    {
+        offsets[i] = used;
+        int n = snprintf(arena + used, 48, "%s_%07ld_%s.%s", words[i % 8], i * 7919 % 10000000,
+                         words[(i / 8) % 8], exts[i % 4]);
+        lengths[i] = (size_t)n;
+        used += (size_t)n + 1;
+    }
+
+    const char *patterns[] = { "0042", "*_0042*.pdf", "summary_*[0-9]9.c" };
+    const char *pattern_names[] = { "substring", "glob", "glob_set" };
+    const int levels[] = { MATCH_SIMD_NONE, MATCH_SIMD_SSE2, MATCH_SIMD_AVX2 };
+    const char *level_names[] = { "memmem", "sse2", "avx2" };
+    volatile long sink = 0;
+    for (int p = 0; p < 3; p++)
+    {
+        struct dfs_matcher matcher;
+        dfs_matcher_init(&matcher, patterns[p]);
+        char variant[64];
+
+        // Baseline: every name goes through fnmatch (strstr for a substring)
+        long long start = now_ns();
+        for (long i = 0; i < count; i++)
+        {
+            const char *name = arena + offsets[i];
+            sink += matcher.is_glob ? (fnmatch(matcher.pattern, name, 0) == 0) : (strstr(name, matcher.pattern) != NULL);
+        }
+        snprintf(variant, sizeof(variant), "%s_libc", pattern_names[p]);
+        emit(cfg, "match", variant, count, count, now_ns() - start, (double)used);
+
+        for (int l = 0; l < 3; l++)
+        {
+            dfs_match_set_simd_level(levels[l]);
+            if (dfs_match_simd_level() != levels[l])
+            {
+                continue; // Not supported on this CPU
+            }
+            start = now_ns();
+            sink += dfs_match_names(&matcher, arena, used, NULL, NULL);
+            snprintf(variant, sizeof(variant), "%s_%s", pattern_names[p], level_names[l]);
+            emit(cfg, "match", variant, count, count, now_ns() - start, (double)used);
+        }
+    }
+    dfs_match_set_simd_level(-1);
+    free(arena);
+    free(offsets);
+    free(lengths);
+}
+
+// Function to time grepf's tree search on a corpus of GREP_FILES text files
+// A rare literal runs with each SIMD level on one thread, then the literal and a regex run
+// on 1 to dfs_grep_threads() threads. Matching lines go to /dev/null. param is the thread
+// count, ns_per_op is per file and mb_per_s is the rate the corpus is scanned at.
+void bench_grep(struct micro_config *cfg)
+{
+    char root[512];
+    snprintf(root, sizeof(root), "%s/grep", cfg->scratch);
+    if (create_directory_tree(root) < 0)
+    {
+        return;
+    }
+    char *text = malloc(GREP_FILE_BYTES);
+    if (text == NULL)
+    {
+        return;
+    }
+    for (int f = 0; f < GREP_FILES; f++)
+    {
+        char path[600];
+        snprintf(path, sizeof(path), "%s/f%02d.txt", root, f);
+        struct stat st;
+        if (stat(path, &st) == 0 && st.st_size == GREP_FILE_BYTES)
+        {
+            continue; // Built by an earlier run
+        }
+        size_t used = 0;
+        long line = 0;
+        while (used < GREP_FILE_BYTES)
+        {
+            char buf[128];
+            int n = snprintf(buf, sizeof(buf), "%ld: the quick brown fox %ld jumps over the lazy dog %s\n",
+                             line, line * 2654435761L % 1000003, (line % 9973 == 0) ? "NEEDLE" : "");
+            size_t copy = ((size_t)n < GREP_FILE_BYTES - used) ? (size_t)n : GREP_FILE_BYTES - used;
+            memcpy(text + used, buf, copy);
+            used += copy;
+            line++;
+        }
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || write(fd, text, GREP_FILE_BYTES) != GREP_FILE_BYTES)
+        {
+            perror("ERROR writing grep corpus");
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    free(text);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    double bytes = (double)GREP_FILES * GREP_FILE_BYTES;
+    struct dfs_grep grep;
+    dfs_grep_init(&grep, "NEEDLE", 0);
+    const int levels[] = { MATCH_SIMD_NONE, MATCH_SIMD_SSE2, MATCH_SIMD_AVX2 };
+    const char *level_names[] = { "literal_memmem", "literal_sse2", "literal_avx2" };
+    for (int l = 0; l < 3; l++)
+    {
+        dfs_match_set_simd_level(levels[l]);
+        if (dfs_match_simd_level() != levels[l])
+        {
+            continue; // Not supported on this CPU
+        }
+        long long start = now_ns();
+        dfs_grep_tree(&grep, root, ".txt", "~S1", null_fd, 1);
+        emit(cfg, "grep", level_names[l], 1, GREP_FILES, now_ns() - start, bytes);
+    }
+    dfs_match_set_simd_level(-1);
+    dfs_grep_free(&grep);
+
+    const char *patterns[] = { "NEEDLE", "fox [0-9]+7 jumps" };
+    const char *pattern_names[] = { "literal", "regex" };
+    for (int p = 0; p < 2; p++)
+    {
+        dfs_grep_init(&grep, patterns[p], p);
+        for (int threads = 1; threads <= dfs_grep_threads(); threads *= 2)
+        {
+            long long start = now_ns();
+            dfs_grep_tree(&grep, root, ".txt", "~S1", null_fd, threads);
+            emit(cfg, "grep", pattern_names[p], threads, GREP_FILES, now_ns() - start, bytes);
+        }
+        dfs_grep_free(&grep);
+    }
+    close(null_fd);
+}
+
+// Function to time server startup on the walk tree of cfg->files files
+// "walk" loads the .txt table the way a server without a snapshot does (DFS_META_RESCAN=1),
+// walking the tree and writing the snapshot. "snapshot" loads that snapshot, and "journal"
+// loads it after cfg->files / 10 changes were journaled. param is the number of files in the
+// tree, ns_per_op is per file.
+void bench_meta(struct micro_config *cfg)
+{
+    char root[DFS_PATH_MAX];
+    snprintf(root, sizeof(root), "%s/tree%ld", cfg->scratch, cfg->files);
+    if (build_tree(root, cfg->files) < 0)
+    {
+        perror("ERROR building tree");
+        return;
+    }
+
+    struct dfs_meta meta;
+    setenv("DFS_META_RESCAN", "1", 1);
+    long long start = now_ns();
+    int rc = dfs_meta_open(&meta, root, DFS_TYPE_TXT);
+    long long elapsed = now_ns() - start;
+    unsetenv("DFS_META_RESCAN");
+    if (rc < 0)
+    {
+        perror("ERROR loading metadata");
+        dfs_meta_close(&meta);
+        return;
+    }
+    emit(cfg, "dfs_meta_open", "walk", cfg->files, cfg->files, elapsed, 0);
+    dfs_meta_close(&meta);
+
+    start = now_ns();
+    rc = dfs_meta_open(&meta, root, DFS_TYPE_TXT);
+    elapsed = now_ns() - start;
+    if (rc == 0)
+    {
+        emit(cfg, "dfs_meta_open", "snapshot", cfg->files, cfg->files, elapsed, 0);
+
+        // Re-add existing .txt files, the records an upload writes
+        char path[DFS_PATH_MAX];
+        for (long i = 2, changes = 0; i < cfg->files && changes < cfg->files / 10; i += 4, changes++)
+        {
+            long leaf = i / FILES_PER_DIR;
+            snprintf(path, sizeof(path), "%s/d%ld/d%ld/f%ld.txt", root, leaf / DIRS_PER_DIR, leaf % DIRS_PER_DIR, i);
+            dfs_meta_add(&meta, path);
+        }
+    }
+    dfs_meta_close(&meta);
+
+    start = now_ns();
+    rc = dfs_meta_open(&meta, root, DFS_TYPE_TXT);
+    elapsed = now_ns() - start;
+    if (rc == 0)
+    {
+        emit(cfg, "dfs_meta_open", "journal", cfg->files, cfg->files, elapsed, 0);
+    }
+    dfs_meta_close(&meta);
+}
+
+// Function to create a synthetic tree of the given number of files, reusing an earlier one
+// Files are empty and spread FILES_PER_DIR to a directory, two levels deep, cycling through
+// the four stored extensions.
+int build_tree(const char *root, long files)
+{
+    char path[DFS_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.complete", root);
+    if (access(path, F_OK) == 0)
+    {
+        return 0;
+    }
+
+    const char *exts[] = { ".c", ".pdf", ".txt", ".zip" };
+    for (long i = 0; i < files; i++)
+    {
+        long leaf = i / FILES_PER_DIR;
+        snprintf(path, sizeof(path), "%s/d%ld/d%ld", root, leaf / DIRS_PER_DIR, leaf % DIRS_PER_DIR);
+        if (i % FILES_PER_DIR == 0 && create_directory_tree(path) < 0)
+        {
+            return -1;
+        }
+        size_t len = strlen(path);
+        snprintf(path + len, sizeof(path) - len, "/f%ld%s", i, exts[i % 4]);
+        int fd = open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        close(fd);
+    }
+
+    snprintf(path, sizeof(path), "%s/.complete", root);
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return 0;
+}
+
+// Function to parse a comma separated list of sizes
+int parse_list(const char *spec, long *out)
+{
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", spec);
+    int count = 0;
+    char *save;
+    for (char *item = strtok_r(copy, ",", &save); item != NULL && count < MAX_LIST; item = strtok_r(NULL, ",", &save))
+    {
+        long value = parse_size(item);
+        if (value <= 0)
+        {
+            return -1;
+        }
+        out[count++] = value;
+    }
+    return count;
+}
+
+// Function to parse a size such as 512, 4k, 16m or 4g
+long parse_size(const char *text)
+{
+    char *end;
+    long value = strtol(text, &end, 10);
+    switch (*end)
+    {
+        case 'k': case 'K': value <<= 10; break;
+        case 'm': case 'M': value <<= 20; break;
+        case 'g': case 'G': value <<= 30; break;
+        case '\0': break;
+        default: return -1;
+    }
+    return value;
+}
+
+// Function to print the command line options
+void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -b list     benchmarks to run (default mkdir,walk,copy,dispatch,framing,match,grep,meta)\n"
+            "  -n files    files in the synthetic tree for walk and meta and names for match, e.g. 1k to 1m (default 1000)\n"
+            "  -i count    calls per mkdir measurement, x10 for dispatch (default 100000)\n"
+            "  -s sizes    copy source sizes, 1k to 4g (default 1k,1m,64m)\n"
+            "  -c chunks   copy buffer sizes (default 1k,64k,1m)\n"
+            "  -d dir      scratch directory (default /tmp/dfs_microbench)\n"
+            "  -f format   json (one object per line, default) or csv\n",
+            prog);
+}
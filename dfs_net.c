@@ -0,0 +1,636 @@
+// Distributed File System - Transfer tuning and framing
+// Copy loops take their chunk size from here instead of the old fixed 1 KB, and every
+// socket gets the configured buffer sizes and TCP_NODELAY. Commands and text replies
+// are single small writes that should not wait for Nagle's algorithm; size headers are
+// different because a body always follows, so senders cork the socket around the pair
+// and the header leaves in the same segment as the first body bytes.
+// TCP is a byte stream, so a read() may return part of a size header or run into the
+// next message. Every framed transfer goes through net_read_full()/net_write_full(),
+// which loop until exactly len bytes have moved or the peer stops making progress.
+
+#define _GNU_SOURCE // for splice() and F_SETPIPE_SZ
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h> // for poll()
+#include <time.h> // for clock_gettime()
+#include <fcntl.h> // for posix_fadvise()
+#include <sys/socket.h>
+#include <sys/sendfile.h> // for sendfile()
+#include <netinet/in.h>
+#include <netinet/tcp.h> // for TCP_NODELAY and TCP_CORK
+#include "dfs_net.h"
+
+struct net_tuning
+{
+    int loaded;
+    size_t io_buffer;
+    int sndbuf; // 0 leaves the kernel's autotuning alone
+    int rcvbuf;
+    int nodelay;
+    int cork;
+    int timeout_ms; // Longest wait for the next piece of a transfer, 0 waits forever
+    int reply_timeout_ms; // Longest wait for the first byte of a reply, 0 waits forever
+    int fuzz; // 0 normally, otherwise the largest piece moved per system call
+    long direct_io; // Smallest download written with O_DIRECT, 0 for never
+};
+
+static struct net_tuning tuning = { 0, NET_IO_BUFFER_DEFAULT, 0, 0, 1, 1, NET_IO_TIMEOUT_DEFAULT * 1000, NET_REPLY_TIMEOUT_DEFAULT * 1000, 0, 0 };
+static unsigned int fuzz_state = 0;
+
+// Function to parse a byte count with an optional K, M or G suffix
+// Returns fallback when the variable is unset or not a number.
+static long parse_size(const char *name, long fallback)
+{
+    char *value = getenv(name);
+    if (value == NULL || *value == '\0')
+    {
+        return fallback;
+    }
+
+    char *end;
+    long size = strtol(value, &end, 10);
+    if (end == value || size < 0)
+    {
+        fprintf(stderr, "Ignoring %s=%s\n", name, value);
+        return fallback;
+    }
+    if (*end == 'k' || *end == 'K')
+    {
+        size *= 1024;
+    }
+    else if (*end == 'm' || *end == 'M')
+    {
+        size *= 1024 * 1024;
+    }
+    else if (*end == 'g' || *end == 'G')
+    {
+        size *= 1024L * 1024 * 1024;
+    }
+    return size;
+}
+
+// Function to read the tuning settings from the environment
+// Servers call it in the parent before forking; every other entry point loads it on first use.
+void net_tuning_init(void)
+{
+    long io_buffer = parse_size("DFS_IO_BUFFER", NET_IO_BUFFER_DEFAULT);
+    if (io_buffer < NET_IO_BUFFER_MIN)
+    {
+        io_buffer = NET_IO_BUFFER_MIN;
+    }
+    if (io_buffer > NET_IO_BUFFER_MAX)
+    {
+        io_buffer = NET_IO_BUFFER_MAX;
+    }
+    tuning.io_buffer = (size_t)io_buffer;
+    tuning.sndbuf = (int)parse_size("DFS_SNDBUF", 0);
+    tuning.rcvbuf = (int)parse_size("DFS_RCVBUF", 0);
+    tuning.nodelay = (parse_size("DFS_NODELAY", 1) != 0);
+    tuning.cork = (parse_size("DFS_CORK", 1) != 0);
+    tuning.timeout_ms = (int)parse_size("DFS_IO_TIMEOUT", NET_IO_TIMEOUT_DEFAULT) * 1000;
+    tuning.reply_timeout_ms = (int)parse_size("DFS_REPLY_TIMEOUT", NET_REPLY_TIMEOUT_DEFAULT) * 1000;
+    tuning.fuzz = (int)parse_size("DFS_IO_FUZZ", 0);
+    tuning.direct_io = parse_size("DFS_DIRECT_IO", 0);
+    tuning.loaded = 1;
+}
+
+// Function to get the chunk size for copy loops
+size_t net_io_buffer(void)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    return tuning.io_buffer;
+}
+
+// Function to apply the socket buffer sizes and TCP_NODELAY to a socket
+// Call it before listen() or connect(): the buffer sizes decide the TCP window scale,
+// which is fixed during the handshake. Accepted sockets inherit the listener's settings.
+// Failures are ignored, the socket simply keeps the kernel defaults.
+void net_tune_socket(int sock)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    if (tuning.sndbuf > 0)
+    {
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &tuning.sndbuf, sizeof(tuning.sndbuf));
+    }
+    if (tuning.rcvbuf > 0)
+    {
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &tuning.rcvbuf, sizeof(tuning.rcvbuf));
+    }
+    if (tuning.nodelay)
+    {
+        int on = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+}
+
+// Function to hold back partial segments until net_uncork()
+// Used around a size header and its body so they share packets.
+void net_cork(int sock)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    if (tuning.cork)
+    {
+        int on = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+    }
+}
+
+// Function to flush whatever net_cork() held back
+void net_uncork(int sock)
+{
+    if (tuning.cork)
+    {
+        int off = 0;
+        setsockopt(sock, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+}
+
+// Function to describe the active settings in one line for startup messages and benchmarks
+int net_describe(char *out, size_t out_size)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    char sndbuf[32] = "auto";
+    char rcvbuf[32] = "auto";
+    if (tuning.sndbuf > 0)
+    {
+        snprintf(sndbuf, sizeof(sndbuf), "%d", tuning.sndbuf);
+    }
+    if (tuning.rcvbuf > 0)
+    {
+        snprintf(rcvbuf, sizeof(rcvbuf), "%d", tuning.rcvbuf);
+    }
+    int len = snprintf(out, out_size, "io_buffer=%zu sndbuf=%s rcvbuf=%s nodelay=%d cork=%d timeout=%ds",
+                       tuning.io_buffer, sndbuf, rcvbuf, tuning.nodelay, tuning.cork, tuning.timeout_ms / 1000);
+    if (tuning.reply_timeout_ms > 0 && len >= 0 && (size_t)len < out_size)
+    {
+        len += snprintf(out + len, out_size - len, " reply_timeout=%ds", tuning.reply_timeout_ms / 1000);
+    }
+    if (tuning.fuzz > 0 && len >= 0 && (size_t)len < out_size)
+    {
+        len += snprintf(out + len, out_size - len, " fuzz=%d", tuning.fuzz);
+    }
+    return len;
+}
+
+// Function to read the monotonic clock in milliseconds
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Function to wait until fd is ready for events or the deadline passes
+// Returns 0 when ready and -1 with errno set to ETIMEDOUT or the poll() error.
+static int wait_ready(int fd, short events, long long deadline)
+{
+    if (deadline == 0)
+    {
+        return 0; // No deadline: let the blocking call wait
+    }
+    while (1)
+    {
+        long long left = deadline - now_ms();
+        if (left <= 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        struct pollfd pfd = { fd, events, 0 };
+        int ready = poll(&pfd, 1, (left > 60000) ? 60000 : (int)left);
+        if (ready > 0)
+        {
+            return 0; // Readable, writable, or an error the next call will report
+        }
+        if (ready < 0 && errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
+
+// Function to cut a transfer down to a random piece when DFS_IO_FUZZ is set
+static size_t fuzz_length(size_t len)
+{
+    if (tuning.fuzz <= 0 || len <= 1)
+    {
+        return len;
+    }
+    if (fuzz_state == 0)
+    {
+        fuzz_state = (unsigned int)getpid() * 2654435761u | 1;
+    }
+    fuzz_state ^= fuzz_state << 13;
+    fuzz_state ^= fuzz_state >> 17;
+    fuzz_state ^= fuzz_state << 5;
+    size_t piece = 1 + fuzz_state % (unsigned int)tuning.fuzz;
+    return (piece < len) ? piece : len;
+}
+
+// Function to start the deadline for the next piece of a framed transfer
+// The deadline is restarted after every piece that moves, so DFS_IO_TIMEOUT bounds how long
+// a transfer may stall, not how long it may take.
+static long long start_deadline(void)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    return (tuning.timeout_ms > 0) ? now_ms() + tuning.timeout_ms : 0;
+}
+
+// Function to read exactly len bytes
+// Returns 0 on success and -1 on error, end of stream before len bytes, or a stall
+// longer than DFS_IO_TIMEOUT.
+int net_read_full(int fd, void *buf, size_t len)
+{
+    long long deadline = start_deadline();
+    char *p = buf;
+    while (len > 0)
+    {
+        if (wait_ready(fd, POLLIN, deadline) < 0)
+        {
+            return -1;
+        }
+        ssize_t n = read(fd, p, fuzz_length(len));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= n;
+        deadline = start_deadline();
+    }
+    return 0;
+}
+
+// Function to write exactly len bytes
+// Returns 0 on success and -1 on error or a stall longer than DFS_IO_TIMEOUT.
+int net_write_full(int fd, const void *buf, size_t len)
+{
+    long long deadline = start_deadline();
+    const char *p = buf;
+    while (len > 0)
+    {
+        if (wait_ready(fd, POLLOUT, deadline) < 0)
+        {
+            return -1;
+        }
+        ssize_t n = write(fd, p, fuzz_length(len));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= n;
+        deadline = start_deadline();
+    }
+    return 0;
+}
+
+// Function to read the first len bytes of the reply to a command that was just sent
+// Like net_read_full(), except that the wait for the first byte is not bounded by
+// DFS_IO_TIMEOUT: the peer may still be working on the request, e.g. compressing an archive
+// or collecting one from the other servers. DFS_REPLY_TIMEOUT bounds it instead.
+int net_read_reply(int fd, void *buf, size_t len)
+{
+    if (len > 0 && net_wait_reply(fd) < 0)
+    {
+        return -1;
+    }
+    return net_read_full(fd, buf, len);
+}
+
+// Function to wait until a reply, or the next part of a streamed result, can be read
+// Result streams (findf, grepf, stats) pause for as long as the server keeps working, so
+// their loops wait here before each net_read_some(). Returns 0 when readable, -1 on timeout.
+int net_wait_reply(int fd)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    if (tuning.reply_timeout_ms > 0)
+    {
+        return wait_ready(fd, POLLIN, now_ms() + tuning.reply_timeout_ms);
+    }
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (poll(&pfd, 1, -1) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to read between 1 and len bytes of a body whose remaining length is known
+// Callers pass min(remaining, buffer size), so the read can never reach the next message.
+// Returns the byte count, 0 at end of stream, or -1 on error or timeout.
+ssize_t net_read_some(int fd, void *buf, size_t len)
+{
+    long long deadline = start_deadline();
+    while (1)
+    {
+        if (wait_ready(fd, POLLIN, deadline) < 0)
+        {
+            return -1;
+        }
+        ssize_t n = read(fd, buf, fuzz_length(len));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        return n;
+    }
+}
+
+// Function to send one framed message: its length as an off_t, then the bytes
+// Used for lists and status vectors that may not fit the single read() a command gets.
+int net_write_frame(int fd, const void *buf, size_t len)
+{
+    off_t size = (off_t)len;
+    net_cork(fd);
+    int rc = (net_write_full(fd, &size, sizeof(size)) == 0 && net_write_full(fd, buf, len) == 0) ? 0 : -1;
+    net_uncork(fd);
+    return rc;
+}
+
+// Function to receive one framed message into a new NUL-terminated buffer the caller frees
+// If the peer sent an "ERROR: ..." message in place of the length, the buffer holds that
+// message and *len is NET_FRAME_ERROR. Returns NULL on error, timeout, or a frame above max_len.
+// The length is read as a reply: a status vector only comes once the whole batch is done.
+char *net_read_frame(int fd, size_t max_len, size_t *len)
+{
+    off_t size;
+    if (net_read_reply(fd, &size, sizeof(size)) < 0)
+    {
+        return NULL;
+    }
+    if (memcmp(&size, "ERROR", 5) == 0)
+    {
+        char *message = calloc(1, 1024);
+        if (message == NULL)
+        {
+            return NULL;
+        }
+        memcpy(message, &size, sizeof(size));
+        net_read_some(fd, message + sizeof(size), 1024 - sizeof(size) - 1); // The rest of a short message
+        *len = NET_FRAME_ERROR;
+        return message;
+    }
+    if (size < 0 || (size_t)size > max_len)
+    {
+        return NULL;
+    }
+
+    char *buf = malloc((size_t)size + 1);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    if (net_read_full(fd, buf, (size_t)size) < 0)
+    {
+        free(buf);
+        return NULL;
+    }
+    buf[size] = '\0';
+    *len = (size_t)size;
+    return buf;
+}
+
+// Function to send len bytes of a file, from its current offset, to a socket
+// sendfile() moves the data from the page cache to the socket without copying it through
+// user space. Where it is not supported, and whenever DFS_IO_FUZZ is set so the framing can
+// be tested, it falls back to a read/net_write_full loop. The deadline applies per piece.
+// Returns 0 on success and -1 on error, timeout, or if the file ends early.
+int net_sendfile(int sock, int fd, off_t len)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Large pieces keep the system call count low; the deadline is checked between them
+    size_t piece = (tuning.io_buffer > (1 << 20)) ? tuning.io_buffer : (1 << 20);
+    off_t remaining = len;
+    while (remaining > 0 && tuning.fuzz <= 0)
+    {
+        if (wait_ready(sock, POLLOUT, start_deadline()) < 0)
+        {
+            return -1;
+        }
+        ssize_t sent = sendfile(sock, fd, NULL, ((size_t)remaining < piece) ? (size_t)remaining : piece);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS) && remaining == len)
+        {
+            break; // Not supported for this file: copy through a buffer instead
+        }
+        if (sent <= 0)
+        {
+            return -1;
+        }
+        remaining -= sent;
+    }
+    if (remaining == 0)
+    {
+        return 0;
+    }
+
+    char *buffer = malloc(tuning.io_buffer);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+    while (remaining > 0)
+    {
+        ssize_t n = read(fd, buffer, ((size_t)remaining < tuning.io_buffer) ? (size_t)remaining : tuning.io_buffer);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0 || net_write_full(sock, buffer, n) < 0)
+        {
+            break;
+        }
+        remaining -= n;
+    }
+    free(buffer);
+    return (remaining == 0) ? 0 : -1;
+}
+
+// Function to decide whether a download of len bytes should be written with O_DIRECT
+int net_use_direct_io(off_t len)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    return tuning.direct_io > 0 && len >= tuning.direct_io;
+}
+
+// Function to receive len bytes from a socket into a file through a pipe with splice()
+// Returns 0 on success, 1 if splice() is not supported before any data moved, and -1 on error.
+static int recv_splice(int sock, int fd, off_t len)
+{
+    int pipefd[2];
+    if (pipe(pipefd) < 0)
+    {
+        return 1;
+    }
+    if (tuning.io_buffer > NET_IO_BUFFER_DEFAULT)
+    {
+        fcntl(pipefd[1], F_SETPIPE_SZ, (int)tuning.io_buffer);
+    }
+
+    int rc = 0;
+    off_t remaining = len;
+    while (remaining > 0)
+    {
+        if (wait_ready(sock, POLLIN, start_deadline()) < 0)
+        {
+            rc = -1;
+            break;
+        }
+        ssize_t in = splice(sock, NULL, pipefd[1], NULL, remaining, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (in < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (in < 0 && errno == EINVAL && remaining == len)
+        {
+            rc = 1;
+            break;
+        }
+        if (in <= 0)
+        {
+            rc = -1;
+            break;
+        }
+        ssize_t left = in;
+        while (left > 0)
+        {
+            ssize_t out = splice(pipefd[0], NULL, fd, NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (out < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (out <= 0)
+            {
+                rc = -1;
+                break;
+            }
+            left -= out;
+        }
+        if (rc < 0)
+        {
+            break;
+        }
+        remaining -= in;
+    }
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return rc;
+}
+
+// Function to receive len bytes from a socket into a file
+// Splices socket -> pipe -> file so the data never enters user space. With direct set
+// (the file is open with O_DIRECT), when splice() is not supported, or under DFS_IO_FUZZ,
+// the data is gathered in a large aligned buffer and written out in whole buffers; for
+// O_DIRECT the last block is padded and the file trimmed back to len afterwards.
+// Returns 0 on success and -1 on error, timeout, or if the stream ends early.
+int net_recvfile(int sock, int fd, off_t len, int direct)
+{
+    if (!tuning.loaded)
+    {
+        net_tuning_init();
+    }
+    if (!direct && tuning.fuzz <= 0)
+    {
+        int rc = recv_splice(sock, fd, len);
+        if (rc <= 0)
+        {
+            return rc;
+        }
+    }
+
+    // Whole pages, so every write but the last is a multiple of the O_DIRECT alignment
+    size_t size = (tuning.io_buffer + NET_DIRECT_ALIGN - 1) / NET_DIRECT_ALIGN * NET_DIRECT_ALIGN;
+    char *buffer;
+    if (posix_memalign((void **)&buffer, NET_DIRECT_ALIGN, size) != 0)
+    {
+        return -1;
+    }
+
+    int rc = 0;
+    off_t remaining = len;
+    while (remaining > 0 && rc == 0)
+    {
+        // Fill the buffer, or take whatever is left of the body
+        size_t fill = 0;
+        size_t want = ((size_t)remaining < size) ? (size_t)remaining : size;
+        while (fill < want)
+        {
+            ssize_t n = net_read_some(sock, buffer + fill, want - fill);
+            if (n <= 0)
+            {
+                rc = -1;
+                break;
+            }
+            fill += n;
+        }
+        if (rc < 0)
+        {
+            break;
+        }
+
+        size_t out = fill;
+        if (direct && out % NET_DIRECT_ALIGN != 0)
+        {
+            size_t padded = (out + NET_DIRECT_ALIGN - 1) / NET_DIRECT_ALIGN * NET_DIRECT_ALIGN;
+            memset(buffer + out, 0, padded - out);
+            out = padded;
+        }
+        if (write(fd, buffer, out) != (ssize_t)out)
+        {
+            rc = -1;
+            break;
+        }
+        remaining -= fill;
+    }
+    free(buffer);
+
+    if (rc == 0 && direct && ftruncate(fd, len) < 0)
+    {
+        rc = -1;
+    }
+    return rc;
+}
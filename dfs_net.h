@@ -0,0 +1,55 @@
+// Distributed File System - Transfer tuning and framing
+// Per-deployment buffer sizes, socket options and exact-length reads and writes shared
+// by the servers, the client and the benchmarks. Settings are read once from the environment:
+//   DFS_IO_BUFFER  bytes per read()/write() in copy loops (default 64K, K/M suffixes allowed)
+//   DFS_SNDBUF     SO_SNDBUF for every socket (default: kernel autotuning)
+//   DFS_RCVBUF     SO_RCVBUF for every socket (default: kernel autotuning)
+//   DFS_NODELAY    0 to leave Nagle's algorithm on for commands and replies (default 1)
+//   DFS_CORK       0 to send size headers and bodies without TCP_CORK (default 1)
+//   DFS_IO_TIMEOUT seconds a framed read or write may stall before it fails (default 60, 0 = never)
+//   DFS_REPLY_TIMEOUT seconds to wait for a reply to start while the peer works on the
+//                  request (default 0 = never)
+//   DFS_DIRECT_IO  client downloads at least this large are written with O_DIRECT (default off)
+//   DFS_IO_FUZZ    testing only: move at most 1..N random bytes per read()/write() in the
+//                  net_read/net_write functions, e.g. 1 to force one-byte segments
+
+#ifndef DFS_NET_H
+#define DFS_NET_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define NET_IO_BUFFER_DEFAULT (64 * 1024)
+#define NET_IO_BUFFER_MIN 512
+#define NET_IO_BUFFER_MAX (16 * 1024 * 1024)
+#define NET_IO_TIMEOUT_DEFAULT 60
+#define NET_REPLY_TIMEOUT_DEFAULT 0
+#define NET_DIRECT_ALIGN 4096 // Buffer, offset and length alignment for O_DIRECT writes
+#define NET_FRAME_MAX (64 * 1024 * 1024) // Largest list or status vector a batch request may send
+#define NET_FRAME_ERROR ((size_t)-1) // Frame length reported when the peer sent an error message
+
+// One character per item in the status vector that answers a batch request
+#define NET_BATCH_OK '0'
+#define NET_BATCH_NOT_FOUND '1'
+#define NET_BATCH_UNSUPPORTED '2'
+#define NET_BATCH_FAILED '3'
+
+// Function prototypes
+void net_tuning_init(void);
+size_t net_io_buffer(void);
+void net_tune_socket(int sock);
+void net_cork(int sock);
+void net_uncork(int sock);
+int net_describe(char *out, size_t out_size);
+int net_read_full(int fd, void *buf, size_t len);
+int net_read_reply(int fd, void *buf, size_t len);
+int net_wait_reply(int fd);
+int net_write_full(int fd, const void *buf, size_t len);
+ssize_t net_read_some(int fd, void *buf, size_t len);
+int net_write_frame(int fd, const void *buf, size_t len);
+char *net_read_frame(int fd, size_t max_len, size_t *len);
+int net_sendfile(int sock, int fd, off_t len);
+int net_use_direct_io(off_t len);
+int net_recvfile(int sock, int fd, off_t len, int direct);
+
+#endif
@@ -0,0 +1,1033 @@
+// Distributed File System - Small-file packing
+// Space in the current segment is handed out under a mutex in shared memory, so children
+// append without coordinating further: each writes its file at its own offset with pwrite()
+// and then journals where it went. Only older segments are ever compacted. The compactor
+// takes the pack lock exclusively before it points the table at its copies, which waits
+// out files still being packed, and deletes the old segment after. A reader that looked a
+// file up before that finds the segment gone, syncs the table and tries the new place.
+
+#define _GNU_SOURCE // for memmem()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dfs_pack.h"
+#include "dfs_core.h"
+#include "dfs_net.h"
+
+#define PACK_SEGMENT_PREFIX ".dfs_pack."
+#define PACK_LOCK ".dfs_pack.lock"
+#define PACK_OUT_BUFFER (64 * 1024) // findf output is sent in pieces of this size
+
+// Segment state shared by the server and its children
+struct pack_shared
+{
+    pthread_mutex_t lock;
+    uint32_t active; // Segment being appended to
+    uint32_t oldest; // No older segment is left
+    uint64_t end; // Bytes of the active segment handed out
+};
+
+// A packed file below some directory, copied out of the table so it can be synced meanwhile
+struct pack_item
+{
+    uint64_t size;
+    int64_t mtime_sec;
+    uint64_t key_offset; // Path relative to the root, in the key arena
+    uint32_t segment;
+    uint32_t segment_offset;
+    uint16_t key_len;
+};
+
+// The segment a reader has open
+struct pack_reader
+{
+    uint32_t segment;
+    int fd;
+};
+
+// Function to build the path of a segment
+static void pack_segment_path(const struct dfs_pack *pack, uint32_t segment, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%s/" PACK_SEGMENT_PREFIX "%06u", pack->meta->root, segment);
+}
+
+// Function to take or release the pack lock (LOCK_SH, LOCK_EX or LOCK_UN)
+// Each process opens the lock file itself, since children share their parent's descriptors.
+static int pack_lock(struct dfs_pack *pack, int how)
+{
+    if (pack->lock_pid != getpid())
+    {
+        if (pack->lock_fd >= 0)
+        {
+            close(pack->lock_fd);
+        }
+        char path[DFS_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/" PACK_LOCK, pack->meta->root);
+        pack->lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        pack->lock_pid = getpid();
+    }
+    if (pack->lock_fd < 0)
+    {
+        return -1;
+    }
+    int rc;
+    while ((rc = flock(pack->lock_fd, how)) < 0 && errno == EINTR)
+    {
+    }
+    return rc;
+}
+
+// Function to read exactly len bytes at offset
+static int pack_read_full(int fd, void *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// Function to write exactly len bytes at offset
+static int pack_write_full(int fd, const void *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = pwrite(fd, (const char *)buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// Function to hand out size bytes of the active segment, starting a new one when it is full
+static void pack_reserve(struct dfs_pack *pack, size_t size, uint32_t *segment, uint32_t *offset)
+{
+    struct pack_shared *shared = pack->shared;
+    pthread_mutex_lock(&shared->lock);
+    if (shared->end > 0 && shared->end + size > PACK_SEGMENT_BYTES)
+    {
+        shared->active++;
+        shared->end = 0;
+    }
+    *segment = shared->active;
+    *offset = shared->end;
+    shared->end += size;
+    pthread_mutex_unlock(&shared->lock);
+}
+
+// Function to read DFS_PACK_MAX, a byte count with an optional K or M suffix
+static off_t pack_max_file(void)
+{
+    char *value = getenv("DFS_PACK_MAX");
+    if (value == NULL || *value == '\0')
+    {
+        return 0;
+    }
+    char *end;
+    long size = strtol(value, &end, 10);
+    if (end == value || size < 0)
+    {
+        fprintf(stderr, "Ignoring DFS_PACK_MAX=%s\n", value);
+        return 0;
+    }
+    if (*end == 'k' || *end == 'K')
+    {
+        size *= 1024;
+    }
+    else if (*end == 'm' || *end == 'M')
+    {
+        size *= 1024 * 1024;
+    }
+    return (size > PACK_MAX_FILE_LIMIT) ? PACK_MAX_FILE_LIMIT : size;
+}
+
+// Function to set up packing for a loaded table before any fork
+// Finds the segments already in the root and continues the newest one. Packing stays off
+// without DFS_PACK_MAX or a table; existing segments are still read. Returns 0 or -1.
+int dfs_pack_open(struct dfs_pack *pack, struct dfs_meta *meta)
+{
+    memset(pack, 0, sizeof(*pack));
+    pack->meta = meta;
+    pack->lock_fd = -1;
+    if (!meta->loaded)
+    {
+        return 0;
+    }
+    pack->max_file = pack_max_file();
+
+    DIR *dir = opendir(meta->root);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+    uint32_t oldest = 0;
+    uint32_t newest = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        char *end;
+        if (strncmp(ent->d_name, PACK_SEGMENT_PREFIX, strlen(PACK_SEGMENT_PREFIX)) != 0)
+        {
+            continue;
+        }
+        unsigned long segment = strtoul(ent->d_name + strlen(PACK_SEGMENT_PREFIX), &end, 10);
+        if (*end != '\0' || segment == 0 || segment > UINT32_MAX)
+        {
+            continue;
+        }
+        oldest = (oldest == 0 || segment < oldest) ? segment : oldest;
+        newest = (segment > newest) ? segment : newest;
+    }
+    closedir(dir);
+    if (pack->max_file == 0 && newest == 0)
+    {
+        return 0; // Nothing packed and nothing to pack
+    }
+
+    struct pack_shared *shared = mmap(NULL, sizeof(struct pack_shared), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        pack->max_file = 0;
+        return -1;
+    }
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&shared->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    shared->active = newest ? newest : 1;
+    shared->oldest = oldest ? oldest : 1;
+    shared->end = 0;
+    if (newest != 0)
+    {
+        char path[DFS_PATH_MAX];
+        struct stat st;
+        pack_segment_path(pack, newest, path, sizeof(path));
+        if (stat(path, &st) == 0)
+        {
+            shared->end = st.st_size;
+        }
+    }
+    pack->shared = shared;
+    return 0;
+}
+
+// Function to check whether an upload of size bytes is packed
+int dfs_pack_accepts(const struct dfs_pack *pack, off_t size)
+{
+    return pack->shared != NULL && pack->max_file > 0 && size >= 0 && size <= pack->max_file;
+}
+
+// Function to pack a file's contents under path, replacing whatever was stored there
+// sync, if given, runs on the segment once the contents are written and again once they
+// are journaled, as an upload is synced before its rename and committed after.
+// Returns 0 or -1.
+int dfs_pack_store(struct dfs_pack *pack, const char *path, const void *data, size_t size, int (*sync)(int fd))
+{
+    if (!dfs_pack_accepts(pack, size) || pack_lock(pack, LOCK_SH) < 0)
+    {
+        return -1;
+    }
+    uint32_t segment;
+    uint32_t offset;
+    pack_reserve(pack, size, &segment, &offset);
+    char segment_path[DFS_PATH_MAX];
+    pack_segment_path(pack, segment, segment_path, sizeof(segment_path));
+    int fd = open(segment_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    int rc = (fd < 0 || pack_write_full(fd, data, size, offset) < 0 || (sync != NULL && sync(fd) < 0)) ? -1 : 0;
+    if (rc == 0)
+    {
+        dfs_meta_add_packed(pack->meta, path, size, dfs_meta_xxh64(data, size), segment, offset);
+        if (sync != NULL && sync(fd) < 0)
+        {
+            rc = -1;
+        }
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    pack_lock(pack, LOCK_UN);
+
+    // A file of its own under the same name would hide the packed one
+    if (rc == 0 && unlink(path) < 0 && errno != ENOENT)
+    {
+        rc = -1;
+    }
+    return rc;
+}
+
+// Function to pack a staged file under path if it is small enough, deleting the staged file
+// Returns 1 if it was packed, 0 if it is to be stored on its own, or -1.
+int dfs_pack_take(struct dfs_pack *pack, const char *src_path, const char *path, int (*sync)(int fd))
+{
+    if (pack->shared == NULL || pack->max_file == 0)
+    {
+        return 0;
+    }
+    int fd = open(src_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    if (!dfs_pack_accepts(pack, st.st_size))
+    {
+        close(fd);
+        return 0;
+    }
+    char *data = malloc(st.st_size ? st.st_size : 1);
+    int rc = (data == NULL || pack_read_full(fd, data, st.st_size, 0) < 0) ? -1 : 0;
+    close(fd);
+    if (rc == 0)
+    {
+        rc = dfs_pack_store(pack, path, data, st.st_size, sync);
+    }
+    free(data);
+    if (rc < 0)
+    {
+        return -1;
+    }
+    unlink(src_path);
+    return 1;
+}
+
+// Function to look up a packed file with the table brought up to date
+// Returns 1 and fills *entry if path is packed and has no file of its own, 0 otherwise.
+int dfs_pack_lookup(struct dfs_pack *pack, const char *path, struct dfs_meta_entry *entry)
+{
+    struct stat st;
+    if (pack->shared == NULL || stat(path, &st) == 0 || dfs_meta_sync(pack->meta) < 0)
+    {
+        return 0;
+    }
+    return dfs_meta_lookup(pack->meta, path, entry) && entry->segment != 0;
+}
+
+// Function to open the segment holding a packed file, positioned at its contents
+// The caller reads entry->size bytes, e.g. with sendfile(), and closes the descriptor.
+// Returns the descriptor, or -1 with errno ENOENT if the file is not packed.
+int dfs_pack_open_file(struct dfs_pack *pack, const char *path, struct dfs_meta_entry *entry)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (!dfs_pack_lookup(pack, path, entry))
+        {
+            errno = ENOENT;
+            return -1;
+        }
+        char segment_path[DFS_PATH_MAX];
+        pack_segment_path(pack, entry->segment, segment_path, sizeof(segment_path));
+        int fd = open(segment_path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && lseek(fd, entry->segment_offset, SEEK_SET) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        if (fd >= 0 || errno != ENOENT)
+        {
+            return fd;
+        }
+        // Compacted since the table was read: the next lookup has the new place
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+// Function to read a packed file into memory, NUL-terminated
+// Returns the malloc'd contents and sets *len, or NULL if the file is not packed.
+char *dfs_pack_load(struct dfs_pack *pack, const char *path, size_t *len)
+{
+    struct dfs_meta_entry entry;
+    int fd = dfs_pack_open_file(pack, path, &entry);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    char *data = malloc(entry.size + 1);
+    if (data == NULL || pack_read_full(fd, data, entry.size, entry.segment_offset) < 0)
+    {
+        free(data);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    data[entry.size] = '\0';
+    *len = entry.size;
+    return data;
+}
+
+// Function to remove a packed file; its bytes are reclaimed by the compactor
+// Returns 0, or -1 with errno ENOENT if the file is not packed.
+int dfs_pack_remove(struct dfs_pack *pack, const char *path)
+{
+    struct dfs_meta_entry entry;
+    if (!dfs_pack_lookup(pack, path, &entry))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    dfs_meta_remove(pack->meta, path);
+    return 0;
+}
+
+// Function to copy (move = 0) or rename a packed file
+// The new name shares the contents in the segment, so nothing is read or written.
+// Returns 0, or -1 with errno ENOENT if the source is not packed.
+int dfs_pack_link(struct dfs_pack *pack, const char *src_path, const char *dst_path, int move)
+{
+    struct dfs_meta_entry entry;
+    if (!dfs_pack_lookup(pack, src_path, &entry))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    dfs_meta_link(pack->meta, src_path, dst_path, move);
+
+    // A file of its own under the new name would hide the packed one
+    unlink(dst_path);
+    return 0;
+}
+
+// Function to turn an absolute directory into a key prefix ("" for the root)
+// Returns the prefix length, or -1 if the directory is outside the root.
+static int pack_prefix(const struct dfs_pack *pack, const char *base_path, char *prefix)
+{
+    const struct dfs_meta *meta = pack->meta;
+    if (strncmp(base_path, meta->root, meta->root_len) != 0 ||
+        (base_path[meta->root_len] != '\0' && base_path[meta->root_len] != '/'))
+    {
+        return -1;
+    }
+    return dfs_meta_key(base_path + meta->root_len, prefix);
+}
+
+// Function to compare packed files by where their contents are
+static int pack_item_compare(const void *a, const void *b)
+{
+    const struct pack_item *x = a;
+    const struct pack_item *y = b;
+    if (x->segment != y->segment)
+    {
+        return (x->segment < y->segment) ? -1 : 1;
+    }
+    return (x->segment_offset < y->segment_offset) ? -1 : (x->segment_offset > y->segment_offset);
+}
+
+// Function to list the packed files below base_path in segment order, so they are read sequentially
+// Sets *items, *keys (the arena of their paths relative to the root) and *prefix_len.
+// Returns the number of files, or -1.
+static long pack_collect(struct dfs_pack *pack, const char *base_path, struct pack_item **items, char **keys,
+                         int *prefix_len)
+{
+    char prefix[DFS_PATH_MAX];
+    struct dfs_meta *meta = pack->meta;
+    *items = NULL;
+    *keys = NULL;
+    if (pack->shared == NULL || (*prefix_len = pack_prefix(pack, base_path, prefix)) < 0)
+    {
+        return 0;
+    }
+    if (dfs_meta_sync(meta) < 0)
+    {
+        return -1;
+    }
+    int len = *prefix_len;
+    long count = 0;
+    size_t capacity = 0;
+    size_t keys_len = 0;
+    size_t keys_capacity = 0;
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        const char *key = meta->paths + entry->path_offset;
+        if (!entry->live || entry->segment == 0 || entry->path_len <= len ||
+            (len > 0 && (memcmp(key, prefix, len) != 0 || key[len] != '/')))
+        {
+            continue;
+        }
+        if ((size_t)count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            struct pack_item *grown = realloc(*items, capacity * sizeof(**items));
+            if (grown == NULL)
+            {
+                return -1;
+            }
+            *items = grown;
+        }
+        if (keys_len + entry->path_len > keys_capacity)
+        {
+            keys_capacity = keys_capacity ? keys_capacity * 2 : 64 * 1024;
+            while (keys_len + entry->path_len > keys_capacity)
+            {
+                keys_capacity *= 2;
+            }
+            char *grown = realloc(*keys, keys_capacity);
+            if (grown == NULL)
+            {
+                return -1;
+            }
+            *keys = grown;
+        }
+        struct pack_item *item = &(*items)[count++];
+        item->size = entry->size;
+        item->mtime_sec = entry->mtime_sec;
+        item->key_offset = keys_len;
+        item->key_len = entry->path_len;
+        item->segment = entry->segment;
+        item->segment_offset = entry->segment_offset;
+        memcpy(*keys + keys_len, key, entry->path_len);
+        keys_len += entry->path_len;
+    }
+    if (count > 1)
+    {
+        qsort(*items, count, sizeof(**items), pack_item_compare);
+    }
+    return count;
+}
+
+// Function to read a listed packed file's contents into buf
+// A segment compacted since the list was made is looked up again once.
+static int pack_read_item(struct dfs_pack *pack, struct pack_reader *reader, struct pack_item *item,
+                          const char *keys, char *buf)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (reader->segment != item->segment)
+        {
+            if (reader->fd >= 0)
+            {
+                close(reader->fd);
+            }
+            char segment_path[DFS_PATH_MAX];
+            pack_segment_path(pack, item->segment, segment_path, sizeof(segment_path));
+            reader->fd = open(segment_path, O_RDONLY | O_CLOEXEC);
+            reader->segment = item->segment;
+        }
+        if (reader->fd >= 0)
+        {
+            return pack_read_full(reader->fd, buf, item->size, item->segment_offset);
+        }
+        if (errno != ENOENT || attempt > 0)
+        {
+            return -1;
+        }
+        char path[DFS_PATH_MAX];
+        struct dfs_meta_entry entry;
+        snprintf(path, sizeof(path), "%s/%.*s", pack->meta->root, item->key_len, keys + item->key_offset);
+        if (!dfs_pack_lookup(pack, path, &entry) || entry.size != item->size)
+        {
+            return -1;
+        }
+        item->segment = entry.segment;
+        item->segment_offset = entry.segment_offset;
+    }
+    return -1;
+}
+
+// Function to write one tar header block in the GNU format tar itself writes
+// owner holds the user and group names, 32 bytes each.
+static int pack_tar_header(FILE *out, const char *name, size_t name_len, char type, uint64_t size, int64_t mtime,
+                           const char *owner)
+{
+    char block[512];
+    memset(block, 0, sizeof(block));
+    memcpy(block, name, (name_len < 100) ? name_len : 100);
+    snprintf(block + 100, 8, "%07o", 0644);
+    snprintf(block + 108, 8, "%07o", (unsigned int)getuid() & 07777777);
+    snprintf(block + 116, 8, "%07o", (unsigned int)getgid() & 07777777);
+    snprintf(block + 124, 12, "%011llo", (unsigned long long)size & 077777777777ULL);
+    snprintf(block + 136, 12, "%011llo", (unsigned long long)mtime & 077777777777ULL);
+    memset(block + 148, ' ', 8); // The checksum counts its own field as spaces
+    block[156] = type;
+    memcpy(block + 257, "ustar  ", 8);
+    memcpy(block + 265, owner, 64);
+    unsigned int sum = 0;
+    for (size_t i = 0; i < sizeof(block); i++)
+    {
+        sum += (unsigned char)block[i];
+    }
+    snprintf(block + 148, 8, "%06o", sum & 0777777);
+    block[155] = ' ';
+    return (fwrite(block, 1, sizeof(block), out) == sizeof(block)) ? 0 : -1;
+}
+
+// Function to write one file as a tar member; names of 100 bytes or more get a GNU long name first
+static int pack_tar_member(FILE *out, const char *name, size_t name_len, const char *data, uint64_t size, int64_t mtime,
+                           const char *owner)
+{
+    static const char zeros[512];
+    if (name_len >= 100 &&
+        (pack_tar_header(out, "././@LongLink", 13, 'L', name_len + 1, 0, owner) < 0 ||
+         fwrite(name, 1, name_len, out) != name_len ||
+         fwrite(zeros, 1, 512 - name_len % 512, out) != 512 - name_len % 512))
+    {
+        return -1;
+    }
+    size_t pad = (512 - size % 512) % 512;
+    if (pack_tar_header(out, name, name_len, '0', size, mtime, owner) < 0 || fwrite(data, 1, size, out) != size ||
+        fwrite(zeros, 1, pad, out) != pad)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Function to add the packed files below base_path to an archive tar has just written
+// The archive must end in exactly two zero blocks (tar -b 1); the members are written over
+// them and the end is written again, so archives can still be concatenated. Members are
+// named like tar names the files it is given, by their absolute path without the leading '/'.
+// Returns the number of files added, or -1.
+long dfs_pack_append_tar(struct dfs_pack *pack, const char *base_path, const char *archive_path)
+{
+    struct pack_item *items;
+    char *keys;
+    int prefix_len;
+    long count = pack_collect(pack, base_path, &items, &keys, &prefix_len);
+    if (count <= 0)
+    {
+        free(items);
+        free(keys);
+        return count;
+    }
+
+    static const char zeros[1024];
+    char tail[1024];
+    struct stat st;
+    FILE *out = fopen(archive_path, "r+");
+    if (out == NULL || fstat(fileno(out), &st) < 0 || st.st_size < (off_t)sizeof(tail) ||
+        pack_read_full(fileno(out), tail, sizeof(tail), st.st_size - sizeof(tail)) < 0 ||
+        memcmp(tail, zeros, sizeof(tail)) != 0 || fseeko(out, st.st_size - sizeof(tail), SEEK_SET) < 0)
+    {
+        count = -1;
+    }
+
+    uint64_t largest = 0;
+    for (long i = 0; i < count; i++)
+    {
+        largest = (items[i].size > largest) ? items[i].size : largest;
+    }
+    char *data = (count > 0) ? malloc(largest ? largest : 1) : NULL;
+    if (count > 0 && data == NULL)
+    {
+        count = -1;
+    }
+    const char *root = pack->meta->root + (pack->meta->root[0] == '/');
+    char owner[64];
+    struct passwd *user = getpwuid(getuid());
+    struct group *group = getgrgid(getgid());
+    memset(owner, 0, sizeof(owner));
+    if (user != NULL)
+    {
+        strncpy(owner, user->pw_name, 31);
+    }
+    if (group != NULL)
+    {
+        strncpy(owner + 32, group->gr_name, 31);
+    }
+    struct pack_reader reader = { 0, -1 };
+    for (long i = 0; i < count; i++)
+    {
+        char name[DFS_PATH_MAX];
+        int name_len = snprintf(name, sizeof(name), "%s/%.*s", root, items[i].key_len, keys + items[i].key_offset);
+        if (name_len >= (int)sizeof(name) || pack_read_item(pack, &reader, &items[i], keys, data) < 0 ||
+            pack_tar_member(out, name, name_len, data, items[i].size, items[i].mtime_sec, owner) < 0)
+        {
+            count = -1;
+        }
+    }
+    if (count > 0 && fwrite(zeros, 1, sizeof(zeros), out) != sizeof(zeros))
+    {
+        count = -1;
+    }
+    if (out != NULL && fclose(out) != 0)
+    {
+        count = -1;
+    }
+    if (reader.fd >= 0)
+    {
+        close(reader.fd);
+    }
+    free(data);
+    free(items);
+    free(keys);
+    return count;
+}
+
+// Function to find a listed file's path below the search root, or NULL if it is hidden
+// Hidden files and directories are skipped, as the tree walks skip them.
+static const char *pack_visible_path(const struct pack_item *item, const char *keys, int prefix_len, size_t *len)
+{
+    int skip = prefix_len ? prefix_len + 1 : 0;
+    const char *rel = keys + item->key_offset + skip;
+    *len = item->key_len - skip;
+    if (rel[0] == '.' || memmem(rel, *len, "/.", 2) != NULL)
+    {
+        return NULL;
+    }
+    return rel;
+}
+
+// Function to send the path of every packed file below base_path whose name matches
+// One line per match, "<prefix>/<path below base_path>", as dfs_find_files() writes them.
+// Returns the number of matches, or -1 if writing failed.
+long dfs_pack_find(struct dfs_pack *pack, const char *base_path, const struct dfs_matcher *matcher,
+                   const char *prefix, int out_fd)
+{
+    struct pack_item *items;
+    char *keys;
+    int prefix_len;
+    long count = pack_collect(pack, base_path, &items, &keys, &prefix_len);
+    char *out = (count > 0) ? malloc(PACK_OUT_BUFFER) : NULL;
+    size_t display_len = strlen(prefix);
+    while (display_len > 0 && prefix[display_len - 1] == '/')
+    {
+        display_len--;
+    }
+    size_t out_len = 0;
+    long matches = (count < 0 || (count > 0 && out == NULL)) ? -1 : 0;
+    for (long i = 0; i < count && matches >= 0; i++)
+    {
+        size_t rel_len;
+        const char *rel = pack_visible_path(&items[i], keys, prefix_len, &rel_len);
+        if (rel == NULL)
+        {
+            continue;
+        }
+        // Patterns with '/' see the path below the search root, others the file name
+        char subject[DFS_PATH_MAX];
+        const char *slash = matcher->full_path ? NULL : memrchr(rel, '/', rel_len);
+        const char *start = (slash != NULL) ? slash + 1 : rel;
+        size_t subject_len = rel + rel_len - start;
+        memcpy(subject, start, subject_len);
+        subject[subject_len] = '\0';
+        if (!dfs_match_name(matcher, subject, subject_len))
+        {
+            continue;
+        }
+        size_t need = display_len + 1 + rel_len + 1;
+        if (out_len + need > PACK_OUT_BUFFER)
+        {
+            if (net_write_full(out_fd, out, out_len) < 0)
+            {
+                matches = -1;
+                break;
+            }
+            out_len = 0;
+        }
+        if (need <= PACK_OUT_BUFFER)
+        {
+            out_len += snprintf(out + out_len, need + 1, "%.*s/%.*s\n", (int)display_len, prefix, (int)rel_len, rel);
+            matches++;
+        }
+    }
+    if (matches > 0 && out_len > 0 && net_write_full(out_fd, out, out_len) < 0)
+    {
+        matches = -1;
+    }
+    free(out);
+    free(items);
+    free(keys);
+    return matches;
+}
+
+// Function to search the packed files below base_path and send their matching lines
+// Lines are written as "<prefix>/<path below base_path>:<line number>:<line>\n". Packed
+// files are small, so they are searched one after another in segment order.
+// Returns the number of matching lines, or -1 if sending them failed.
+long dfs_pack_grep(struct dfs_pack *pack, const struct dfs_grep *grep, const char *base_path,
+                   const char *prefix, int out_fd)
+{
+    struct pack_item *items;
+    char *keys;
+    int prefix_len;
+    long count = pack_collect(pack, base_path, &items, &keys, &prefix_len);
+    size_t display_len = strlen(prefix);
+    while (display_len > 0 && prefix[display_len - 1] == '/')
+    {
+        display_len--;
+    }
+    uint64_t largest = 0;
+    for (long i = 0; i < count; i++)
+    {
+        largest = (items[i].size > largest) ? items[i].size : largest;
+    }
+    char *data = (count > 0) ? malloc(largest ? largest : 1) : NULL;
+    long matches = (count < 0 || (count > 0 && data == NULL)) ? -1 : 0;
+    struct pack_reader reader = { 0, -1 };
+    for (long i = 0; i < count && matches >= 0; i++)
+    {
+        size_t rel_len;
+        const char *rel = pack_visible_path(&items[i], keys, prefix_len, &rel_len);
+        if (rel == NULL || pack_read_item(pack, &reader, &items[i], keys, data) < 0)
+        {
+            continue; // Removed and compacted since the list was made
+        }
+        char label[DFS_PATH_MAX * 2];
+        snprintf(label, sizeof(label), "%.*s/%.*s", (int)display_len, prefix, (int)rel_len, rel);
+        long found = dfs_grep_data(grep, data, items[i].size, label, out_fd);
+        matches = (found < 0) ? -1 : matches + found;
+    }
+    if (reader.fd >= 0)
+    {
+        close(reader.fd);
+    }
+    free(data);
+    free(items);
+    free(keys);
+    return matches;
+}
+
+// Function to compare two segment offsets
+static int pack_offset_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+// Function to copy the live contents of one older segment into the active one and delete it
+// Files sharing contents (copies) share the copy too. Returns the bytes kept, or -1 if
+// the segment had to be kept.
+static long pack_compact_segment(struct dfs_pack *pack, uint32_t segment)
+{
+    struct dfs_meta *meta = pack->meta;
+
+    // Offset in the high half and size in the low half, so sorting orders by offset
+    uint64_t *spans = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        if (!entry->live || entry->segment != segment)
+        {
+            continue;
+        }
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            uint64_t *grown = realloc(spans, capacity * sizeof(*spans));
+            if (grown == NULL)
+            {
+                free(spans);
+                return -1;
+            }
+            spans = grown;
+        }
+        spans[count++] = ((uint64_t)entry->segment_offset << 32) | (uint32_t)entry->size;
+    }
+    if (count > 1)
+    {
+        qsort(spans, count, sizeof(*spans), pack_offset_compare);
+    }
+
+    // Copies point at the same offset; a file of 0 bytes may share one with the next file
+    uint32_t *from_offsets = malloc((count ? count : 1) * sizeof(uint32_t));
+    uint32_t *to_offsets = malloc((count ? count : 1) * sizeof(uint32_t));
+    uint32_t *sizes = malloc((count ? count : 1) * sizeof(uint32_t));
+    size_t kept = 0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < count && from_offsets != NULL && to_offsets != NULL && sizes != NULL; i++)
+    {
+        uint32_t offset = spans[i] >> 32;
+        uint32_t size = (uint32_t)spans[i];
+        if (kept > 0 && from_offsets[kept - 1] == offset)
+        {
+            total += (size > sizes[kept - 1]) ? size - sizes[kept - 1] : 0;
+            sizes[kept - 1] = (size > sizes[kept - 1]) ? size : sizes[kept - 1];
+            continue;
+        }
+        from_offsets[kept] = offset;
+        sizes[kept] = size;
+        total += size;
+        kept++;
+    }
+    free(spans);
+    char *data = malloc(total ? total : 1);
+    char from_path[DFS_PATH_MAX];
+    pack_segment_path(pack, segment, from_path, sizeof(from_path));
+    int from_fd = open(from_path, O_RDONLY | O_CLOEXEC);
+    long rc = (from_offsets == NULL || to_offsets == NULL || sizes == NULL || data == NULL || from_fd < 0) ? -1 : 0;
+
+    // All the live contents go into one stretch of the active segment with one write
+    uint32_t to_segment = 0;
+    uint32_t to_start = 0;
+    uint64_t pos = 0;
+    for (size_t i = 0; i < kept && rc == 0; i++)
+    {
+        if (pack_read_full(from_fd, data + pos, sizes[i], from_offsets[i]) < 0)
+        {
+            rc = -1;
+        }
+        pos += sizes[i];
+    }
+    if (rc == 0)
+    {
+        pack_reserve(pack, total, &to_segment, &to_start);
+        pos = 0;
+        for (size_t i = 0; i < kept; i++)
+        {
+            to_offsets[i] = to_start + pos;
+            pos += sizes[i];
+        }
+        char to_path[DFS_PATH_MAX];
+        pack_segment_path(pack, to_segment, to_path, sizeof(to_path));
+        int to_fd = (total > 0) ? open(to_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644) : -1;
+        if (total > 0 && (to_fd < 0 || pack_write_full(to_fd, data, total, to_start) < 0 || fdatasync(to_fd) < 0))
+        {
+            rc = -1;
+        }
+        if (to_fd >= 0)
+        {
+            close(to_fd);
+        }
+    }
+    if (from_fd >= 0)
+    {
+        close(from_fd);
+    }
+
+    // Files still being packed finish first; the table must not point into the segment after
+    if (rc == 0 && pack_lock(pack, LOCK_EX) == 0)
+    {
+        if (dfs_meta_relocate(meta, segment, from_offsets, to_offsets, kept, to_segment) < 0 || unlink(from_path) < 0)
+        {
+            rc = -1;
+        }
+        pack_lock(pack, LOCK_UN);
+    }
+    else
+    {
+        rc = -1;
+    }
+    free(data);
+    free(from_offsets);
+    free(to_offsets);
+    free(sizes);
+    return (rc < 0) ? -1 : (long)total;
+}
+
+// Function to compact every older segment that is mostly dead
+// Live bytes are counted from the table; copies count their shared contents twice, which
+// only makes compaction later. Returns 0, or -1 if a segment could not be compacted.
+int dfs_pack_compact(struct dfs_pack *pack)
+{
+    struct dfs_meta *meta = pack->meta;
+    if (pack->shared == NULL || dfs_meta_sync(meta) < 0)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&pack->shared->lock);
+    uint32_t active = pack->shared->active;
+    uint32_t oldest = pack->shared->oldest;
+    pthread_mutex_unlock(&pack->shared->lock);
+    uint64_t *live = calloc(active + 1, sizeof(uint64_t));
+    if (live == NULL)
+    {
+        return -1;
+    }
+    for (uint64_t e = 0; e < meta->count; e++)
+    {
+        const struct dfs_meta_entry *entry = &meta->entries[e];
+        if (entry->live && entry->segment != 0 && entry->segment < active)
+        {
+            live[entry->segment] += entry->size;
+        }
+    }
+
+    int rc = 0;
+    uint32_t first_left = active;
+    for (uint32_t segment = oldest; segment < active; segment++)
+    {
+        char path[DFS_PATH_MAX];
+        struct stat st;
+        pack_segment_path(pack, segment, path, sizeof(path));
+        if (stat(path, &st) < 0)
+        {
+            continue;
+        }
+        if (live[segment] * 100 < (uint64_t)st.st_size * PACK_COMPACT_LIVE)
+        {
+            long kept = pack_compact_segment(pack, segment);
+            if (kept >= 0)
+            {
+                printf("Compacted pack segment %u: kept %ld bytes, freed %lld\n", segment, kept,
+                       (long long)st.st_size - kept);
+                continue;
+            }
+            fprintf(stderr, "ERROR compacting pack segment %u\n", segment);
+            rc = -1;
+        }
+        first_left = (segment < first_left) ? segment : first_left;
+    }
+    pthread_mutex_lock(&pack->shared->lock);
+    pack->shared->oldest = first_left;
+    pthread_mutex_unlock(&pack->shared->lock);
+    free(live);
+    fflush(stdout);
+    return rc;
+}
+
+// Function to start a compactor in a child process every PACK_COMPACT_SEC
+// Called by the accepting parent, which reaps the child with the connection handlers.
+// Nothing is started while older segments are gone or a compactor is still running.
+void dfs_pack_maybe_compact(struct dfs_pack *pack)
+{
+    time_t now = time(NULL);
+    if (pack->shared == NULL || now - pack->compact_at < PACK_COMPACT_SEC ||
+        (pack->compact_pid > 0 && kill(pack->compact_pid, 0) == 0))
+    {
+        return;
+    }
+    pthread_mutex_lock(&pack->shared->lock);
+    int older = (pack->shared->oldest < pack->shared->active);
+    pthread_mutex_unlock(&pack->shared->lock);
+    if (!older)
+    {
+        return;
+    }
+    pack->compact_at = now;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        _exit(dfs_pack_compact(pack) < 0);
+    }
+    pack->compact_pid = pid;
+}
@@ -0,0 +1,63 @@
+// Distributed File System - Small-file packing
+// Most .c and .txt uploads are a few KB, and stored one per file each costs an inode and a
+// directory entry. With DFS_PACK_MAX set, S1 and S3 append files up to that size to large
+// segment files in their root instead, and the metadata table records the segment, offset
+// and size of each packed file, so the table is the offset index:
+//   .dfs_pack.<n>   contents of packed files back to back, appended to until PACK_SEGMENT_BYTES
+//   .dfs_pack.lock  flock()ed shared while a file is packed, and exclusively while the
+//                   compactor points the table away from a segment and deletes it
+// Packed files are sent straight from their offset in the segment. Removing, replacing or renaming
+// one only changes the table. Every PACK_COMPACT_SEC the accepting server forks a compactor
+// that copies the live contents of mostly dead segments into the current one.
+//   DFS_PACK_MAX  largest file packed, in bytes, K and M suffixes allowed (default 0: off)
+// A file of its own under the same name takes precedence over a packed one. Packed files
+// stay readable after DFS_PACK_MAX is turned off.
+
+#ifndef DFS_PACK_H
+#define DFS_PACK_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include "dfs_meta.h"
+#include "dfs_match.h"
+#include "dfs_grep.h"
+
+#define PACK_MAX_FILE_LIMIT (1024 * 1024) // DFS_PACK_MAX is capped at this
+#define PACK_SEGMENT_BYTES (64 * 1024 * 1024) // A new segment is started past this size
+#define PACK_COMPACT_SEC 60 // How often the accepting server starts a compactor
+#define PACK_COMPACT_LIVE 50 // Older segments with less than this percentage of live bytes are compacted
+
+struct pack_shared;
+
+// One server's packing settings and the segment state it shares with its children
+struct dfs_pack
+{
+    struct dfs_meta *meta;
+    off_t max_file; // Largest file packed, 0 if packing is off
+    struct pack_shared *shared; // NULL if packing is off and there are no segments
+    int lock_fd; // Opened per process: flock() locks belong to the open file
+    pid_t lock_pid;
+    time_t compact_at; // When the accepting server last started a compactor
+    pid_t compact_pid;
+};
+
+// Function prototypes
+int dfs_pack_open(struct dfs_pack *pack, struct dfs_meta *meta);
+int dfs_pack_accepts(const struct dfs_pack *pack, off_t size);
+int dfs_pack_store(struct dfs_pack *pack, const char *path, const void *data, size_t size, int (*sync)(int fd));
+int dfs_pack_take(struct dfs_pack *pack, const char *src_path, const char *path, int (*sync)(int fd));
+int dfs_pack_lookup(struct dfs_pack *pack, const char *path, struct dfs_meta_entry *entry);
+int dfs_pack_open_file(struct dfs_pack *pack, const char *path, struct dfs_meta_entry *entry);
+char *dfs_pack_load(struct dfs_pack *pack, const char *path, size_t *len);
+int dfs_pack_remove(struct dfs_pack *pack, const char *path);
+int dfs_pack_link(struct dfs_pack *pack, const char *src_path, const char *dst_path, int move);
+long dfs_pack_append_tar(struct dfs_pack *pack, const char *base_path, const char *archive_path);
+long dfs_pack_find(struct dfs_pack *pack, const char *base_path, const struct dfs_matcher *matcher,
+                   const char *prefix, int out_fd);
+long dfs_pack_grep(struct dfs_pack *pack, const struct dfs_grep *grep, const char *base_path,
+                   const char *prefix, int out_fd);
+int dfs_pack_compact(struct dfs_pack *pack);
+void dfs_pack_maybe_compact(struct dfs_pack *pack);
+
+#endif
@@ -0,0 +1,756 @@
+// Distributed File System - PDF metadata index
+// A small reader for the parts of the PDF file structure that hold the metadata: the
+// "%PDF-x.y" header, the linearization dictionary at the front, "startxref" at the end,
+// the cross-reference tables it leads to (following /Prev through incremental updates)
+// and the trailer's /Root and /Info objects. Cross-reference streams are compressed, so
+// for those objects are found by searching for "N 0 obj" instead. Objects inside
+// compressed object streams cannot be read without zlib; the page count is then unknown.
+
+#define _GNU_SOURCE // for memmem()
+#include <stdio.h>
+#include <stddef.h> // for offsetof()
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dfs_pdf.h"
+#include "dfs_core.h"
+
+#define PDF_INDEX_MAGIC "DFSPIDX1"
+#define PDF_SUFFIX ".pidx"
+#define PDF_HEAD_SCAN 1024 // The header and the linearization dictionary start within this
+#define PDF_TAIL_SCAN 2048 // "startxref" is within this many bytes of the end
+#define PDF_XREF_CHAIN_MAX 32 // Incremental updates followed through /Prev
+#define PDF_NEST_MAX 64 // Deepest dictionary or array nesting accepted
+#define PDF_STRING_MAX 1024
+
+// Index file contents
+struct pdf_index_file
+{
+    char magic[8];
+    uint64_t size; // Size, modification time and inode of the indexed PDF
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t ino;
+    struct dfs_pdf_info info;
+};
+
+// A mapped document and the object offsets read from its cross-reference tables
+struct pdf_doc
+{
+    const char *data;
+    size_t len;
+    uint64_t *xref; // Offset of each object, 0 if unknown
+    size_t xref_count;
+};
+
+// Functions to classify characters as PDF defines them
+static int is_space(char c)
+{
+    return c == '\0' || c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+}
+
+static int is_regular(char c)
+{
+    return !is_space(c) && strchr("()<>[]{}/%", c) == NULL;
+}
+
+// Function to skip white space and comments
+static size_t skip_space(const struct pdf_doc *doc, size_t pos)
+{
+    while (pos < doc->len)
+    {
+        if (doc->data[pos] == '%')
+        {
+            while (pos < doc->len && doc->data[pos] != '\n' && doc->data[pos] != '\r')
+            {
+                pos++;
+            }
+        }
+        else if (is_space(doc->data[pos]))
+        {
+            pos++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return pos;
+}
+
+// Function to check for a keyword at pos that is not the start of a longer token
+static int at_keyword(const struct pdf_doc *doc, size_t pos, const char *keyword)
+{
+    size_t n = strlen(keyword);
+    return pos + n <= doc->len && memcmp(doc->data + pos, keyword, n) == 0 &&
+           (pos + n == doc->len || !is_regular(doc->data[pos + n]));
+}
+
+// Function to read an integer; returns the position after it, or 0 if there is none
+static size_t read_int(const struct pdf_doc *doc, size_t pos, int64_t *value)
+{
+    pos = skip_space(doc, pos);
+    int negative = (pos < doc->len && (doc->data[pos] == '-' || doc->data[pos] == '+'));
+    negative = negative && doc->data[pos++] == '-';
+    size_t start = pos;
+    int64_t v = 0;
+    while (pos < doc->len && doc->data[pos] >= '0' && doc->data[pos] <= '9' && pos - start < 18)
+    {
+        v = v * 10 + (doc->data[pos++] - '0');
+    }
+    if (pos == start)
+    {
+        return 0;
+    }
+    *value = negative ? -v : v;
+    return pos;
+}
+
+// Function to read an indirect reference "N G R"; returns the position after it, or 0
+static size_t read_ref(const struct pdf_doc *doc, size_t pos, int64_t *num)
+{
+    int64_t generation;
+    pos = read_int(doc, pos, num);
+    pos = pos ? read_int(doc, pos, &generation) : 0;
+    pos = pos ? skip_space(doc, pos) : 0;
+    return (pos && at_keyword(doc, pos, "R")) ? pos + 1 : 0;
+}
+
+// Function to skip one value: dictionary, array, string, name, number, reference or keyword
+static size_t skip_value(const struct pdf_doc *doc, size_t pos, int depth)
+{
+    pos = skip_space(doc, pos);
+    if (pos >= doc->len || depth > PDF_NEST_MAX)
+    {
+        return doc->len;
+    }
+    const char *d = doc->data;
+    char c = d[pos];
+    if (c == '<' && pos + 1 < doc->len && d[pos + 1] == '<')
+    {
+        pos += 2;
+        while ((pos = skip_space(doc, pos)) < doc->len)
+        {
+            if (pos + 1 < doc->len && d[pos] == '>' && d[pos + 1] == '>')
+            {
+                return pos + 2;
+            }
+            pos = skip_value(doc, pos, depth + 1);
+        }
+        return doc->len;
+    }
+    if (c == '[')
+    {
+        pos++;
+        while ((pos = skip_space(doc, pos)) < doc->len)
+        {
+            if (d[pos] == ']')
+            {
+                return pos + 1;
+            }
+            pos = skip_value(doc, pos, depth + 1);
+        }
+        return doc->len;
+    }
+    if (c == '(')
+    {
+        int nesting = 1;
+        for (pos++; pos < doc->len && nesting > 0; pos++)
+        {
+            if (d[pos] == '\\')
+            {
+                pos++;
+            }
+            else if (d[pos] == '(')
+            {
+                nesting++;
+            }
+            else if (d[pos] == ')')
+            {
+                nesting--;
+            }
+        }
+        return (pos < doc->len) ? pos : doc->len;
+    }
+    if (c == '<')
+    {
+        const char *end = memchr(d + pos, '>', doc->len - pos);
+        return (end != NULL) ? (size_t)(end - d) + 1 : doc->len;
+    }
+    if (c == '/')
+    {
+        for (pos++; pos < doc->len && is_regular(d[pos]); pos++)
+        {
+        }
+        return pos;
+    }
+    if (!is_regular(c))
+    {
+        return pos + 1; // Stray delimiter
+    }
+    int64_t num;
+    size_t after_ref = read_ref(doc, pos, &num);
+    if (after_ref)
+    {
+        return after_ref;
+    }
+    for (; pos < doc->len && is_regular(d[pos]); pos++)
+    {
+    }
+    return pos;
+}
+
+// Function to find the value of /key in the dictionary starting at dict ("<<")
+// Returns the position of the value, or 0 if the key is not there.
+static size_t dict_get(const struct pdf_doc *doc, size_t dict, const char *key)
+{
+    size_t key_len = strlen(key);
+    size_t pos = dict + 2;
+    while ((pos = skip_space(doc, pos)) + 1 < doc->len)
+    {
+        const char *d = doc->data;
+        if (d[pos] == '>' && d[pos + 1] == '>')
+        {
+            return 0;
+        }
+        if (d[pos] != '/')
+        {
+            pos = skip_value(doc, pos, 0); // Not a key: malformed, keep going
+            continue;
+        }
+        size_t name = pos + 1;
+        for (pos = name; pos < doc->len && is_regular(d[pos]); pos++)
+        {
+        }
+        if (pos - name == key_len && memcmp(d + name, key, key_len) == 0)
+        {
+            return skip_space(doc, pos);
+        }
+        pos = skip_value(doc, pos, 0);
+    }
+    return 0;
+}
+
+// Function to check for "num G obj" at pos; returns the position after "obj", or 0
+static size_t object_header(const struct pdf_doc *doc, size_t pos, int64_t num)
+{
+    int64_t found;
+    int64_t generation;
+    pos = read_int(doc, pos, &found);
+    pos = (pos && found == num) ? read_int(doc, pos, &generation) : 0;
+    pos = pos ? skip_space(doc, pos) : 0;
+    return (pos && at_keyword(doc, pos, "obj")) ? pos + 3 : 0;
+}
+
+// Function to find where the body of object num starts
+// Uses the cross-reference offsets, or the last "num 0 obj" in the file if they do not help.
+static size_t object_body(const struct pdf_doc *doc, int64_t num)
+{
+    if (num <= 0)
+    {
+        return 0;
+    }
+    size_t pos = 0;
+    if ((uint64_t)num < doc->xref_count && doc->xref[num] != 0)
+    {
+        pos = object_header(doc, doc->xref[num], num);
+    }
+    if (pos == 0)
+    {
+        char needle[32];
+        int needle_len = snprintf(needle, sizeof(needle), "%lld 0 obj", (long long)num);
+        const char *from = doc->data;
+        const char *match;
+        while ((match = memmem(from, doc->data + doc->len - from, needle, needle_len)) != NULL)
+        {
+            if (match == doc->data || !is_regular(match[-1]))
+            {
+                pos = (size_t)(match - doc->data) + needle_len;
+            }
+            from = match + 1;
+        }
+    }
+    return pos ? skip_space(doc, pos) : 0;
+}
+
+// Function to follow a value that may be an indirect reference to the object it names
+static size_t resolve(const struct pdf_doc *doc, size_t pos)
+{
+    int64_t num;
+    return (pos && read_ref(doc, pos, &num)) ? object_body(doc, num) : pos;
+}
+
+// Function to find the dictionary of object num; returns its "<<" position or 0
+static size_t object_dict(const struct pdf_doc *doc, int64_t num)
+{
+    size_t pos = object_body(doc, num);
+    return (pos && pos + 1 < doc->len && doc->data[pos] == '<' && doc->data[pos + 1] == '<') ? pos : 0;
+}
+
+// Function to read a classic cross-reference table and the trailer after it
+// Entries already known from a newer table are kept. Returns the trailer's "<<" or 0.
+static size_t load_xref_table(struct pdf_doc *doc, size_t pos)
+{
+    pos = skip_space(doc, pos);
+    if (!at_keyword(doc, pos, "xref"))
+    {
+        return 0;
+    }
+    pos += 4;
+    for (;;)
+    {
+        pos = skip_space(doc, pos);
+        if (at_keyword(doc, pos, "trailer"))
+        {
+            pos = skip_space(doc, pos + 7);
+            return (pos + 1 < doc->len && doc->data[pos] == '<' && doc->data[pos + 1] == '<') ? pos : 0;
+        }
+        int64_t first;
+        int64_t count;
+        pos = read_int(doc, pos, &first);
+        pos = pos ? read_int(doc, pos, &count) : 0;
+        if (pos == 0 || first < 0 || count < 0 || (uint64_t)(first + count) > doc->len / 18)
+        {
+            return 0; // Every entry takes 20 bytes, so more objects than this cannot be real
+        }
+        if ((size_t)(first + count) > doc->xref_count)
+        {
+            uint64_t *grown = realloc(doc->xref, (first + count) * sizeof(uint64_t));
+            if (grown == NULL)
+            {
+                return 0;
+            }
+            memset(grown + doc->xref_count, 0, (first + count - doc->xref_count) * sizeof(uint64_t));
+            doc->xref = grown;
+            doc->xref_count = first + count;
+        }
+        for (int64_t i = 0; i < count; i++)
+        {
+            int64_t offset;
+            int64_t generation;
+            pos = read_int(doc, pos, &offset);
+            pos = pos ? read_int(doc, pos, &generation) : 0;
+            pos = pos ? skip_space(doc, pos) : 0;
+            if (pos == 0 || pos >= doc->len)
+            {
+                return 0;
+            }
+            if (doc->data[pos] == 'n' && offset > 0 && (uint64_t)offset < doc->len && doc->xref[first + i] == 0)
+            {
+                doc->xref[first + i] = offset;
+            }
+            pos++;
+        }
+    }
+}
+
+// Function to find the newest trailer dictionary, loading the cross-reference tables on the way
+// A cross-reference stream's own dictionary plays the trailer's part. Returns "<<" or 0.
+static size_t find_trailer(struct pdf_doc *doc)
+{
+    size_t tail = (doc->len > PDF_TAIL_SCAN) ? doc->len - PDF_TAIL_SCAN : 0;
+    const char *last = NULL;
+    const char *match;
+    for (const char *from = doc->data + tail;
+         (match = memmem(from, doc->data + doc->len - from, "startxref", 9)) != NULL; from = match + 1)
+    {
+        last = match;
+    }
+    int64_t offset = -1;
+    size_t trailer = 0;
+    if (last != NULL && read_int(doc, (size_t)(last - doc->data) + 9, &offset) && offset >= 0 && (uint64_t)offset < doc->len)
+    {
+        trailer = load_xref_table(doc, offset);
+        if (trailer == 0)
+        {
+            // A cross-reference stream: "N G obj << ... >> stream"
+            int64_t num;
+            size_t pos = read_int(doc, offset, &num);
+            pos = pos ? object_header(doc, offset, num) : 0;
+            pos = pos ? skip_space(doc, pos) : 0;
+            if (pos && pos + 1 < doc->len && doc->data[pos] == '<' && doc->data[pos + 1] == '<')
+            {
+                trailer = pos;
+            }
+        }
+        else
+        {
+            // Older tables from incremental updates fill in the objects that did not change
+            size_t current = trailer;
+            for (int i = 0; i < PDF_XREF_CHAIN_MAX; i++)
+            {
+                int64_t prev;
+                size_t value = dict_get(doc, current, "Prev");
+                if (value == 0 || !read_int(doc, value, &prev) || prev < 0 || (uint64_t)prev >= doc->len)
+                {
+                    break;
+                }
+                current = load_xref_table(doc, prev);
+                if (current == 0)
+                {
+                    break;
+                }
+            }
+        }
+    }
+    if (trailer == 0)
+    {
+        // Damaged "startxref": use the last "trailer" keyword in the file
+        const char *found = NULL;
+        for (const char *from = doc->data; (match = memmem(from, doc->data + doc->len - from, "trailer", 7)) != NULL; from = match + 1)
+        {
+            found = match;
+        }
+        size_t pos = found ? skip_space(doc, (size_t)(found - doc->data) + 7) : 0;
+        if (pos && pos + 1 < doc->len && doc->data[pos] == '<' && doc->data[pos + 1] == '<')
+        {
+            trailer = pos;
+        }
+    }
+    return trailer;
+}
+
+// Function to append one code point to a UTF-8 string if it fits
+static void put_utf8(char *out, size_t out_size, size_t *len, uint32_t cp)
+{
+    char buf[4];
+    size_t n;
+    if (cp < 0x20)
+    {
+        cp = ' '; // Keep the title on one line
+    }
+    if (cp < 0x80)
+    {
+        buf[0] = cp;
+        n = 1;
+    }
+    else if (cp < 0x800)
+    {
+        buf[0] = 0xC0 | (cp >> 6);
+        buf[1] = 0x80 | (cp & 0x3F);
+        n = 2;
+    }
+    else if (cp < 0x10000)
+    {
+        buf[0] = 0xE0 | (cp >> 12);
+        buf[1] = 0x80 | ((cp >> 6) & 0x3F);
+        buf[2] = 0x80 | (cp & 0x3F);
+        n = 3;
+    }
+    else
+    {
+        buf[0] = 0xF0 | (cp >> 18);
+        buf[1] = 0x80 | ((cp >> 12) & 0x3F);
+        buf[2] = 0x80 | ((cp >> 6) & 0x3F);
+        buf[3] = 0x80 | (cp & 0x3F);
+        n = 4;
+    }
+    if (*len + n < out_size)
+    {
+        memcpy(out + *len, buf, n);
+        *len += n;
+    }
+}
+
+// Function to decode a literal or hex string at pos into UTF-8
+// Text strings are UTF-16BE when they start with a byte order mark, PDFDocEncoding
+// (treated as Latin-1) otherwise.
+static void read_text(const struct pdf_doc *doc, size_t pos, char *out, size_t out_size)
+{
+    unsigned char raw[PDF_STRING_MAX];
+    size_t raw_len = 0;
+    const char *d = doc->data;
+    out[0] = '\0';
+    if (pos == 0 || pos >= doc->len)
+    {
+        return;
+    }
+    if (d[pos] == '(')
+    {
+        int nesting = 1;
+        for (pos++; pos < doc->len && raw_len < sizeof(raw); pos++)
+        {
+            char c = d[pos];
+            if (c == '(')
+            {
+                nesting++;
+            }
+            else if (c == ')' && --nesting == 0)
+            {
+                break;
+            }
+            else if (c == '\\' && pos + 1 < doc->len)
+            {
+                c = d[++pos];
+                if (c >= '0' && c <= '7')
+                {
+                    int v = 0;
+                    for (int i = 0; i < 3 && pos < doc->len && d[pos] >= '0' && d[pos] <= '7'; i++)
+                    {
+                        v = v * 8 + (d[pos++] - '0');
+                    }
+                    pos--;
+                    c = (char)v;
+                }
+                else if (c == '\r' || c == '\n')
+                {
+                    if (c == '\r' && pos + 1 < doc->len && d[pos + 1] == '\n')
+                    {
+                        pos++;
+                    }
+                    continue; // Line continuation
+                }
+                else
+                {
+                    const char *escapes = "n\nr\rt\tb\bf\f";
+                    const char *e = strchr(escapes, c);
+                    if (e != NULL && (e - escapes) % 2 == 0)
+                    {
+                        c = e[1];
+                    }
+                }
+            }
+            raw[raw_len++] = (unsigned char)c;
+        }
+    }
+    else if (d[pos] == '<')
+    {
+        int high = -1;
+        for (pos++; pos < doc->len && d[pos] != '>' && raw_len < sizeof(raw); pos++)
+        {
+            char c = d[pos];
+            int v = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                    (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if (v < 0)
+            {
+                continue;
+            }
+            if (high < 0)
+            {
+                high = v;
+            }
+            else
+            {
+                raw[raw_len++] = (unsigned char)(high * 16 + v);
+                high = -1;
+            }
+        }
+        if (high >= 0 && raw_len < sizeof(raw))
+        {
+            raw[raw_len++] = (unsigned char)(high * 16);
+        }
+    }
+
+    size_t len = 0;
+    if (raw_len >= 2 && raw[0] == 0xFE && raw[1] == 0xFF)
+    {
+        for (size_t i = 2; i + 1 < raw_len; i += 2)
+        {
+            uint32_t cp = (raw[i] << 8) | raw[i + 1];
+            if (cp >= 0xD800 && cp < 0xDC00 && i + 3 < raw_len)
+            {
+                uint32_t low = (raw[i + 2] << 8) | raw[i + 3];
+                if (low >= 0xDC00 && low < 0xE000)
+                {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 2;
+                }
+            }
+            put_utf8(out, out_size, &len, cp);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < raw_len; i++)
+        {
+            put_utf8(out, out_size, &len, raw[i]);
+        }
+    }
+    while (len > 0 && out[len - 1] == ' ')
+    {
+        len--;
+    }
+    out[len] = '\0';
+}
+
+// Function to read the metadata of a mapped PDF
+// Returns 0, or PDF_INVALID if there is no "%PDF-" header near the start.
+static int pdf_parse(const char *data, size_t len, struct dfs_pdf_info *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->size = len;
+    info->pages = -1;
+    struct pdf_doc doc = { data, len, NULL, 0 };
+
+    size_t head = (len < PDF_HEAD_SCAN) ? len : PDF_HEAD_SCAN;
+    const char *magic = memmem(data, head, "%PDF-", 5);
+    if (magic == NULL)
+    {
+        return PDF_INVALID;
+    }
+    size_t pos = (size_t)(magic - data) + 5;
+    for (size_t n = 0; pos < len && n + 1 < sizeof(info->version) && is_regular(data[pos]); n++)
+    {
+        info->version[n] = data[pos++];
+    }
+
+    // A linearized file describes itself in the first object: /L length, /E end of page 1, /N pages
+    const char *first_obj = memmem(data + pos, head - (pos < head ? pos : head), "obj", 3);
+    size_t dict = first_obj ? skip_space(&doc, (size_t)(first_obj - data) + 3) : 0;
+    if (dict && dict + 1 < len && data[dict] == '<' && data[dict + 1] == '<' && dict_get(&doc, dict, "Linearized"))
+    {
+        int64_t file_len = 0;
+        int64_t first_end = 0;
+        int64_t pages = 0;
+        size_t value = dict_get(&doc, dict, "L");
+        // An incremental update after linearization leaves /L behind the real length
+        if (value && read_int(&doc, value, &file_len) && (uint64_t)file_len == len)
+        {
+            value = dict_get(&doc, dict, "E");
+            if (value && read_int(&doc, value, &first_end) && first_end > 0 && (uint64_t)first_end <= len)
+            {
+                info->first_page_end = first_end;
+            }
+            value = dict_get(&doc, dict, "N");
+            if (value && read_int(&doc, value, &pages) && pages > 0)
+            {
+                info->pages = pages;
+            }
+        }
+    }
+
+    size_t trailer = find_trailer(&doc);
+    if (trailer)
+    {
+        int64_t root = 0;
+        int64_t info_num = 0;
+        size_t value = dict_get(&doc, trailer, "Root");
+        if (info->pages < 0 && value && read_ref(&doc, value, &root))
+        {
+            size_t catalog = object_dict(&doc, root);
+            int64_t pages_num;
+            value = catalog ? dict_get(&doc, catalog, "Pages") : 0;
+            size_t pages = (value && read_ref(&doc, value, &pages_num)) ? object_dict(&doc, pages_num) : 0;
+            int64_t count;
+            value = resolve(&doc, pages ? dict_get(&doc, pages, "Count") : 0);
+            if (value && read_int(&doc, value, &count) && count >= 0)
+            {
+                info->pages = count;
+            }
+        }
+
+        // Strings of encrypted documents are encrypted too
+        value = dict_get(&doc, trailer, "Info");
+        if (!dict_get(&doc, trailer, "Encrypt") && value && read_ref(&doc, value, &info_num))
+        {
+            size_t info_dict = object_dict(&doc, info_num);
+            value = resolve(&doc, info_dict ? dict_get(&doc, info_dict, "Title") : 0);
+            read_text(&doc, value, info->title, sizeof(info->title));
+        }
+    }
+    free(doc.xref);
+    return 0;
+}
+
+// Function to fill in the identity of the indexed PDF
+static void pdf_identify(struct pdf_index_file *file, const struct stat *st)
+{
+    memset(file, 0, sizeof(*file));
+    memcpy(file->magic, PDF_INDEX_MAGIC, sizeof(file->magic));
+    file->size = st->st_size;
+    file->mtime_sec = st->st_mtim.tv_sec;
+    file->mtime_nsec = st->st_mtim.tv_nsec;
+    file->ino = st->st_ino;
+}
+
+// Function to parse an open PDF and store its index next to it
+// Returns 0, PDF_INVALID or -1.
+static int pdf_index_fd(int fd, const struct stat *st, const char *index_path, struct dfs_pdf_info *info)
+{
+    if (st->st_size == 0)
+    {
+        return PDF_INVALID;
+    }
+    char *data = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+    struct pdf_index_file file;
+    pdf_identify(&file, st);
+    int rc = pdf_parse(data, st->st_size, &file.info);
+    munmap(data, st->st_size);
+    if (rc == 0)
+    {
+        struct iovec part = { &file, sizeof(file) };
+        dfs_replace_file(index_path, &part, 1);
+        *info = file.info;
+    }
+    return rc;
+}
+
+// Function to build and store the index of a PDF, replacing any older one
+// Returns 0, PDF_INVALID if the file is not a PDF, or -1.
+int dfs_pdf_build(const char *path)
+{
+    char index_path[DFS_PATH_MAX];
+    if (dfs_sidecar_path(path, PDF_SUFFIX, index_path, sizeof(index_path)) < 0)
+    {
+        return -1;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    struct dfs_pdf_info info;
+    int rc = (fstat(fd, &st) == 0) ? pdf_index_fd(fd, &st, index_path, &info) : -1;
+    close(fd);
+    return rc;
+}
+
+// Function to get the metadata of an open PDF
+// The stored index is used if it still describes the file; otherwise the PDF is parsed
+// again and the index replaced. Returns 0, PDF_INVALID or -1.
+int dfs_pdf_info(int fd, const char *path, struct dfs_pdf_info *info)
+{
+    struct stat st;
+    char index_path[DFS_PATH_MAX];
+    if (fstat(fd, &st) < 0 || dfs_sidecar_path(path, PDF_SUFFIX, index_path, sizeof(index_path)) < 0)
+    {
+        return -1;
+    }
+
+    struct pdf_index_file stored;
+    struct pdf_index_file expected;
+    pdf_identify(&expected, &st);
+    int index_fd = open(index_path, O_RDONLY);
+    if (index_fd >= 0)
+    {
+        ssize_t n = read(index_fd, &stored, sizeof(stored));
+        close(index_fd);
+        if (n == (ssize_t)sizeof(stored) && memcmp(&stored, &expected, offsetof(struct pdf_index_file, info)) == 0)
+        {
+            *info = stored.info;
+            info->title[sizeof(info->title) - 1] = '\0';
+            return 0;
+        }
+    }
+    return pdf_index_fd(fd, &st, index_path, info);
+}
+
+// Function to drop the index of a PDF that was removed
+void dfs_pdf_remove(const char *path)
+{
+    dfs_sidecar_remove(path, PDF_SUFFIX);
+}
+
+// Function to carry a PDF's index over to its new name after a rename
+void dfs_pdf_rename(const char *old_path, const char *new_path)
+{
+    dfs_sidecar_rename(old_path, new_path, PDF_SUFFIX);
+}
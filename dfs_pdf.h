@@ -0,0 +1,32 @@
+// Distributed File System - PDF metadata index
+// Lets S2 answer "how many pages, what title" and send the first page of a linearized PDF
+// without a viewer downloading the whole file. The facts are read from the linearization
+// dictionary, the trailer, the cross-reference table and the Catalog, Pages and Info
+// objects, and kept in a hidden ".<name>.pidx" file next to the PDF, tagged with its size,
+// mtime and inode like the line and ZIP indexes.
+
+#ifndef DFS_PDF_H
+#define DFS_PDF_H
+
+#include <stdint.h>
+
+#define PDF_TITLE_MAX 256
+#define PDF_INVALID -2 // The file does not start with a PDF header
+
+// What the index knows about one PDF
+struct dfs_pdf_info
+{
+    int64_t pages; // -1 if the page tree could not be read (e.g. it is in a compressed object stream)
+    uint64_t size;
+    uint64_t first_page_end; // Linearized files: bytes 0..first_page_end-1 render page 1; 0 otherwise
+    char version[8];
+    char title[PDF_TITLE_MAX]; // UTF-8, empty if the document has none
+};
+
+// Function prototypes
+int dfs_pdf_build(const char *path);
+int dfs_pdf_info(int fd, const char *path, struct dfs_pdf_info *info);
+void dfs_pdf_remove(const char *path);
+void dfs_pdf_rename(const char *old_path, const char *new_path);
+
+#endif
@@ -0,0 +1,16 @@
+// Distributed File System - Server-to-server transfers
+// Lets one server pull a file straight from another with the same "downlf" framing
+// the client uses, so copies and moves between servers never pass through the client.
+
+#ifndef DFS_PEER_H
+#define DFS_PEER_H
+
+#include <sys/types.h>
+
+#define PEER_NOT_FOUND -2 // The source server answered the request with an error
+
+// Function prototypes
+int peer_connect(int port);
+int peer_fetch_file(int port, const char *filename, const char *dest_file, off_t *size);
+
+#endif
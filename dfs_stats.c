@@ -0,0 +1,299 @@
+// Distributed File System - Per-operation statistics
+// Counters live in an anonymous shared mapping created before the server forks,
+// so every child updates the same histograms with atomic adds and no locks.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "dfs_stats.h"
+
+#define STATS_REPORT_SIZE (64 * 1024) // Largest report sent by stats_send()
+
+struct op_stats
+{
+    uint64_t count;
+    uint64_t errors;
+    uint64_t sum_us;
+    uint64_t max_us;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t buckets[STAT_HIST_BUCKETS];
+};
+
+static const char *op_names[STAT_OP_COUNT] =
+{
+    "uploadf", "downlf", "removef", "downltar", "dispfnames", "forward", "other"
+};
+
+static struct op_stats *shared_stats = NULL;
+static char stats_server[16] = "?";
+
+// Bytes moved by the request this child is serving, reported with its latency
+static uint64_t request_bytes_in = 0;
+static uint64_t request_bytes_out = 0;
+
+// Function to set up the shared counters
+// Must run in the parent before any fork; statistics are silently skipped if it fails.
+void stats_init(const char *server_name)
+{
+    snprintf(stats_server, sizeof(stats_server), "%s", server_name);
+
+    void *region = mmap(NULL, sizeof(struct op_stats) * STAT_OP_COUNT, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        perror("ERROR mapping statistics, stats command disabled");
+        return;
+    }
+    shared_stats = region; // Zero-filled by mmap()
+}
+
+// Function to read a monotonic clock in microseconds
+uint64_t stats_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Function to map a protocol command to the operation it is counted under
+int stats_op_from_command(const char *cmd)
+{
+    for (int op = 0; op < STAT_OP_COUNT; op++)
+    {
+        if (op != STAT_FORWARD && op != STAT_OTHER && strcmp(cmd, op_names[op]) == 0)
+        {
+            return op;
+        }
+    }
+    return STAT_OTHER;
+}
+
+// Function to add payload bytes to the request currently being served
+void stats_add_bytes(uint64_t bytes_in, uint64_t bytes_out)
+{
+    request_bytes_in += bytes_in;
+    request_bytes_out += bytes_out;
+}
+
+// Function to map a latency to its histogram bucket
+static int bucket_index(uint64_t value)
+{
+    if (value < STAT_SUB_BUCKETS)
+    {
+        return (int)value;
+    }
+    int shift = 63 - __builtin_clzll(value) - 4; // value >> shift lands in [16, 31]
+    int index = STAT_SUB_BUCKETS + shift * STAT_SUB_BUCKETS + (int)((value >> shift) - STAT_SUB_BUCKETS);
+    return (index < STAT_HIST_BUCKETS) ? index : STAT_HIST_BUCKETS - 1;
+}
+
+// Function to get the largest latency that falls in a bucket
+static uint64_t bucket_upper_bound(int index)
+{
+    if (index < STAT_SUB_BUCKETS)
+    {
+        return (uint64_t)index;
+    }
+    int shift = (index - STAT_SUB_BUCKETS) / STAT_SUB_BUCKETS;
+    uint64_t sub = (index - STAT_SUB_BUCKETS) % STAT_SUB_BUCKETS;
+    return ((STAT_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+// Function to record one completed operation
+// Client operations also take the bytes accumulated with stats_add_bytes().
+void stats_record(int op, uint64_t elapsed_us, int ok)
+{
+    if (shared_stats == NULL || op < 0 || op >= STAT_OP_COUNT)
+    {
+        return;
+    }
+
+    struct op_stats *s = &shared_stats[op];
+    __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->sum_us, elapsed_us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->buckets[bucket_index(elapsed_us)], 1, __ATOMIC_RELAXED);
+    if (!ok)
+    {
+        __atomic_fetch_add(&s->errors, 1, __ATOMIC_RELAXED);
+    }
+
+    uint64_t max = __atomic_load_n(&s->max_us, __ATOMIC_RELAXED);
+    while (elapsed_us > max &&
+           !__atomic_compare_exchange_n(&s->max_us, &max, elapsed_us, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if (op != STAT_FORWARD)
+    {
+        __atomic_fetch_add(&s->bytes_in, request_bytes_in, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->bytes_out, request_bytes_out, __ATOMIC_RELAXED);
+        request_bytes_in = 0;
+        request_bytes_out = 0;
+    }
+}
+
+// Function to estimate a latency percentile (quantile in [0, 1]) from the histogram
+uint64_t stats_percentile(int op, double quantile)
+{
+    if (shared_stats == NULL)
+    {
+        return 0;
+    }
+
+    struct op_stats *s = &shared_stats[op];
+    uint64_t count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(quantile * count + 0.5);
+    if (target < 1)
+    {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < STAT_HIST_BUCKETS; i++)
+    {
+        seen += __atomic_load_n(&s->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= target)
+        {
+            uint64_t bound = bucket_upper_bound(i);
+            uint64_t max = __atomic_load_n(&s->max_us, __ATOMIC_RELAXED);
+            return (bound < max) ? bound : max;
+        }
+    }
+    return __atomic_load_n(&s->max_us, __ATOMIC_RELAXED);
+}
+
+// Function to get the name an operation is reported under
+const char *stats_op_name(int op)
+{
+    return (op >= 0 && op < STAT_OP_COUNT) ? op_names[op] : "?";
+}
+
+// Function to read the counters of one operation
+void stats_totals(int op, uint64_t *count, uint64_t *errors, uint64_t *bytes_in, uint64_t *bytes_out)
+{
+    *count = *errors = *bytes_in = *bytes_out = 0;
+    if (shared_stats == NULL || op < 0 || op >= STAT_OP_COUNT)
+    {
+        return;
+    }
+    struct op_stats *s = &shared_stats[op];
+    *count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+    *errors = __atomic_load_n(&s->errors, __ATOMIC_RELAXED);
+    *bytes_in = __atomic_load_n(&s->bytes_in, __ATOMIC_RELAXED);
+    *bytes_out = __atomic_load_n(&s->bytes_out, __ATOMIC_RELAXED);
+}
+
+// Function to write a statistics report into out
+// The plain report is a table of percentiles; the Prometheus report uses the text exposition format.
+size_t stats_format(char *out, size_t size, int prometheus)
+{
+    size_t len = 0;
+    out[0] = '\0';
+    if (shared_stats == NULL)
+    {
+        return snprintf(out, size, "%s: statistics disabled\n", stats_server);
+    }
+
+    #define APPEND(...) do { if (len < size) len += snprintf(out + len, size - len, __VA_ARGS__); } while (0)
+
+    if (!prometheus)
+    {
+        APPEND("%s operation latencies (microseconds)\n", stats_server);
+        APPEND("%-11s %8s %6s %9s %9s %9s %9s %12s %12s\n",
+               "op", "count", "errors", "p50", "p99", "p999", "max", "bytes_in", "bytes_out");
+        for (int op = 0; op < STAT_OP_COUNT; op++)
+        {
+            struct op_stats *s = &shared_stats[op];
+            if (s->count == 0)
+            {
+                continue;
+            }
+            APPEND("%-11s %8llu %6llu %9llu %9llu %9llu %9llu %12llu %12llu\n", op_names[op],
+                   (unsigned long long)s->count, (unsigned long long)s->errors,
+                   (unsigned long long)stats_percentile(op, 0.50), (unsigned long long)stats_percentile(op, 0.99),
+                   (unsigned long long)stats_percentile(op, 0.999), (unsigned long long)s->max_us,
+                   (unsigned long long)s->bytes_in, (unsigned long long)s->bytes_out);
+        }
+        return (len < size) ? len : size - 1;
+    }
+
+    APPEND("# HELP dfs_op_latency_seconds Request latency per operation\n");
+    APPEND("# TYPE dfs_op_latency_seconds histogram\n");
+    for (int op = 0; op < STAT_OP_COUNT; op++)
+    {
+        struct op_stats *s = &shared_stats[op];
+        if (s->count == 0)
+        {
+            continue;
+        }
+        // Only non-empty buckets are listed; Prometheus buckets are cumulative
+        uint64_t cumulative = 0;
+        for (int i = 0; i < STAT_HIST_BUCKETS; i++)
+        {
+            uint64_t n = __atomic_load_n(&s->buckets[i], __ATOMIC_RELAXED);
+            if (n == 0)
+            {
+                continue;
+            }
+            cumulative += n;
+            APPEND("dfs_op_latency_seconds_bucket{server=\"%s\",op=\"%s\",le=\"%.6f\"} %llu\n", stats_server,
+                   op_names[op], (bucket_upper_bound(i) + 1) / 1e6, (unsigned long long)cumulative);
+        }
+        APPEND("dfs_op_latency_seconds_bucket{server=\"%s\",op=\"%s\",le=\"+Inf\"} %llu\n", stats_server,
+               op_names[op], (unsigned long long)s->count);
+        APPEND("dfs_op_latency_seconds_sum{server=\"%s\",op=\"%s\"} %.6f\n", stats_server, op_names[op], s->sum_us / 1e6);
+        APPEND("dfs_op_latency_seconds_count{server=\"%s\",op=\"%s\"} %llu\n", stats_server, op_names[op],
+               (unsigned long long)s->count);
+    }
+
+    APPEND("# TYPE dfs_op_errors_total counter\n");
+    APPEND("# TYPE dfs_op_bytes_total counter\n");
+    for (int op = 0; op < STAT_OP_COUNT; op++)
+    {
+        struct op_stats *s = &shared_stats[op];
+        if (s->count == 0)
+        {
+            continue;
+        }
+        APPEND("dfs_op_errors_total{server=\"%s\",op=\"%s\"} %llu\n", stats_server, op_names[op],
+               (unsigned long long)s->errors);
+        APPEND("dfs_op_bytes_total{server=\"%s\",op=\"%s\",direction=\"in\"} %llu\n", stats_server, op_names[op],
+               (unsigned long long)s->bytes_in);
+        APPEND("dfs_op_bytes_total{server=\"%s\",op=\"%s\",direction=\"out\"} %llu\n", stats_server, op_names[op],
+               (unsigned long long)s->bytes_out);
+    }
+
+    #undef APPEND
+    return (len < size) ? len : size - 1;
+}
+
+// Function to send a statistics report over a socket
+int stats_send(int sock, int prometheus)
+{
+    char *report = malloc(STATS_REPORT_SIZE);
+    if (report == NULL)
+    {
+        return -1;
+    }
+
+    size_t len = stats_format(report, STATS_REPORT_SIZE, prometheus);
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = write(sock, report + sent, len - sent);
+        if (n <= 0)
+        {
+            free(report);
+            return -1;
+        }
+        sent += n;
+    }
+    free(report);
+    return 0;
+}
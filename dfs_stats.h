@@ -0,0 +1,38 @@
+// Distributed File System - Per-operation statistics
+// Latency histograms and byte counters shared by all forked children of a server.
+// Used by S1-S4; exposed through the "stats" command.
+
+#ifndef DFS_STATS_H
+#define DFS_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Operations that are timed separately
+#define STAT_UPLOADF 0
+#define STAT_DOWNLF 1
+#define STAT_REMOVEF 2
+#define STAT_DOWNLTAR 3
+#define STAT_DISPFNAMES 4
+#define STAT_FORWARD 5 // Time S1 spends talking to S2-S4 on behalf of a client
+#define STAT_OTHER 6
+#define STAT_OP_COUNT 7
+
+// HDR-style log-linear histogram: 16 linear sub-buckets per power of two,
+// giving about 6% relative precision from 1 microsecond to several days
+#define STAT_SUB_BUCKETS 16
+#define STAT_HIST_BUCKETS (STAT_SUB_BUCKETS * 38)
+
+// Function prototypes
+void stats_init(const char *server_name);
+uint64_t stats_now_us(void);
+int stats_op_from_command(const char *cmd);
+void stats_add_bytes(uint64_t bytes_in, uint64_t bytes_out);
+void stats_record(int op, uint64_t elapsed_us, int ok);
+uint64_t stats_percentile(int op, double quantile);
+const char *stats_op_name(int op);
+void stats_totals(int op, uint64_t *count, uint64_t *errors, uint64_t *bytes_in, uint64_t *bytes_out);
+size_t stats_format(char *out, size_t size, int prometheus);
+int stats_send(int sock, int prometheus);
+
+#endif
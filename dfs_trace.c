@@ -0,0 +1,215 @@
+// Distributed File System - Request tracing
+// Every command may start with "@<request id>"; the id is stripped before parsing,
+// remembered for the rest of the request and put in front of every command forwarded
+// to another server, so the spans recorded by S1-S4 for one client command line up.
+// Spans go to a ring in an anonymous shared mapping created before the server forks.
+// Writers claim a slot with an atomic increment and publish it with a sequence number,
+// so recording never takes a lock and readers skip slots that are being overwritten.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "dfs_trace.h"
+
+struct trace_event
+{
+    uint64_t seq; // Slot index + 1 once the event is complete, 0 while being written
+    uint64_t request_id;
+    uint64_t start_us;
+    uint64_t dur_us;
+    int32_t tid;
+    char name[TRACE_NAME_LEN];
+};
+
+struct trace_ring
+{
+    uint64_t head; // Number of events ever recorded
+    struct trace_event events[TRACE_RING_SLOTS];
+};
+
+static struct trace_ring *trace_ring = NULL;
+static char trace_server[16] = "?";
+static int trace_server_id = 0;
+static uint64_t current_request_id = 0;
+
+// Function to set up the shared span ring
+// Must run in the parent before any fork; tracing is silently skipped if it fails.
+void trace_init(const char *server_name, int server_id)
+{
+    snprintf(trace_server, sizeof(trace_server), "%s", server_name);
+    trace_server_id = server_id;
+
+    void *region = mmap(NULL, sizeof(struct trace_ring), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        perror("ERROR mapping trace ring, tracing disabled");
+        return;
+    }
+    trace_ring = region; // Zero-filled by mmap()
+}
+
+// Function to read the wall clock in microseconds
+// Wall time rather than a monotonic clock so spans from different hosts can be merged.
+uint64_t trace_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Function to make up a request id for commands that arrive without one
+static uint64_t trace_new_id(void)
+{
+    uint64_t x = trace_now_us() ^ ((uint64_t)getpid() << 40);
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Function to take the request id off the front of a command
+// Returns the command without its "@<id> " prefix.
+char *trace_begin_request(char *command)
+{
+    if (command[0] == '@')
+    {
+        char *end;
+        current_request_id = strtoull(command + 1, &end, 16);
+        while (*end == ' ')
+        {
+            end++;
+        }
+        return end;
+    }
+    current_request_id = trace_new_id();
+    return command;
+}
+
+// Function to get the id of the request this child is serving
+uint64_t trace_request_id(void)
+{
+    return current_request_id;
+}
+
+// Function to record one span of the current request
+void trace_span(const char *name, uint64_t start_us, uint64_t end_us)
+{
+    if (trace_ring == NULL)
+    {
+        return;
+    }
+
+    uint64_t index = __atomic_fetch_add(&trace_ring->head, 1, __ATOMIC_RELAXED);
+    struct trace_event *e = &trace_ring->events[index % TRACE_RING_SLOTS];
+
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELEASE);
+    e->request_id = current_request_id;
+    e->start_us = start_us;
+    e->dur_us = (end_us > start_us) ? end_us - start_us : 0;
+    e->tid = (int32_t)getpid();
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    __atomic_store_n(&e->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+// Function to send a command to another server tagged with the current request id
+int trace_send_command(int sock, const char *command)
+{
+    char tagged[2048];
+    int len = snprintf(tagged, sizeof(tagged), "@%016llx %s", (unsigned long long)current_request_id, command);
+    if (len < 0 || len >= (int)sizeof(tagged))
+    {
+        return -1;
+    }
+    return (write(sock, tagged, len) == len) ? 0 : -1;
+}
+
+// Function to copy a span name into a JSON string body
+// Span names include the client's command token, so quotes, backslashes and bytes outside
+// printable ASCII are escaped; out needs 6 bytes per input byte plus one.
+static void trace_escape(const char *name, char *out)
+{
+    for (const unsigned char *p = (const unsigned char *)name; *p != '\0'; p++)
+    {
+        if (*p == '"' || *p == '\\')
+        {
+            *out++ = '\\';
+            *out++ = (char)*p;
+        }
+        else if (*p < 0x20 || *p > 0x7e)
+        {
+            out += sprintf(out, "\\u%04x", *p);
+        }
+        else
+        {
+            *out++ = (char)*p;
+        }
+    }
+    *out = '\0';
+}
+
+// Function to write all complete spans as Chrome trace events, one per line, each followed by a comma
+// A request_id of 0 selects every request.
+int trace_send_events(int sock, uint64_t request_id)
+{
+    if (trace_ring == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t head = __atomic_load_n(&trace_ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = (head > TRACE_RING_SLOTS) ? head - TRACE_RING_SLOTS : 0;
+    char line[512];
+    char name[TRACE_NAME_LEN * 6];
+    for (uint64_t i = first; i < head; i++)
+    {
+        struct trace_event *slot = &trace_ring->events[i % TRACE_RING_SLOTS];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != i + 1)
+        {
+            continue; // Still being written, or already reused by a newer span
+        }
+        struct trace_event e = *slot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != i + 1)
+        {
+            continue;
+        }
+        e.name[TRACE_NAME_LEN - 1] = '\0';
+        if (request_id != 0 && e.request_id != request_id)
+        {
+            continue;
+        }
+
+        trace_escape(e.name, name);
+        int len = snprintf(line, sizeof(line),
+                           "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+                           "\"pid\":%d,\"tid\":%d,\"args\":{\"request\":\"%016llx\"}},\n",
+                           name, trace_server, (unsigned long long)e.start_us, (unsigned long long)e.dur_us,
+                           trace_server_id, e.tid, (unsigned long long)e.request_id);
+        if (write(sock, line, len) != len)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to close a Chrome trace event list
+// Ends the list with process name records for S1-S4 so viewers label each server.
+int trace_send_footer(int sock)
+{
+    char footer[512];
+    int len = 0;
+    for (int id = 1; id <= 4; id++)
+    {
+        len += snprintf(footer + len, sizeof(footer) - len,
+                        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"S%d\"}}%s\n",
+                        id, id, (id < 4) ? "," : "");
+    }
+    len += snprintf(footer + len, sizeof(footer) - len, "]}\n");
+    return (write(sock, footer, len) == len) ? 0 : -1;
+}
@@ -0,0 +1,23 @@
+// Distributed File System - Request tracing
+// Spans of each request are kept in a lock-free shared-memory ring per server
+// and exported as Chrome trace JSON through the "trace" command.
+
+#ifndef DFS_TRACE_H
+#define DFS_TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_RING_SLOTS 4096 // Most recent spans kept per server
+#define TRACE_NAME_LEN 24
+
+// Function prototypes
+void trace_init(const char *server_name, int server_id);
+uint64_t trace_now_us(void);
+char *trace_begin_request(char *command);
+uint64_t trace_request_id(void);
+void trace_span(const char *name, uint64_t start_us, uint64_t end_us);
+int trace_send_command(int sock, const char *command);
+int trace_send_events(int sock, uint64_t request_id);
+int trace_send_footer(int sock);
+
+#endif
@@ -0,0 +1,312 @@
+// Distributed File System - Storage root watcher
+// One inotify watch per directory below the root, kept in step as directories come and go.
+// Every event is checked against the table before anything is journaled, so the DFS's own
+// uploads and moves, which journal themselves, rarely produce a second record. Lost events
+// (IN_Q_OVERFLOW) are made up for by rescanning the tree and pruning what is gone.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/prctl.h> // for PR_SET_PDEATHSIG
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "dfs_watch.h"
+#include "dfs_core.h"
+
+#define WATCH_EVENTS (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+#define WATCH_BUFFER (64 * 1024)
+#define WATCH_SETTLE_US 50000 // Time a server has to journal its own change before the event is checked
+
+// What the watcher process keeps
+struct watch_state
+{
+    struct dfs_meta *meta;
+    void (*on_change)(void *arg);
+    void *on_change_arg;
+    int fd;
+    char **dirs; // Directory of each watch descriptor, NULL once it is no longer watched
+    int dir_capacity;
+    int watched;
+    int full_warned;
+};
+
+// Function to remember which directory a watch descriptor belongs to
+static void watch_set_dir(struct watch_state *state, int wd, const char *path)
+{
+    if (wd >= state->dir_capacity)
+    {
+        int capacity = state->dir_capacity ? state->dir_capacity : 1024;
+        while (capacity <= wd)
+        {
+            capacity *= 2;
+        }
+        char **dirs = realloc(state->dirs, capacity * sizeof(*dirs));
+        if (dirs == NULL)
+        {
+            return;
+        }
+        memset(dirs + state->dir_capacity, 0, (capacity - state->dir_capacity) * sizeof(*dirs));
+        state->dirs = dirs;
+        state->dir_capacity = capacity;
+    }
+    if (state->dirs[wd] == NULL)
+    {
+        state->watched++;
+    }
+    free(state->dirs[wd]);
+    state->dirs[wd] = strdup(path);
+}
+
+// Function to bring the table in line with one file on disk
+// Returns 1 if a change was journaled, 0 if the table already matched or the file is
+// not of the server's type.
+static int watch_refresh(struct watch_state *state, const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    if (dot == NULL || strcmp(dot, state->meta->ext) != 0)
+    {
+        return 0;
+    }
+    struct dfs_meta_entry entry;
+    struct stat st;
+    int known = dfs_meta_lookup(state->meta, path, &entry);
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        if (known && entry.size == (uint64_t)st.st_size && entry.mtime_sec == st.st_mtim.tv_sec &&
+            entry.mtime_nsec == (uint32_t)st.st_mtim.tv_nsec)
+        {
+            return 0;
+        }
+        dfs_meta_add(state->meta, path);
+        return 1;
+    }
+    if (known && entry.segment == 0) // Packed files never had a file of their own
+    {
+        dfs_meta_remove(state->meta, path);
+        return 1;
+    }
+    return 0;
+}
+
+// Function to watch a directory and every directory below it
+// The watch is added before the directory is read, so nothing created meanwhile is missed.
+// With scan set, the files found are refreshed too, for directories that were moved in or
+// gained files before their watch existed. Returns 1 if a change was journaled.
+static int watch_tree(struct watch_state *state, char *path, size_t path_len, int scan)
+{
+    int wd = inotify_add_watch(state->fd, path, WATCH_EVENTS);
+    if (wd < 0)
+    {
+        if (errno == ENOSPC && !state->full_warned)
+        {
+            fprintf(stderr, "ERROR watching %s: out of inotify watches, raise fs.inotify.max_user_watches\n", path);
+            state->full_warned = 1;
+        }
+        return 0;
+    }
+    watch_set_dir(state, wd, path);
+
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        return 0;
+    }
+    int changed = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' || (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+        {
+            continue;
+        }
+        size_t name_len = strlen(ent->d_name);
+        if (path_len + 1 + name_len >= DFS_PATH_MAX)
+        {
+            continue;
+        }
+        path[path_len] = '/';
+        memcpy(path + path_len + 1, ent->d_name, name_len + 1);
+        int type = ent->d_type;
+        struct stat st;
+        if (type == DT_UNKNOWN && lstat(path, &st) == 0)
+        {
+            type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+        }
+        if (type == DT_DIR)
+        {
+            changed |= watch_tree(state, path, path_len + 1 + name_len, scan);
+        }
+        else if (type == DT_REG && scan)
+        {
+            changed |= watch_refresh(state, path);
+        }
+        path[path_len] = '\0';
+    }
+    closedir(dir);
+    return changed;
+}
+
+// Function to stop watching a directory that left the tree and everything below it
+static void watch_forget(struct watch_state *state, const char *path)
+{
+    size_t len = strlen(path);
+    for (int wd = 0; wd < state->dir_capacity; wd++)
+    {
+        const char *dir = state->dirs[wd];
+        if (dir != NULL && strncmp(dir, path, len) == 0 && (dir[len] == '\0' || dir[len] == '/'))
+        {
+            inotify_rm_watch(state->fd, wd);
+            free(state->dirs[wd]);
+            state->dirs[wd] = NULL;
+            state->watched--;
+        }
+    }
+}
+
+// Function to rescan the whole tree after the kernel dropped events
+static int watch_rescan(struct watch_state *state)
+{
+    char path[DFS_PATH_MAX];
+    memcpy(path, state->meta->root, state->meta->root_len + 1);
+    int changed = watch_tree(state, path, state->meta->root_len, 1);
+    return (dfs_meta_prune(state->meta, state->meta->root) > 0) || changed;
+}
+
+// Function to apply one inotify event to the table
+// Returns 1 if a change was journaled.
+static int watch_event(struct watch_state *state, const struct inotify_event *event)
+{
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+        return watch_rescan(state);
+    }
+    if (event->wd < 0 || event->wd >= state->dir_capacity || state->dirs[event->wd] == NULL)
+    {
+        return 0;
+    }
+    if (event->mask & IN_IGNORED)
+    {
+        // The directory is gone; its files were reported one by one or are pruned below
+        free(state->dirs[event->wd]);
+        state->dirs[event->wd] = NULL;
+        state->watched--;
+        return 0;
+    }
+    if (event->len == 0)
+    {
+        return 0;
+    }
+
+    char path[DFS_PATH_MAX];
+    int path_len = snprintf(path, sizeof(path), "%s/%s", state->dirs[event->wd], event->name);
+    if (path_len < 0 || path_len >= DFS_PATH_MAX)
+    {
+        return 0;
+    }
+    if (event->mask & IN_ISDIR)
+    {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            return watch_tree(state, path, path_len, 1);
+        }
+        if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            watch_forget(state, path);
+            return dfs_meta_prune(state->meta, path) > 0;
+        }
+        return 0;
+    }
+    return watch_refresh(state, path);
+}
+
+// Function to read events until the inotify descriptor fails
+// Each read waits WATCH_SETTLE_US and syncs the table before checking its events, so the
+// changes the servers journal right after making them are known by then.
+static void watch_loop(struct watch_state *state)
+{
+    char buffer[WATCH_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1)
+    {
+        ssize_t n = read(state->fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            perror("ERROR reading inotify events");
+            return;
+        }
+        usleep(WATCH_SETTLE_US);
+        dfs_meta_sync(state->meta);
+        int changed = 0;
+        const struct inotify_event *event;
+        for (char *p = buffer; p < buffer + n; p += sizeof(*event) + event->len)
+        {
+            event = (const struct inotify_event *)p;
+            changed |= watch_event(state, event);
+        }
+        if (changed && state->on_change != NULL)
+        {
+            state->on_change(state->on_change_arg);
+        }
+    }
+}
+
+// Function to start the watcher process for a loaded table
+// on_change(arg) runs in the watcher once its watches are in place and after each batch of
+// events that changed the table, e.g. to mark cached archives stale. Returns the watcher's pid, 0 if it is turned off, or -1.
+// The watcher keeps every descriptor open at the fork, so start it before opening a listener.
+pid_t dfs_watch_start(struct dfs_meta *meta, void (*on_change)(void *arg), void *arg)
+{
+    const char *setting = getenv("DFS_WATCH");
+    if (!meta->loaded || (setting != NULL && strcmp(setting, "0") == 0))
+    {
+        return 0;
+    }
+    pid_t parent = getpid();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        return pid;
+    }
+
+    // The watcher ends with the server
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != parent)
+    {
+        _exit(0);
+    }
+    struct watch_state state;
+    memset(&state, 0, sizeof(state));
+    state.meta = meta;
+    state.on_change = on_change;
+    state.on_change_arg = arg;
+    state.fd = inotify_init1(IN_CLOEXEC);
+    if (state.fd < 0)
+    {
+        perror("ERROR starting the storage watcher");
+        _exit(1);
+    }
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    char path[DFS_PATH_MAX];
+    memcpy(path, meta->root, meta->root_len + 1);
+    watch_tree(&state, path, meta->root_len, 0);
+    gettimeofday(&end, NULL);
+    printf("Watching %d directories in %s for changes made outside the DFS (set up in %.1f ms)\n",
+           state.watched, meta->root, (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0);
+    fflush(stdout);
+    if (on_change != NULL)
+    {
+        on_change(arg); // Lets the server record that its root is watched from here on
+    }
+    watch_loop(&state);
+    _exit(1);
+}
@@ -0,0 +1,17 @@
+// Distributed File System - Storage root watcher
+// Files copied, moved or deleted straight in a server's root (not through the DFS) are
+// picked up by a watcher process that follows the tree with inotify and journals each
+// change to the metadata table, so listings and archives see them without a rescan.
+//   DFS_WATCH  0 to run without the watcher (default 1)
+// Changes made while the server is down still need DFS_META_RESCAN=1 at the next start.
+
+#ifndef DFS_WATCH_H
+#define DFS_WATCH_H
+
+#include <sys/types.h>
+#include "dfs_meta.h"
+
+// Function prototypes
+pid_t dfs_watch_start(struct dfs_meta *meta, void (*on_change)(void *arg), void *arg);
+
+#endif
@@ -0,0 +1,373 @@
+// Distributed File System - ZIP central directory index
+// The archive is mapped and its end of central directory record found (ZIP64 records too,
+// for archives over 4 GB or 65535 members). Every central directory entry is resolved to
+// the offset of its data by reading the member's local header, so serving a member later
+// is a single ranged sendfile(). The index file is a header, the entries, then the names,
+// and is used in place through mmap() on every request.
+
+#include <stdio.h>
+#include <stddef.h> // for offsetof()
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dfs_zip.h"
+#include "dfs_core.h"
+
+#define ZIP_INDEX_MAGIC "DFSZIDX1"
+#define ZIP_SUFFIX ".zidx"
+
+// Record signatures and fixed sizes from the ZIP specification (APPNOTE.TXT)
+#define ZIP_SIG_LOCAL 0x04034b50
+#define ZIP_SIG_CENTRAL 0x02014b50
+#define ZIP_SIG_END 0x06054b50
+#define ZIP_SIG_END64 0x06064b50
+#define ZIP_SIG_END64_LOCATOR 0x07064b50
+#define ZIP_LOCAL_SIZE 30
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_END_SIZE 22
+#define ZIP_END64_SIZE 56
+#define ZIP_LOCATOR_SIZE 20
+#define ZIP_EXTRA_ZIP64 0x0001
+
+// On-disk header; the entries and then the names follow it
+struct zip_header
+{
+    char magic[8];
+    uint64_t size; // Size, modification time and inode of the indexed archive
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t ino;
+    uint64_t count;
+    uint64_t names_len;
+};
+
+// Functions to read little-endian fields
+static uint16_t get16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+    return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+// Function to fill in the identity of the indexed archive
+static void zip_identify(struct zip_header *header, const struct stat *st)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, ZIP_INDEX_MAGIC, sizeof(header->magic));
+    header->size = st->st_size;
+    header->mtime_sec = st->st_mtim.tv_sec;
+    header->mtime_nsec = st->st_mtim.tv_nsec;
+    header->ino = st->st_ino;
+}
+
+// Function to point an index at its entries and names
+static void zip_attach(struct dfs_zip_index *index)
+{
+    const struct zip_header *header = index->data;
+    index->count = header->count;
+    index->entries = (const struct dfs_zip_entry *)(header + 1);
+    index->names = (const char *)(index->entries + header->count);
+}
+
+// Function to find the central directory of a mapped archive
+// Returns 0 and sets its offset, size and number of entries, or -1 if there is none.
+static int zip_find_directory(const unsigned char *data, size_t len, uint64_t *offset, uint64_t *size, uint64_t *count)
+{
+    if (len < ZIP_END_SIZE)
+    {
+        return -1;
+    }
+
+    // The end record is last, followed only by a comment of at most 65535 bytes
+    size_t stop = (len > ZIP_END_SIZE + 65535) ? len - ZIP_END_SIZE - 65535 : 0;
+    size_t end = len - ZIP_END_SIZE;
+    while (get32(data + end) != ZIP_SIG_END)
+    {
+        if (end == stop)
+        {
+            return -1;
+        }
+        end--;
+    }
+    *count = get16(data + end + 10);
+    *size = get32(data + end + 12);
+    *offset = get32(data + end + 16);
+
+    // Fields that overflowed are in the ZIP64 end record, found through the locator before it
+    if ((*count == 0xFFFF || *size == 0xFFFFFFFF || *offset == 0xFFFFFFFF) && end >= ZIP_LOCATOR_SIZE &&
+        get32(data + end - ZIP_LOCATOR_SIZE) == ZIP_SIG_END64_LOCATOR)
+    {
+        uint64_t end64 = get64(data + end - ZIP_LOCATOR_SIZE + 8);
+        if (len >= ZIP_END64_SIZE && end64 <= len - ZIP_END64_SIZE && get32(data + end64) == ZIP_SIG_END64)
+        {
+            *count = get64(data + end64 + 32);
+            *size = get64(data + end64 + 40);
+            *offset = get64(data + end64 + 48);
+        }
+    }
+    return (*offset <= len && *size <= len - *offset) ? 0 : -1;
+}
+
+// Function to parse the central directory of a mapped archive into an index image
+// The image has the layout of the index file. Returns it malloc'd with *image_len set,
+// or NULL if the archive is not valid or memory runs out.
+static void *zip_scan(const unsigned char *data, size_t len, const struct stat *st, size_t *image_len)
+{
+    uint64_t cd_offset;
+    uint64_t cd_size;
+    uint64_t count;
+    if (zip_find_directory(data, len, &cd_offset, &cd_size, &count) < 0 || count > cd_size / ZIP_CENTRAL_SIZE)
+    {
+        return NULL;
+    }
+
+    // Names take less room than their central directory entries, so this bounds the image
+    size_t cap = sizeof(struct zip_header) + count * sizeof(struct dfs_zip_entry) + cd_size;
+    struct zip_header *header = malloc(cap);
+    if (header == NULL)
+    {
+        return NULL;
+    }
+    zip_identify(header, st);
+    struct dfs_zip_entry *entries = (struct dfs_zip_entry *)(header + 1);
+    uint64_t kept = 0;
+    char *names = malloc(cd_size + 1);
+    size_t names_len = 0;
+    if (names == NULL)
+    {
+        free(header);
+        return NULL;
+    }
+
+    const unsigned char *p = data + cd_offset;
+    const unsigned char *cd_end = p + cd_size;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if ((size_t)(cd_end - p) < ZIP_CENTRAL_SIZE || get32(p) != ZIP_SIG_CENTRAL)
+        {
+            break;
+        }
+        uint16_t name_len = get16(p + 28);
+        uint16_t extra_len = get16(p + 30);
+        uint16_t comment_len = get16(p + 32);
+        if ((size_t)(cd_end - p) < (size_t)ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len)
+        {
+            break;
+        }
+        struct dfs_zip_entry entry;
+        entry.flags = get16(p + 8);
+        entry.method = get16(p + 10);
+        entry.crc32 = get32(p + 16);
+        entry.compressed_size = get32(p + 20);
+        entry.size = get32(p + 24);
+        uint64_t local = get32(p + 42);
+
+        // The ZIP64 extra field holds, in order, whichever of these did not fit in 32 bits
+        const unsigned char *extra = p + ZIP_CENTRAL_SIZE + name_len;
+        const unsigned char *extra_end = extra + extra_len;
+        while (extra_end - extra >= 4)
+        {
+            uint16_t id = get16(extra);
+            uint16_t field_len = get16(extra + 2);
+            const unsigned char *field = extra + 4;
+            const unsigned char *field_end = field + field_len;
+            if (field_end > extra_end)
+            {
+                break;
+            }
+            if (id == ZIP_EXTRA_ZIP64)
+            {
+                if (entry.size == 0xFFFFFFFF && field_end - field >= 8)
+                {
+                    entry.size = get64(field);
+                    field += 8;
+                }
+                if (entry.compressed_size == 0xFFFFFFFF && field_end - field >= 8)
+                {
+                    entry.compressed_size = get64(field);
+                    field += 8;
+                }
+                if (local == 0xFFFFFFFF && field_end - field >= 8)
+                {
+                    local = get64(field);
+                }
+            }
+            extra = field_end;
+        }
+
+        // The local header's name and extra field may differ from the central copy
+        if (len >= ZIP_LOCAL_SIZE && local <= len - ZIP_LOCAL_SIZE && get32(data + local) == ZIP_SIG_LOCAL)
+        {
+            entry.data_offset = local + ZIP_LOCAL_SIZE + get16(data + local + 26) + get16(data + local + 28);
+            if (entry.data_offset <= len && entry.compressed_size <= len - entry.data_offset)
+            {
+                entry.name_offset = names_len;
+                entry.name_len = name_len;
+                memcpy(names + names_len, p + ZIP_CENTRAL_SIZE, name_len);
+                names_len += name_len;
+                names[names_len++] = '\0';
+                entries[kept++] = entry;
+            }
+        }
+        p += ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len;
+    }
+
+    header->count = kept;
+    header->names_len = names_len;
+    memcpy(entries + kept, names, names_len);
+    free(names);
+    *image_len = sizeof(struct zip_header) + kept * sizeof(struct dfs_zip_entry) + names_len;
+    return header;
+}
+
+// Function to index an open archive and store the index next to it
+// Returns the index image (see zip_scan), or NULL if the archive could not be read.
+static void *zip_index_fd(int fd, const struct stat *st, const char *index_path, size_t *image_len)
+{
+    if (st->st_size == 0)
+    {
+        return NULL;
+    }
+    unsigned char *data = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+    void *image = zip_scan(data, st->st_size, st, image_len);
+    munmap(data, st->st_size);
+    if (image != NULL)
+    {
+        struct iovec part = { image, *image_len };
+        dfs_replace_file(index_path, &part, 1);
+    }
+    return image;
+}
+
+// Function to build and store the index of an archive, replacing any older one
+// Returns 0 on success, ZIP_INVALID if the file is not a ZIP archive and -1 on failure.
+int dfs_zip_build(const char *path)
+{
+    char index_path[DFS_PATH_MAX];
+    if (dfs_sidecar_path(path, ZIP_SUFFIX, index_path, sizeof(index_path)) < 0)
+    {
+        return -1;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t image_len;
+    void *image = zip_index_fd(fd, &st, index_path, &image_len);
+    close(fd);
+    free(image);
+    return (image != NULL) ? 0 : ZIP_INVALID;
+}
+
+// Function to get the index of an open archive
+// The stored index is used if it still describes the file; otherwise it is rebuilt and
+// stored again. Returns 0, ZIP_INVALID if the file is not a ZIP archive, or -1.
+int dfs_zip_open(int fd, const char *path, struct dfs_zip_index *index)
+{
+    memset(index, 0, sizeof(*index));
+    struct stat st;
+    char index_path[DFS_PATH_MAX];
+    if (fstat(fd, &st) < 0 || dfs_sidecar_path(path, ZIP_SUFFIX, index_path, sizeof(index_path)) < 0)
+    {
+        return -1;
+    }
+
+    int index_fd = open(index_path, O_RDONLY);
+    struct stat index_st;
+    if (index_fd >= 0 && fstat(index_fd, &index_st) == 0 && (size_t)index_st.st_size >= sizeof(struct zip_header))
+    {
+        struct zip_header *header = mmap(NULL, index_st.st_size, PROT_READ, MAP_PRIVATE, index_fd, 0);
+        struct zip_header expected;
+        zip_identify(&expected, &st);
+        if (header != MAP_FAILED && memcmp(header, &expected, offsetof(struct zip_header, count)) == 0 &&
+            header->count <= (index_st.st_size - sizeof(struct zip_header)) / sizeof(struct dfs_zip_entry) &&
+            (size_t)index_st.st_size == sizeof(struct zip_header) + header->count * sizeof(struct dfs_zip_entry) + header->names_len)
+        {
+            close(index_fd);
+            index->data = header;
+            index->data_len = index_st.st_size;
+            index->mapped = 1;
+            zip_attach(index);
+            return 0;
+        }
+        if (header != MAP_FAILED)
+        {
+            munmap(header, index_st.st_size);
+        }
+    }
+    if (index_fd >= 0)
+    {
+        close(index_fd);
+    }
+
+    index->data = zip_index_fd(fd, &st, index_path, &index->data_len);
+    if (index->data == NULL)
+    {
+        return ZIP_INVALID;
+    }
+    zip_attach(index);
+    return 0;
+}
+
+// Function to look up a member by its full name in the archive
+const struct dfs_zip_entry *dfs_zip_find(const struct dfs_zip_index *index, const char *name)
+{
+    size_t len = strlen(name);
+    for (uint64_t i = 0; i < index->count; i++)
+    {
+        const struct dfs_zip_entry *entry = &index->entries[i];
+        if (entry->name_len == len && memcmp(index->names + entry->name_offset, name, len) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Function to release an index from dfs_zip_open
+void dfs_zip_close(struct dfs_zip_index *index)
+{
+    if (index->mapped)
+    {
+        munmap(index->data, index->data_len);
+    }
+    else
+    {
+        free(index->data);
+    }
+    index->data = NULL;
+}
+
+// Function to drop the index of an archive that was removed
+void dfs_zip_remove(const char *path)
+{
+    dfs_sidecar_remove(path, ZIP_SUFFIX);
+}
+
+// Function to carry an archive's index over to its new name after a rename
+void dfs_zip_rename(const char *old_path, const char *new_path)
+{
+    dfs_sidecar_rename(old_path, new_path, ZIP_SUFFIX);
+}
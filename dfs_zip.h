@@ -0,0 +1,49 @@
+// Distributed File System - ZIP central directory index
+// Lets S4 list the members of a stored archive and send one of them without reading the
+// rest. The central directory is parsed once into a hidden ".<name>.zidx" file next to
+// the archive, tagged with its size, mtime and inode like the line index of dfs_lines.
+
+#ifndef DFS_ZIP_H
+#define DFS_ZIP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+#define ZIP_FLAG_ENCRYPTED 0x0001
+#define ZIP_INVALID -2 // The file is not a readable ZIP archive
+
+// One member as stored in the index
+struct dfs_zip_entry
+{
+    uint64_t data_offset; // Start of the member's compressed data in the archive
+    uint64_t compressed_size;
+    uint64_t size;
+    uint32_t crc32;
+    uint16_t method;
+    uint16_t flags;
+    uint32_t name_offset; // Into the index's block of NUL-terminated names
+    uint32_t name_len;
+};
+
+// An archive's index, mapped from its sidecar or freshly built in memory
+struct dfs_zip_index
+{
+    void *data;
+    size_t data_len;
+    int mapped;
+    uint64_t count;
+    const struct dfs_zip_entry *entries;
+    const char *names;
+};
+
+// Function prototypes
+int dfs_zip_build(const char *path);
+int dfs_zip_open(int fd, const char *path, struct dfs_zip_index *index);
+const struct dfs_zip_entry *dfs_zip_find(const struct dfs_zip_index *index, const char *name);
+void dfs_zip_close(struct dfs_zip_index *index);
+void dfs_zip_remove(const char *path);
+void dfs_zip_rename(const char *old_path, const char *new_path);
+
+#endif
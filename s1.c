@@ -1,845 +1,3194 @@
-// Distributed File System - S1 Server Implementation
-// This file implements the main server (S1) which interacts with the client and other servers (S2, S3, S4).
-// S1 handles .c files locally and forwards other file types to the appropriate servers.
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/socket.h> // for socket()
-#include <netinet/in.h> // for sockaddr_in
-#include <netdb.h> // for gethostbyname()
-#include <arpa/inet.h> // for inet_ntoa()
-#include <sys/stat.h> // for stat()
-#include <fcntl.h> // for open()
-#include <dirent.h> // for opendir()
-#include <libgen.h> // for basename()
-#include <sys/wait.h> // for waitpid()
-#include <sys/sendfile.h> // for sendfile()
-#include <time.h> // for time()
-#include <errno.h> // for errno
-
-#define PORT 4307 // S1 server port
-#define MAX_CLIENTS 5 // Maximum number of clients
-#define BUFFER_SIZE 1024 // Buffer size for file transfer
-#define MAX_PATH_LEN 1024 // Maximum path length
-
-// Server ports for S2, S3, S4
-#define S2_PORT 4308
-#define S3_PORT 4309
-#define S4_PORT 4310
-
-// Function prototypes
-void handle_client(int client_sock);
-int upload_file(int client_sock, char *filename, char *dest_path);
-int download_file(int client_sock, char *filename);
-int remove_file(int client_sock, char *filename);
-int download_tar(int client_sock, char *filetype);
-int display_filenames(int client_sock, char *pathname);
-int send_to_server(int port, char *command, char *response);
-int create_directory_tree(char *path);
-void error(const char *msg);
-
-// Main function initializes the server and listens for client connections.
-// It creates a child process for each client to handle requests concurrently.
-int main() 
-{
-    // Create socket
-    int sockfd, newsockfd;
-    socklen_t clilen;
-    struct sockaddr_in serv_addr, cli_addr;
-    pid_t pid;
-
-    // Create socket
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) 
-    {
-        error("ERROR opening socket");
-    }
-
-    // Initialize socket structure
-    bzero((char *) &serv_addr, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(PORT);
-
-    // Bind the host address
-    if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
-    {
-        error("ERROR on binding");
-    }
-
-    // Start listening for the clients
-    listen(sockfd, MAX_CLIENTS);
-    clilen = sizeof(cli_addr);
-
-    // Print server start message
-    printf("S1 (MAIN SERVER) started on port %d\n", PORT);
-
-    // Main loop to accept clients
-    while (1) 
-    {
-        // Accept connection from client
-        newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
-        if (newsockfd < 0) {
-            error("ERROR on accept");
-        }
-
-        // Create child process to handle client
-        pid = fork();
-        if (pid < 0) 
-        {
-            error("ERROR on fork");
-        }
-
-        if (pid == 0) 
-        {
-            // Child process
-            close(sockfd);
-            handle_client(newsockfd);
-            close(newsockfd);
-            exit(0);
-        } 
-
-        else 
-        {
-            // Parent process
-            close(newsockfd);
-            // Clean up zombie processes
-            while (waitpid(-1, NULL, WNOHANG) > 0);
-        }
-    }
-
-    close(sockfd); // Close the socket
-    return 0;
-}
-
-// Function to handle client requests
-// Parses the command received from the client and calls the appropriate function.
-void handle_client(int client_sock) 
-{
-    char buffer[BUFFER_SIZE]; // Buffer for commands
-    int n;
-    
-    // Read command from client
-    bzero(buffer, BUFFER_SIZE);
-    n = read(client_sock, buffer, BUFFER_SIZE - 1);
-    if (n < 0) 
-    {
-        error("ERROR reading from socket");
-    }
-    
-    printf("Received command: %s\n", buffer);
-    
-    // Parse command
-    char *cmd = strtok(buffer, " ");
-    if (cmd == NULL) 
-    {
-        write(client_sock, "ERROR: Invalid command", 22);
-        return;
-    }
-    
-    if (strcmp(cmd, "uploadf") == 0) 
-    {
-        // Handle file upload
-        char *filename = strtok(NULL, " ");
-        char *dest_path = strtok(NULL, " ");
-        if (filename == NULL || dest_path == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid uploadf command format", 36);
-            return;
-        }
-        upload_file(client_sock, filename, dest_path);
-    } 
-    else if (strcmp(cmd, "downlf") == 0) 
-    {
-        // Handle file download
-        char *filename = strtok(NULL, " ");
-        if (filename == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid downlf command format", 34);
-            return;
-        }
-        download_file(client_sock, filename);
-    } 
-    else if (strcmp(cmd, "removef") == 0) 
-    {
-        // Handle file removal
-        char *filename = strtok(NULL, " ");
-        if (filename == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid removef command format", 35);
-            return;
-        }
-        remove_file(client_sock, filename);
-    } 
-    else if (strcmp(cmd, "downltar") == 0) 
-    {
-        // Handle tar file download
-        char *filetype = strtok(NULL, " ");
-        if (filetype == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid downltar command format", 36);
-            return;
-        }
-        download_tar(client_sock, filetype);
-    } 
-    else if (strcmp(cmd, "dispfnames") == 0) 
-    {
-        // Handle display filenames request
-        char *pathname = strtok(NULL, " ");
-        if (pathname == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid dispfnames command format", 38);
-            return;
-        }
-        display_filenames(client_sock, pathname);
-    } 
-    else 
-    {
-        // Handle unknown command
-        write(client_sock, "ERROR: Unknown command", 21);
-    }
-}
-
-// Function to upload a file to S1 or forward it to the appropriate server
-// Receives the file from the client and determines its type based on the extension.
-int upload_file(int client_sock, char *filename, char *dest_path) 
-{
-    // First, receive the file from client
-    char buffer[BUFFER_SIZE];
-    int n;
-    
-    // Send acknowledgment to client to start sending file
-    write(client_sock, "READY", 5);
-    
-    // Get file size
-    off_t file_size;
-    read(client_sock, &file_size, sizeof(off_t));
-    
-    // Determine file type
-    char *ext = strrchr(filename, '.');
-    if (ext == NULL) 
-    {
-        write(client_sock, "ERROR: File has no extension", 27);
-        return -1;
-    }
-    
-    // Create destination path in S1
-    char s1_path[MAX_PATH_LEN];
-    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), dest_path + 3); // +3 to skip "~S1"
-    
-    // Create directory tree if needed
-    if (create_directory_tree(s1_path) < 0) 
-    {
-        write(client_sock, "ERROR: Failed to create directory", 32);
-        return -1;
-    }
-    
-    // Construct full file path
-    char *base_name = basename(filename);
-    char full_path[MAX_PATH_LEN];
-    snprintf(full_path, MAX_PATH_LEN, "%s/%s", s1_path, base_name);
-    
-    // Open file for writing
-    int fd = open(full_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0) 
-    {
-        write(client_sock, "ERROR: Failed to create file", 27);
-        return -1;
-    }
-    
-    // Receive file data
-    off_t remaining = file_size;
-    while (remaining > 0) 
-    {
-        n = read(client_sock, buffer, BUFFER_SIZE);
-        if (n <= 0) 
-        {
-            close(fd);
-            write(client_sock, "ERROR: File transfer failed", 27);
-            return -1;
-        }
-        write(fd, buffer, n);
-        remaining -= n;
-    }
-    close(fd);
-    
-    // Determine which server should handle this file
-    int target_port = 0;
-    if (strcmp(ext, ".c") == 0) 
-    {
-        // File stays in S1
-        write(client_sock, "SUCCESS: File uploaded to S1", 27);
-        return 0;
-    } 
-    else if (strcmp(ext, ".pdf") == 0) 
-    {
-        target_port = S2_PORT;
-    } 
-    else if (strcmp(ext, ".txt") == 0) 
-    {
-        target_port = S3_PORT;
-    } 
-    else if (strcmp(ext, ".zip") == 0) 
-    {
-        target_port = S4_PORT;
-    } 
-    else 
-    {
-        write(client_sock, "ERROR: Unsupported file type", 27);
-        return -1;
-    }
-    
-    // Forward file to appropriate server
-    char command[MAX_PATH_LEN * 2];
-    snprintf(command, MAX_PATH_LEN * 2, "uploadf %s %s", full_path, dest_path);
-    
-    char response[BUFFER_SIZE];
-    if (send_to_server(target_port, command, response) < 0) 
-    {
-        write(client_sock, "ERROR: Failed to forward file to target server", 44);
-        return -1;
-    }
-    
-    // Remove the file from S1 after forwarding
-    unlink(full_path);
-    
-    write(client_sock, response, strlen(response));
-    return 0;
-}
-
-// Function to download a file from S1 or request it from the appropriate server
-// Checks if the file exists in S1 and sends it to the client, or forwards the request to another server.
-int download_file(int client_sock, char *filename) 
-{
-    // Check if file exists in S1
-    char s1_path[MAX_PATH_LEN];
-    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
-    
-    struct stat st;
-    if (stat(s1_path, &st) == 0) 
-    {
-        // File exists in S1 - send it directly
-        int fd = open(s1_path, O_RDONLY);
-        if (fd < 0) 
-        {
-            write(client_sock, "ERROR: Failed to open file", 25);
-            return -1;
-        }
-        
-        // Send file size
-        if (write(client_sock, &st.st_size, sizeof(off_t)) != sizeof(off_t)) 
-        {
-            close(fd);
-            write(client_sock, "ERROR: Failed to send file size", 31);
-            return -1;
-        }
-        
-        // Send file data
-        off_t remaining = st.st_size;
-        char buffer[BUFFER_SIZE];
-        while (remaining > 0) 
-        {
-            ssize_t n = read(fd, buffer, (remaining < BUFFER_SIZE) ? remaining : BUFFER_SIZE);
-            if (n <= 0) 
-            {
-                close(fd);
-                write(client_sock, "ERROR: File transfer failed", 27);
-                return -1;
-            }
-            if (write(client_sock, buffer, n) != n) 
-            {
-                close(fd);
-                write(client_sock, "ERROR: File transfer failed", 27);
-                return -1;
-            }
-            remaining -= n;
-        }
-        close(fd);
-        return 0;
-    }
-    
-    // File not in S1 - forward to appropriate server
-    char *ext = strrchr(filename, '.');
-    int target_port = 0;
-    if (strcmp(ext, ".pdf") == 0) 
-    {
-        target_port = S2_PORT;
-    } 
-    else if (strcmp(ext, ".txt") == 0) 
-    {
-        target_port = S3_PORT;
-    } 
-    else if (strcmp(ext, ".zip") == 0) 
-    {
-        target_port = S4_PORT;
-    } 
-    else 
-    {
-        write(client_sock, "ERROR: Unsupported file type", 28);
-        return -1;
-    }
-    
-    // Forward request to target server
-    char command[BUFFER_SIZE];
-    snprintf(command, BUFFER_SIZE, "downlf %s", filename);
-    int sockfd;
-    struct sockaddr_in serv_addr;
-    struct hostent *server;
-
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) 
-    {
-        write(client_sock, "ERROR: Socket creation failed", 29);
-        return -1;
-    }
-
-    server = gethostbyname("localhost");
-    if (server == NULL) 
-    {
-        close(sockfd);
-        write(client_sock, "ERROR: Host resolution failed", 29);
-        return -1;
-    }
-
-    bzero((char *)&serv_addr, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
-    serv_addr.sin_port = htons(target_port);
-
-    if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) 
-    {
-        close(sockfd);
-        write(client_sock, "ERROR: Connection to server failed", 34);
-        return -1;
-    }
-
-    // Send command to target server
-    if (write(sockfd, command, strlen(command)) < 0) 
-    {
-        close(sockfd);
-        write(client_sock, "ERROR: Command send failed", 26);
-        return -1;
-    }
-
-    // Read file size from target server
-    off_t filesize;
-    if (read(sockfd, &filesize, sizeof(off_t)) != sizeof(off_t)) 
-    {
-        close(sockfd);
-        write(client_sock, "ERROR: Failed to read file size", 31);
-        return -1;
-    }
-
-    // Send file size to client
-    if (write(client_sock, &filesize, sizeof(off_t)) != sizeof(off_t)) 
-    {
-        close(sockfd);
-        return -1;
-    }
-
-    // Relay file content from target server to client
-    off_t remaining = filesize;
-    char buffer[BUFFER_SIZE];
-    while (remaining > 0) 
-    {
-        ssize_t bytes_read = read(sockfd, buffer, sizeof(buffer));
-        if (bytes_read <= 0) break;
-        write(client_sock, buffer, bytes_read);
-        remaining -= bytes_read;
-    }
-
-    close(sockfd);
-    return 0;
-}
-
-// Function to remove a file from S1 or request its removal from another server
-// Determines the file's location based on its extension and sends the removal request.
-int remove_file(int client_sock, char *filename) 
-{
-    // Check if file exists in S1
-    char s1_path[MAX_PATH_LEN];
-    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
-    
-    if (unlink(s1_path) == 0) 
-    {
-        write(client_sock, "SUCCESS: File deleted from S1", 28);
-        return 0;
-    }
-    
-    // File not in S1 - check other servers based on extension
-    char *ext = strrchr(filename, '.');
-    if (ext == NULL) 
-    {
-        write(client_sock, "ERROR: File has no extension", 27);
-        return -1;
-    }
-    
-    int target_port = 0;
-    if (strcmp(ext, ".pdf") == 0) 
-    {
-        target_port = S2_PORT;
-    } 
-    else if (strcmp(ext, ".txt") == 0) 
-    {
-        target_port = S3_PORT;
-    } 
-    else if (strcmp(ext, ".zip") == 0) 
-    {
-        target_port = S4_PORT;
-    } 
-    else 
-    {
-        write(client_sock, "ERROR: File not found", 21);
-        return -1;
-    }
-    
-    // Request deletion from appropriate server
-    char command[MAX_PATH_LEN];
-    snprintf(command, MAX_PATH_LEN, "removef %s", filename);
-    
-    char response[BUFFER_SIZE];
-    if (send_to_server(target_port, command, response) < 0) 
-    {
-        write(client_sock, "ERROR: Failed to delete file from target server", 45);
-        return -1;
-    }
-    
-    write(client_sock, response, strlen(response));
-    return 0;
-}
-
-// Function to download a tar file containing files of a specific type
-// Handles .c files locally and forwards requests for other file types to the appropriate server.
-int download_tar(int client_sock, char *filetype) 
-{
-    if (strcmp(filetype, ".c") == 0) 
-    {
-        // Handle .c files in S1
-        char s1_dir[MAX_PATH_LEN];
-        snprintf(s1_dir, MAX_PATH_LEN, "%s/S1", getenv("HOME"));
-
-        // Find all .c files recursively and tar them
-        char find_cmd[MAX_PATH_LEN * 2];
-        snprintf(find_cmd, sizeof(find_cmd), "find %s -type f -name \"*.c\" | tar -cf /tmp/cfiles.tar -T -", s1_dir);
-
-        if (system(find_cmd) != 0) 
-        {
-            write(client_sock, "ERROR: Failed to create tar file", 32);
-            return -1;
-        }
-
-        // Send tar file to client
-        struct stat st;
-        if (stat("/tmp/cfiles.tar", &st) != 0) 
-        {
-            write(client_sock, "ERROR: Tar file not found", 25);
-            return -1;
-        }
-
-        int fd = open("/tmp/cfiles.tar", O_RDONLY);
-        if (fd < 0) 
-        {
-            write(client_sock, "ERROR: Failed to open tar file", 30);
-            return -1;
-        }
-
-        // Send file size
-        write(client_sock, &st.st_size, sizeof(off_t));
-
-        // Send file data
-        off_t remaining = st.st_size;
-        while (remaining > 0) 
-        {
-            ssize_t sent = sendfile(client_sock, fd, NULL, remaining);
-            if (sent <= 0) 
-            {
-                close(fd);
-                write(client_sock, "ERROR: File transfer failed", 28);
-                return -1;
-            }
-            remaining -= sent;
-        }
-        close(fd);
-
-        // Clean up
-        unlink("/tmp/cfiles.tar");
-        return 0;
-
-    } 
-    else if (strcmp(filetype, ".pdf") == 0 || strcmp(filetype, ".txt") == 0) 
-    {
-        // Handle .pdf and .txt files from other servers
-        int target_port = (strcmp(filetype, ".pdf") == 0) ? S2_PORT : S3_PORT;
-
-        char command[BUFFER_SIZE];
-        snprintf(command, BUFFER_SIZE, "downltar %s", filetype);
-
-        int sockfd;
-        struct sockaddr_in serv_addr;
-        struct hostent *server;
-
-        sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) 
-        {
-            write(client_sock, "ERROR: Socket creation failed", 29);
-            return -1;
-        }
-
-        server = gethostbyname("localhost");
-        if (server == NULL) 
-        {
-            close(sockfd);
-            write(client_sock, "ERROR: Host resolution failed", 29);
-            return -1;
-        }
-
-        bzero((char *)&serv_addr, sizeof(serv_addr));
-        serv_addr.sin_family = AF_INET;
-        bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
-        serv_addr.sin_port = htons(target_port);
-
-        if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) 
-        {
-            close(sockfd);
-            write(client_sock, "ERROR: Connection to server failed", 34);
-            return -1;
-        }
-
-        // Send command to target server
-        if (write(sockfd, command, strlen(command)) < 0) 
-        {
-            close(sockfd);
-            write(client_sock, "ERROR: Command send failed", 26);
-            return -1;
-        }
-
-        // Read tar file size
-        off_t filesize;
-        if (read(sockfd, &filesize, sizeof(off_t)) != sizeof(off_t)) 
-        {
-            close(sockfd);
-            write(client_sock, "ERROR: Failed to read file size", 31);
-            return -1;
-        }
-
-        // Send file size to client
-        write(client_sock, &filesize, sizeof(off_t));
-
-        // Relay tar file content from target server to client
-        off_t remaining = filesize;
-        char buffer[1024];
-        while (remaining > 0) 
-        {
-            ssize_t bytes_read = read(sockfd, buffer, sizeof(buffer));
-            if (bytes_read <= 0) break;
-            write(client_sock, buffer, bytes_read);
-            remaining -= bytes_read;
-        }
-
-        close(sockfd);
-        return 0;
-    } 
-    else 
-    {
-        write(client_sock, "ERROR: Unsupported file type for tar", 36);
-        return -1;
-    }
-}
-
-// Function to display filenames from S1 and other servers
-// Recursively lists files in S1 and sends requests to other servers for their file lists.
-int display_filenames(int client_sock, char *pathname) 
-{
-    // Get the corresponding path in S1
-    char s1_path[MAX_PATH_LEN];
-    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), 
-             (strcmp(pathname, "~S1") == 0) ? "" : (pathname + 3)); // Handle root case
-
-    // Check if path exists and is a directory
-    struct stat st;
-    if (stat(s1_path, &st) != 0 || !S_ISDIR(st.st_mode)) 
-    {
-        write(client_sock, "ERROR: Invalid directory path", 29);
-        return -1;
-    }
-
-    // Get files from S1 (.c files) recursively
-    char file_list[BUFFER_SIZE] = {0};
-    DIR *dir;
-    struct dirent *ent;
-
-    // Function to recursively list files
-    void list_files_recursive(const char *base_path, const char *relative_path) 
-    {
-        char path[MAX_PATH_LEN];
-        struct dirent *dp;
-        DIR *dir = opendir(base_path);
-
-        if (!dir) return;
-
-        while ((dp = readdir(dir)) != NULL) 
-        {
-            if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
-                continue;
-
-            snprintf(path, MAX_PATH_LEN, "%s/%s", base_path, dp->d_name);
-
-            char new_relative_path[MAX_PATH_LEN];
-            if (strcmp(relative_path, "") == 0) 
-            {
-                snprintf(new_relative_path, sizeof(new_relative_path), "%s", dp->d_name);
-            } 
-            else 
-            {
-                snprintf(new_relative_path, sizeof(new_relative_path), "%s/%s", relative_path, dp->d_name);
-            }
-
-            if (dp->d_type == DT_REG) {
-                char *ext = strrchr(dp->d_name, '.');
-                if (ext && strcmp(ext, ".c") == 0) 
-                {
-                    // Build ~S1-style path
-                    char output_path[MAX_PATH_LEN];
-                    snprintf(output_path, sizeof(output_path), "~S1/%s", new_relative_path);
-                    strncat(file_list, output_path, BUFFER_SIZE - strlen(file_list) - 1);
-                    strncat(file_list, "\n", BUFFER_SIZE - strlen(file_list) - 1);
-                }
-            } 
-            else if (dp->d_type == DT_DIR) 
-            {
-                list_files_recursive(path, new_relative_path);
-            }
-        }
-        closedir(dir);
-    }
-
-    // Start recursive traversal from the base path
-    list_files_recursive(s1_path, "");
-
-    // Get files from other servers
-    char command[MAX_PATH_LEN];
-    snprintf(command, MAX_PATH_LEN, "dispfnames %s", pathname);
-    char response[BUFFER_SIZE];
-
-    // Get PDF files from S2
-    if (send_to_server(S2_PORT, command, response) == 0) 
-    {
-        strncat(file_list, response, BUFFER_SIZE - strlen(file_list) - 1);
-    }
-
-    // Get TXT files from S3
-    if (send_to_server(S3_PORT, command, response) == 0) 
-    {
-        strncat(file_list, response, BUFFER_SIZE - strlen(file_list) - 1);
-    }
-
-    // Get ZIP files from S4
-    if (send_to_server(S4_PORT, command, response) == 0) 
-    {
-        strncat(file_list, response, BUFFER_SIZE - strlen(file_list) - 1);
-    }
-
-    // Send the combined list to client
-    write(client_sock, file_list, strlen(file_list));
-    return 0;
-}
-
-// Function to send a command to another server and receive its response
-// Establishes a connection to the target server, sends the command, and reads the response.
-int send_to_server(int port, char *command, char *response) 
-{
-    int sockfd;
-    struct sockaddr_in serv_addr;
-    struct hostent *server;
-    
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) 
-    {
-        return -1;
-    }
-    
-    server = gethostbyname("localhost");
-    if (server == NULL) 
-    {
-        close(sockfd);
-        return -1;
-    }
-    
-    bzero((char *) &serv_addr, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
-    serv_addr.sin_port = htons(port);
-    
-    if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
-    {
-        close(sockfd);
-        return -1;
-    }
-    
-    // Send command
-    if (write(sockfd, command, strlen(command)) < 0) 
-    {
-        close(sockfd);
-        return -1;
-    }
-    
-    // Read response
-    bzero(response, BUFFER_SIZE);
-    if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
-    {
-        close(sockfd);
-        return -1;
-    }
-    
-    close(sockfd);
-    return 0;
-}
-
-// Function to create a directory tree for a given path
-// Ensures that all intermediate directories in the path exist.
-int create_directory_tree(char *path) 
-{
-    char *p;
-    char tmp[MAX_PATH_LEN];
-    
-    snprintf(tmp, MAX_PATH_LEN, "%s", path);
-    
-    // Skip leading slash if present
-    if (tmp[0] == '/') 
-    {
-        p = tmp + 1;
-    } else {
-        p = tmp;
-    }
-    
-    // Create each directory in the path
-    while ((p = strchr(p, '/'))) 
-    {
-        *p = '\0';
-        if (mkdir(tmp, 0755) && errno != EEXIST) 
-        {
-            return -1;
-        }
-        *p = '/';
-        p++;
-    }
-    
-    // Create the final directory
-    if (mkdir(tmp, 0755) && errno != EEXIST) 
-    {
-        return -1;
-    }
-    
-    return 0;
-}
-
-// Function to handle errors
-// Prints the error message and exits the program.
-void error(const char *msg) 
-{
-    perror(msg);
-    exit(1);
+// Distributed File System - S1 Server Implementation
+// This file implements the main server (S1) which interacts with the client and other servers (S2, S3, S4).
+// S1 handles .c files locally and forwards other file types to the appropriate servers.
+
+#define _GNU_SOURCE // for syncfs(), fallocate(), splice()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h> // for socket()
+#include <netinet/in.h> // for sockaddr_in
+#include <netdb.h> // for gethostbyname()
+#include <arpa/inet.h> // for inet_ntoa()
+#include <sys/stat.h> // for stat()
+#include <fcntl.h> // for open()
+#include <dirent.h> // for opendir()
+#include <libgen.h> // for basename()
+#include <sys/wait.h> // for waitpid()
+#include <sys/sendfile.h> // for sendfile()
+#include <time.h> // for time()
+#include <errno.h> // for errno
+#include <sys/mman.h> // for mmap()
+#include <pthread.h> // for process-shared mutex/condvar
+#include <sys/uio.h> // for writev()
+#include <signal.h> // for kill()
+#include "dfs_stats.h" // for per-operation statistics
+#include "dfs_trace.h" // for request tracing
+#include "dfs_core.h" // for directory, listing and copy helpers
+#include "dfs_net.h" // for transfer buffer sizes and socket options
+#include "dfs_peer.h" // for server-to-server file transfers
+#include "dfs_match.h" // for findf name matching
+#include "dfs_grep.h" // for grepf content search
+#include "dfs_meta.h" // for the metadata journal behind listings and archives
+#include "dfs_pack.h" // for packing small files into segments
+
+#define PORT 4307 // S1 server port
+#define MAX_CLIENTS 5 // Maximum number of clients
+#define BUFFER_SIZE 1024 // Buffer size for file transfer
+#define MAX_PATH_LEN 1024 // Maximum path length
+
+// Server ports for S2, S3, S4
+#define S2_PORT 4308
+#define S3_PORT 4309
+#define S4_PORT 4310
+
+// Server that stores each file type, indexed by DFS_TYPE_*
+const int type_ports[DFS_TYPE_COUNT] = { PORT, S2_PORT, S3_PORT, S4_PORT };
+
+// Upload durability policies (selected with the DFS_FSYNC environment variable)
+#define FSYNC_NONE 0 // Rename into place without syncing (fastest, not crash safe)
+#define FSYNC_ALWAYS 1 // fdatasync every upload and fsync its directory
+#define FSYNC_GROUP 2 // Batch syncs of concurrent uploads into group-commit windows
+#define GROUP_COMMIT_WINDOW_US 2000 // Default group-commit window (DFS_GROUP_COMMIT_US)
+
+// Group-commit state shared by all forked children.
+// Uploads join the open batch; one of them becomes leader, waits out the window,
+// closes the batch and issues a single syncfs() that covers every member.
+struct group_commit
+{
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    unsigned long open_batch; // Batch new uploads join
+    unsigned long synced_batch; // Highest batch made durable
+    unsigned long failed_batch; // Highest batch whose sync failed
+    int leader_active; // A leader is currently waiting or syncing
+};
+
+// Hot-file cache for downloads proxied from S2-S4
+#define CACHE_PARENT_DIR "/dev/shm" // Cached bodies live on tmpfs (memory)
+#define CACHE_DIR_NAME "dfs_s1_cache" // Each S1 process caches in CACHE_PARENT_DIR/<name>.<uid>.<pid>
+#define CACHE_SLOTS 1024 // Maximum number of cached files
+#define CACHE_BYTES_MB 64 // Default cache budget (DFS_CACHE_MB, 0 disables)
+#define CACHE_MAX_FILE (4 * 1024 * 1024) // Larger files bypass the cache
+#define CACHE_TTL_SEC 60 // Entries are refetched after this age even if the backend did not change
+
+struct cache_entry
+{
+    char key[MAX_PATH_LEN]; // Normalized ~S1 path
+    unsigned long id; // Names the body file in cache_dir
+    off_t size;
+    uint64_t backend_generation; // Backend generation read before the body was fetched
+    time_t filled_at;
+    unsigned long last_used; // LRU clock value of the last hit
+    int valid;
+};
+
+// Cache index and counters shared by all forked children
+struct file_cache
+{
+    pthread_mutex_t lock;
+    unsigned long clock; // LRU clock, bumped on every access
+    unsigned long next_id;
+    unsigned long invalidations; // Fills that started before an invalidation are dropped
+    off_t used_bytes;
+    off_t budget_bytes;
+    unsigned long hits, misses;
+    unsigned long long hit_bytes, miss_bytes;
+    struct cache_entry entries[CACHE_SLOTS];
+};
+
+// Cached .c tar archive, rebuilt only after an upload or removal in S1
+#define TAR_CACHE_PATH "/tmp/dfs_s1_cfiles.tar"
+
+// Lookup filters of the paths stored on S2-S4 (Bloom filters), so downloads of paths that
+// do not exist are answered without a round trip to the backend. Files dropped into a
+// backend's root by hand reach its filter only at the next rebuild, so a miss is final only
+// while the backend's watcher runs and its generation (DFS_GENERATION_FILE) is still the
+// one the filter was built at; otherwise the download goes to the backend and the filter
+// is rebuilt.
+#define FILTER_MB 4 // Size of each filter (DFS_FILTER_MB, 0 disables); every backend has two
+#define FILTER_HASHES 7 // Bits set per path; about 1% false positives at 10 bits per path
+#define FILTER_REFRESH_SEC 300 // Also rebuilt after this age, to drop the bits of removed files
+#define FILTER_STALL_SEC 60 // A rebuild that has not finished by then may be taken over
+
+// One backend's filter: lookups use the current buffer while the other one is rebuilt
+struct path_filter
+{
+    int current;
+    int ready; // The current buffer holds a whole inventory
+    int stale; // The backend's generation moved on since the current buffer was built
+    uint64_t built_generation; // Backend generation the current buffer's inventory was taken at
+    time_t built_at;
+    time_t rebuild_started; // 0 when no rebuild is running
+    unsigned long lookups, definite_misses, stale_misses;
+};
+
+// Filters shared by all forked children; the bit buffers follow in the same mapping
+struct path_filters
+{
+    uint64_t bit_count; // Bits per buffer, a power of two
+    struct path_filter filters[DFS_TYPE_COUNT];
+};
+
+// Lines S1 forwards to one backend in a batch request, and where each result belongs
+// in the status vector returned to the client
+struct batch_list
+{
+    char *text;
+    size_t len;
+    size_t cap;
+    size_t *slots;
+    size_t count;
+};
+
+int fsync_policy = FSYNC_GROUP;
+long group_commit_window_us = GROUP_COMMIT_WINDOW_US;
+struct group_commit *commit_state = NULL;
+struct file_cache *file_cache = NULL;
+char cache_dir[MAX_PATH_LEN]; // This server's own cache directory, so instances never share one
+struct path_filters *path_filters = NULL;
+struct dfs_meta file_meta; // Metadata table of the .c files in S1
+struct dfs_pack file_pack; // Segments small .c files are packed into
+// What the shared helpers in dfs_core need to know about this server
+struct dfs_store file_store = { "S1", DFS_TYPE_C, "C", ".c", TAR_CACHE_PATH, NULL, &file_meta, &file_pack,
+                                NULL, NULL, NULL };
+
+// Function prototypes
+void handle_client(int client_sock);
+int upload_file(int client_sock, char *filename, char *dest_path);
+int upload_packed(int client_sock, const char *full_path, off_t file_size);
+int download_file(int client_sock, char *filename);
+int read_lines(int client_sock, char *filename, char *start, char *count);
+int relay_request(int client_sock, int type, char *command);
+int zip_request(int client_sock, char *cmd, char *filename, char *member);
+int pdf_request(int client_sock, char *cmd, char *filename, char *range);
+int remove_file(int client_sock, char *filename);
+int copy_move_file(int client_sock, char *src, char *dst, int move);
+int remove_batch(int client_sock);
+int upload_batch(int client_sock, char *dest_path);
+int batch_append(struct batch_list *list, const char *path, const char *name, size_t slot);
+int forward_batch(int port, char *command, struct batch_list *list, char *status);
+int download_tar(int client_sock, char *filetype, char *codec, int level);
+int display_filenames(int client_sock, char *pathname);
+int find_files(int client_sock, char *pattern, char *pathname);
+int grep_files(int client_sock, char *pattern, char *pathname, int regex);
+int send_to_server(int port, char *command, char *response);
+void init_durability(void);
+int sync_file_data(int fd);
+int sync_directory(const char *dir_path);
+int commit_directory(const char *dir_path, int fd);
+int group_commit(int fd);
+void init_file_cache(void);
+int remove_cache_dir(const char *path);
+void sweep_cache_dirs(void);
+void cache_key(const char *path, char *key);
+uint64_t cache_backend_generation(int type);
+int cache_serve(int client_sock, const char *key, int type);
+int cache_begin_fill(off_t size, uint64_t backend_generation, char *fill_path, unsigned long *generation);
+void cache_publish(const char *key, const char *fill_path, off_t size, unsigned long generation, uint64_t backend_generation);
+void cache_invalidate(const char *key);
+int cache_stats(int client_sock);
+void init_path_filters(void);
+void filter_add(const char *path);
+int filter_may_contain(int type, const char *path);
+void filter_refresh(int type);
+int report_stats(int client_sock, int prometheus);
+int report_trace(int client_sock, uint64_t request_id);
+int download_tar_all(int client_sock, char *pathname);
+int open_server_connection(int port);
+int relay_stream(int from_fd, int to_fd, off_t length);
+void error(const char *msg);
+
+// Main function initializes the server and listens for client connections.
+// It creates a child process for each client to handle requests concurrently.
+int main() 
+{
+    // Create socket
+    int sockfd, newsockfd;
+    socklen_t clilen;
+    struct sockaddr_in serv_addr, cli_addr;
+    pid_t pid;
+
+    // Set up upload durability and the download caches before forking any children
+    // and before opening the listener, so the watcher process never holds it
+    init_durability();
+    init_file_cache();
+    init_path_filters();
+    dfs_tar_cache_init(&file_store);
+    dfs_store_open(&file_store);
+    stats_init("S1");
+    trace_init("S1", 1);
+
+    // Create socket
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) 
+    {
+        error("ERROR opening socket");
+    }
+
+    // Accepted sockets inherit the buffer sizes and TCP_NODELAY from the listener
+    net_tuning_init();
+    net_tune_socket(sockfd);
+
+    // Allow an immediate restart while old connections are still in TIME_WAIT
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Initialize socket structure
+    bzero((char *) &serv_addr, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = INADDR_ANY;
+    serv_addr.sin_port = htons(PORT);
+
+    // Bind the host address
+    if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
+    {
+        error("ERROR on binding");
+    }
+
+    // Start listening for the clients
+    listen(sockfd, MAX_CLIENTS);
+    clilen = sizeof(cli_addr);
+
+    // Print server start message
+    printf("S1 (MAIN SERVER) started on port %d\n", PORT);
+    char tuning[128];
+    net_describe(tuning, sizeof(tuning));
+    printf("Transfer tuning: %s\n", tuning);
+
+    // Main loop to accept clients
+    while (1) 
+    {
+        // Accept connection from client
+        newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
+        if (newsockfd < 0) {
+            error("ERROR on accept");
+        }
+        
+        // Children start from a current table; a snapshot is written once the journal is long
+        dfs_meta_sync(&file_meta);
+        dfs_meta_maybe_compact(&file_meta);
+        dfs_pack_maybe_compact(&file_pack);
+
+        // Create child process to handle client
+        pid = fork();
+        if (pid < 0) 
+        {
+            error("ERROR on fork");
+        }
+
+        if (pid == 0) 
+        {
+            // Child process
+            close(sockfd);
+            handle_client(newsockfd);
+            close(newsockfd);
+            exit(0);
+        } 
+
+        else 
+        {
+            // Parent process
+            close(newsockfd);
+            // Clean up zombie processes
+            while (waitpid(-1, NULL, WNOHANG) > 0);
+        }
+    }
+
+    close(sockfd); // Close the socket
+    return 0;
+}
+
+// Function to handle client requests
+// Parses the command received from the client and calls the appropriate function.
+void handle_client(int client_sock) 
+{
+    char buffer[BUFFER_SIZE]; // Buffer for commands
+    int n;
+    
+    // Read command from client
+    bzero(buffer, BUFFER_SIZE);
+    n = read(client_sock, buffer, BUFFER_SIZE - 1);
+    if (n < 0) 
+    {
+        error("ERROR reading from socket");
+    }
+    
+    // Take the request id the client put in front of the command
+    uint64_t trace_start_us = trace_now_us();
+    char *request = trace_begin_request(buffer);
+    
+    printf("Received command: %s\n", request);
+    
+    // Parse command
+    char *cmd = strtok(request, " ");
+    if (cmd == NULL) 
+    {
+        write(client_sock, "ERROR: Invalid command", 22);
+        return;
+    }
+    trace_span("parse", trace_start_us, trace_now_us());
+    
+    // Time the whole request, including any work forwarded to S2-S4
+    uint64_t start_us = stats_now_us();
+    int op = stats_op_from_command(cmd);
+    int rc = -1;
+    
+    if (strcmp(cmd, "uploadf") == 0) 
+    {
+        // Handle file upload
+        char *filename = strtok(NULL, " ");
+        char *dest_path = strtok(NULL, " ");
+        if (filename == NULL || dest_path == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid uploadf command format", 36);
+            return;
+        }
+        rc = upload_file(client_sock, filename, dest_path);
+    } 
+    else if (strcmp(cmd, "downlf") == 0) 
+    {
+        // Handle file download
+        char *filename = strtok(NULL, " ");
+        if (filename == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid downlf command format", 34);
+            return;
+        }
+        rc = download_file(client_sock, filename);
+    } 
+    else if (strcmp(cmd, "readlines") == 0) 
+    {
+        // Handle a request for a range of lines of a TXT file
+        char *filename = strtok(NULL, " ");
+        char *start = strtok(NULL, " ");
+        char *count = strtok(NULL, " ");
+        if (filename == NULL || start == NULL || count == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid readlines command format", 39);
+            return;
+        }
+        rc = read_lines(client_sock, filename, start, count);
+    } 
+    else if (strcmp(cmd, "zipls") == 0 || strcmp(cmd, "zipget") == 0) 
+    {
+        // Handle member listing and extraction for a ZIP archive; a member name may contain spaces
+        char *filename = strtok(NULL, " ");
+        char *member = strtok(NULL, "");
+        if (filename == NULL || (strcmp(cmd, "zipget") == 0 && member == NULL)) 
+        {
+            write(client_sock, "ERROR: Invalid zipls/zipget command format", 42);
+            return;
+        }
+        rc = zip_request(client_sock, cmd, filename, member);
+    } 
+    else if (strcmp(cmd, "pdfinfo") == 0 || strcmp(cmd, "pdfrange") == 0) 
+    {
+        // Handle metadata and byte range requests for a PDF; the range is "<offset> <length>" or "first"
+        char *filename = strtok(NULL, " ");
+        char *range = strtok(NULL, "");
+        if (filename == NULL || (strcmp(cmd, "pdfrange") == 0 && range == NULL)) 
+        {
+            write(client_sock, "ERROR: Invalid pdfinfo/pdfrange command format", 46);
+            return;
+        }
+        rc = pdf_request(client_sock, cmd, filename, range);
+    } 
+    else if (strcmp(cmd, "removef") == 0) 
+    {
+        // Handle file removal
+        char *filename = strtok(NULL, " ");
+        if (filename == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid removef command format", 35);
+            return;
+        }
+        rc = remove_file(client_sock, filename);
+    } 
+    else if (strcmp(cmd, "mremovef") == 0) 
+    {
+        // Handle removal of many files; the list follows as one frame
+        rc = remove_batch(client_sock);
+    } 
+    else if (strcmp(cmd, "muploadf") == 0) 
+    {
+        // Handle upload of many files into one directory
+        char *dest_path = strtok(NULL, " ");
+        if (dest_path == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid muploadf command format", 38);
+            return;
+        }
+        rc = upload_batch(client_sock, dest_path);
+    } 
+    else if (strcmp(cmd, "copyf") == 0 || strcmp(cmd, "movef") == 0) 
+    {
+        // Handle server-side copy or move; the data never passes through the client
+        char *src = strtok(NULL, " ");
+        char *dst = strtok(NULL, " ");
+        if (src == NULL || dst == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid copyf/movef command format", 41);
+            return;
+        }
+        rc = copy_move_file(client_sock, src, dst, strcmp(cmd, "movef") == 0);
+    } 
+    else if (strcmp(cmd, "downltar") == 0) 
+    {
+        // Handle tar file download
+        char *filetype = strtok(NULL, " ");
+        if (filetype == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid downltar command format", 36);
+            return;
+        }
+        if (strcmp(filetype, "all") == 0) 
+        {
+            // Every file type below a path, assembled from all servers
+            char *pathname = strtok(NULL, " ");
+            rc = download_tar_all(client_sock, (pathname != NULL) ? pathname : "~S1");
+        } 
+        else 
+        {
+            char *codec = strtok(NULL, " "); // Optional: gzip or zstd
+            char *level = strtok(NULL, " "); // Optional: compression level
+            rc = download_tar(client_sock, filetype, codec, (level != NULL) ? atoi(level) : 0);
+        }
+    } 
+    else if (strcmp(cmd, "dispfnames") == 0) 
+    {
+        // Handle display filenames request
+        char *pathname = strtok(NULL, " ");
+        if (pathname == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid dispfnames command format", 38);
+            return;
+        }
+        rc = display_filenames(client_sock, pathname);
+    } 
+    else if (strcmp(cmd, "findf") == 0) 
+    {
+        // Handle file name search on every server
+        char *pattern = strtok(NULL, " ");
+        char *pathname = strtok(NULL, " "); // Optional: directory to search below
+        if (pattern == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid findf command format", 35);
+            return;
+        }
+        rc = find_files(client_sock, pattern, (pathname != NULL) ? pathname : "~S1");
+    } 
+    else if (strcmp(cmd, "grepf") == 0) 
+    {
+        // Handle content search of the .c and .txt files
+        char *pattern = strtok(NULL, " ");
+        int regex = (pattern != NULL && strcmp(pattern, "-E") == 0);
+        if (regex) 
+        {
+            pattern = strtok(NULL, " ");
+        }
+        char *pathname = strtok(NULL, " "); // Optional: directory to search below
+        if (pattern == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid grepf command format", 35);
+            return;
+        }
+        rc = grep_files(client_sock, pattern, (pathname != NULL) ? pathname : "~S1", regex);
+    } 
+    else if (strcmp(cmd, "cachestats") == 0) 
+    {
+        // Report hot-file cache hit rates
+        rc = cache_stats(client_sock);
+    } 
+    else if (strcmp(cmd, "stats") == 0) 
+    {
+        // Report latency histograms for S1 and every backend
+        char *format = strtok(NULL, " ");
+        rc = report_stats(client_sock, format != NULL && strcmp(format, "prom") == 0);
+    } 
+    else if (strcmp(cmd, "trace") == 0) 
+    {
+        // Dump recorded spans of all servers as Chrome trace JSON, optionally for one request
+        char *request_id = strtok(NULL, " ");
+        rc = report_trace(client_sock, (request_id != NULL) ? strtoull(request_id, NULL, 16) : 0);
+    } 
+    else 
+    {
+        // Handle unknown command
+        write(client_sock, "ERROR: Unknown command", 21);
+    }
+    
+    stats_record(op, stats_now_us() - start_us, rc == 0);
+    trace_span(cmd, trace_start_us, trace_now_us());
+}
+
+// Function to upload a file to S1 or forward it to the appropriate server
+// Receives the file from the client and determines its type based on the extension.
+int upload_file(int client_sock, char *filename, char *dest_path) 
+{
+    // First, receive the file from client
+    ssize_t n;
+    
+    // Send acknowledgment to client to start sending file
+    write(client_sock, "READY", 5);
+    
+    // Get file size; it may arrive split across several segments
+    off_t file_size;
+    if (net_read_full(client_sock, &file_size, sizeof(off_t)) < 0 || file_size < 0) 
+    {
+        write(client_sock, "ERROR: Failed to read file size", 31);
+        return -1;
+    }
+    
+    // Determine file type
+    int type = dfs_file_type(filename);
+    if (type == DFS_TYPE_NONE) 
+    {
+        write(client_sock, "ERROR: File has no extension", 27);
+        return -1;
+    }
+    
+    // Create destination path in S1
+    char s1_path[MAX_PATH_LEN];
+    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), dest_path + 3); // +3 to skip "~S1"
+    
+    // Construct full file path
+    char *base_name = basename(filename);
+    char full_path[MAX_PATH_LEN];
+    snprintf(full_path, MAX_PATH_LEN, "%s/%s", s1_path, base_name);
+    
+    // Small .c files go into a pack segment, with no directory or staged file
+    if (type == DFS_TYPE_C && dfs_pack_accepts(&file_pack, file_size)) 
+    {
+        return upload_packed(client_sock, full_path, file_size);
+    }
+    
+    // Create directory tree if needed
+    if (create_directory_tree(s1_path) < 0) 
+    {
+        write(client_sock, "ERROR: Failed to create directory", 32);
+        return -1;
+    }
+    
+    // Determine which server should handle this file (.c files stay in S1)
+    if (type < 0) 
+    {
+        write(client_sock, "ERROR: Unsupported file type", 27);
+        return -1;
+    }
+    int target_port = type_ports[type];
+    
+    // Stage the upload in a hidden temporary file next to its destination.
+    // Readers only ever see the old file or the complete new one after rename().
+    char temp_path[MAX_PATH_LEN];
+    snprintf(temp_path, MAX_PATH_LEN, "%s/.%s.%d.tmp", s1_path, base_name, (int)getpid());
+    
+    // Open file for writing
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) 
+    {
+        write(client_sock, "ERROR: Failed to create file", 27);
+        return -1;
+    }
+    
+    // Reserve the announced size up front so the file is laid out contiguously
+    // and a full disk is reported before any data is transferred
+    if (file_size > 0 && fallocate(fd, 0, 0, file_size) < 0 && errno != EOPNOTSUPP) 
+    {
+        close(fd);
+        unlink(temp_path);
+        write(client_sock, "ERROR: Not enough space for file", 32);
+        return -1;
+    }
+    
+    // Receive file data
+    size_t chunk = net_io_buffer();
+    char *buffer = malloc(chunk);
+    if (buffer == NULL) 
+    {
+        close(fd);
+        unlink(temp_path);
+        write(client_sock, "ERROR: Out of memory", 20);
+        return -1;
+    }
+    off_t remaining = file_size;
+    while (remaining > 0) 
+    {
+        n = net_read_some(client_sock, buffer, ((size_t)remaining < chunk) ? (size_t)remaining : chunk);
+        if (n <= 0 || write(fd, buffer, n) != n) 
+        {
+            free(buffer);
+            close(fd);
+            unlink(temp_path); // Never leave a truncated file behind
+            write(client_sock, "ERROR: File transfer failed", 27);
+            return -1;
+        }
+        remaining -= n;
+    }
+    free(buffer);
+    stats_add_bytes(file_size, 0);
+    
+    // Make the data durable before it becomes visible under its final name
+    if (fsync_policy != FSYNC_NONE && sync_file_data(fd) < 0) 
+    {
+        close(fd);
+        unlink(temp_path);
+        write(client_sock, "ERROR: Failed to sync file", 26);
+        return -1;
+    }
+    
+    if (target_port == PORT) 
+    {
+        // File stays in S1
+        if (rename(temp_path, full_path) < 0) 
+        {
+            close(fd);
+            unlink(temp_path);
+            write(client_sock, "ERROR: Failed to commit file", 28);
+            return -1;
+        }
+        dfs_meta_add(&file_meta, full_path); // Before the commit, so group commit covers the record too
+        if (fsync_policy != FSYNC_NONE && commit_directory(s1_path, fd) < 0) 
+        {
+            close(fd);
+            write(client_sock, "ERROR: Failed to sync directory", 31);
+            return -1;
+        }
+        close(fd);
+        dfs_tar_cache_invalidate(&file_store);
+        write(client_sock, "SUCCESS: File uploaded to S1", 27);
+        dfs_meta_hash(&file_meta, full_path);
+        return 0;
+    }
+    
+    // Forward file to appropriate server, which renames the staged file into its own tree
+    char command[MAX_PATH_LEN * 3];
+    snprintf(command, sizeof(command), "uploadf %s %s %s", temp_path, dest_path, base_name);
+    
+    char response[BUFFER_SIZE];
+    if (send_to_server(target_port, command, response) < 0) 
+    {
+        close(fd);
+        unlink(temp_path);
+        write(client_sock, "ERROR: Failed to forward file to target server", 44);
+        return -1;
+    }
+    
+    // Remove the staged file if the target server did not take it
+    unlink(temp_path);
+    
+    // Any cached copy of the old contents is now stale
+    char uploaded[MAX_PATH_LEN * 2];
+    char key[MAX_PATH_LEN];
+    snprintf(uploaded, sizeof(uploaded), "%s/%s", dest_path, base_name);
+    cache_key(uploaded, key);
+    cache_invalidate(key);
+    if (strncmp(response, "SUCCESS", 7) == 0) 
+    {
+        filter_add(key);
+    }
+    
+    if (fsync_policy != FSYNC_NONE && strncmp(response, "SUCCESS", 7) == 0 && commit_directory(NULL, fd) < 0) 
+    {
+        close(fd);
+        write(client_sock, "ERROR: Failed to sync directory", 31);
+        return -1;
+    }
+    close(fd);
+    
+    write(client_sock, response, strlen(response));
+    return (strncmp(response, "SUCCESS", 7) == 0) ? 0 : -1;
+}
+
+// Function to receive a small .c upload into memory and pack it into a segment
+// The segment is synced under the same policy as a file of its own would be.
+int upload_packed(int client_sock, const char *full_path, off_t file_size) 
+{
+    char *data = malloc(file_size ? file_size : 1);
+    if (data == NULL) 
+    {
+        write(client_sock, "ERROR: Out of memory", 20);
+        return -1;
+    }
+    if (net_read_full(client_sock, data, file_size) < 0) 
+    {
+        free(data);
+        write(client_sock, "ERROR: File transfer failed", 27);
+        return -1;
+    }
+    stats_add_bytes(file_size, 0);
+    
+    int rc = dfs_pack_store(&file_pack, full_path, data, file_size, 
+                            (fsync_policy != FSYNC_NONE) ? sync_file_data : NULL);
+    free(data);
+    if (rc < 0) 
+    {
+        write(client_sock, "ERROR: Failed to pack file", 26);
+        return -1;
+    }
+    dfs_tar_cache_invalidate(&file_store);
+    write(client_sock, "SUCCESS: File uploaded to S1", 27);
+    return 0;
+}
+
+// Function to download a file from S1 or request it from the appropriate server
+// Checks if the file exists in S1 and sends it to the client, or forwards the request to another server.
+int download_file(int client_sock, char *filename) 
+{
+    // Check if file exists in S1
+    char s1_path[MAX_PATH_LEN];
+    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+    
+    struct stat st;
+    struct dfs_meta_entry packed;
+    int local = (stat(s1_path, &st) == 0);
+    int fd = -1;
+    if (!local && (fd = dfs_pack_open_file(&file_pack, s1_path, &packed)) >= 0) 
+    {
+        st.st_size = packed.size; // Packed files are sent from their segment
+        local = 1;
+    }
+    if (local) 
+    {
+        // File exists in S1 - send it directly
+        if (fd < 0) 
+        {
+            fd = open(s1_path, O_RDONLY);
+        }
+        if (fd < 0) 
+        {
+            write(client_sock, "ERROR: Failed to open file", 25);
+            return -1;
+        }
+        
+        // Send file size and data; corked so the header shares a segment with the body
+        net_cork(client_sock);
+        if (net_write_full(client_sock, &st.st_size, sizeof(off_t)) < 0) 
+        {
+            net_uncork(client_sock);
+            close(fd);
+            write(client_sock, "ERROR: Failed to send file size", 31);
+            return -1;
+        }
+        int copied = dfs_copy_fd(fd, client_sock, st.st_size, net_io_buffer());
+        net_uncork(client_sock);
+        if (copied < 0) 
+        {
+            close(fd);
+            write(client_sock, "ERROR: File transfer failed", 27);
+            return -1;
+        }
+        close(fd);
+        stats_add_bytes(0, st.st_size);
+        return 0;
+    }
+    
+    // File not in S1 - forward to appropriate server
+    int type = dfs_file_type(filename);
+    if (type < 0 || type == DFS_TYPE_C) 
+    {
+        write(client_sock, "ERROR: Unsupported file type", 28);
+        return -1;
+    }
+    int target_port = type_ports[type];
+    
+    // Serve popular files from the hot-file cache without contacting the backend
+    char key[MAX_PATH_LEN];
+    cache_key(filename, key);
+    if (cache_serve(client_sock, key, type) == 0) 
+    {
+        return 0;
+    }
+    
+    // A path the backend's lookup filter has never seen is not stored there
+    if (!filter_may_contain(type, filename)) 
+    {
+        char reply[64];
+        snprintf(reply, sizeof(reply), "ERROR: %s file not found in S%d", (type == DFS_TYPE_PDF) ? "PDF" : 
+                 (type == DFS_TYPE_TXT) ? "TXT" : "ZIP", type + 1);
+        write(client_sock, reply, strlen(reply));
+        filter_refresh(type);
+        return -1;
+    }
+    
+    // Forward request to target server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "downlf %s", filename);
+    uint64_t forward_start_us = stats_now_us();
+    int sockfd;
+    struct sockaddr_in serv_addr;
+    struct hostent *server;
+
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) 
+    {
+        write(client_sock, "ERROR: Socket creation failed", 29);
+        return -1;
+    }
+    net_tune_socket(sockfd);
+
+    uint64_t span_start_us = trace_now_us();
+    server = gethostbyname("localhost");
+    if (server == NULL) 
+    {
+        close(sockfd);
+        write(client_sock, "ERROR: Host resolution failed", 29);
+        return -1;
+    }
+    trace_span("lookup", span_start_us, trace_now_us());
+
+    bzero((char *)&serv_addr, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
+    serv_addr.sin_port = htons(target_port);
+
+    span_start_us = trace_now_us();
+    if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) 
+    {
+        close(sockfd);
+        write(client_sock, "ERROR: Connection to server failed", 34);
+        return -1;
+    }
+    trace_span("connect", span_start_us, trace_now_us());
+
+    // Taken before the backend opens the file, so a later edit moves it past the cached copy
+    uint64_t backend_generation = cache_backend_generation(type);
+
+    // Send command to target server
+    span_start_us = trace_now_us();
+    if (trace_send_command(sockfd, command) < 0) 
+    {
+        close(sockfd);
+        write(client_sock, "ERROR: Command send failed", 26);
+        return -1;
+    }
+
+    // Read file size from target server
+    off_t filesize;
+    if (net_read_reply(sockfd, &filesize, sizeof(off_t)) < 0) 
+    {
+        close(sockfd);
+        write(client_sock, "ERROR: Failed to read file size", 31);
+        return -1;
+    }
+    trace_span("first_byte", span_start_us, trace_now_us());
+    span_start_us = trace_now_us();
+
+    // Send file size to client, corked until the first body bytes join it
+    net_cork(client_sock);
+    if (net_write_full(client_sock, &filesize, sizeof(off_t)) < 0) 
+    {
+        net_uncork(client_sock);
+        close(sockfd);
+        return -1;
+    }
+
+    // Copy small and medium files into the cache while relaying them.
+    // Error replies from the backend start with "ERROR" in place of a size.
+    char fill_path[MAX_PATH_LEN];
+    unsigned long generation = 0;
+    int fill_fd = -1;
+    if (memcmp(&filesize, "ERROR", 5) != 0) 
+    {
+        fill_fd = cache_begin_fill(filesize, backend_generation, fill_path, &generation);
+    }
+
+    // Relay file content from target server to client
+    off_t remaining = filesize;
+    size_t chunk = net_io_buffer();
+    char *buffer = malloc(chunk);
+    while (buffer != NULL && remaining > 0) 
+    {
+        ssize_t bytes_read = net_read_some(sockfd, buffer, ((size_t)remaining < chunk) ? (size_t)remaining : chunk);
+        if (bytes_read <= 0 || net_write_full(client_sock, buffer, bytes_read) < 0) break;
+        if (fill_fd >= 0 && write(fill_fd, buffer, bytes_read) != bytes_read) 
+        {
+            close(fill_fd);
+            unlink(fill_path);
+            fill_fd = -1;
+        }
+        remaining -= bytes_read;
+    }
+    free(buffer);
+    net_uncork(client_sock);
+
+    if (fill_fd >= 0) 
+    {
+        close(fill_fd);
+        if (remaining == 0) 
+        {
+            cache_publish(key, fill_path, filesize, generation, backend_generation);
+        } 
+        else 
+        {
+            unlink(fill_path);
+        }
+    }
+
+    close(sockfd);
+    trace_span("last_byte", span_start_us, trace_now_us());
+    int ok = (memcmp(&filesize, "ERROR", 5) != 0 && remaining == 0);
+    stats_record(STAT_FORWARD, stats_now_us() - forward_start_us, ok);
+    if (ok) 
+    {
+        stats_add_bytes(0, filesize);
+    }
+    
+    // The filter is built, or rebuilt once old, after the client has its answer
+    filter_refresh(type);
+    return ok ? 0 : -1;
+}
+
+// Function to fetch lines start..start+count-1 of a TXT file from S3
+// S3 finds the range with its line offset index; the reply has the same framing as a
+// download (length, then bytes) and is relayed to the client without copying it through S1.
+int read_lines(int client_sock, char *filename, char *start, char *count) 
+{
+    if (strncmp(filename, "~S1/", 4) != 0 || dfs_file_type(filename) != DFS_TYPE_TXT) 
+    {
+        write(client_sock, "ERROR: readlines only reads ~S1/ TXT files", 42);
+        return -1;
+    }
+    if (strtoull(start, NULL, 10) == 0 || strtoull(count, NULL, 10) == 0) 
+    {
+        write(client_sock, "ERROR: Line numbers start at 1", 30);
+        return -1;
+    }
+    
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "readlines %s %s %s", filename, start, count);
+    uint64_t forward_start_us = stats_now_us();
+    int sockfd = open_server_connection(type_ports[DFS_TYPE_TXT]);
+    if (sockfd < 0) 
+    {
+        stats_record(STAT_FORWARD, stats_now_us() - forward_start_us, 0);
+        write(client_sock, "ERROR: Connection to server failed", 34);
+        return -1;
+    }
+    
+    uint64_t span_start_us = trace_now_us();
+    off_t length;
+    if (trace_send_command(sockfd, command) < 0 || net_read_reply(sockfd, &length, sizeof(off_t)) < 0) 
+    {
+        close(sockfd);
+        stats_record(STAT_FORWARD, stats_now_us() - forward_start_us, 0);
+        write(client_sock, "ERROR: Failed to read line range", 32);
+        return -1;
+    }
+    trace_span("first_byte", span_start_us, trace_now_us());
+    span_start_us = trace_now_us();
+    
+    // Relay the length (or the start of an error message) and the rest of the reply
+    net_cork(client_sock);
+    int ok = (net_write_full(client_sock, &length, sizeof(off_t)) == 0);
+    ok = ok && relay_stream(sockfd, client_sock, length) == 0 && memcmp(&length, "ERROR", 5) != 0;
+    net_uncork(client_sock);
+    
+    close(sockfd);
+    trace_span("last_byte", span_start_us, trace_now_us());
+    stats_record(STAT_FORWARD, stats_now_us() - forward_start_us, ok);
+    if (ok) 
+    {
+        stats_add_bytes(0, length);
+    }
+    return ok ? 0 : -1;
+}
+
+// Function to send a command to the server for type and relay its answer to the client
+// The answer is relayed until the server closes; its first bytes tell an error message from
+// a reply. Used for requests whose reply S1 does not need to understand.
+int relay_request(int client_sock, int type, char *command) 
+{
+    uint64_t forward_start_us = stats_now_us();
+    int sockfd = open_server_connection(type_ports[type]);
+    if (sockfd < 0 || trace_send_command(sockfd, command) < 0) 
+    {
+        if (sockfd >= 0) 
+        {
+            close(sockfd);
+        }
+        stats_record(STAT_FORWARD, stats_now_us() - forward_start_us, 0);
+        write(client_sock, "ERROR: Connection to server failed", 34);
+        return -1;
+    }
+    
+    uint64_t span_start_us = trace_now_us();
+    char first[BUFFER_SIZE];
+    ssize_t n = (net_wait_reply(sockfd) == 0) ? net_read_some(sockfd, first, sizeof(first)) : -1;
+    int ok = (n > 0 && !(n >= 5 && memcmp(first, "ERROR", 5) == 0));
+    trace_span("first_byte", span_start_us, trace_now_us());
+    span_start_us = trace_now_us();
+    if (n > 0 && net_write_full(client_sock, first, n) == 0) 
+    {
+        relay_stream(sockfd, client_sock, (off_t)1 << 40); // Until the server closes
+    }
+    close(sockfd);
+    trace_span("last_byte", span_start_us, trace_now_us());
+    stats_record(STAT_FORWARD, stats_now_us() - forward_start_us, ok);
+    return ok ? 0 : -1;
+}
+
+// Function to forward a zipls or zipget request to S4 and relay its answer
+// S4 reads members straight out of its archives using a central directory index, so only
+// the listing or the one member crosses the network.
+int zip_request(int client_sock, char *cmd, char *filename, char *member) 
+{
+    if (strncmp(filename, "~S1/", 4) != 0 || dfs_file_type(filename) != DFS_TYPE_ZIP) 
+    {
+        write(client_sock, "ERROR: zipls/zipget only read ~S1/ ZIP files", 44);
+        return -1;
+    }
+    
+    char command[BUFFER_SIZE];
+    if (member != NULL) 
+    {
+        snprintf(command, BUFFER_SIZE, "%s %s %s", cmd, filename, member);
+    } 
+    else 
+    {
+        snprintf(command, BUFFER_SIZE, "%s %s", cmd, filename);
+    }
+    return relay_request(client_sock, DFS_TYPE_ZIP, command);
+}
+
+// Function to forward a pdfinfo or pdfrange request to S2 and relay its answer
+// S2 answers pdfinfo from its PDF index and sends only the requested bytes for pdfrange,
+// so a viewer can show the first page of a linearized PDF before fetching the rest.
+int pdf_request(int client_sock, char *cmd, char *filename, char *range) 
+{
+    if (strncmp(filename, "~S1/", 4) != 0 || dfs_file_type(filename) != DFS_TYPE_PDF) 
+    {
+        write(client_sock, "ERROR: pdfinfo/pdfrange only read ~S1/ PDF files", 48);
+        return -1;
+    }
+    
+    char command[BUFFER_SIZE];
+    if (range != NULL) 
+    {
+        snprintf(command, BUFFER_SIZE, "%s %s %s", cmd, filename, range);
+    } 
+    else 
+    {
+        snprintf(command, BUFFER_SIZE, "%s %s", cmd, filename);
+    }
+    return relay_request(client_sock, DFS_TYPE_PDF, command);
+}
+
+// Function to remove a file from S1 or request its removal from another server
+// Determines the file's location based on its extension and sends the removal request.
+int remove_file(int client_sock, char *filename) 
+{
+    // Check if file exists in S1
+    char s1_path[MAX_PATH_LEN];
+    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+    
+    if (unlink(s1_path) == 0) 
+    {
+        dfs_meta_remove(&file_meta, s1_path);
+        dfs_tar_cache_invalidate(&file_store);
+        write(client_sock, "SUCCESS: File deleted from S1", 28);
+        return 0;
+    }
+    if (dfs_pack_remove(&file_pack, s1_path) == 0) 
+    {
+        dfs_tar_cache_invalidate(&file_store);
+        write(client_sock, "SUCCESS: File deleted from S1", 28);
+        return 0;
+    }
+    
+    // File not in S1 - check other servers based on extension
+    int type = dfs_file_type(filename);
+    if (type == DFS_TYPE_NONE) 
+    {
+        write(client_sock, "ERROR: File has no extension", 27);
+        return -1;
+    }
+    if (type < 0 || type == DFS_TYPE_C) 
+    {
+        write(client_sock, "ERROR: File not found", 21);
+        return -1;
+    }
+    int target_port = type_ports[type];
+    
+    // Drop any cached copy before the backend deletes the file
+    char key[MAX_PATH_LEN];
+    cache_key(filename, key);
+    cache_invalidate(key);
+    
+    // Request deletion from appropriate server
+    char command[MAX_PATH_LEN];
+    snprintf(command, MAX_PATH_LEN, "removef %s", filename);
+    
+    char response[BUFFER_SIZE];
+    if (send_to_server(target_port, command, response) < 0) 
+    {
+        write(client_sock, "ERROR: Failed to delete file from target server", 45);
+        return -1;
+    }
+    
+    write(client_sock, response, strlen(response));
+    return (strncmp(response, "SUCCESS", 7) == 0) ? 0 : -1;
+}
+
+// Function to remove many files with one request per server
+// The client sends the paths as one newline-separated frame after "READY". S1 deletes its own
+// files, groups the rest by owning backend into one "mremovef" each, and answers with a frame
+// holding one NET_BATCH_* character per path, in the order the paths were given.
+int remove_batch(int client_sock) 
+{
+    write(client_sock, "READY", 5);
+    
+    size_t list_len;
+    char *list = net_read_frame(client_sock, NET_FRAME_MAX, &list_len);
+    if (list == NULL || list_len == NET_FRAME_ERROR) 
+    {
+        free(list);
+        write(client_sock, "ERROR: Failed to read file list", 31);
+        return -1;
+    }
+    char **items;
+    size_t count = dfs_split_lines(list, list_len, &items);
+    char *status = malloc(count + 1);
+    if (items == NULL || status == NULL) 
+    {
+        free(items);
+        free(status);
+        free(list);
+        write(client_sock, "ERROR: Out of memory", 20);
+        return -1;
+    }
+    
+    struct batch_list forward[DFS_TYPE_COUNT];
+    memset(forward, 0, sizeof(forward));
+    int removed_local = 0;
+    for (size_t i = 0; i < count; i++) 
+    {
+        char *filename = items[i];
+        if (strncmp(filename, "~S1/", 4) != 0) 
+        {
+            status[i] = NET_BATCH_UNSUPPORTED;
+            continue;
+        }
+        
+        // Files in S1's own tree go first, as in remove_file
+        char s1_path[MAX_PATH_LEN];
+        snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+        if (unlink(s1_path) == 0) 
+        {
+            dfs_meta_remove(&file_meta, s1_path);
+            status[i] = NET_BATCH_OK;
+            removed_local = 1;
+            continue;
+        }
+        if (dfs_pack_remove(&file_pack, s1_path) == 0) 
+        {
+            status[i] = NET_BATCH_OK;
+            removed_local = 1;
+            continue;
+        }
+        
+        int type = dfs_file_type(filename);
+        if (type < 0) 
+        {
+            status[i] = NET_BATCH_UNSUPPORTED;
+            continue;
+        }
+        if (type == DFS_TYPE_C) 
+        {
+            status[i] = NET_BATCH_NOT_FOUND;
+            continue;
+        }
+        
+        char key[MAX_PATH_LEN];
+        cache_key(filename, key);
+        cache_invalidate(key);
+        status[i] = (batch_append(&forward[type], filename, NULL, i) == 0) ? NET_BATCH_OK : NET_BATCH_FAILED;
+    }
+    if (removed_local) 
+    {
+        dfs_tar_cache_invalidate(&file_store);
+    }
+    
+    // One request per backend instead of one per file
+    for (int t = DFS_TYPE_C + 1; t < DFS_TYPE_COUNT; t++) 
+    {
+        if (forward[t].count > 0) 
+        {
+            forward_batch(type_ports[t], "mremovef", &forward[t], status);
+        }
+        free(forward[t].text);
+        free(forward[t].slots);
+    }
+    
+    int rc = net_write_frame(client_sock, status, count);
+    for (size_t i = 0; i < count; i++) 
+    {
+        if (status[i] != NET_BATCH_OK) 
+        {
+            rc = -1;
+        }
+    }
+    free(status);
+    free(items);
+    free(list);
+    return rc;
+}
+
+// Function to upload many files into one directory in a single request
+// After "READY" the client sends the file names as one frame, then every file as a size
+// header and body. S1 stages all of them next to the destination, makes them durable with
+// one sync, keeps its .c files and hands each backend its files in one "muploadf" request.
+// The reply is a frame with one NET_BATCH_* character per file.
+int upload_batch(int client_sock, char *dest_path) 
+{
+    write(client_sock, "READY", 5);
+    
+    size_t list_len;
+    char *list = net_read_frame(client_sock, NET_FRAME_MAX, &list_len);
+    if (list == NULL || list_len == NET_FRAME_ERROR) 
+    {
+        free(list);
+        write(client_sock, "ERROR: Failed to read file list", 31);
+        return -1;
+    }
+    char **names;
+    size_t count = dfs_split_lines(list, list_len, &names);
+    char *status = malloc(count + 1);
+    char **temp_paths = calloc(count + 1, sizeof(char *));
+    if (names == NULL || status == NULL || temp_paths == NULL) 
+    {
+        free(names);
+        free(status);
+        free(temp_paths);
+        free(list);
+        write(client_sock, "ERROR: Out of memory", 20);
+        return -1;
+    }
+    
+    char s1_path[MAX_PATH_LEN];
+    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), dest_path + 3); // +3 to skip "~S1"
+    int dir_ok = (strncmp(dest_path, "~S1", 3) == 0 && create_directory_tree(s1_path) == 0);
+    
+    // Receive every file; files that cannot be stored are still read so the stream stays in step
+    int rc = 0;
+    off_t total = 0;
+    int null_fd = open("/dev/null", O_WRONLY);
+    for (size_t i = 0; i < count && rc == 0; i++) 
+    {
+        off_t file_size;
+        if (net_read_full(client_sock, &file_size, sizeof(off_t)) < 0 || file_size < 0) 
+        {
+            rc = -1;
+            break;
+        }
+        total += file_size;
+        
+        status[i] = NET_BATCH_OK;
+        if (strchr(names[i], '/') != NULL || dfs_file_type(names[i]) < 0) 
+        {
+            status[i] = NET_BATCH_UNSUPPORTED;
+        } 
+        else if (!dir_ok) 
+        {
+            status[i] = NET_BATCH_FAILED;
+        }
+        
+        int fd = -1;
+        if (status[i] == NET_BATCH_OK) 
+        {
+            char temp_path[MAX_PATH_LEN];
+            snprintf(temp_path, MAX_PATH_LEN, "%s/.%s.%d.%zu.tmp", s1_path, names[i], (int)getpid(), i);
+            fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (fd >= 0 && file_size > 0 && fallocate(fd, 0, 0, file_size) < 0 && errno != EOPNOTSUPP) 
+            {
+                close(fd);
+                unlink(temp_path);
+                fd = -1;
+            }
+            if (fd >= 0) 
+            {
+                temp_paths[i] = strdup(temp_path);
+            }
+            else 
+            {
+                status[i] = NET_BATCH_FAILED;
+            }
+        }
+        
+        if (net_recvfile(client_sock, (fd >= 0) ? fd : null_fd, file_size, 0) < 0) 
+        {
+            rc = -1;
+        }
+        if (fd >= 0 && fsync_policy == FSYNC_ALWAYS && sync_file_data(fd) < 0) 
+        {
+            status[i] = NET_BATCH_FAILED;
+        }
+        if (fd >= 0) 
+        {
+            close(fd);
+        }
+    }
+    if (null_fd >= 0) 
+    {
+        close(null_fd);
+    }
+    stats_add_bytes(total, 0);
+    
+    // One sync makes the data of the whole batch durable before any of it is renamed
+    int dir_fd = dir_ok ? open(s1_path, O_RDONLY | O_DIRECTORY) : -1;
+    if (rc == 0 && fsync_policy == FSYNC_GROUP && (dir_fd < 0 || group_commit(dir_fd) < 0)) 
+    {
+        rc = -1;
+    }
+    
+    struct batch_list forward[DFS_TYPE_COUNT];
+    memset(forward, 0, sizeof(forward));
+    int stored_local = 0;
+    for (size_t i = 0; i < count && rc == 0; i++) 
+    {
+        if (status[i] != NET_BATCH_OK) 
+        {
+            continue;
+        }
+        int type = dfs_file_type(names[i]);
+        if (type == DFS_TYPE_C) 
+        {
+            char full_path[MAX_PATH_LEN * 2];
+            snprintf(full_path, sizeof(full_path), "%s/%s", s1_path, names[i]);
+            int packed = dfs_pack_take(&file_pack, temp_paths[i], full_path, 
+                                       (fsync_policy == FSYNC_ALWAYS) ? sync_file_data : NULL);
+            if (packed > 0) 
+            {
+                stored_local = 1;
+            }
+            else if (packed == 0 && rename(temp_paths[i], full_path) == 0) 
+            {
+                dfs_meta_add(&file_meta, full_path);
+                stored_local = 1;
+            }
+            else 
+            {
+                status[i] = NET_BATCH_FAILED;
+            }
+            continue;
+        }
+        
+        // Any cached copy of the old contents is now stale
+        char uploaded[MAX_PATH_LEN * 2];
+        char key[MAX_PATH_LEN];
+        snprintf(uploaded, sizeof(uploaded), "%s/%s", dest_path, names[i]);
+        cache_key(uploaded, key);
+        cache_invalidate(key);
+        if (batch_append(&forward[type], temp_paths[i], names[i], i) < 0) 
+        {
+            status[i] = NET_BATCH_FAILED;
+        }
+    }
+    
+    // One request per backend; each renames the staged files it accepts into its tree
+    char command[MAX_PATH_LEN + 16];
+    snprintf(command, sizeof(command), "muploadf %s", dest_path);
+    int stored_remote = 0;
+    for (int t = DFS_TYPE_C + 1; t < DFS_TYPE_COUNT; t++) 
+    {
+        if (forward[t].count > 0 && forward_batch(type_ports[t], command, &forward[t], status) == 0) 
+        {
+            stored_remote = 1;
+        }
+        free(forward[t].text);
+        free(forward[t].slots);
+    }
+    for (size_t i = 0; i < count && stored_remote; i++) 
+    {
+        if (status[i] == NET_BATCH_OK) 
+        {
+            // Backend files go into its lookup filter; filter_add() skips the .c files
+            char uploaded[MAX_PATH_LEN * 2];
+            snprintf(uploaded, sizeof(uploaded), "%s/%s", dest_path, names[i]);
+            filter_add(uploaded);
+        }
+    }
+    if (stored_local) 
+    {
+        dfs_tar_cache_invalidate(&file_store);
+    }
+    if (fsync_policy != FSYNC_NONE && (stored_local || stored_remote) && 
+        commit_directory(stored_remote ? NULL : s1_path, dir_fd) < 0) 
+    {
+        rc = -1;
+    }
+    if (dir_fd >= 0) 
+    {
+        close(dir_fd);
+    }
+    
+    // Remove whatever was staged but not taken
+    for (size_t i = 0; i < count; i++) 
+    {
+        if (temp_paths[i] != NULL) 
+        {
+            unlink(temp_paths[i]);
+            free(temp_paths[i]);
+        }
+    }
+    
+    if (rc == 0) 
+    {
+        net_write_frame(client_sock, status, count);
+        for (size_t i = 0; i < count; i++) 
+        {
+            if (status[i] != NET_BATCH_OK) 
+            {
+                rc = -1;
+            }
+        }
+    }
+    else 
+    {
+        write(client_sock, "ERROR: File transfer failed", 27);
+    }
+    
+    // Hash the files kept in S1 once the client has its answer
+    for (size_t i = 0; i < count && stored_local; i++) 
+    {
+        if (status[i] == NET_BATCH_OK && dfs_file_type(names[i]) == DFS_TYPE_C) 
+        {
+            char full_path[MAX_PATH_LEN * 2];
+            snprintf(full_path, sizeof(full_path), "%s/%s", s1_path, names[i]);
+            dfs_meta_hash(&file_meta, full_path);
+        }
+    }
+    free(temp_paths);
+    free(status);
+    free(names);
+    free(list);
+    return rc;
+}
+
+// Function to add one line ("path" or "path name") for a backend to a batch list
+// slot is the item's position in the status vector the client gets back.
+int batch_append(struct batch_list *list, const char *path, const char *name, size_t slot) 
+{
+    size_t need = strlen(path) + ((name != NULL) ? strlen(name) + 1 : 0) + 1;
+    if (list->len + need > list->cap) 
+    {
+        size_t cap = (list->cap > 0) ? list->cap * 2 : 64 * 1024;
+        while (list->len + need > cap) 
+        {
+            cap *= 2;
+        }
+        char *text = realloc(list->text, cap);
+        size_t *slots = realloc(list->slots, (cap / 2) * sizeof(size_t)); // A line is at least 2 bytes
+        if (text != NULL) 
+        {
+            list->text = text;
+        }
+        if (slots != NULL) 
+        {
+            list->slots = slots;
+        }
+        if (text == NULL || slots == NULL) 
+        {
+            return -1;
+        }
+        list->cap = cap;
+    }
+    
+    if (name != NULL) 
+    {
+        list->len += sprintf(list->text + list->len, "%s %s\n", path, name);
+    }
+    else 
+    {
+        list->len += sprintf(list->text + list->len, "%s\n", path);
+    }
+    list->slots[list->count++] = slot;
+    return 0;
+}
+
+// Function to send a batch list to a backend and place its per-line results in status
+// The backend answers "READY", takes the list as one frame and replies with a status frame.
+// If the backend cannot be reached or answers wrongly, every line is marked as failed.
+int forward_batch(int port, char *command, struct batch_list *list, char *status) 
+{
+    uint64_t start_us = stats_now_us();
+    char *reply = NULL;
+    size_t reply_len = 0;
+    int sockfd = open_server_connection(port);
+    if (sockfd >= 0) 
+    {
+        char ready[5];
+        if (trace_send_command(sockfd, command) == 0 && net_read_reply(sockfd, ready, 5) == 0 && 
+            memcmp(ready, "READY", 5) == 0 && net_write_frame(sockfd, list->text, list->len) == 0) 
+        {
+            reply = net_read_frame(sockfd, list->count, &reply_len);
+        }
+        close(sockfd);
+    }
+    
+    int ok = (reply != NULL && reply_len == list->count);
+    for (size_t j = 0; j < list->count; j++) 
+    {
+        status[list->slots[j]] = ok ? reply[j] : NET_BATCH_FAILED;
+    }
+    free(reply);
+    stats_record(STAT_FORWARD, stats_now_us() - start_us, ok);
+    return ok ? 0 : -1;
+}
+
+// Function to copy or move a file between two ~S1 paths without sending it through the client
+// A destination ending in '/' keeps the source's name. When both paths map to the same server
+// that server copies (reflink/copy_file_range) or renames locally; when the extension changes,
+// the destination server pulls the file straight from the source server and a move then
+// removes the original.
+int copy_move_file(int client_sock, char *src, char *dst, int move) 
+{
+    if (strncmp(src, "~S1/", 4) != 0 || strncmp(dst, "~S1/", 4) != 0) 
+    {
+        write(client_sock, "ERROR: Paths must start with ~S1/", 33);
+        return -1;
+    }
+    
+    // Complete a directory destination with the source file name
+    char dest[MAX_PATH_LEN];
+    size_t dst_len = strlen(dst);
+    if (dst[dst_len - 1] == '/') 
+    {
+        snprintf(dest, MAX_PATH_LEN, "%s%s", dst, strrchr(src, '/') + 1);
+    } 
+    else 
+    {
+        snprintf(dest, MAX_PATH_LEN, "%s", dst);
+    }
+    
+    int src_type = dfs_file_type(src);
+    int dst_type = dfs_file_type(dest);
+    if (src_type < 0 || dst_type < 0) 
+    {
+        write(client_sock, "ERROR: Unsupported file type", 28);
+        return -1;
+    }
+    
+    char src_key[MAX_PATH_LEN];
+    char dst_key[MAX_PATH_LEN];
+    cache_key(src, src_key);
+    cache_key(dest, dst_key);
+    if (strcmp(src_key, dst_key) == 0) 
+    {
+        write(client_sock, "ERROR: Source and destination are the same file", 47);
+        return -1;
+    }
+    
+    // A file found in S1's tree is served by S1 whatever its type, as download_file does
+    char src_local[MAX_PATH_LEN];
+    char dst_local[MAX_PATH_LEN];
+    snprintf(src_local, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), src + 3); // +3 to skip "~S1"
+    snprintf(dst_local, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), dest + 3);
+    struct stat st;
+    struct dfs_meta_entry packed;
+    int src_file = (stat(src_local, &st) == 0);
+    int src_packed = (!src_file && dfs_pack_lookup(&file_pack, src_local, &packed)); // Packed files are S1's too
+    int src_port = (src_file || src_packed) ? PORT : type_ports[src_type];
+    int dst_port = type_ports[dst_type];
+    
+    // Cached copies of either name are stale from here on
+    cache_invalidate(dst_key);
+    if (move) 
+    {
+        cache_invalidate(src_key);
+    }
+    
+    char response[BUFFER_SIZE];
+    char command[MAX_PATH_LEN * 2 + 32];
+    if (src_port == dst_port && dst_port != PORT) 
+    {
+        // Both names live on one backend: it copies or renames locally
+        snprintf(command, sizeof(command), "%s %s %s", move ? "movef" : "copyf", src, dest);
+        if (send_to_server(dst_port, command, response) < 0) 
+        {
+            write(client_sock, "ERROR: Failed to contact target server", 38);
+            return -1;
+        }
+        if (strncmp(response, "SUCCESS", 7) == 0) 
+        {
+            filter_add(dst_key);
+        }
+        write(client_sock, response, strlen(response));
+        return (strncmp(response, "SUCCESS", 7) == 0) ? 0 : -1;
+    }
+    
+    if (dst_port == PORT) 
+    {
+        // The file ends up in S1: copy or rename locally, or pull it from the backend
+        char dir_path[MAX_PATH_LEN];
+        snprintf(dir_path, MAX_PATH_LEN, "%s", dst_local);
+        *strrchr(dir_path, '/') = '\0';
+        if (!src_packed && create_directory_tree(dir_path) < 0) 
+        {
+            write(client_sock, "ERROR: Failed to create directory", 32);
+            return -1;
+        }
+        
+        int rc;
+        if (src_packed) 
+        {
+            // A packed file is copied or renamed in the table alone
+            rc = dfs_pack_link(&file_pack, src_local, dst_local, move);
+        } 
+        else if (src_port == PORT) 
+        {
+            rc = move ? rename(src_local, dst_local) : dfs_copy_file(src_local, dst_local);
+        } 
+        else 
+        {
+            rc = peer_fetch_file(src_port, src, dst_local, NULL);
+        }
+        if (rc == PEER_NOT_FOUND || (rc < 0 && errno == ENOENT)) 
+        {
+            write(client_sock, "ERROR: File not found", 21);
+            return -1;
+        }
+        if (rc < 0) 
+        {
+            write(client_sock, "ERROR: Failed to copy file", 26);
+            return -1;
+        }
+        if (src_packed) 
+        {
+            // Already journaled by dfs_pack_link()
+        } 
+        else if (src_port != PORT) 
+        {
+            dfs_meta_add(&file_meta, dst_local);
+        } 
+        else if (move) 
+        {
+            dfs_meta_rename(&file_meta, src_local, dst_local);
+        } 
+        else 
+        {
+            dfs_meta_copy(&file_meta, src_local, dst_local);
+        }
+        
+        // Make the new name durable; a copy also has fresh data to flush.
+        // A packed file's new name is only in the journal, next to the segments in the root.
+        if (fsync_policy != FSYNC_NONE) 
+        {
+            int fd = open(src_packed ? file_meta.root : dst_local, O_RDONLY);
+            if (fd < 0 || (!(move && src_port == PORT) && !src_packed && sync_file_data(fd) < 0) || 
+                commit_directory(src_packed ? NULL : dir_path, fd) < 0) 
+            {
+                if (fd >= 0) 
+                {
+                    close(fd);
+                }
+                write(client_sock, "ERROR: Failed to sync file", 26);
+                return -1;
+            }
+            close(fd);
+        }
+        dfs_tar_cache_invalidate(&file_store);
+    } 
+    else 
+    {
+        // The destination backend pulls the file from the server that holds it
+        snprintf(command, sizeof(command), "fetchf %d %s %s", src_port, src, dest);
+        if (send_to_server(dst_port, command, response) < 0) 
+        {
+            write(client_sock, "ERROR: Failed to contact target server", 38);
+            return -1;
+        }
+        if (strncmp(response, "SUCCESS", 7) != 0) 
+        {
+            write(client_sock, response, strlen(response));
+            return -1;
+        }
+        filter_add(dst_key);
+    }
+    
+    // A move across servers finishes by removing the original
+    if (move && src_port != dst_port) 
+    {
+        if (src_port == PORT) 
+        {
+            if ((src_packed ? dfs_pack_remove(&file_pack, src_local) : unlink(src_local)) < 0) 
+            {
+                write(client_sock, "ERROR: File copied but original not removed", 43);
+                return -1;
+            }
+            if (!src_packed) 
+            {
+                dfs_meta_remove(&file_meta, src_local);
+            }
+            dfs_tar_cache_invalidate(&file_store);
+        } 
+        else 
+        {
+            snprintf(command, sizeof(command), "removef %s", src);
+            if (send_to_server(src_port, command, response) < 0 || strncmp(response, "SUCCESS", 7) != 0) 
+            {
+                write(client_sock, "ERROR: File copied but original not removed", 43);
+                return -1;
+            }
+        }
+    }
+    
+    if (move) 
+    {
+        write(client_sock, "SUCCESS: File moved", 19);
+    } 
+    else 
+    {
+        write(client_sock, "SUCCESS: File copied", 20);
+    }
+    
+    // A file pulled from a backend is hashed once the client has its answer
+    if (dst_port == PORT && src_port != PORT) 
+    {
+        dfs_meta_hash(&file_meta, dst_local);
+    }
+    return 0;
+}
+
+// Function to download a tar file containing files of a specific type
+// Handles .c files locally and forwards requests for other file types to the appropriate server.
+// A codec ("gzip" or "zstd") and level may be given to receive a compressed archive.
+int download_tar(int client_sock, char *filetype, char *codec, int level) 
+{
+    if (codec != NULL && dfs_compression_suffix(codec, &level) == NULL) 
+    {
+        write(client_sock, "ERROR: Unsupported compression codec", 36);
+        return -1;
+    }
+    
+    if (strcmp(filetype, ".c") == 0) 
+    {
+        // Handle .c files in S1
+        char s1_dir[MAX_PATH_LEN];
+        snprintf(s1_dir, MAX_PATH_LEN, "%s/S1", getenv("HOME"));
+
+        // Reuse the cached archive unless S1 changed since it was built
+        struct stat st;
+        int fd = dfs_open_tar_archive(&file_store, s1_dir, 1, &st);
+        if (fd < 0) 
+        {
+            write(client_sock, "ERROR: Failed to create tar file", 32);
+            return -1;
+        }
+
+        // Swap in the compressed archive if one was requested
+        if (codec != NULL) 
+        {
+            int comp_fd = dfs_open_compressed_archive(&file_store, fd, codec, level, &st);
+            close(fd);
+            if (comp_fd < 0) 
+            {
+                write(client_sock, "ERROR: Failed to compress tar file", 34);
+                return -1;
+            }
+            fd = comp_fd;
+        }
+
+        // Send file size
+        net_cork(client_sock);
+        if (net_write_full(client_sock, &st.st_size, sizeof(off_t)) < 0) 
+        {
+            net_uncork(client_sock);
+            close(fd);
+            return -1;
+        }
+
+        // Send file data
+        off_t remaining = st.st_size;
+        while (remaining > 0) 
+        {
+            ssize_t sent = sendfile(client_sock, fd, NULL, remaining);
+            if (sent <= 0) 
+            {
+                net_uncork(client_sock);
+                close(fd);
+                write(client_sock, "ERROR: File transfer failed", 28);
+                return -1;
+            }
+            remaining -= sent;
+        }
+        net_uncork(client_sock);
+        close(fd);
+        stats_add_bytes(0, st.st_size);
+        return 0;
+
+    } 
+    else if (strcmp(filetype, ".pdf") == 0 || strcmp(filetype, ".txt") == 0 || strcmp(filetype, ".zip") == 0) 
+    {
+        // Handle .pdf, .txt and .zip files from other servers
+        int target_port = S4_PORT;
+        if (strcmp(filetype, ".pdf") == 0) 
+        {
+            target_port = S2_PORT;
+        } 
+        else if (strcmp(filetype, ".txt") == 0) 
+        {
+            target_port = S3_PORT;
+        }
+
+        char command[BUFFER_SIZE];
+        if (codec != NULL) 
+        {
+            snprintf(command, BUFFER_SIZE, "downltar %s %s %d", filetype, codec, level);
+        } 
+        else 
+        {
+            snprintf(command, BUFFER_SIZE, "downltar %s", filetype);
+        }
+        uint64_t forward_start_us = stats_now_us();
+
+        int sockfd;
+        struct sockaddr_in serv_addr;
+        struct hostent *server;
+
+        sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd < 0) 
+        {
+            write(client_sock, "ERROR: Socket creation failed", 29);
+            return -1;
+        }
+        net_tune_socket(sockfd);
+
+        uint64_t span_start_us = trace_now_us();
+        server = gethostbyname("localhost");
+        if (server == NULL) 
+        {
+            close(sockfd);
+            write(client_sock, "ERROR: Host resolution failed", 29);
+            return -1;
+        }
+        trace_span("lookup", span_start_us, trace_now_us());
+
+        bzero((char *)&serv_addr, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
+        serv_addr.sin_port = htons(target_port);
+
+        span_start_us = trace_now_us();
+        if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) 
+        {
+            close(sockfd);
+            write(client_sock, "ERROR: Connection to server failed", 34);
+            return -1;
+        }
+        trace_span("connect", span_start_us, trace_now_us());
+
+        // Send command to target server
+        span_start_us = trace_now_us();
+        if (trace_send_command(sockfd, command) < 0) 
+        {
+            close(sockfd);
+            write(client_sock, "ERROR: Command send failed", 26);
+            return -1;
+        }
+
+        // Read tar file size
+        off_t filesize;
+        if (net_read_reply(sockfd, &filesize, sizeof(off_t)) < 0) 
+        {
+            close(sockfd);
+            write(client_sock, "ERROR: Failed to read file size", 31);
+            return -1;
+        }
+        trace_span("first_byte", span_start_us, trace_now_us());
+        span_start_us = trace_now_us();
+
+        // Send file size to client
+        net_cork(client_sock);
+        int ok = (net_write_full(client_sock, &filesize, sizeof(off_t)) == 0);
+
+        // Relay tar file content from target server to client without copying it through S1
+        ok = ok && relay_stream(sockfd, client_sock, filesize) == 0 && memcmp(&filesize, "ERROR", 5) != 0;
+        net_uncork(client_sock);
+
+        close(sockfd);
+        trace_span("last_byte", span_start_us, trace_now_us());
+        stats_record(STAT_FORWARD, stats_now_us() - forward_start_us, ok);
+        if (ok) 
+        {
+            stats_add_bytes(0, filesize);
+        }
+        return ok ? 0 : -1;
+    } 
+    else 
+    {
+        write(client_sock, "ERROR: Unsupported file type for tar", 36);
+        return -1;
+    }
+}
+
+// Function to download one tar archive of every file type below a ~S1 path
+// Asks S2, S3 and S4 for their parts in parallel while S1 archives its own .c files,
+// then streams the parts back to back, dropping each part's two-block end marker
+// and writing a single one at the end. No part is buffered in S1.
+int download_tar_all(int client_sock, char *pathname) 
+{
+    if (strncmp(pathname, "~S1", 3) != 0) 
+    {
+        write(client_sock, "ERROR: Path must start with ~S1", 31);
+        return -1;
+    }
+    
+    // Start all backends building their parts before doing any local work
+    uint64_t forward_start_us = stats_now_us();
+    int ports[3] = { S2_PORT, S3_PORT, S4_PORT };
+    int socks[3];
+    char command[BUFFER_SIZE];
+    snprintf(command, sizeof(command), "downltar all %s", pathname);
+    for (int i = 0; i < 3; i++) 
+    {
+        socks[i] = open_server_connection(ports[i]);
+        if (socks[i] >= 0 && trace_send_command(socks[i], command) < 0) 
+        {
+            close(socks[i]);
+            socks[i] = -1;
+        }
+    }
+    
+    // Archive S1's own .c files; the whole-tree archive can come from the cache
+    int whole_tree = (strcmp(pathname, "~S1") == 0 || strcmp(pathname, "~S1/") == 0);
+    char s1_dir[MAX_PATH_LEN];
+    snprintf(s1_dir, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), whole_tree ? "" : pathname + 3); // +3 to skip "~S1"
+    struct stat st;
+    int local_fd = dfs_open_tar_archive(&file_store, s1_dir, whole_tree, &st);
+    off_t local_size = (local_fd >= 0) ? st.st_size : 0;
+    
+    // Collect part sizes; a backend that fails or replies with an error is left out
+    const off_t end_marker = 2 * 512;
+    off_t sizes[3];
+    off_t total = end_marker;
+    if (local_size >= end_marker) 
+    {
+        total += local_size - end_marker;
+    }
+    for (int i = 0; i < 3; i++) 
+    {
+        sizes[i] = 0;
+        if (socks[i] < 0) 
+        {
+            continue;
+        }
+        if (net_read_reply(socks[i], &sizes[i], sizeof(off_t)) < 0 || 
+            memcmp(&sizes[i], "ERROR", 5) == 0 || sizes[i] < end_marker) 
+        {
+            close(socks[i]);
+            socks[i] = -1;
+            sizes[i] = 0;
+            continue;
+        }
+        total += sizes[i] - end_marker;
+    }
+    
+    net_cork(client_sock);
+    if (net_write_full(client_sock, &total, sizeof(off_t)) < 0) 
+    {
+        total = -1;
+    }
+    
+    // Local entries first, without their end marker
+    off_t remaining = (local_size >= end_marker) ? local_size - end_marker : 0;
+    while (total >= 0 && remaining > 0) 
+    {
+        ssize_t sent = sendfile(client_sock, local_fd, NULL, remaining);
+        if (sent <= 0) 
+        {
+            total = -1;
+            break;
+        }
+        remaining -= sent;
+    }
+    if (local_fd >= 0) 
+    {
+        close(local_fd);
+    }
+    
+    // Then each backend's entries as they arrive; its end marker is read and dropped
+    char marker[2 * 512];
+    for (int i = 0; i < 3; i++) 
+    {
+        if (socks[i] < 0) 
+        {
+            continue;
+        }
+        if (total >= 0 && relay_stream(socks[i], client_sock, sizes[i] - end_marker) < 0) 
+        {
+            total = -1;
+        }
+        close(socks[i]);
+    }
+    
+    stats_record(STAT_FORWARD, stats_now_us() - forward_start_us, total >= 0);
+    if (total < 0) 
+    {
+        net_uncork(client_sock);
+        return -1; // The client sees a short transfer and discards the archive
+    }
+    
+    bzero(marker, sizeof(marker));
+    int ok = (net_write_full(client_sock, marker, sizeof(marker)) == 0);
+    net_uncork(client_sock);
+    if (!ok) 
+    {
+        return -1;
+    }
+    stats_add_bytes(0, total);
+    return 0;
+}
+
+// Function to display filenames from S1 and other servers
+// Recursively lists files in S1 and sends requests to other servers for their file lists.
+int display_filenames(int client_sock, char *pathname) 
+{
+    // Get the corresponding path in S1
+    char s1_path[MAX_PATH_LEN];
+    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), 
+             (strcmp(pathname, "~S1") == 0) ? "" : (pathname + 3)); // Handle root case
+
+    // Get files from S1 (.c files) recursively
+    char file_list[BUFFER_SIZE] = {0};
+    size_t listed = dfs_meta_list(&file_meta, s1_path, file_list, sizeof(file_list));
+
+    // Check if path exists and is a directory; packed files have no directory on disk
+    struct stat st;
+    if (listed == 0 && (stat(s1_path, &st) != 0 || !S_ISDIR(st.st_mode))) 
+    {
+        write(client_sock, "ERROR: Invalid directory path", 29);
+        return -1;
+    }
+
+    // Get files from other servers
+    char command[MAX_PATH_LEN];
+    snprintf(command, MAX_PATH_LEN, "dispfnames %s", pathname);
+    char response[BUFFER_SIZE];
+
+    // Get PDF files from S2
+    if (send_to_server(S2_PORT, command, response) == 0) 
+    {
+        strncat(file_list, response, BUFFER_SIZE - strlen(file_list) - 1);
+    }
+
+    // Get TXT files from S3
+    if (send_to_server(S3_PORT, command, response) == 0) 
+    {
+        strncat(file_list, response, BUFFER_SIZE - strlen(file_list) - 1);
+    }
+
+    // Get ZIP files from S4
+    if (send_to_server(S4_PORT, command, response) == 0) 
+    {
+        strncat(file_list, response, BUFFER_SIZE - strlen(file_list) - 1);
+    }
+
+    // Send the combined list to client
+    write(client_sock, file_list, strlen(file_list));
+    stats_add_bytes(0, strlen(file_list));
+    return 0;
+}
+
+// Function to search the whole namespace for files whose name matches a glob or substring
+// The backends are asked first so they search their trees while S1 searches its own. S1
+// sends its matches, then relays each backend's in turn; the client reads until the
+// connection closes, so the result is not limited to one buffer.
+int find_files(int client_sock, char *pattern, char *pathname) 
+{
+    if (strncmp(pathname, "~S1", 3) != 0 || (pathname[3] != '\0' && pathname[3] != '/')) 
+    {
+        write(client_sock, "ERROR: Path must start with ~S1", 31);
+        return -1;
+    }
+    struct dfs_matcher matcher;
+    if (dfs_matcher_init(&matcher, pattern) < 0) 
+    {
+        write(client_sock, "ERROR: Invalid search pattern", 29);
+        return -1;
+    }
+    
+    char command[MAX_PATH_LEN + MATCH_PATTERN_MAX + 16];
+    snprintf(command, sizeof(command), "findf %s %s", pattern, pathname);
+    int socks[DFS_TYPE_COUNT];
+    for (int t = DFS_TYPE_C + 1; t < DFS_TYPE_COUNT; t++) 
+    {
+        socks[t] = open_server_connection(type_ports[t]);
+        if (socks[t] >= 0 && trace_send_command(socks[t], command) < 0) 
+        {
+            close(socks[t]);
+            socks[t] = -1;
+        }
+    }
+    
+    char s1_path[MAX_PATH_LEN];
+    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), pathname + 3); // +3 to skip "~S1"
+    uint64_t span_start_us = trace_now_us();
+    int rc = (dfs_find_files(s1_path, ".c", &matcher, pathname, client_sock) < 0 || 
+              dfs_pack_find(&file_pack, s1_path, &matcher, pathname, client_sock) < 0) ? -1 : 0;
+    trace_span("find_local", span_start_us, trace_now_us());
+    
+    // Relay the backends' matches as they come
+    size_t chunk = net_io_buffer();
+    char *buffer = malloc(chunk);
+    uint64_t relayed = 0;
+    for (int t = DFS_TYPE_C + 1; t < DFS_TYPE_COUNT; t++) 
+    {
+        if (socks[t] < 0) 
+        {
+            continue;
+        }
+        ssize_t n;
+        while (rc == 0 && buffer != NULL && net_wait_reply(socks[t]) == 0 && (n = net_read_some(socks[t], buffer, chunk)) > 0) 
+        {
+            if (net_write_full(client_sock, buffer, n) < 0) 
+            {
+                rc = -1;
+            }
+            relayed += n;
+        }
+        close(socks[t]);
+    }
+    free(buffer);
+    stats_add_bytes(0, relayed);
+    return rc;
+}
+
+// Function to search the contents of the .c and .txt files below pathname
+// Only S1 and S3 store text, so S3 is asked first and greps its TXT files while S1 greps
+// the C files; S1 then relays S3's matching lines. Each line is "path:line number:text".
+int grep_files(int client_sock, char *pattern, char *pathname, int regex) 
+{
+    if (strncmp(pathname, "~S1", 3) != 0 || (pathname[3] != '\0' && pathname[3] != '/')) 
+    {
+        write(client_sock, "ERROR: Path must start with ~S1", 31);
+        return -1;
+    }
+    struct dfs_grep grep;
+    if (dfs_grep_init(&grep, pattern, regex) < 0) 
+    {
+        write(client_sock, "ERROR: Invalid search pattern", 29);
+        return -1;
+    }
+    
+    char command[MAX_PATH_LEN + GREP_PATTERN_MAX + 16];
+    snprintf(command, sizeof(command), "grepf %s%s %s", regex ? "-E " : "", pattern, pathname);
+    int s3_sock = open_server_connection(type_ports[DFS_TYPE_TXT]);
+    if (s3_sock >= 0 && trace_send_command(s3_sock, command) < 0) 
+    {
+        close(s3_sock);
+        s3_sock = -1;
+    }
+    
+    char s1_path[MAX_PATH_LEN];
+    snprintf(s1_path, MAX_PATH_LEN, "%s/S1%s", getenv("HOME"), pathname + 3); // +3 to skip "~S1"
+    uint64_t span_start_us = trace_now_us();
+    int rc = (dfs_grep_tree(&grep, s1_path, ".c", pathname, client_sock, dfs_grep_threads()) < 0 || 
+              dfs_pack_grep(&file_pack, &grep, s1_path, pathname, client_sock) < 0) ? -1 : 0;
+    trace_span("grep_local", span_start_us, trace_now_us());
+    dfs_grep_free(&grep);
+    
+    // Relay S3's matches as they come
+    if (s3_sock >= 0) 
+    {
+        size_t chunk = net_io_buffer();
+        char *buffer = malloc(chunk);
+        uint64_t relayed = 0;
+        ssize_t n;
+        while (rc == 0 && buffer != NULL && net_wait_reply(s3_sock) == 0 && (n = net_read_some(s3_sock, buffer, chunk)) > 0) 
+        {
+            if (net_write_full(client_sock, buffer, n) < 0) 
+            {
+                rc = -1;
+            }
+            relayed += n;
+        }
+        free(buffer);
+        close(s3_sock);
+        stats_add_bytes(0, relayed);
+    }
+    return rc;
+}
+
+// Function to send a command to another server and receive its response
+// Establishes a connection to the target server, sends the command, and reads the response.
+int send_to_server(int port, char *command, char *response) 
+{
+    uint64_t start_us = stats_now_us();
+    int sockfd = open_server_connection(port);
+    if (sockfd < 0) 
+    {
+        stats_record(STAT_FORWARD, stats_now_us() - start_us, 0);
+        return -1;
+    }
+    
+    // Send command
+    uint64_t span_start_us = trace_now_us();
+    if (trace_send_command(sockfd, command) < 0) 
+    {
+        close(sockfd);
+        stats_record(STAT_FORWARD, stats_now_us() - start_us, 0);
+        return -1;
+    }
+    
+    // Read response
+    bzero(response, BUFFER_SIZE);
+    if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
+    {
+        close(sockfd);
+        stats_record(STAT_FORWARD, stats_now_us() - start_us, 0);
+        return -1;
+    }
+    trace_span("first_byte", span_start_us, trace_now_us());
+    
+    close(sockfd);
+    stats_record(STAT_FORWARD, stats_now_us() - start_us, 1);
+    return 0;
+}
+
+// Function to open a connection to another server
+// Returns the connected socket, or -1 on failure.
+int open_server_connection(int port) 
+{
+    int sockfd;
+    struct sockaddr_in serv_addr;
+    struct hostent *server;
+    
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) 
+    {
+        return -1;
+    }
+    net_tune_socket(sockfd);
+    
+    uint64_t span_start_us = trace_now_us();
+    server = gethostbyname("localhost");
+    if (server == NULL) 
+    {
+        close(sockfd);
+        return -1;
+    }
+    trace_span("lookup", span_start_us, trace_now_us());
+    
+    bzero((char *) &serv_addr, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
+    serv_addr.sin_port = htons(port);
+    
+    span_start_us = trace_now_us();
+    if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
+    {
+        close(sockfd);
+        return -1;
+    }
+    trace_span("connect", span_start_us, trace_now_us());
+    return sockfd;
+}
+
+// Function to read the durability policy and set up shared group-commit state
+// Must run in the parent before any fork so every child shares the same batch counters.
+void init_durability(void) 
+{
+    char *policy = getenv("DFS_FSYNC");
+    if (policy != NULL) 
+    {
+        if (strcmp(policy, "none") == 0) 
+        {
+            fsync_policy = FSYNC_NONE;
+        } 
+        else if (strcmp(policy, "always") == 0) 
+        {
+            fsync_policy = FSYNC_ALWAYS;
+        } 
+        else if (strcmp(policy, "group") == 0) 
+        {
+            fsync_policy = FSYNC_GROUP;
+        } 
+        else 
+        {
+            fprintf(stderr, "Unknown DFS_FSYNC policy '%s', using group\n", policy);
+        }
+    }
+    
+    char *window = getenv("DFS_GROUP_COMMIT_US");
+    if (window != NULL && atol(window) >= 0) 
+    {
+        group_commit_window_us = atol(window);
+    }
+    
+    if (fsync_policy != FSYNC_GROUP) 
+    {
+        return;
+    }
+    
+    // Anonymous shared mapping survives fork(), so all children see one commit state
+    commit_state = mmap(NULL, sizeof(struct group_commit), PROT_READ | PROT_WRITE, 
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (commit_state == MAP_FAILED) 
+    {
+        perror("ERROR mapping group-commit state, falling back to per-file fsync");
+        commit_state = NULL;
+        fsync_policy = FSYNC_ALWAYS;
+        return;
+    }
+    
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&commit_state->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&commit_state->done, &cattr);
+    pthread_condattr_destroy(&cattr);
+    
+    commit_state->open_batch = 1;
+    commit_state->synced_batch = 0;
+    commit_state->failed_batch = 0;
+    commit_state->leader_active = 0;
+}
+
+// Function to make a staged file's data durable according to the active policy
+int sync_file_data(int fd) 
+{
+    if (fsync_policy == FSYNC_GROUP) 
+    {
+        return group_commit(fd);
+    }
+    return fdatasync(fd);
+}
+
+// Function to fsync a directory so a rename inside it survives a crash
+int sync_directory(const char *dir_path) 
+{
+    int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) 
+    {
+        return -1;
+    }
+    int rc = fsync(dir_fd);
+    close(dir_fd);
+    return rc;
+}
+
+// Function to make a rename durable according to the active policy
+// dir_path may be NULL when the directory belongs to another server's tree.
+int commit_directory(const char *dir_path, int fd) 
+{
+    if (fsync_policy == FSYNC_GROUP) 
+    {
+        return group_commit(fd);
+    }
+    if (dir_path == NULL) 
+    {
+        return syncfs(fd);
+    }
+    return sync_directory(dir_path);
+}
+
+// Function to wait until everything written before the call is durable
+// Concurrent callers share one syncfs() per window instead of one fsync each.
+int group_commit(int fd) 
+{
+    pthread_mutex_lock(&commit_state->lock);
+    unsigned long my_batch = commit_state->open_batch;
+    
+    while (commit_state->synced_batch < my_batch) 
+    {
+        if (!commit_state->leader_active) 
+        {
+            // Become the leader: let other uploads join, then sync them all at once
+            commit_state->leader_active = 1;
+            pthread_mutex_unlock(&commit_state->lock);
+            
+            if (group_commit_window_us > 0) 
+            {
+                usleep(group_commit_window_us);
+            }
+            
+            pthread_mutex_lock(&commit_state->lock);
+            unsigned long closing = commit_state->open_batch++;
+            pthread_mutex_unlock(&commit_state->lock);
+            
+            int rc = syncfs(fd);
+            
+            pthread_mutex_lock(&commit_state->lock);
+            if (rc < 0) 
+            {
+                commit_state->failed_batch = closing;
+            }
+            commit_state->synced_batch = closing;
+            commit_state->leader_active = 0;
+            pthread_cond_broadcast(&commit_state->done);
+        } 
+        else 
+        {
+            pthread_cond_wait(&commit_state->done, &commit_state->lock);
+        }
+    }
+    
+    int failed = (commit_state->failed_batch >= my_batch);
+    pthread_mutex_unlock(&commit_state->lock);
+    return failed ? -1 : 0;
+}
+
+// Function to set up the shared hot-file cache index
+// Must run in the parent before any fork; the cache stays disabled if tmpfs is unavailable.
+void init_file_cache(void) 
+{
+    long budget_mb = CACHE_BYTES_MB;
+    char *env = getenv("DFS_CACHE_MB");
+    if (env != NULL) 
+    {
+        budget_mb = atol(env);
+    }
+    if (budget_mb <= 0) 
+    {
+        return;
+    }
+    
+    // Start from an empty directory of this server's own; bodies from a previous run are not indexed
+    sweep_cache_dirs();
+    snprintf(cache_dir, sizeof(cache_dir), "%s/%s.%d.%d", CACHE_PARENT_DIR, CACHE_DIR_NAME, (int)getuid(), (int)getpid());
+    remove_cache_dir(cache_dir);
+    if (mkdir(cache_dir, 0700) < 0) 
+    {
+        perror("ERROR creating cache directory, download cache disabled");
+        return;
+    }
+    
+    struct file_cache *cache = mmap(NULL, sizeof(struct file_cache), PROT_READ | PROT_WRITE, 
+                                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (cache == MAP_FAILED) 
+    {
+        perror("ERROR mapping cache index, download cache disabled");
+        return;
+    }
+    
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&cache->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    
+    cache->budget_bytes = (off_t)budget_mb * 1024 * 1024;
+    file_cache = cache; // mmap() returns zeroed memory, so all entries start invalid
+}
+
+// Function to delete a cache directory and the bodies in it
+// The directory is flat (bodies and fill files only), so no recursion is needed.
+int remove_cache_dir(const char *path) 
+{
+    DIR *dir = opendir(path);
+    if (dir == NULL) 
+    {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) 
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) 
+        {
+            continue;
+        }
+        char file_path[MAX_PATH_LEN * 2];
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
+        unlink(file_path);
+    }
+    closedir(dir);
+    return rmdir(path);
+}
+
+// Function to delete the cache directories left by earlier S1 processes of this user
+// S1 is stopped with a signal, so a directory is only reclaimed once its process is gone.
+void sweep_cache_dirs(void) 
+{
+    char prefix[MAX_PATH_LEN];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "%s.%d.", CACHE_DIR_NAME, (int)getuid());
+    
+    DIR *dir = opendir(CACHE_PARENT_DIR);
+    if (dir == NULL) 
+    {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) 
+    {
+        if (strncmp(entry->d_name, prefix, prefix_len) != 0) 
+        {
+            continue;
+        }
+        pid_t owner = (pid_t)atoi(entry->d_name + prefix_len);
+        if (owner > 0 && kill(owner, 0) < 0 && errno == ESRCH) 
+        {
+            char path[MAX_PATH_LEN * 2];
+            snprintf(path, sizeof(path), "%s/%s", CACHE_PARENT_DIR, entry->d_name);
+            remove_cache_dir(path);
+        }
+    }
+    closedir(dir);
+}
+
+// Function to build the cache key for a ~S1 path
+// Collapses repeated slashes so "~S1/a//b.pdf" and "~S1/a/b.pdf" share an entry.
+void cache_key(const char *path, char *key) 
+{
+    int j = 0;
+    for (int i = 0; path[i] != '\0' && j < MAX_PATH_LEN - 1; i++) 
+    {
+        if (path[i] == '/' && j > 0 && key[j - 1] == '/') 
+        {
+            continue;
+        }
+        key[j++] = path[i];
+    }
+    key[j] = '\0';
+}
+
+// Function to find the cache slot holding a key (caller holds the lock)
+static struct cache_entry *cache_lookup(const char *key) 
+{
+    for (int i = 0; i < CACHE_SLOTS; i++) 
+    {
+        if (file_cache->entries[i].valid && strcmp(file_cache->entries[i].key, key) == 0) 
+        {
+            return &file_cache->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Function to drop a cache entry and its body file (caller holds the lock)
+static void cache_drop(struct cache_entry *entry) 
+{
+    char body_path[MAX_PATH_LEN];
+    snprintf(body_path, sizeof(body_path), "%s/%lu", cache_dir, entry->id);
+    unlink(body_path); // Children still serving it keep their open descriptor
+    file_cache->used_bytes -= entry->size;
+    entry->valid = 0;
+}
+
+// Function to read the generation of the backend storing a file type
+// Returns 0 when no watcher is running there, since edits made by hand would then go unnoticed.
+uint64_t cache_backend_generation(int type) 
+{
+    char name[8];
+    snprintf(name, sizeof(name), "S%d", type + 1);
+    uint64_t generation = dfs_read_generation(name);
+    pid_t watcher = (pid_t)(generation >> 32);
+    if (watcher == 0 || (kill(watcher, 0) < 0 && errno != EPERM)) 
+    {
+        return 0;
+    }
+    return generation;
+}
+
+// Function to send a cached file to the client
+// The size header and the body go out in a single writev() from the mapped body.
+int cache_serve(int client_sock, const char *key, int type) 
+{
+    if (file_cache == NULL) 
+    {
+        return -1;
+    }
+    
+    uint64_t backend_generation = cache_backend_generation(type);
+    pthread_mutex_lock(&file_cache->lock);
+    struct cache_entry *entry = cache_lookup(key);
+    if (entry != NULL && (entry->backend_generation != backend_generation || 
+                          time(NULL) - entry->filled_at > CACHE_TTL_SEC)) 
+    {
+        cache_drop(entry); // Changed on the backend or too old, fetch it again
+        entry = NULL;
+    }
+    if (entry == NULL) 
+    {
+        file_cache->misses++;
+        pthread_mutex_unlock(&file_cache->lock);
+        return -1;
+    }
+    
+    char body_path[MAX_PATH_LEN];
+    snprintf(body_path, sizeof(body_path), "%s/%lu", cache_dir, entry->id);
+    off_t size = entry->size;
+    int fd = open(body_path, O_RDONLY);
+    if (fd < 0) 
+    {
+        cache_drop(entry);
+        file_cache->misses++;
+        pthread_mutex_unlock(&file_cache->lock);
+        return -1;
+    }
+    entry->last_used = ++file_cache->clock;
+    file_cache->hits++;
+    file_cache->hit_bytes += size;
+    pthread_mutex_unlock(&file_cache->lock);
+    
+    char *body = NULL;
+    if (size > 0) 
+    {
+        body = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (body == MAP_FAILED) 
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    
+    struct iovec iov[2];
+    iov[0].iov_base = &size;
+    iov[0].iov_len = sizeof(off_t);
+    iov[1].iov_base = body;
+    iov[1].iov_len = size;
+    
+    // Large bodies may need more than one writev() on a full socket buffer
+    int iovcnt = 2;
+    struct iovec *cur = iov;
+    while (iovcnt > 0) 
+    {
+        ssize_t sent = writev(client_sock, cur, iovcnt);
+        if (sent < 0) 
+        {
+            break;
+        }
+        while (iovcnt > 0 && (size_t)sent >= cur->iov_len) 
+        {
+            sent -= cur->iov_len;
+            cur++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) 
+        {
+            cur->iov_base = (char *)cur->iov_base + sent;
+            cur->iov_len -= sent;
+        }
+    }
+    
+    if (body != NULL) 
+    {
+        munmap(body, size);
+    }
+    stats_add_bytes(0, size);
+    return 0;
+}
+
+// Function to open a temporary body file for a file about to be relayed
+// Returns -1 when the file should not be cached, also when the backend has no watcher.
+int cache_begin_fill(off_t size, uint64_t backend_generation, char *fill_path, unsigned long *generation) 
+{
+    if (file_cache == NULL || size < 0) 
+    {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&file_cache->lock);
+    file_cache->miss_bytes += size;
+    *generation = file_cache->invalidations;
+    pthread_mutex_unlock(&file_cache->lock);
+    
+    if (size > CACHE_MAX_FILE || size > file_cache->budget_bytes || backend_generation == 0) 
+    {
+        return -1;
+    }
+    
+    snprintf(fill_path, MAX_PATH_LEN, "%s/fill.%d", cache_dir, (int)getpid());
+    return open(fill_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+}
+
+// Function to insert a completely relayed file into the cache
+// Evicts least recently used entries until the new body fits the budget.
+void cache_publish(const char *key, const char *fill_path, off_t size, unsigned long generation, uint64_t backend_generation) 
+{
+    pthread_mutex_lock(&file_cache->lock);
+    
+    // An upload or removal happened while we were fetching; the copy may be stale
+    if (generation != file_cache->invalidations) 
+    {
+        pthread_mutex_unlock(&file_cache->lock);
+        unlink(fill_path);
+        return;
+    }
+    
+    struct cache_entry *old = cache_lookup(key);
+    if (old != NULL) 
+    {
+        cache_drop(old);
+    }
+    
+    struct cache_entry *slot = NULL;
+    while (slot == NULL || file_cache->used_bytes + size > file_cache->budget_bytes) 
+    {
+        struct cache_entry *lru = NULL;
+        slot = NULL;
+        for (int i = 0; i < CACHE_SLOTS; i++) 
+        {
+            struct cache_entry *e = &file_cache->entries[i];
+            if (!e->valid) 
+            {
+                slot = e;
+            } 
+            else if (lru == NULL || e->last_used < lru->last_used) 
+            {
+                lru = e;
+            }
+        }
+        if (slot != NULL && file_cache->used_bytes + size <= file_cache->budget_bytes) 
+        {
+            break;
+        }
+        if (lru == NULL) 
+        {
+            break;
+        }
+        cache_drop(lru);
+    }
+    
+    if (slot == NULL) 
+    {
+        pthread_mutex_unlock(&file_cache->lock);
+        unlink(fill_path);
+        return;
+    }
+    
+    char body_path[MAX_PATH_LEN];
+    slot->id = ++file_cache->next_id;
+    snprintf(body_path, sizeof(body_path), "%s/%lu", cache_dir, slot->id);
+    if (rename(fill_path, body_path) < 0) 
+    {
+        pthread_mutex_unlock(&file_cache->lock);
+        unlink(fill_path);
+        return;
+    }
+    
+    snprintf(slot->key, MAX_PATH_LEN, "%s", key);
+    slot->size = size;
+    slot->backend_generation = backend_generation;
+    slot->filled_at = time(NULL);
+    slot->last_used = ++file_cache->clock;
+    slot->valid = 1;
+    file_cache->used_bytes += size;
+    pthread_mutex_unlock(&file_cache->lock);
+}
+
+// Function to remove a path from the cache after it was uploaded or removed
+void cache_invalidate(const char *key) 
+{
+    if (file_cache == NULL) 
+    {
+        return;
+    }
+    
+    pthread_mutex_lock(&file_cache->lock);
+    file_cache->invalidations++;
+    struct cache_entry *entry = cache_lookup(key);
+    if (entry != NULL) 
+    {
+        cache_drop(entry);
+    }
+    pthread_mutex_unlock(&file_cache->lock);
+}
+
+// Function to report cache hit-rate and byte-hit metrics and the lookup filter counters to the client
+int cache_stats(int client_sock) 
+{
+    char report[BUFFER_SIZE];
+    int len = 0;
+    if (file_cache == NULL) 
+    {
+        len = snprintf(report, sizeof(report), "Cache disabled\n");
+    }
+    else 
+    {
+        pthread_mutex_lock(&file_cache->lock);
+        unsigned long lookups = file_cache->hits + file_cache->misses;
+        unsigned long long bytes = file_cache->hit_bytes + file_cache->miss_bytes;
+        int entries = 0;
+        for (int i = 0; i < CACHE_SLOTS; i++) 
+        {
+            entries += file_cache->entries[i].valid;
+        }
+        len = snprintf(report, sizeof(report), 
+                       "cache_hits %lu\ncache_misses %lu\ncache_hit_ratio %.4f\n"
+                       "cache_hit_bytes %llu\ncache_miss_bytes %llu\ncache_byte_hit_ratio %.4f\n"
+                       "cache_entries %d\ncache_used_bytes %lld\ncache_budget_bytes %lld\n",
+                       file_cache->hits, file_cache->misses, lookups ? (double)file_cache->hits / lookups : 0.0,
+                       file_cache->hit_bytes, file_cache->miss_bytes, bytes ? (double)file_cache->hit_bytes / bytes : 0.0,
+                       entries, (long long)file_cache->used_bytes, (long long)file_cache->budget_bytes);
+        pthread_mutex_unlock(&file_cache->lock);
+    }
+    
+    // Lookups the backend filters answered, and how many of them without the backend
+    for (int type = DFS_TYPE_PDF; path_filters != NULL && type < DFS_TYPE_COUNT && len < (int)sizeof(report); type++) 
+    {
+        struct path_filter *filter = &path_filters->filters[type];
+        len += snprintf(report + len, sizeof(report) - len, 
+                        "filter_s%d_ready %d\nfilter_s%d_lookups %lu\nfilter_s%d_definite_misses %lu\n"
+                        "filter_s%d_stale_misses %lu\n", 
+                        type + 1, filter->ready, type + 1, filter->lookups, type + 1, filter->definite_misses, 
+                        type + 1, filter->stale_misses);
+    }
+    
+    write(client_sock, report, strlen(report));
+    return 0;
+}
+
+// Function to set up the shared lookup filters of S2-S4
+// Must run in the parent before any fork. Pages are only touched as filters are built.
+void init_path_filters(void) 
+{
+    long filter_mb = FILTER_MB;
+    char *env = getenv("DFS_FILTER_MB");
+    if (env != NULL) 
+    {
+        filter_mb = atol(env);
+    }
+    if (filter_mb <= 0) 
+    {
+        return;
+    }
+    
+    // Round down to a power of two so a hash is reduced with a mask
+    uint64_t bit_count = 1ULL << 16;
+    while (bit_count * 2 <= (uint64_t)filter_mb * 1024 * 1024 * 8) 
+    {
+        bit_count *= 2;
+    }
+    size_t size = sizeof(struct path_filters) + (size_t)DFS_TYPE_COUNT * 2 * (bit_count / 8);
+    struct path_filters *filters = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (filters == MAP_FAILED) 
+    {
+        perror("ERROR mapping lookup filters, every download goes to its server");
+        return;
+    }
+    filters->bit_count = bit_count;
+    path_filters = filters; // mmap() returns zeroed memory, so no filter is ready yet
+}
+
+// Function to find one of a backend's two bit buffers
+static uint64_t *filter_buffer(int type, int buffer) 
+{
+    uint64_t *bits = (uint64_t *)(path_filters + 1);
+    return bits + (size_t)(type * 2 + buffer) * (path_filters->bit_count / 64);
+}
+
+// Function to hash a ~S1 path the way its backend stores it, "a//./b.txt" as "a/b.txt"
+// Returns -1 for paths the backend would not store under a key.
+static int filter_hash(const char *path, uint64_t *hash) 
+{
+    char key[MAX_PATH_LEN];
+    int len = dfs_meta_key(path + 3, key); // +3 to skip "~S1"
+    if (len <= 0) 
+    {
+        return -1;
+    }
+    *hash = dfs_meta_xxh64(key, len);
+    return 0;
+}
+
+// Function to set a path's bits in one buffer
+// Bits are only ever added while lookups run, so an atomic OR is all the locking needed.
+static void filter_set(int type, int buffer, uint64_t hash) 
+{
+    uint64_t *bits = filter_buffer(type, buffer);
+    uint64_t mask = path_filters->bit_count - 1;
+    uint64_t step = (hash >> 32 | hash << 32) | 1;
+    for (int i = 0; i < FILTER_HASHES; i++) 
+    {
+        uint64_t bit = (hash + i * step) & mask;
+        __atomic_fetch_or(&bits[bit / 64], 1ULL << (bit % 64), __ATOMIC_RELAXED);
+    }
+}
+
+// Function to add a path stored on a backend to its filter
+// Called once the backend has the file. Both buffers get the bits, so a rebuild that
+// cleared the spare buffer before asking for the inventory cannot lose the path.
+void filter_add(const char *path) 
+{
+    int type = dfs_file_type(path);
+    uint64_t hash;
+    if (path_filters == NULL || type <= DFS_TYPE_C || filter_hash(path, &hash) < 0) 
+    {
+        return;
+    }
+    filter_set(type, 0, hash);
+    filter_set(type, 1, hash);
+}
+
+// Function to check whether a backend's filter still lists every file the backend stores
+// True while the watcher that wrote the backend's generation is running and nothing it
+// picked up moved the generation past the one the filter's inventory was taken at.
+static int filter_current(int type, struct path_filter *filter) 
+{
+    char name[8];
+    snprintf(name, sizeof(name), "S%d", type + 1);
+    uint64_t generation = dfs_read_generation(name);
+    pid_t watcher = (pid_t)(generation >> 32);
+    return watcher != 0 && (kill(watcher, 0) == 0 || errno == EPERM) && 
+           generation == __atomic_load_n(&filter->built_generation, __ATOMIC_ACQUIRE);
+}
+
+// Function to check whether a backend may store a path
+// Returns 0 only when the path is certainly not there, 1 if it may be or there is no
+// complete and current filter.
+int filter_may_contain(int type, const char *path) 
+{
+    uint64_t hash;
+    if (path_filters == NULL || type <= DFS_TYPE_C || filter_hash(path, &hash) < 0) 
+    {
+        return 1;
+    }
+    struct path_filter *filter = &path_filters->filters[type];
+    if (!__atomic_load_n(&filter->ready, __ATOMIC_ACQUIRE)) 
+    {
+        return 1;
+    }
+    __sync_fetch_and_add(&filter->lookups, 1);
+    uint64_t *bits = filter_buffer(type, __atomic_load_n(&filter->current, __ATOMIC_ACQUIRE));
+    uint64_t mask = path_filters->bit_count - 1;
+    uint64_t step = (hash >> 32 | hash << 32) | 1;
+    for (int i = 0; i < FILTER_HASHES; i++) 
+    {
+        uint64_t bit = (hash + i * step) & mask;
+        if (!(__atomic_load_n(&bits[bit / 64], __ATOMIC_RELAXED) & (1ULL << (bit % 64)))) 
+        {
+            if (!filter_current(type, filter)) 
+            {
+                // Ask the backend this time, and have filter_refresh() rebuild the filter
+                __sync_fetch_and_add(&filter->stale_misses, 1);
+                __atomic_store_n(&filter->stale, 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+            __sync_fetch_and_add(&filter->definite_misses, 1);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to rebuild a backend's filter from its inventory when it is missing, stale or old
+// Runs in the child after it has answered its client; one child rebuilds at a time.
+void filter_refresh(int type) 
+{
+    if (path_filters == NULL || type <= DFS_TYPE_C) 
+    {
+        return;
+    }
+    struct path_filter *filter = &path_filters->filters[type];
+    time_t now = time(NULL);
+    time_t started = filter->rebuild_started;
+    if ((filter->ready && !filter->stale && now - filter->built_at < FILTER_REFRESH_SEC) || 
+        (started != 0 && now - started < FILTER_STALL_SEC) || 
+        !__sync_bool_compare_and_swap(&filter->rebuild_started, started, now)) 
+    {
+        return;
+    }
+    
+    // Clear the spare buffer before the inventory is taken; uploads finishing from here
+    // on set their bits in it too
+    // A change the backend picks up after this point moves its generation past the one
+    // in the inventory, so it marks the filter stale again
+    int spare = !filter->current;
+    memset(filter_buffer(type, spare), 0, path_filters->bit_count / 8);
+    __atomic_store_n(&filter->stale, 0, __ATOMIC_RELEASE);
+    __sync_synchronize();
+    
+    int sockfd = open_server_connection(type_ports[type]);
+    off_t header[3]; // Path count, list length and the backend's generation
+    int complete = 0;
+    if (sockfd >= 0 && trace_send_command(sockfd, "inventory") == 0 && 
+        net_read_reply(sockfd, header, sizeof(header)) == 0 && memcmp(header, "ERROR", 5) != 0) 
+    {
+        // Hash the list line by line as it streams in; a line may span two reads
+        char *buffer = malloc(net_io_buffer() + MAX_PATH_LEN);
+        size_t carry = 0;
+        off_t remaining = header[1];
+        while (buffer != NULL && remaining > 0) 
+        {
+            size_t want = ((size_t)remaining < net_io_buffer()) ? (size_t)remaining : net_io_buffer();
+            ssize_t n = net_read_some(sockfd, buffer + carry, want);
+            if (n <= 0) 
+            {
+                break;
+            }
+            remaining -= n;
+            size_t len = carry + n;
+            char *line = buffer;
+            char *newline;
+            while ((newline = memchr(line, '\n', buffer + len - line)) != NULL) 
+            {
+                if (newline > line) 
+                {
+                    filter_set(type, spare, dfs_meta_xxh64(line, newline - line));
+                }
+                line = newline + 1;
+            }
+            carry = buffer + len - line;
+            if (carry >= MAX_PATH_LEN) 
+            {
+                break;
+            }
+            memmove(buffer, line, carry);
+        }
+        complete = (buffer != NULL && remaining == 0 && carry == 0);
+        free(buffer);
+    }
+    if (sockfd >= 0) 
+    {
+        close(sockfd);
+    }
+    
+    if (complete) 
+    {
+        // The generation is stored last: until then lookups see the new buffer with the old
+        // generation, which only sends them to the backend
+        __atomic_store_n(&filter->current, spare, __ATOMIC_RELEASE);
+        __atomic_store_n(&filter->ready, 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&filter->built_generation, (uint64_t)header[2], __ATOMIC_RELEASE);
+        filter->built_at = now;
+    }
+    filter->rebuild_started = 0;
+}
+
+// Function to report operation statistics for S1 followed by S2, S3 and S4
+// The hot-file cache counters are appended to S1's part; they are valid Prometheus samples as-is.
+int report_stats(int client_sock, int prometheus) 
+{
+    if (stats_send(client_sock, prometheus) < 0 || cache_stats(client_sock) < 0) 
+    {
+        return -1;
+    }
+    
+    // Append each backend's report; a backend that is down is simply left out
+    int ports[3] = { S2_PORT, S3_PORT, S4_PORT };
+    const char *command = prometheus ? "stats prom" : "stats";
+    char buffer[BUFFER_SIZE];
+    for (int i = 0; i < 3; i++) 
+    {
+        int sockfd = open_server_connection(ports[i]);
+        if (sockfd < 0) 
+        {
+            continue;
+        }
+        if (trace_send_command(sockfd, command) == 0) 
+        {
+            ssize_t n;
+            while (net_wait_reply(sockfd) == 0 && (n = net_read_some(sockfd, buffer, sizeof(buffer))) > 0) 
+            {
+                if (net_write_full(client_sock, buffer, n) < 0) 
+                {
+                    break;
+                }
+            }
+        }
+        close(sockfd);
+    }
+    return 0;
+}
+
+// Function to report recorded spans of S1, S2, S3 and S4 as one Chrome trace JSON document
+// A request_id of 0 includes every request still in the rings.
+int report_trace(int client_sock, uint64_t request_id) 
+{
+    const char *header = "{\"traceEvents\":[\n";
+    if (write(client_sock, header, strlen(header)) < 0 || trace_send_events(client_sock, request_id) < 0) 
+    {
+        return -1;
+    }
+    
+    // Backends answer with bare event lines, which are spliced into the same list
+    int ports[3] = { S2_PORT, S3_PORT, S4_PORT };
+    char command[64];
+    snprintf(command, sizeof(command), "trace %016llx", (unsigned long long)request_id);
+    for (int i = 0; i < 3; i++) 
+    {
+        int sockfd = open_server_connection(ports[i]);
+        if (sockfd < 0) 
+        {
+            continue;
+        }
+        if (trace_send_command(sockfd, command) == 0) 
+        {
+            relay_stream(sockfd, client_sock, (off_t)1 << 40); // Until the backend closes
+        }
+        close(sockfd);
+    }
+    return trace_send_footer(client_sock);
+}
+
+// Function to copy exactly length bytes from one socket to another
+// Uses splice() through a pipe so the data never enters user space, and falls
+// back to a read/write loop where splice is unsupported.
+int relay_stream(int from_fd, int to_fd, off_t length) 
+{
+    off_t remaining = length;
+    int pipefd[2];
+    
+    if (pipe(pipefd) == 0) 
+    {
+        // Let each splice() move a whole transfer buffer when it is larger than the default pipe
+        if (net_io_buffer() > NET_IO_BUFFER_DEFAULT) 
+        {
+            fcntl(pipefd[1], F_SETPIPE_SZ, (int)net_io_buffer());
+        }
+        while (remaining > 0) 
+        {
+            ssize_t in = splice(from_fd, NULL, pipefd[1], NULL, remaining, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (in <= 0) 
+            {
+                break;
+            }
+            ssize_t left = in;
+            while (left > 0) 
+            {
+                ssize_t out = splice(pipefd[0], NULL, to_fd, NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (out <= 0) 
+                {
+                    close(pipefd[0]);
+                    close(pipefd[1]);
+                    return -1;
+                }
+                left -= out;
+            }
+            remaining -= in;
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
+        if (remaining < length) 
+        {
+            return (remaining == 0) ? 0 : -1; // Done, or the stream broke midway
+        }
+    }
+    
+    // splice() moved nothing: fall back to copying through a buffer
+    size_t chunk = net_io_buffer();
+    char *buffer = malloc(chunk);
+    if (buffer == NULL) 
+    {
+        return -1;
+    }
+    while (remaining > 0) 
+    {
+        ssize_t bytes_read = net_read_some(from_fd, buffer, ((size_t)remaining < chunk) ? (size_t)remaining : chunk);
+        if (bytes_read <= 0 || net_write_full(to_fd, buffer, bytes_read) < 0) 
+        {
+            break;
+        }
+        remaining -= bytes_read;
+    }
+    free(buffer);
+    return (remaining == 0) ? 0 : -1;
+}
+
+// Function to handle errors
+// Prints the error message and exits the program.
+void error(const char *msg) 
+{
+    perror(msg);
+    exit(1);
 }
\ No newline at end of file
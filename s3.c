@@ -1,486 +1,656 @@
-// Distributed File System - S3 Server Implementation
-// This file implements the server (S3) which handles TXT files.
-// S3 receives commands from S1 and processes them accordingly.
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <netdb.h>
-#include <arpa/inet.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <dirent.h>
-#include <libgen.h>
-#include <sys/wait.h>
-#include <sys/sendfile.h>
-#include <time.h>
-#include <errno.h>
-
-#define PORT 4309
-#define MAX_CLIENTS 5
-#define BUFFER_SIZE 1024
-#define MAX_PATH_LEN 1024
-
-// Function prototypes
-void handle_client(int client_sock);
-int upload_file(int client_sock, char *filename, char *dest_path);
-int download_file(int client_sock, char *filename);
-int remove_file(int client_sock, char *filename);
-int download_tar(int client_sock);
-int display_filenames(int client_sock, char *pathname);
-int create_directory_tree(char *path);
-void error(const char *msg);
-
-// Main function initializes the server and listens for connections from S1.
-// It creates a child process for each connection to handle requests concurrently.
-int main() 
-{
-    int sockfd, newsockfd;
-    socklen_t clilen;
-    struct sockaddr_in serv_addr, cli_addr;
-    pid_t pid;
-
-    // Create socket
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) 
-    {
-        error("ERROR opening socket");
-    }
-
-    // Initialize socket structure
-    bzero((char *) &serv_addr, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(PORT);
-
-    // Bind the host address
-    if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
-    {
-        error("ERROR on binding");
-    }
-
-    // Start listening for the clients
-    listen(sockfd, MAX_CLIENTS);
-    clilen = sizeof(cli_addr);
-
-    printf("S3 server (TXT files) started on port %d\n", PORT);
-
-    // Main loop to accept connections from S1
-    while (1) 
-    {
-        // Accept connection from S1
-        newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
-        if (newsockfd < 0) 
-        {
-            error("ERROR on accept");
-        }
-
-        // Create child process to handle the connection
-        pid = fork();
-        if (pid < 0) 
-        {
-            error("ERROR on fork");
-        }
-
-        if (pid == 0)
-        {
-            // Child process
-            close(sockfd);
-            handle_client(newsockfd);
-            close(newsockfd);
-            exit(0);
-        } 
-        else 
-        {
-            // Parent process
-            close(newsockfd);
-            // Clean up zombie processes
-            while (waitpid(-1, NULL, WNOHANG) > 0);
-        }
-    }
-
-    // Close the socket
-    close(sockfd);
-    return 0;
-}
-
-// Function to handle requests from S1
-// Parses the command received from S1 and calls the appropriate function.
-void handle_client(int client_sock) 
-{
-    char buffer[BUFFER_SIZE];
-    int n;
-    
-    // Read command from client (S1)
-    bzero(buffer, BUFFER_SIZE);
-    n = read(client_sock, buffer, BUFFER_SIZE - 1);
-    if (n < 0) 
-    {
-        error("ERROR reading from socket");
-    }
-    
-    printf("Received command: %s\n", buffer);
-    
-    // Parse command
-    char *cmd = strtok(buffer, " ");
-    if (cmd == NULL) 
-    {
-        write(client_sock, "ERROR: Invalid command", 22);
-        return;
-    }
-    
-    if (strcmp(cmd, "uploadf") == 0) 
-    {
-        // Handle file upload
-        char *filename = strtok(NULL, " ");
-        char *dest_path = strtok(NULL, " ");
-        if (filename == NULL || dest_path == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid uploadf command format", 36);
-            return;
-        }
-        upload_file(client_sock, filename, dest_path);
-    } 
-    else if (strcmp(cmd, "downlf") == 0) 
-    {
-        // Handle file download
-        char *filename = strtok(NULL, " ");
-        if (filename == NULL) {
-            write(client_sock, "ERROR: Invalid downlf command format", 34);
-            return;
-        }
-        download_file(client_sock, filename);
-    } 
-    else if (strcmp(cmd, "removef") == 0) 
-    {
-        // Handle file removal
-        char *filename = strtok(NULL, " ");
-        if (filename == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid removef command format", 35);
-            return;
-        }
-        remove_file(client_sock, filename);
-    } 
-    else if (strcmp(cmd, "downltar") == 0)
-    {
-        // Handle tar file download
-        download_tar(client_sock);
-    } 
-    else if (strcmp(cmd, "dispfnames") == 0)
-    {
-        // Handle display filenames request
-        char *pathname = strtok(NULL, " ");
-        if (pathname == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid dispfnames command format", 38);
-            return;
-        }
-        display_filenames(client_sock, pathname);
-    } 
-    else 
-    {
-        // Handle unknown command
-        write(client_sock, "ERROR: Unknown command", 21);
-    }
-}
-
-// Function to upload a TXT file to S3
-// Receives the file from S1 and stores it in the appropriate directory.
-int upload_file(int client_sock, char *filename, char *dest_path) 
-{
-    // First, check if the file is a TXT file
-    char *ext = strrchr(filename, '.');
-    if (ext == NULL || strcmp(ext, ".txt") != 0) 
-    {
-        write(client_sock, "ERROR: S3 only handles TXT files", 31);
-        return -1;
-    }
-    
-    // Create destination path in S3
-    char s3_path[MAX_PATH_LEN];
-    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), dest_path + 3); // +3 to skip "~S1"
-    
-    // Create directory tree if needed
-    if (create_directory_tree(s3_path) < 0) 
-    {
-        write(client_sock, "ERROR: Failed to create directory", 32);
-        return -1;
-    }
-    
-    // Construct full file path
-    char *base_name = basename(filename);
-    char full_path[MAX_PATH_LEN];
-    snprintf(full_path, MAX_PATH_LEN, "%s/%s", s3_path, base_name);
-    
-    // Rename/move the file from temporary location (sent by S1) to final destination
-    if (rename(filename, full_path) < 0) 
-    {
-        write(client_sock, "ERROR: Failed to move file to destination", 38);
-        return -1;
-    }
-    
-    write(client_sock, "SUCCESS: TXT file stored in S3", 30);
-    return 0;
-}
-
-// Function to download a TXT file from S3
-// Sends the requested file to S1 if it exists.
-int download_file(int client_sock, char *filename)
-{
-    // Check if file exists in S3
-    char s3_path[MAX_PATH_LEN];
-    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
-    
-    struct stat st;
-    if (stat(s3_path, &st) != 0) 
-    {
-        write(client_sock, "ERROR: TXT file not found in S3", 30);
-        return -1;
-    }
-    
-    // Open file
-    int fd = open(s3_path, O_RDONLY);
-    if (fd < 0) 
-    {
-        write(client_sock, "ERROR: Failed to open TXT file", 29);
-        return -1;
-    }
-    
-    // Send file size
-    if (write(client_sock, &st.st_size, sizeof(off_t)) != sizeof(off_t))
-    {
-        close(fd);
-        write(client_sock, "ERROR: Failed to send file size", 31);
-        return -1;
-    }
-    
-    // Send file data
-    off_t remaining = st.st_size;
-    char buffer[BUFFER_SIZE];
-    while (remaining > 0) 
-    {
-        ssize_t n = read(fd, buffer, (remaining < BUFFER_SIZE) ? remaining : BUFFER_SIZE);
-        if (n <= 0)
-        {
-            close(fd);
-            write(client_sock, "ERROR: File transfer failed", 27);
-            return -1;
-        }
-        if (write(client_sock, buffer, n) != n) 
-        {
-            close(fd);
-            write(client_sock, "ERROR: File transfer failed", 27);
-            return -1;
-        }
-        remaining -= n;
-    }
-    close(fd);
-    return 0;
-}
-
-// Function to remove a TXT file from S3
-// Deletes the specified file if it exists.
-int remove_file(int client_sock, char *filename)
-{
-    // Check if file exists in S3
-    char s3_path[MAX_PATH_LEN];
-    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
-    
-    if (unlink(s3_path) == 0) 
-    {
-        write(client_sock, "SUCCESS: TXT file deleted from S3", 32);
-        return 0;
-    }
-    
-    write(client_sock, "ERROR: TXT file not found in S3", 30);
-    return -1;
-}
-
-// Function to create a tar file containing all TXT files in S3
-// Finds all .txt files and creates a tar archive to send to S1.
-int download_tar(int client_sock) 
-{
-    char s3_dir[MAX_PATH_LEN];
-    snprintf(s3_dir, MAX_PATH_LEN, "%s/S3", getenv("HOME"));
-    
-    // Create tar file for .txt files
-    char tar_cmd[MAX_PATH_LEN + 50];
-    snprintf(tar_cmd, sizeof(tar_cmd), "find %s -type f -name \"*.txt\" | tar -cf /tmp/txtfiles.tar -T -", s3_dir);
-
-    // Execute the tar command
-    if (system(tar_cmd) != 0) 
-    {
-        write(client_sock, "ERROR: Failed to create tar file", 30);
-        return -1;
-    }
-    
-    // Send tar file to client
-    struct stat st;
-    if (stat("/tmp/txtfiles.tar", &st) != 0)
-    {
-        write(client_sock, "ERROR: Tar file not found", 25);
-        return -1;
-    }
-    
-    int fd = open("/tmp/txtfiles.tar", O_RDONLY);
-    if (fd < 0) 
-    {
-        write(client_sock, "ERROR: Failed to open tar file", 29);
-        return -1;
-    }
-    
-    // Send file size
-    write(client_sock, &st.st_size, sizeof(off_t));
-    
-    // Send file data
-    off_t remaining = st.st_size;
-    while (remaining > 0) 
-    {
-        ssize_t sent = sendfile(client_sock, fd, NULL, remaining);
-        if (sent <= 0) 
-        {
-            close(fd);
-            write(client_sock, "ERROR: File transfer failed", 27);
-            return -1;
-        }
-        remaining -= sent;
-    }
-    close(fd);
-    
-    // Clean up
-    unlink("/tmp/txtfiles.tar");
-    
-    return 0;
-}
-
-// Function to display filenames of TXT files in S3
-// Recursively lists all .txt files in the S3 directory.
-int display_filenames(int client_sock, char *pathname)
-{
-    // Get the corresponding path in S3
-    char s3_path[MAX_PATH_LEN];
-    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), 
-             (strcmp(pathname, "~S1") == 0) ? "" : (pathname + 3)); // Handle root case
-    
-    // Check if path exists and is a directory
-    struct stat st;
-    if (stat(s3_path, &st) != 0 || !S_ISDIR(st.st_mode)) 
-    {
-        write(client_sock, "", 0); // Send empty response if directory doesn't exist
-        return 0;
-    }
-    
-    // Get TXT files from S3 recursively
-    char file_list[BUFFER_SIZE] = {0};
-    
-    // Recursive directory traversal function
-    void list_txt_files(const char *base_path, const char *relative_path)
-    {
-        DIR *dir = opendir(base_path);
-        if (!dir) return;
-        
-        struct dirent *ent;
-        while ((ent = readdir(dir)) != NULL) 
-        {
-            // Skip . and .. directories
-            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) 
-            {
-                continue;
-            }
-            
-            char full_path[MAX_PATH_LEN];
-            snprintf(full_path, sizeof(full_path), "%s/%s", base_path, ent->d_name);
-            
-            char new_relative_path[MAX_PATH_LEN];
-            if (strcmp(relative_path, "") == 0) 
-            {
-                snprintf(new_relative_path, sizeof(new_relative_path), "%s", ent->d_name);
-            } 
-            else 
-            {
-                snprintf(new_relative_path, sizeof(new_relative_path), "%s/%s", relative_path, ent->d_name);
-            }
-            
-            if (ent->d_type == DT_REG) 
-            {
-                // Check if it's a TXT file
-                char *ext = strrchr(ent->d_name, '.');
-                if (ext && strcmp(ext, ".txt") == 0) 
-                {
-                    // Convert to ~S1-style path
-                    char output_path[MAX_PATH_LEN];
-                    snprintf(output_path, sizeof(output_path), "~S1/%s", new_relative_path);
-
-                    
-                    strncat(file_list, output_path, BUFFER_SIZE - strlen(file_list) - 1);
-                    strncat(file_list, "\n", BUFFER_SIZE - strlen(file_list) - 1);
-                }
-            } else if (ent->d_type == DT_DIR)
-            {
-                // Recursively process subdirectory
-                list_txt_files(full_path, new_relative_path);
-            }
-        }
-        closedir(dir);
-    }
-    
-    // Start recursive traversal from the base path
-    list_txt_files(s3_path, "");
-    
-    // Send the list to S1
-    write(client_sock, file_list, strlen(file_list));
-    return 0;
-}
-
-// Function to create a directory tree for a given path
-// Ensures that all intermediate directories in the path exist.
-int create_directory_tree(char *path) 
-{
-    char *p;
-    char tmp[MAX_PATH_LEN];
-    
-    snprintf(tmp, MAX_PATH_LEN, "%s", path);
-    
-    // Skip leading slash if present
-    if (tmp[0] == '/')
-    {
-        p = tmp + 1;
-    }
-    else 
-    {
-        p = tmp;
-    }
-    
-    // Create each directory in the path
-    while ((p = strchr(p, '/'))) 
-    {
-        *p = '\0';
-        if (mkdir(tmp, 0755) && errno != EEXIST) 
-        {
-            return -1;
-        }
-        *p = '/';
-        p++;
-    }
-    
-    // Create the final directory
-    if (mkdir(tmp, 0755) && errno != EEXIST) 
-    {
-        return -1;
-    }
-    
-    return 0;
-}
-
-// Function to handle errors
-// Prints the error message and exits the program.
-void error(const char *msg) 
-{
-    perror(msg);
-    exit(1);
+// Distributed File System - S3 Server Implementation
+// This file implements the server (S3) which handles TXT files.
+// S3 receives commands from S1 and processes them accordingly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/wait.h>
+#include <sys/sendfile.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "dfs_stats.h"
+#include "dfs_trace.h"
+#include "dfs_core.h"
+#include "dfs_net.h"
+#include "dfs_peer.h"
+#include "dfs_match.h"
+#include "dfs_grep.h"
+#include "dfs_lines.h"
+#include "dfs_meta.h"
+#include "dfs_pack.h"
+
+#define PORT 4309
+#define MAX_CLIENTS 5
+#define BUFFER_SIZE 1024
+#define MAX_PATH_LEN 1024
+
+// Cached tar archive, rebuilt only after an upload or removal in S3
+#define TAR_CACHE_PATH "/tmp/dfs_s3_txtfiles.tar"
+
+struct dfs_meta file_meta; // Metadata table of the files in S3
+struct dfs_pack file_pack; // Segments small TXT files are packed into
+// What the shared helpers in dfs_core need to know about this server
+struct dfs_store file_store = { "S3", DFS_TYPE_TXT, "TXT", ".txt", TAR_CACHE_PATH, NULL, &file_meta, &file_pack,
+                                dfs_lines_build, dfs_lines_remove, dfs_lines_rename };
+
+// Function prototypes
+void handle_client(int client_sock);
+int upload_file(int client_sock, char *filename, char *dest_path, char *final_name);
+int download_file(int client_sock, char *filename);
+int read_lines(int client_sock, char *filename, uint64_t first, uint64_t count);
+int read_packed_lines(int client_sock, const char *s3_path, uint64_t first, uint64_t count);
+int remove_file(int client_sock, char *filename);
+int display_filenames(int client_sock, char *pathname);
+int grep_files(int client_sock, char *pattern, char *pathname, int regex);
+void error(const char *msg);
+
+// Main function initializes the server and listens for connections from S1.
+// It creates a child process for each connection to handle requests concurrently.
+int main() 
+{
+    int sockfd, newsockfd;
+    socklen_t clilen;
+    struct sockaddr_in serv_addr, cli_addr;
+    pid_t pid;
+
+    // Set up the shared tar cache state before forking any children
+    // and before opening the listener, so the watcher process never holds it
+    dfs_tar_cache_init(&file_store);
+    dfs_store_open(&file_store);
+    stats_init("S3");
+    trace_init("S3", 3);
+
+    // Create socket
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) 
+    {
+        error("ERROR opening socket");
+    }
+
+    // Accepted connections inherit the buffer sizes and TCP_NODELAY from the listener
+    net_tuning_init();
+    net_tune_socket(sockfd);
+
+    // Allow an immediate restart while old connections are still in TIME_WAIT
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Initialize socket structure
+    bzero((char *) &serv_addr, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = INADDR_ANY;
+    serv_addr.sin_port = htons(PORT);
+
+    // Bind the host address
+    if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
+    {
+        error("ERROR on binding");
+    }
+
+    // Start listening for the clients
+    listen(sockfd, MAX_CLIENTS);
+    clilen = sizeof(cli_addr);
+
+    printf("S3 server (TXT files) started on port %d\n", PORT);
+    char tuning[128];
+    net_describe(tuning, sizeof(tuning));
+    printf("Transfer tuning: %s\n", tuning);
+
+    // Main loop to accept connections from S1
+    while (1) 
+    {
+        // Accept connection from S1
+        newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
+        if (newsockfd < 0) 
+        {
+            error("ERROR on accept");
+        }
+        
+        // Children start from a current table; a snapshot is written once the journal is long
+        dfs_meta_sync(&file_meta);
+        dfs_meta_maybe_compact(&file_meta);
+        dfs_pack_maybe_compact(&file_pack);
+
+        // Create child process to handle the connection
+        pid = fork();
+        if (pid < 0) 
+        {
+            error("ERROR on fork");
+        }
+
+        if (pid == 0)
+        {
+            // Child process
+            close(sockfd);
+            handle_client(newsockfd);
+            close(newsockfd);
+            exit(0);
+        } 
+        else 
+        {
+            // Parent process
+            close(newsockfd);
+            // Clean up zombie processes
+            while (waitpid(-1, NULL, WNOHANG) > 0);
+        }
+    }
+
+    // Close the socket
+    close(sockfd);
+    return 0;
+}
+
+// Function to handle requests from S1
+// Parses the command received from S1 and calls the appropriate function.
+void handle_client(int client_sock) 
+{
+    char buffer[BUFFER_SIZE];
+    int n;
+    
+    // Read command from client (S1)
+    bzero(buffer, BUFFER_SIZE);
+    n = read(client_sock, buffer, BUFFER_SIZE - 1);
+    if (n < 0) 
+    {
+        error("ERROR reading from socket");
+    }
+    
+    // Take the request id S1 put in front of the command
+    uint64_t trace_start_us = trace_now_us();
+    char *request = trace_begin_request(buffer);
+    
+    printf("Received command: %s\n", request);
+    
+    // Parse command
+    char *cmd = strtok(request, " ");
+    if (cmd == NULL) 
+    {
+        write(client_sock, "ERROR: Invalid command", 22);
+        return;
+    }
+    trace_span("parse", trace_start_us, trace_now_us());
+    
+    // Time the whole request as seen by S1
+    uint64_t start_us = stats_now_us();
+    int op = stats_op_from_command(cmd);
+    int rc = -1;
+    
+    if (strcmp(cmd, "uploadf") == 0) 
+    {
+        // Handle file upload
+        char *filename = strtok(NULL, " ");
+        char *dest_path = strtok(NULL, " ");
+        if (filename == NULL || dest_path == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid uploadf command format", 36);
+            return;
+        }
+        char *final_name = strtok(NULL, " "); // Optional: name to store a staged file under
+        rc = upload_file(client_sock, filename, dest_path, final_name);
+    } 
+    else if (strcmp(cmd, "downlf") == 0) 
+    {
+        // Handle file download
+        char *filename = strtok(NULL, " ");
+        if (filename == NULL) {
+            write(client_sock, "ERROR: Invalid downlf command format", 34);
+            return;
+        }
+        rc = download_file(client_sock, filename);
+    } 
+    else if (strcmp(cmd, "readlines") == 0) 
+    {
+        // Handle a request for count lines starting at line start (1-based)
+        char *filename = strtok(NULL, " ");
+        char *start = strtok(NULL, " ");
+        char *count = strtok(NULL, " ");
+        if (filename == NULL || start == NULL || count == NULL || strtoull(start, NULL, 10) == 0 || strtoull(count, NULL, 10) == 0) 
+        {
+            write(client_sock, "ERROR: Invalid readlines command format", 39);
+            return;
+        }
+        rc = read_lines(client_sock, filename, strtoull(start, NULL, 10) - 1, strtoull(count, NULL, 10));
+    } 
+    else if (strcmp(cmd, "removef") == 0) 
+    {
+        // Handle file removal
+        char *filename = strtok(NULL, " ");
+        if (filename == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid removef command format", 35);
+            return;
+        }
+        rc = remove_file(client_sock, filename);
+    } 
+    else if (strcmp(cmd, "mremovef") == 0) 
+    {
+        // Handle a batch of removals grouped by S1; the paths follow as one frame
+        rc = dfs_remove_batch(&file_store, client_sock);
+    } 
+    else if (strcmp(cmd, "muploadf") == 0) 
+    {
+        // Handle a batch of files S1 staged for one directory
+        char *dest_path = strtok(NULL, " ");
+        if (dest_path == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid muploadf command format", 38);
+            return;
+        }
+        rc = dfs_upload_batch(&file_store, client_sock, dest_path);
+    } 
+    else if (strcmp(cmd, "copyf") == 0 || strcmp(cmd, "movef") == 0) 
+    {
+        // Handle a copy or rename between two names stored in S3
+        char *src = strtok(NULL, " ");
+        char *dst = strtok(NULL, " ");
+        if (src == NULL || dst == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid copyf/movef command format", 41);
+            return;
+        }
+        rc = dfs_copy_move_file(&file_store, client_sock, src, dst, strcmp(cmd, "movef") == 0);
+    } 
+    else if (strcmp(cmd, "fetchf") == 0) 
+    {
+        // Handle a file S1 wants moved here from another server: "fetchf <port> <src> <dst>"
+        char *port = strtok(NULL, " ");
+        char *src = strtok(NULL, " ");
+        char *dst = strtok(NULL, " ");
+        if (port == NULL || src == NULL || dst == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid fetchf command format", 36);
+            return;
+        }
+        rc = dfs_fetch_file(&file_store, client_sock, atoi(port), src, dst);
+    } 
+    else if (strcmp(cmd, "downltar") == 0)
+    {
+        // Handle tar file download, optionally compressed.
+        // "downltar all <path>" asks for this server's part of a federated archive.
+        char *filetype = strtok(NULL, " ");
+        if (filetype != NULL && strcmp(filetype, "all") == 0) 
+        {
+            char *subtree = strtok(NULL, " ");
+            if (subtree == NULL) 
+            {
+                write(client_sock, "ERROR: Invalid downltar command format", 36);
+                return;
+            }
+            rc = dfs_download_tar(&file_store, client_sock, subtree, NULL, 0);
+        } 
+        else 
+        {
+            char *codec = strtok(NULL, " ");
+            char *level = strtok(NULL, " ");
+            rc = dfs_download_tar(&file_store, client_sock, NULL, codec, (level != NULL) ? atoi(level) : 0);
+        }
+    } 
+    else if (strcmp(cmd, "dispfnames") == 0)
+    {
+        // Handle display filenames request
+        char *pathname = strtok(NULL, " ");
+        if (pathname == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid dispfnames command format", 38);
+            return;
+        }
+        rc = display_filenames(client_sock, pathname);
+    } 
+    else if (strcmp(cmd, "inventory") == 0) 
+    {
+        // Send S1 every stored path for its lookup filter
+        rc = dfs_send_inventory(&file_store, client_sock);
+    } 
+    else if (strcmp(cmd, "findf") == 0) 
+    {
+        // Handle S1's file name search over the TXT files
+        char *pattern = strtok(NULL, " ");
+        char *pathname = strtok(NULL, " ");
+        if (pattern == NULL || pathname == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid findf command format", 35);
+            return;
+        }
+        rc = dfs_find_store_files(&file_store, client_sock, pattern, pathname);
+    } 
+    else if (strcmp(cmd, "grepf") == 0) 
+    {
+        // Handle S1's content search over the TXT files
+        char *pattern = strtok(NULL, " ");
+        int regex = (pattern != NULL && strcmp(pattern, "-E") == 0);
+        if (regex) 
+        {
+            pattern = strtok(NULL, " ");
+        }
+        char *pathname = strtok(NULL, " ");
+        if (pattern == NULL || pathname == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid grepf command format", 35);
+            return;
+        }
+        rc = grep_files(client_sock, pattern, pathname, regex);
+    } 
+    else if (strcmp(cmd, "stats") == 0) 
+    {
+        // Report latency histograms for S3
+        char *format = strtok(NULL, " ");
+        rc = stats_send(client_sock, format != NULL && strcmp(format, "prom") == 0);
+    } 
+    else if (strcmp(cmd, "trace") == 0) 
+    {
+        // Send recorded spans as Chrome trace events for S1 to merge
+        char *request_id = strtok(NULL, " ");
+        rc = trace_send_events(client_sock, (request_id != NULL) ? strtoull(request_id, NULL, 16) : 0);
+    } 
+    else 
+    {
+        // Handle unknown command
+        write(client_sock, "ERROR: Unknown command", 21);
+    }
+    
+    stats_record(op, stats_now_us() - start_us, rc == 0);
+    trace_span(cmd, trace_start_us, trace_now_us());
+}
+
+// Function to upload a TXT file to S3
+// Receives the file from S1 and stores it in the appropriate directory.
+int upload_file(int client_sock, char *filename, char *dest_path, char *final_name) 
+{
+    // Staged uploads from S1 carry the real file name separately
+    char *base_name = (final_name != NULL) ? final_name : basename(filename);
+    
+    // First, check if the file is a TXT file
+    char *ext = strrchr(base_name, '.');
+    if (ext == NULL || strcmp(ext, ".txt") != 0) 
+    {
+        write(client_sock, "ERROR: S3 only handles TXT files", 31);
+        return -1;
+    }
+    
+    // Create destination path in S3
+    char s3_path[MAX_PATH_LEN];
+    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), dest_path + 3); // +3 to skip "~S1"
+    
+    // Construct full file path
+    char full_path[MAX_PATH_LEN];
+    snprintf(full_path, MAX_PATH_LEN, "%s/%s", s3_path, base_name);
+    
+    // Small files go into a pack segment, and need no directory
+    int packed = dfs_pack_take(&file_pack, filename, full_path, NULL);
+    if (packed < 0) 
+    {
+        write(client_sock, "ERROR: Failed to pack TXT file", 30);
+        return -1;
+    }
+    if (packed) 
+    {
+        dfs_lines_remove(full_path);
+        dfs_tar_cache_invalidate(&file_store);
+        write(client_sock, "SUCCESS: TXT file stored in S3", 30);
+        return 0;
+    }
+    
+    // Create directory tree if needed
+    if (create_directory_tree(s3_path) < 0) 
+    {
+        write(client_sock, "ERROR: Failed to create directory", 32);
+        return -1;
+    }
+    
+    // Rename/move the file from temporary location (sent by S1) to final destination
+    if (rename(filename, full_path) < 0) 
+    {
+        write(client_sock, "ERROR: Failed to move file to destination", 38);
+        return -1;
+    }
+    
+    dfs_meta_add(&file_meta, full_path);
+    dfs_tar_cache_invalidate(&file_store);
+    write(client_sock, "SUCCESS: TXT file stored in S3", 30);
+    
+    // Index the lines of large files once S1 has its answer
+    dfs_lines_build(full_path);
+    dfs_meta_hash(&file_meta, full_path);
+    return 0;
+}
+
+// Function to send count lines of a TXT file starting at line first (0-based)
+// The range is found with the file's line offset index and sent like a download:
+// its length, then the bytes straight from the page cache with sendfile().
+int read_lines(int client_sock, char *filename, uint64_t first, uint64_t count)
+{
+    char s3_path[MAX_PATH_LEN];
+    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+    
+    uint64_t span_start_us = trace_now_us();
+    int fd = open(s3_path, O_RDONLY);
+    if (fd < 0) 
+    {
+        return read_packed_lines(client_sock, s3_path, first, count);
+    }
+    off_t offset;
+    off_t length;
+    int rc = dfs_lines_slice(fd, s3_path, first, count, &offset, &length);
+    if (rc < 0) 
+    {
+        close(fd);
+        if (rc == LINES_OUT_OF_RANGE) 
+        {
+            write(client_sock, "ERROR: Line number past the end of the file", 43);
+        } 
+        else 
+        {
+            write(client_sock, "ERROR: Failed to index TXT file", 31);
+        }
+        return -1;
+    }
+    trace_span("lookup", span_start_us, trace_now_us());
+    
+    // Send the range's length, then the range itself
+    span_start_us = trace_now_us();
+    net_cork(client_sock);
+    if (net_write_full(client_sock, &length, sizeof(off_t)) < 0 || lseek(fd, offset, SEEK_SET) < 0 ||
+        net_sendfile(client_sock, fd, length) < 0) 
+    {
+        net_uncork(client_sock);
+        close(fd);
+        return -1;
+    }
+    net_uncork(client_sock);
+    close(fd);
+    trace_span("last_byte", span_start_us, trace_now_us());
+    stats_add_bytes(0, length);
+    return 0;
+}
+
+// Function to send count lines of a packed TXT file starting at line first (0-based)
+// Packed files are small, so the range is found by scanning the contents in memory.
+int read_packed_lines(int client_sock, const char *s3_path, uint64_t first, uint64_t count)
+{
+    uint64_t span_start_us = trace_now_us();
+    size_t len;
+    char *data = dfs_pack_load(&file_pack, s3_path, &len);
+    if (data == NULL) 
+    {
+        const char *reply = "ERROR: TXT file not found in S3";
+        write(client_sock, reply, strlen(reply));
+        return -1;
+    }
+    off_t offset;
+    off_t length;
+    if (dfs_lines_slice_data(data, len, first, count, &offset, &length) < 0) 
+    {
+        free(data);
+        write(client_sock, "ERROR: Line number past the end of the file", 43);
+        return -1;
+    }
+    trace_span("lookup", span_start_us, trace_now_us());
+    
+    span_start_us = trace_now_us();
+    net_cork(client_sock);
+    int rc = net_write_full(client_sock, &length, sizeof(off_t));
+    if (rc == 0) 
+    {
+        rc = net_write_full(client_sock, data + offset, length);
+    }
+    net_uncork(client_sock);
+    free(data);
+    if (rc < 0) 
+    {
+        return -1;
+    }
+    trace_span("last_byte", span_start_us, trace_now_us());
+    stats_add_bytes(0, length);
+    return 0;
+}
+
+// Function to download a TXT file from S3
+// Sends the requested file to S1 if it exists; packed files are sent from their segment.
+int download_file(int client_sock, char *filename)
+{
+    // Check if file exists in S3
+    char s3_path[MAX_PATH_LEN];
+    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+    
+    uint64_t span_start_us = trace_now_us();
+    struct stat st;
+    struct dfs_meta_entry packed;
+    int fd;
+    if (stat(s3_path, &st) != 0) 
+    {
+        fd = dfs_pack_open_file(&file_pack, s3_path, &packed);
+        if (fd < 0) 
+        {
+            write(client_sock, "ERROR: TXT file not found in S3", 30);
+            return -1;
+        }
+        st.st_size = packed.size;
+    }
+    else 
+    {
+        fd = open(s3_path, O_RDONLY);
+    }
+    if (fd < 0) 
+    {
+        write(client_sock, "ERROR: Failed to open TXT file", 29);
+        return -1;
+    }
+    
+    trace_span("lookup", span_start_us, trace_now_us());
+    
+    // Send file size
+    span_start_us = trace_now_us();
+    net_cork(client_sock); // Header and body leave together
+    if (net_write_full(client_sock, &st.st_size, sizeof(off_t)) < 0)
+    {
+        net_uncork(client_sock);
+        close(fd);
+        write(client_sock, "ERROR: Failed to send file size", 31);
+        return -1;
+    }
+    
+    trace_span("first_byte", span_start_us, trace_now_us());
+    
+    // Send file data
+    span_start_us = trace_now_us();
+    int copied = dfs_copy_fd(fd, client_sock, st.st_size, net_io_buffer());
+    net_uncork(client_sock);
+    if (copied < 0) 
+    {
+        close(fd);
+        write(client_sock, "ERROR: File transfer failed", 27);
+        return -1;
+    }
+    close(fd);
+    trace_span("last_byte", span_start_us, trace_now_us());
+    stats_add_bytes(0, st.st_size);
+    return 0;
+}
+
+// Function to remove a TXT file from S3
+// Deletes the specified file if it exists.
+int remove_file(int client_sock, char *filename)
+{
+    // Check if file exists in S3
+    char s3_path[MAX_PATH_LEN];
+    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+    
+    if (unlink(s3_path) == 0) 
+    {
+        dfs_lines_remove(s3_path);
+        dfs_meta_remove(&file_meta, s3_path);
+        dfs_tar_cache_invalidate(&file_store);
+        write(client_sock, "SUCCESS: TXT file deleted from S3", 32);
+        return 0;
+    }
+    if (dfs_pack_remove(&file_pack, s3_path) == 0) 
+    {
+        dfs_tar_cache_invalidate(&file_store);
+        write(client_sock, "SUCCESS: TXT file deleted from S3", 32);
+        return 0;
+    }
+    
+    write(client_sock, "ERROR: TXT file not found in S3", 30);
+    return -1;
+}
+
+// Function to display filenames of TXT files in S3
+// Recursively lists all .txt files in the S3 directory.
+int display_filenames(int client_sock, char *pathname)
+{
+    // Get the corresponding path in S3
+    char s3_path[MAX_PATH_LEN];
+    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), 
+             (strcmp(pathname, "~S1") == 0) ? "" : (pathname + 3)); // Handle root case
+    
+    // Get TXT files from S3 recursively; packed files have no directory on disk
+    char file_list[BUFFER_SIZE] = {0};
+    dfs_meta_list(&file_meta, s3_path, file_list, sizeof(file_list));
+    
+    // Send the list to S1
+    write(client_sock, file_list, strlen(file_list));
+    stats_add_bytes(0, strlen(file_list));
+    return 0;
+}
+
+// Function to send S1 the matching lines of the TXT files below pathname
+// The lines are streamed until the connection is closed.
+int grep_files(int client_sock, char *pattern, char *pathname, int regex) 
+{
+    struct dfs_grep grep;
+    if (strncmp(pathname, "~S1", 3) != 0 || dfs_grep_init(&grep, pattern, regex) < 0) 
+    {
+        return -1;
+    }
+    
+    char s3_path[MAX_PATH_LEN];
+    snprintf(s3_path, MAX_PATH_LEN, "%s/S3%s", getenv("HOME"), pathname + 3); // +3 to skip "~S1"
+    long found = dfs_grep_tree(&grep, s3_path, ".txt", pathname, client_sock, dfs_grep_threads());
+    if (found >= 0) 
+    {
+        found = dfs_pack_grep(&file_pack, &grep, s3_path, pathname, client_sock);
+    }
+    dfs_grep_free(&grep);
+    return (found < 0) ? -1 : 0;
+}
+
+// Function to handle errors
+// Prints the error message and exits the program.
+void error(const char *msg) 
+{
+    perror(msg);
+    exit(1);
 }
\ No newline at end of file
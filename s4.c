@@ -1,424 +1,644 @@
-// Distributed File System - S4 Server Implementation
-// This file implements the server (S4) which handles ZIP files.
-// S4 receives commands from S1 and processes them accordingly.
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <netdb.h>
-#include <arpa/inet.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <dirent.h>
-#include <libgen.h>
-#include <sys/wait.h>
-#include <sys/sendfile.h>
-#include <time.h>
-#include <errno.h>
-
-#define PORT 4310
-#define MAX_CLIENTS 5
-#define BUFFER_SIZE 1024
-#define MAX_PATH_LEN 1024
-
-// Function prototypes
-void handle_client(int client_sock);
-int upload_file(int client_sock, char *filename, char *dest_path);
-int download_file(int client_sock, char *filename);
-int remove_file(int client_sock, char *filename);
-int display_filenames(int client_sock, char *pathname);
-int create_directory_tree(char *path);
-void error(const char *msg);
-
-// Main function initializes the server and listens for connections from S1.
-// It creates a child process for each connection to handle requests concurrently.
-int main() 
-{
-    int sockfd, newsockfd;
-    socklen_t clilen;
-    struct sockaddr_in serv_addr, cli_addr;
-    pid_t pid;
-
-    // Create socket
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd < 0) 
-    {
-        error("ERROR opening socket");
-    }
-
-    // Initialize socket structure
-    bzero((char *) &serv_addr, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(PORT);
-
-    // Bind the host address
-    if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
-    {
-        error("ERROR on binding");
-    }
-
-    // Start listening for the clients
-    listen(sockfd, MAX_CLIENTS);
-    clilen = sizeof(cli_addr);
-
-    printf("S4 server (ZIP files) started on port %d\n", PORT);
-
-    // Main loop to accept connections from S1
-    while (1) 
-    {
-        // Accept connection from S1
-        newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
-        if (newsockfd < 0) 
-        {
-            error("ERROR on accept");
-        }
-
-        // Create child process to handle the connection
-        pid = fork();
-        if (pid < 0) {
-            error("ERROR on fork");
-        }
-
-        if (pid == 0) {
-            // Child process
-            close(sockfd);
-            handle_client(newsockfd);
-            close(newsockfd);
-            exit(0);
-        } 
-        else 
-        {
-            // Parent process
-            close(newsockfd);
-            // Clean up zombie processes
-            while (waitpid(-1, NULL, WNOHANG) > 0);
-        }
-    }
-
-    // Close the socket
-    close(sockfd);
-    return 0;
-}
-
-// Function to handle requests from S1
-// Parses the command received from S1 and calls the appropriate function.
-void handle_client(int client_sock) 
-{
-    char buffer[BUFFER_SIZE];
-    int n;
-    
-    // Read command from client (S1)
-    bzero(buffer, BUFFER_SIZE);
-    n = read(client_sock, buffer, BUFFER_SIZE - 1);
-    if (n < 0) 
-    {
-        error("ERROR reading from socket");
-    }
-    
-    printf("Received command: %s\n", buffer);
-    
-    // Parse command
-    char *cmd = strtok(buffer, " ");
-    if (cmd == NULL) 
-    {
-        write(client_sock, "ERROR: Invalid command", 22);
-        return;
-    }
-    
-    if (strcmp(cmd, "uploadf") == 0) 
-    {
-        // Handle file upload
-        char *filename = strtok(NULL, " ");
-        char *dest_path = strtok(NULL, " ");
-        if (filename == NULL || dest_path == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid uploadf command format", 36);
-            return;
-        }
-        upload_file(client_sock, filename, dest_path);
-    } 
-    else if (strcmp(cmd, "downlf") == 0) 
-    {
-        // Handle file download
-        char *filename = strtok(NULL, " ");
-        if (filename == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid downlf command format", 34);
-            return;
-        }
-        download_file(client_sock, filename);
-    } 
-    else if (strcmp(cmd, "removef") == 0) 
-    {
-        // Handle file removal
-        char *filename = strtok(NULL, " ");
-        if (filename == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid removef command format", 35);
-            return;
-        }
-        remove_file(client_sock, filename);
-    } 
-    else if (strcmp(cmd, "dispfnames") == 0) 
-    {
-        // Handle display filenames request
-        char *pathname = strtok(NULL, " ");
-        if (pathname == NULL) 
-        {
-            write(client_sock, "ERROR: Invalid dispfnames command format", 38);
-            return;
-        }
-        display_filenames(client_sock, pathname);
-    } 
-    else 
-    {
-        // Handle unknown command
-        write(client_sock, "ERROR: Unknown command", 21);
-    }
-}
-
-// Function to upload a ZIP file to S4
-// Receives the file from S1 and stores it in the appropriate directory.
-int upload_file(int client_sock, char *filename, char *dest_path) 
-{
-    // First, check if the file is a ZIP file
-    char *ext = strrchr(filename, '.');
-    if (ext == NULL || strcmp(ext, ".zip") != 0) 
-    {
-        write(client_sock, "ERROR: S4 only handles ZIP files", 31);
-        return -1;
-    }
-    
-    // Create destination path in S4
-    char s4_path[MAX_PATH_LEN];
-    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), dest_path + 3); // +3 to skip "~S1"
-    
-    // Create directory tree if needed
-    if (create_directory_tree(s4_path) < 0) 
-    {
-        write(client_sock, "ERROR: Failed to create directory", 32);
-        return -1;
-    }
-    
-    // Construct full file path
-    char *base_name = basename(filename);
-    char full_path[MAX_PATH_LEN];
-    snprintf(full_path, MAX_PATH_LEN, "%s/%s", s4_path, base_name);
-    
-    // Rename/move the file from temporary location (sent by S1) to final destination
-    if (rename(filename, full_path) < 0) 
-    {
-        write(client_sock, "ERROR: Failed to move file to destination", 38);
-        return -1;
-    }
-    
-    write(client_sock, "SUCCESS: ZIP file stored in S4", 30);
-    return 0;
-}
-
-// Function to download a ZIP file from S4
-// Sends the requested file to S1 if it exists.
-int download_file(int client_sock, char *filename) 
-{
-    // Check if file exists in S4
-    char s4_path[MAX_PATH_LEN];
-    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
-    
-    struct stat st;
-    if (stat(s4_path, &st) != 0) 
-    {
-        write(client_sock, "ERROR: ZIP file not found in S4", 30);
-        return -1;
-    }
-    
-    // Open file
-    int fd = open(s4_path, O_RDONLY);
-    if (fd < 0) 
-    {
-        write(client_sock, "ERROR: Failed to open ZIP file", 29);
-        return -1;
-    }
-    
-    // Send file size
-    if (write(client_sock, &st.st_size, sizeof(off_t)) != sizeof(off_t)) 
-    {
-        close(fd);
-        write(client_sock, "ERROR: Failed to send file size", 31);
-        return -1;
-    }
-    
-    // Send file data
-    off_t remaining = st.st_size;
-    char buffer[BUFFER_SIZE];
-    while (remaining > 0) 
-    {
-        ssize_t n = read(fd, buffer, (remaining < BUFFER_SIZE) ? remaining : BUFFER_SIZE);
-        if (n <= 0) {
-            close(fd);
-            write(client_sock, "ERROR: File transfer failed", 27);
-            return -1;
-        }
-        if (write(client_sock, buffer, n) != n) 
-        {
-            close(fd);
-            write(client_sock, "ERROR: File transfer failed", 27);
-            return -1;
-        }
-        remaining -= n;
-    }
-    close(fd);
-    return 0;
-}
-
-// Function to remove a ZIP file from S4
-// Deletes the specified file if it exists.
-int remove_file(int client_sock, char *filename) 
-{
-    // Check if file exists in S4
-    char s4_path[MAX_PATH_LEN];
-    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
-    
-    if (unlink(s4_path) == 0) 
-    {
-        write(client_sock, "SUCCESS: ZIP file deleted from S4", 32);
-        return 0;
-    }
-    
-    write(client_sock, "ERROR: ZIP file not found in S4", 30);
-    return -1;
-}
-
-// Function to display filenames of ZIP files in S4
-// Recursively lists all .zip files in the S4 directory.
-int display_filenames(int client_sock, char *pathname) 
-{
-    // Get the corresponding path in S4
-    char s4_path[MAX_PATH_LEN];
-    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), 
-             (strcmp(pathname, "~S1") == 0) ? "" : (pathname + 3)); // Handle root case
-    
-    // Check if path exists and is a directory
-    struct stat st;
-    if (stat(s4_path, &st) != 0 || !S_ISDIR(st.st_mode)) 
-    {
-        write(client_sock, "", 0); // Send empty response if directory doesn't exist
-        return 0;
-    }
-    
-    // Get ZIP files from S4 recursively
-    char file_list[BUFFER_SIZE] = {0};
-    
-    // Recursive directory traversal function
-    void list_zip_files(const char *base_path, const char *relative_path) 
-    {
-        DIR *dir = opendir(base_path);
-        if (!dir) return;
-        
-        struct dirent *ent;
-        while ((ent = readdir(dir)) != NULL) 
-        {
-            // Skip . and .. directories
-            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) 
-            {
-                continue;
-            }
-            
-            char full_path[MAX_PATH_LEN];
-            snprintf(full_path, sizeof(full_path), "%s/%s", base_path, ent->d_name);
-            
-            char new_relative_path[MAX_PATH_LEN];
-            if (strcmp(relative_path, "") == 0) 
-            {
-                snprintf(new_relative_path, sizeof(new_relative_path), "%s", ent->d_name);
-            } 
-            else 
-            {
-                snprintf(new_relative_path, sizeof(new_relative_path), "%s/%s", relative_path, ent->d_name);
-            }
-            
-            if (ent->d_type == DT_REG) 
-            {
-                // Check if it's a ZIP file
-                char *ext = strrchr(ent->d_name, '.');
-                if (ext && strcmp(ext, ".zip") == 0) 
-                {
-                    // Convert to ~S1-style path
-                    char output_path[MAX_PATH_LEN];
-                    // snprintf(output_path, sizeof(output_path), "~S1%s/%s", 
-                            // pathname + 2, new_relative_path); // +2 to skip "~S"
-					snprintf(output_path, sizeof(output_path), "~S1/%s", new_relative_path);
-
-                    
-                    strncat(file_list, output_path, BUFFER_SIZE - strlen(file_list) - 1);
-                    strncat(file_list, "\n", BUFFER_SIZE - strlen(file_list) - 1);
-                }
-            } 
-            else if (ent->d_type == DT_DIR) 
-            {
-                // Recursively process subdirectory
-                list_zip_files(full_path, new_relative_path);
-            }
-        }
-        closedir(dir);
-    }
-    
-    // Start recursive traversal from the base path
-    list_zip_files(s4_path, "");
-    
-    // Send the list to S1
-    write(client_sock, file_list, strlen(file_list));
-    return 0;
-}
-
-// Function to create a directory tree for a given path
-// Ensures that all intermediate directories in the path exist.
-int create_directory_tree(char *path) 
-{
-    char *p;
-    char tmp[MAX_PATH_LEN];
-    
-    snprintf(tmp, MAX_PATH_LEN, "%s", path);
-    
-    // Skip leading slash if present
-    if (tmp[0] == '/') 
-    {
-        p = tmp + 1;
-    } 
-    else 
-    {
-        p = tmp;
-    }
-    
-    // Create each directory in the path
-    while ((p = strchr(p, '/'))) 
-    {
-        *p = '\0';
-        if (mkdir(tmp, 0755) && errno != EEXIST) 
-        {
-            return -1;
-        }
-        *p = '/';
-        p++;
-    }
-    
-    // Create the final directory
-    if (mkdir(tmp, 0755) && errno != EEXIST) 
-    {
-        return -1;
-    }
-    
-    return 0;
-}
-
-// Function to handle errors
-// Prints the error message and exits the program.
-void error(const char *msg) 
-{
-    perror(msg);
-    exit(1);
+// Distributed File System - S4 Server Implementation
+// This file implements the server (S4) which handles ZIP files.
+// S4 receives commands from S1 and processes them accordingly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/wait.h>
+#include <sys/sendfile.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "dfs_stats.h"
+#include "dfs_trace.h"
+#include "dfs_core.h"
+#include "dfs_net.h"
+#include "dfs_peer.h"
+#include "dfs_match.h"
+#include "dfs_zip.h"
+#include "dfs_meta.h"
+
+#define PORT 4310
+#define MAX_CLIENTS 5
+#define BUFFER_SIZE 1024
+#define MAX_PATH_LEN 1024
+
+// Cached tar archive, rebuilt only after an upload or removal in S4
+#define TAR_CACHE_PATH "/tmp/dfs_s4_zipfiles.tar"
+
+struct dfs_meta file_meta; // Metadata table of the files in S4
+// What the shared helpers in dfs_core need to know about this server
+struct dfs_store file_store = { "S4", DFS_TYPE_ZIP, "ZIP", ".zip", TAR_CACHE_PATH, NULL, &file_meta, NULL,
+                                dfs_zip_build, dfs_zip_remove, dfs_zip_rename };
+
+// Function prototypes
+void handle_client(int client_sock);
+int upload_file(int client_sock, char *filename, char *dest_path, char *final_name);
+int download_file(int client_sock, char *filename);
+int open_archive(int client_sock, char *filename, char *s4_path, struct dfs_zip_index *index);
+int list_members(int client_sock, char *filename);
+int download_member(int client_sock, char *filename, char *member);
+int remove_file(int client_sock, char *filename);
+int display_filenames(int client_sock, char *pathname);
+void error(const char *msg);
+
+// Main function initializes the server and listens for connections from S1.
+// It creates a child process for each connection to handle requests concurrently.
+int main() 
+{
+    int sockfd, newsockfd;
+    socklen_t clilen;
+    struct sockaddr_in serv_addr, cli_addr;
+    pid_t pid;
+
+    // Set up the shared tar cache state before forking any children
+    // and before opening the listener, so the watcher process never holds it
+    dfs_tar_cache_init(&file_store);
+    dfs_store_open(&file_store);
+    stats_init("S4");
+    trace_init("S4", 4);
+
+    // Create socket
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) 
+    {
+        error("ERROR opening socket");
+    }
+
+    // Accepted connections inherit the buffer sizes and TCP_NODELAY from the listener
+    net_tuning_init();
+    net_tune_socket(sockfd);
+
+    // Allow an immediate restart while old connections are still in TIME_WAIT
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Initialize socket structure
+    bzero((char *) &serv_addr, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = INADDR_ANY;
+    serv_addr.sin_port = htons(PORT);
+
+    // Bind the host address
+    if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
+    {
+        error("ERROR on binding");
+    }
+
+    // Start listening for the clients
+    listen(sockfd, MAX_CLIENTS);
+    clilen = sizeof(cli_addr);
+
+    printf("S4 server (ZIP files) started on port %d\n", PORT);
+    char tuning[128];
+    net_describe(tuning, sizeof(tuning));
+    printf("Transfer tuning: %s\n", tuning);
+
+    // Main loop to accept connections from S1
+    while (1) 
+    {
+        // Accept connection from S1
+        newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
+        if (newsockfd < 0) 
+        {
+            error("ERROR on accept");
+        }
+        
+        // Children start from a current table; a snapshot is written once the journal is long
+        dfs_meta_sync(&file_meta);
+        dfs_meta_maybe_compact(&file_meta);
+
+        // Create child process to handle the connection
+        pid = fork();
+        if (pid < 0) {
+            error("ERROR on fork");
+        }
+
+        if (pid == 0) {
+            // Child process
+            close(sockfd);
+            handle_client(newsockfd);
+            close(newsockfd);
+            exit(0);
+        } 
+        else 
+        {
+            // Parent process
+            close(newsockfd);
+            // Clean up zombie processes
+            while (waitpid(-1, NULL, WNOHANG) > 0);
+        }
+    }
+
+    // Close the socket
+    close(sockfd);
+    return 0;
+}
+
+// Function to handle requests from S1
+// Parses the command received from S1 and calls the appropriate function.
+void handle_client(int client_sock) 
+{
+    char buffer[BUFFER_SIZE];
+    int n;
+    
+    // Read command from client (S1)
+    bzero(buffer, BUFFER_SIZE);
+    n = read(client_sock, buffer, BUFFER_SIZE - 1);
+    if (n < 0) 
+    {
+        error("ERROR reading from socket");
+    }
+    
+    // Take the request id S1 put in front of the command
+    uint64_t trace_start_us = trace_now_us();
+    char *request = trace_begin_request(buffer);
+    
+    printf("Received command: %s\n", request);
+    
+    // Parse command
+    char *cmd = strtok(request, " ");
+    if (cmd == NULL) 
+    {
+        write(client_sock, "ERROR: Invalid command", 22);
+        return;
+    }
+    trace_span("parse", trace_start_us, trace_now_us());
+    
+    // Time the whole request as seen by S1
+    uint64_t start_us = stats_now_us();
+    int op = stats_op_from_command(cmd);
+    int rc = -1;
+    
+    if (strcmp(cmd, "uploadf") == 0) 
+    {
+        // Handle file upload
+        char *filename = strtok(NULL, " ");
+        char *dest_path = strtok(NULL, " ");
+        if (filename == NULL || dest_path == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid uploadf command format", 36);
+            return;
+        }
+        char *final_name = strtok(NULL, " "); // Optional: name to store a staged file under
+        rc = upload_file(client_sock, filename, dest_path, final_name);
+    } 
+    else if (strcmp(cmd, "downlf") == 0) 
+    {
+        // Handle file download
+        char *filename = strtok(NULL, " ");
+        if (filename == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid downlf command format", 34);
+            return;
+        }
+        rc = download_file(client_sock, filename);
+    } 
+    else if (strcmp(cmd, "zipls") == 0) 
+    {
+        // Handle a listing of the members of an archive
+        char *filename = strtok(NULL, " ");
+        if (filename == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid zipls command format", 35);
+            return;
+        }
+        rc = list_members(client_sock, filename);
+    } 
+    else if (strcmp(cmd, "zipget") == 0) 
+    {
+        // Handle a download of one member; the member name is the rest of the line
+        char *filename = strtok(NULL, " ");
+        char *member = strtok(NULL, "");
+        if (filename == NULL || member == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid zipget command format", 36);
+            return;
+        }
+        rc = download_member(client_sock, filename, member);
+    } 
+    else if (strcmp(cmd, "removef") == 0) 
+    {
+        // Handle file removal
+        char *filename = strtok(NULL, " ");
+        if (filename == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid removef command format", 35);
+            return;
+        }
+        rc = remove_file(client_sock, filename);
+    } 
+    else if (strcmp(cmd, "mremovef") == 0) 
+    {
+        // Handle a batch of removals grouped by S1; the paths follow as one frame
+        rc = dfs_remove_batch(&file_store, client_sock);
+    } 
+    else if (strcmp(cmd, "muploadf") == 0) 
+    {
+        // Handle a batch of files S1 staged for one directory
+        char *dest_path = strtok(NULL, " ");
+        if (dest_path == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid muploadf command format", 38);
+            return;
+        }
+        rc = dfs_upload_batch(&file_store, client_sock, dest_path);
+    } 
+    else if (strcmp(cmd, "copyf") == 0 || strcmp(cmd, "movef") == 0) 
+    {
+        // Handle a copy or rename between two names stored in S4
+        char *src = strtok(NULL, " ");
+        char *dst = strtok(NULL, " ");
+        if (src == NULL || dst == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid copyf/movef command format", 41);
+            return;
+        }
+        rc = dfs_copy_move_file(&file_store, client_sock, src, dst, strcmp(cmd, "movef") == 0);
+    } 
+    else if (strcmp(cmd, "fetchf") == 0) 
+    {
+        // Handle a file S1 wants moved here from another server: "fetchf <port> <src> <dst>"
+        char *port = strtok(NULL, " ");
+        char *src = strtok(NULL, " ");
+        char *dst = strtok(NULL, " ");
+        if (port == NULL || src == NULL || dst == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid fetchf command format", 36);
+            return;
+        }
+        rc = dfs_fetch_file(&file_store, client_sock, atoi(port), src, dst);
+    } 
+    else if (strcmp(cmd, "downltar") == 0) 
+    {
+        // Handle tar file download, optionally compressed.
+        // "downltar all <path>" asks for this server's part of a federated archive.
+        char *filetype = strtok(NULL, " ");
+        if (filetype != NULL && strcmp(filetype, "all") == 0) 
+        {
+            char *subtree = strtok(NULL, " ");
+            if (subtree == NULL) 
+            {
+                write(client_sock, "ERROR: Invalid downltar command format", 36);
+                return;
+            }
+            rc = dfs_download_tar(&file_store, client_sock, subtree, NULL, 0);
+        } 
+        else 
+        {
+            char *codec = strtok(NULL, " ");
+            char *level = strtok(NULL, " ");
+            rc = dfs_download_tar(&file_store, client_sock, NULL, codec, (level != NULL) ? atoi(level) : 0);
+        }
+    } 
+    else if (strcmp(cmd, "dispfnames") == 0) 
+    {
+        // Handle display filenames request
+        char *pathname = strtok(NULL, " ");
+        if (pathname == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid dispfnames command format", 38);
+            return;
+        }
+        rc = display_filenames(client_sock, pathname);
+    } 
+    else if (strcmp(cmd, "inventory") == 0) 
+    {
+        // Send S1 every stored path for its lookup filter
+        rc = dfs_send_inventory(&file_store, client_sock);
+    } 
+    else if (strcmp(cmd, "findf") == 0) 
+    {
+        // Handle S1's file name search over the ZIP files
+        char *pattern = strtok(NULL, " ");
+        char *pathname = strtok(NULL, " ");
+        if (pattern == NULL || pathname == NULL) 
+        {
+            write(client_sock, "ERROR: Invalid findf command format", 35);
+            return;
+        }
+        rc = dfs_find_store_files(&file_store, client_sock, pattern, pathname);
+    } 
+    else if (strcmp(cmd, "stats") == 0) 
+    {
+        // Report latency histograms for S4
+        char *format = strtok(NULL, " ");
+        rc = stats_send(client_sock, format != NULL && strcmp(format, "prom") == 0);
+    } 
+    else if (strcmp(cmd, "trace") == 0) 
+    {
+        // Send recorded spans as Chrome trace events for S1 to merge
+        char *request_id = strtok(NULL, " ");
+        rc = trace_send_events(client_sock, (request_id != NULL) ? strtoull(request_id, NULL, 16) : 0);
+    } 
+    else 
+    {
+        // Handle unknown command
+        write(client_sock, "ERROR: Unknown command", 21);
+    }
+    
+    stats_record(op, stats_now_us() - start_us, rc == 0);
+    trace_span(cmd, trace_start_us, trace_now_us());
+}
+
+// Function to upload a ZIP file to S4
+// Receives the file from S1 and stores it in the appropriate directory.
+int upload_file(int client_sock, char *filename, char *dest_path, char *final_name) 
+{
+    // Staged uploads from S1 carry the real file name separately
+    char *base_name = (final_name != NULL) ? final_name : basename(filename);
+    
+    // First, check if the file is a ZIP file
+    char *ext = strrchr(base_name, '.');
+    if (ext == NULL || strcmp(ext, ".zip") != 0) 
+    {
+        write(client_sock, "ERROR: S4 only handles ZIP files", 31);
+        return -1;
+    }
+    
+    // Create destination path in S4
+    char s4_path[MAX_PATH_LEN];
+    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), dest_path + 3); // +3 to skip "~S1"
+    
+    // Create directory tree if needed
+    if (create_directory_tree(s4_path) < 0) 
+    {
+        write(client_sock, "ERROR: Failed to create directory", 32);
+        return -1;
+    }
+    
+    // Construct full file path
+    char full_path[MAX_PATH_LEN];
+    snprintf(full_path, MAX_PATH_LEN, "%s/%s", s4_path, base_name);
+    
+    // Rename/move the file from temporary location (sent by S1) to final destination
+    if (rename(filename, full_path) < 0) 
+    {
+        write(client_sock, "ERROR: Failed to move file to destination", 38);
+        return -1;
+    }
+    
+    dfs_meta_add(&file_meta, full_path);
+    dfs_tar_cache_invalidate(&file_store);
+    write(client_sock, "SUCCESS: ZIP file stored in S4", 30);
+    
+    // Index the central directory once S1 has its answer
+    dfs_zip_build(full_path);
+    dfs_meta_hash(&file_meta, full_path);
+    return 0;
+}
+
+// Function to open a stored archive and its member index
+// Answers the request with an error itself if that fails. Returns the open file or -1.
+int open_archive(int client_sock, char *filename, char *s4_path, struct dfs_zip_index *index) 
+{
+    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+    int fd = open(s4_path, O_RDONLY);
+    if (fd < 0) 
+    {
+        write(client_sock, "ERROR: ZIP file not found in S4", 30);
+        return -1;
+    }
+    int rc = dfs_zip_open(fd, s4_path, index);
+    if (rc < 0) 
+    {
+        close(fd);
+        if (rc == ZIP_INVALID) 
+        {
+            write(client_sock, "ERROR: File is not a valid ZIP archive", 38);
+        } 
+        else 
+        {
+            write(client_sock, "ERROR: Failed to index ZIP file", 31);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// Function to list the members of an archive from its index
+// One line per member, "<size> <compressed size> <method> <name>", streamed until the connection closes.
+int list_members(int client_sock, char *filename) 
+{
+    char s4_path[MAX_PATH_LEN];
+    struct dfs_zip_index index;
+    uint64_t span_start_us = trace_now_us();
+    int fd = open_archive(client_sock, filename, s4_path, &index);
+    if (fd < 0) 
+    {
+        return -1;
+    }
+    close(fd);
+    trace_span("lookup", span_start_us, trace_now_us());
+    
+    char *out = malloc(BUFFER_SIZE * 64);
+    size_t out_len = 0;
+    int rc = (out != NULL) ? 0 : -1;
+    for (uint64_t i = 0; rc == 0 && i < index.count; i++) 
+    {
+        const struct dfs_zip_entry *entry = &index.entries[i];
+        if (out_len + entry->name_len + 64 > BUFFER_SIZE * 64) 
+        {
+            rc = net_write_full(client_sock, out, out_len);
+            stats_add_bytes(0, out_len);
+            out_len = 0;
+        }
+        const char *method = (entry->method == ZIP_METHOD_STORED) ? "stored" : 
+                             (entry->method == ZIP_METHOD_DEFLATED) ? "deflated" : "other";
+        out_len += snprintf(out + out_len, BUFFER_SIZE * 64 - out_len, "%llu %llu %s %s\n", 
+                            (unsigned long long)entry->size, (unsigned long long)entry->compressed_size, 
+                            method, index.names + entry->name_offset);
+    }
+    if (rc == 0 && out_len > 0) 
+    {
+        rc = net_write_full(client_sock, out, out_len);
+        stats_add_bytes(0, out_len);
+    }
+    free(out);
+    dfs_zip_close(&index);
+    return rc;
+}
+
+// Function to send one member of an archive
+// The reply is a frame with "<method> <crc32 in hex> <size>", then the member's compressed
+// data framed like a download and sent with sendfile() straight from its offset in the archive.
+int download_member(int client_sock, char *filename, char *member) 
+{
+    char s4_path[MAX_PATH_LEN];
+    struct dfs_zip_index index;
+    uint64_t span_start_us = trace_now_us();
+    int fd = open_archive(client_sock, filename, s4_path, &index);
+    if (fd < 0) 
+    {
+        return -1;
+    }
+    const struct dfs_zip_entry *found = dfs_zip_find(&index, member);
+    struct dfs_zip_entry entry;
+    if (found != NULL) 
+    {
+        entry = *found;
+    }
+    dfs_zip_close(&index);
+    trace_span("lookup", span_start_us, trace_now_us());
+    
+    const char *problem = NULL;
+    if (found == NULL) 
+    {
+        problem = "ERROR: Member not found in ZIP file";
+    } 
+    else if (entry.flags & ZIP_FLAG_ENCRYPTED) 
+    {
+        problem = "ERROR: Encrypted ZIP members are not supported";
+    } 
+    else if (entry.method != ZIP_METHOD_STORED && entry.method != ZIP_METHOD_DEFLATED) 
+    {
+        problem = "ERROR: Only stored and deflated ZIP members are supported";
+    }
+    if (problem != NULL) 
+    {
+        close(fd);
+        write(client_sock, problem, strlen(problem));
+        return -1;
+    }
+    
+    span_start_us = trace_now_us();
+    char meta[64];
+    int meta_len = snprintf(meta, sizeof(meta), "%u %08x %llu", entry.method, entry.crc32, (unsigned long long)entry.size);
+    off_t length = entry.compressed_size;
+    net_cork(client_sock);
+    if (net_write_frame(client_sock, meta, meta_len) < 0 || net_write_full(client_sock, &length, sizeof(off_t)) < 0 || 
+        lseek(fd, entry.data_offset, SEEK_SET) < 0 || net_sendfile(client_sock, fd, length) < 0) 
+    {
+        net_uncork(client_sock);
+        close(fd);
+        return -1;
+    }
+    net_uncork(client_sock);
+    close(fd);
+    trace_span("last_byte", span_start_us, trace_now_us());
+    stats_add_bytes(0, length);
+    return 0;
+}
+
+// Function to download a ZIP file from S4
+// Sends the requested file to S1 if it exists.
+int download_file(int client_sock, char *filename) 
+{
+    // Check if file exists in S4
+    char s4_path[MAX_PATH_LEN];
+    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+    
+    uint64_t span_start_us = trace_now_us();
+    struct stat st;
+    if (stat(s4_path, &st) != 0) 
+    {
+        write(client_sock, "ERROR: ZIP file not found in S4", 30);
+        return -1;
+    }
+    
+    // Open file
+    int fd = open(s4_path, O_RDONLY);
+    if (fd < 0) 
+    {
+        write(client_sock, "ERROR: Failed to open ZIP file", 29);
+        return -1;
+    }
+    
+    trace_span("lookup", span_start_us, trace_now_us());
+    
+    // Send file size
+    span_start_us = trace_now_us();
+    net_cork(client_sock); // Header and body leave together
+    if (net_write_full(client_sock, &st.st_size, sizeof(off_t)) < 0) 
+    {
+        net_uncork(client_sock);
+        close(fd);
+        write(client_sock, "ERROR: Failed to send file size", 31);
+        return -1;
+    }
+    
+    trace_span("first_byte", span_start_us, trace_now_us());
+    
+    // Send file data
+    span_start_us = trace_now_us();
+    int copied = dfs_copy_fd(fd, client_sock, st.st_size, net_io_buffer());
+    net_uncork(client_sock);
+    if (copied < 0) 
+    {
+        close(fd);
+        write(client_sock, "ERROR: File transfer failed", 27);
+        return -1;
+    }
+    close(fd);
+    trace_span("last_byte", span_start_us, trace_now_us());
+    stats_add_bytes(0, st.st_size);
+    return 0;
+}
+
+// Function to remove a ZIP file from S4
+// Deletes the specified file if it exists.
+int remove_file(int client_sock, char *filename) 
+{
+    // Check if file exists in S4
+    char s4_path[MAX_PATH_LEN];
+    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), filename + 3); // +3 to skip "~S1"
+    
+    if (unlink(s4_path) == 0) 
+    {
+        dfs_zip_remove(s4_path);
+        dfs_meta_remove(&file_meta, s4_path);
+        dfs_tar_cache_invalidate(&file_store);
+        write(client_sock, "SUCCESS: ZIP file deleted from S4", 32);
+        return 0;
+    }
+    
+    write(client_sock, "ERROR: ZIP file not found in S4", 30);
+    return -1;
+}
+
+// Function to display filenames of ZIP files in S4
+// Recursively lists all .zip files in the S4 directory.
+int display_filenames(int client_sock, char *pathname) 
+{
+    // Get the corresponding path in S4
+    char s4_path[MAX_PATH_LEN];
+    snprintf(s4_path, MAX_PATH_LEN, "%s/S4%s", getenv("HOME"), 
+             (strcmp(pathname, "~S1") == 0) ? "" : (pathname + 3)); // Handle root case
+    
+    // Check if path exists and is a directory
+    struct stat st;
+    if (stat(s4_path, &st) != 0 || !S_ISDIR(st.st_mode)) 
+    {
+        write(client_sock, "", 0); // Send empty response if directory doesn't exist
+        return 0;
+    }
+    
+    // Get ZIP files from S4 recursively
+    char file_list[BUFFER_SIZE] = {0};
+    dfs_meta_list(&file_meta, s4_path, file_list, sizeof(file_list));
+    
+    // Send the list to S1
+    write(client_sock, file_list, strlen(file_list));
+    stats_add_bytes(0, strlen(file_list));
+    return 0;
+}
+
+// Function to handle errors
+// Prints the error message and exits the program.
+void error(const char *msg) 
+{
+    perror(msg);
+    exit(1);
 }
\ No newline at end of file
@@ -17,7 +17,7 @@ run_client_command() {
     # Add exit command to quit after the command
     echo "exit" >> "$SCRIPT_DIR/cmd.txt"
     # Run client with input from the file
-    (cd "$SCRIPT_DIR" && ./w25clients 9000 < "$SCRIPT_DIR/cmd.txt")
+    (cd "$SCRIPT_DIR" && ./w25clients < "$SCRIPT_DIR/cmd.txt")
     rm "$SCRIPT_DIR/cmd.txt"
     wait_for_enter
 }
@@ -30,6 +30,26 @@ check_file_exists() {
     fi
 }
 
+# Function to run a client command and check that its output contains the expected text
+check_client_output() {
+    echo -e "\n\033[1;33m==== Checking command: $1 ====\033[0m"
+    local output
+    output=$(cd "$SCRIPT_DIR" && printf '%s\nexit\n' "$1" | ./w25clients 2>&1)
+    echo "$output"
+    if ! grep -q -- "$2" <<< "$output"; then
+        echo "Error: '$1' did not print '$2'"
+        exit 1
+    fi
+}
+
+# Function to check that a downloaded file matches the one that was uploaded
+check_files_match() {
+    if ! cmp -s "$SCRIPT_DIR/$1" "$SCRIPT_DIR/$2"; then
+        echo "Error: $2 does not match $1"
+        exit 1
+    fi
+}
+
 # Function to start a server and wait for it to be ready
 start_server() {
     local port=$1
@@ -63,7 +83,7 @@ start_server() {
 # Function to kill existing server processes
 kill_existing_servers() {
     echo "Checking for existing server processes..."
-    for port in 9000 9001 9002 9003; do
+    for port in 4307 4308 4309 4310; do
         # Kill processes using the port
         lsof -ti:$port | xargs kill -9 2>/dev/null
         # Wait for the port to be released
@@ -86,16 +106,16 @@ rm -rf ~/S1/* ~/S2/* ~/S3/* ~/S4/*
 kill_existing_servers
 
 # Start all servers ---------------------------------------------------------------------------------------------------------------------
-start_server 9000 "S1"
+start_server 4307 "S1"
 S1_PID=$!
 
-start_server 9001 "S2"
+start_server 4308 "S2"
 S2_PID=$!
 
-start_server 9002 "S3"
+start_server 4309 "S3"
 S3_PID=$!
 
-start_server 9003 "S4"
+start_server 4310 "S4"
 S4_PID=$!
 
 echo -e "\n\033[1;32m=============================================\033[0m"
@@ -198,6 +218,314 @@ run_client_command "uploadf multilevel.pdf ~/S1/level1/level2/level3"
 run_client_command "uploadf multilevel.txt ~/S1/level1/level2/level3"
 run_client_command "uploadf multilevel.zip ~/S1/level1/level2/level3"
 
+echo -e "\n\033[1;34m=== TEST 10: Download a File Dropped into a Backend by Hand ===\033[0m"
+# The first miss builds S3's lookup filter; the watcher then picks up the dropped file ------------------------------------------------
+run_client_command "downlf ~S1/dropped/missing.txt"
+mkdir -p ~/S3/dropped
+echo "This TXT file was copied into S3 by hand" > ~/S3/dropped/byhand.txt
+sleep 1
+run_client_command "downlf ~S1/dropped/byhand.txt"
+check_file_exists "byhand.txt"
+
+# Once the filter is rebuilt, a miss is answered by S1 without asking S3
+sleep 1
+check_client_output "downlf ~S1/dropped/missing2.txt" "not found"
+check_client_output "cachestats" "filter_s3_definite_misses [1-9]"
+
+echo -e "\n\033[1;34m=== TEST 11: Durable Uploads with Group Commit ===\033[0m"
+# Concurrent uploads share one sync per group-commit window (DFS_FSYNC=group) ------------------------------------------------------
+upload_pids=""
+for i in 1 2 3 4; do
+    echo "This is group commit C file $i" > "$SCRIPT_DIR/group$i.c"
+    (cd "$SCRIPT_DIR" && printf 'uploadf group%d.c ~S1/durable/\nexit\n' $i | ./w25clients > /dev/null) &
+    upload_pids="$upload_pids $!"
+done
+wait $upload_pids
+for i in 1 2 3 4; do
+    mv "$SCRIPT_DIR/group$i.c" "$SCRIPT_DIR/sent_group$i.c"
+    check_client_output "downlf ~S1/durable/group$i.c" "downloaded successfully"
+    check_files_match "sent_group$i.c" "group$i.c"
+done
+
+echo -e "\n\033[1;34m=== TEST 12: Uploads Staged in Temporary Files ===\033[0m"
+# Uploads are renamed into place once complete, so no temporary file is left behind ------------------------------------------------
+echo "This is a staged C file" > "$SCRIPT_DIR/staged.c"
+echo "This is a staged TXT file" > "$SCRIPT_DIR/staged.txt"
+check_client_output "uploadf staged.c ~S1/staged/" "SUCCESS"
+check_client_output "uploadf staged.txt ~S1/staged/" "SUCCESS"
+if ls -A ~/S1/staged ~/S3/staged | grep -q '\.tmp$'; then
+    echo "Error: an upload left a temporary file behind"
+    exit 1
+fi
+check_file_exists "staged.c"
+if ! cmp -s "$SCRIPT_DIR/staged.c" ~/S1/staged/staged.c; then
+    echo "Error: ~/S1/staged/staged.c does not match staged.c"
+    exit 1
+fi
+
+echo -e "\n\033[1;34m=== TEST 13: Hot-file Download Cache ===\033[0m"
+# The second download of the same file is answered from S1's cache ------------------------------------------------------------------
+echo "This TXT file is served from S1's cache" > "$SCRIPT_DIR/cached.txt"
+check_client_output "uploadf cached.txt ~S1/cached/" "SUCCESS"
+mv "$SCRIPT_DIR/cached.txt" "$SCRIPT_DIR/sent_cached.txt"
+check_client_output "downlf ~S1/cached/cached.txt" "downloaded successfully"
+check_client_output "downlf ~S1/cached/cached.txt" "downloaded successfully"
+check_files_match "sent_cached.txt" "cached.txt"
+check_client_output "cachestats" "cache_hits [1-9]"
+# A file edited by hand on S3 is fetched again instead of being served from the cache
+echo "This TXT file was edited on S3 by hand" > "$SCRIPT_DIR/sent_cached.txt"
+cp "$SCRIPT_DIR/sent_cached.txt" ~/S3/cached/cached.txt
+sleep 1
+check_client_output "downlf ~S1/cached/cached.txt" "downloaded successfully"
+check_files_match "sent_cached.txt" "cached.txt"
+
+echo -e "\n\033[1;34m=== TEST 14: Cached Tar Archives ===\033[0m"
+# An upload marks the cached archive stale, so the next one includes the new file ---------------------------------------------------
+check_client_output "downltar .txt" "downloaded successfully"
+echo "This TXT file is uploaded after the archive was cached" > "$SCRIPT_DIR/late.txt"
+check_client_output "uploadf late.txt ~S1/tarcache/" "SUCCESS"
+check_client_output "downltar .txt" "downloaded successfully"
+if ! tar -tf "$SCRIPT_DIR/txtfiles.tar" | grep -q "tarcache/late.txt"; then
+    echo "Error: txtfiles.tar does not contain tarcache/late.txt"
+    exit 1
+fi
+
+echo -e "\n\033[1;34m=== TEST 15: Compressed Tar Archives ===\033[0m"
+# Each codec produces an archive its own tool accepts ---------------------------------------------------------------------------------
+check_client_output "downltar .txt gzip" "txtfiles.tar.gz"
+if ! gzip -t "$SCRIPT_DIR/txtfiles.tar.gz"; then
+    echo "Error: txtfiles.tar.gz is not a valid gzip file"
+    exit 1
+fi
+if command -v zstd >/dev/null; then
+    check_client_output "downltar .txt zstd 3" "txtfiles.tar.zst"
+    if ! zstd -q -t "$SCRIPT_DIR/txtfiles.tar.zst"; then
+        echo "Error: txtfiles.tar.zst is not a valid zstd file"
+        exit 1
+    fi
+else
+    echo "zstd is not installed, skipping the zstd archive"
+fi
+
+echo -e "\n\033[1;34m=== TEST 16: ZIP and All-types Tar Archives ===\033[0m"
+# downltar all collects every file type below a path from all servers ----------------------------------------------------------------
+for ext in c pdf txt zip; do
+    echo "This is a federated $ext file" > "$SCRIPT_DIR/federated.$ext"
+    check_client_output "uploadf federated.$ext ~S1/federated/" "SUCCESS"
+done
+check_client_output "downltar .zip" "zipfiles.tar"
+if ! tar -tf "$SCRIPT_DIR/zipfiles.tar" | grep -q "federated/federated.zip"; then
+    echo "Error: zipfiles.tar does not contain federated/federated.zip"
+    exit 1
+fi
+check_client_output "downltar all ~S1/federated" "allfiles.tar"
+for ext in c pdf txt zip; do
+    if ! tar -tf "$SCRIPT_DIR/allfiles.tar" | grep -q "federated/federated.$ext"; then
+        echo "Error: allfiles.tar does not contain federated/federated.$ext"
+        exit 1
+    fi
+done
+
+echo -e "\n\033[1;34m=== TEST 17: Operation Statistics ===\033[0m"
+# Every server reports its latency histograms ------------------------------------------------------------------------------------------
+check_client_output "stats" "S4 operation latencies"
+check_client_output "stats prom" "dfs_op_latency_seconds_bucket"
+
+echo -e "\n\033[1;34m=== TEST 18: Request Tracing ===\033[0m"
+# The trace holds spans recorded by S1 and by the backends ------------------------------------------------------------------------------
+check_client_output "trace" "Trace saved to trace.json"
+for server in S1 S2 S3 S4; do
+    if ! grep -q "\"cat\":\"$server\"" "$SCRIPT_DIR/trace.json"; then
+        echo "Error: trace.json has no spans from $server"
+        exit 1
+    fi
+done
+
+echo -e "\n\033[1;34m=== TEST 19: Load Generator ===\033[0m"
+# A short w25bench run against S1 completes without errors. removef is left out of the mix, so the
+# check does not depend on archives being built while other clients remove files --------------------------------------------------------
+if [ -x "$SCRIPT_DIR/w25bench" ]; then
+    bench_output=$(cd "$SCRIPT_DIR" && ./w25bench -c 2 -n 10 -m uploadf=30,downlf=50,dispfnames=10,downltar=10 2>&1)
+    echo "$bench_output"
+    if ! grep -q " 0 errors" <<< "$bench_output"; then
+        echo "Error: w25bench reported errors"
+        exit 1
+    fi
+else
+    echo "w25bench is not built, skipping"
+fi
+
+echo -e "\n\033[1;34m=== TEST 20: Micro-benchmarks ===\033[0m"
+# The framing benchmark exits with status 1 if any message is corrupted -------------------------------------------------------------------
+if [ -x "$SCRIPT_DIR/dfs_microbench" ]; then
+    if ! (cd "$SCRIPT_DIR" && ./dfs_microbench -b framing); then
+        echo "Error: dfs_microbench framing check failed"
+        exit 1
+    fi
+else
+    echo "dfs_microbench is not built, skipping"
+fi
+
+echo -e "\n\033[1;34m=== TEST 21: Transfer Buffer Size ===\033[0m"
+# A client with a small DFS_IO_BUFFER moves a multi-megabyte file in many pieces ----------------------------------------------------------
+head -c 3000000 /dev/urandom > "$SCRIPT_DIR/tuned.pdf"
+DFS_IO_BUFFER=4K check_client_output "uploadf tuned.pdf ~S1/tuned/" "SUCCESS"
+mv "$SCRIPT_DIR/tuned.pdf" "$SCRIPT_DIR/sent_tuned.pdf"
+DFS_IO_BUFFER=4K check_client_output "downlf ~S1/tuned/tuned.pdf" "downloaded successfully"
+check_files_match "sent_tuned.pdf" "tuned.pdf"
+
+echo -e "\n\033[1;34m=== TEST 22: Size Header Framing ===\033[0m"
+# DFS_IO_FUZZ splits every header and body into random small pieces -------------------------------------------------------------------------
+head -c 65536 /dev/urandom > "$SCRIPT_DIR/framed.zip"
+DFS_IO_FUZZ=7 check_client_output "uploadf framed.zip ~S1/framed/" "SUCCESS"
+mv "$SCRIPT_DIR/framed.zip" "$SCRIPT_DIR/sent_framed.zip"
+DFS_IO_FUZZ=7 check_client_output "downlf ~S1/framed/framed.zip" "downloaded successfully"
+check_files_match "sent_framed.zip" "framed.zip"
+
+echo -e "\n\033[1;34m=== TEST 23: Large Upload with sendfile ===\033[0m"
+# The stored file matches the uploaded one byte for byte -------------------------------------------------------------------------------------
+head -c 8000000 /dev/urandom > "$SCRIPT_DIR/large.c"
+check_client_output "uploadf large.c ~S1/large/" "SUCCESS"
+if ! cmp -s "$SCRIPT_DIR/large.c" ~/S1/large/large.c; then
+    echo "Error: ~/S1/large/large.c does not match large.c"
+    exit 1
+fi
+
+echo -e "\n\033[1;34m=== TEST 24: Large Download into a Preallocated File ===\033[0m"
+# The download is spliced into a file preallocated to the announced size ----------------------------------------------------------------------
+mv "$SCRIPT_DIR/large.c" "$SCRIPT_DIR/sent_large.c"
+check_client_output "downlf ~S1/large/large.c" "downloaded successfully"
+check_files_match "sent_large.c" "large.c"
+
+echo -e "\n\033[1;34m=== TEST 25: Server-side Copy and Move ===\033[0m"
+# A copy within S3, then a move from S3 to S1 that changes the file type -------------------------------------------------------------------------
+echo "This TXT file is copied and moved on the servers" > "$SCRIPT_DIR/copied.txt"
+check_client_output "uploadf copied.txt ~S1/copy/" "SUCCESS"
+check_client_output "copyf ~S1/copy/copied.txt ~S1/copy/backup/" "SUCCESS"
+check_client_output "movef ~S1/copy/copied.txt ~S1/copy/renamed.c" "SUCCESS"
+mv "$SCRIPT_DIR/copied.txt" "$SCRIPT_DIR/sent_copied.txt"
+check_client_output "downlf ~S1/copy/backup/copied.txt" "downloaded successfully"
+check_files_match "sent_copied.txt" "copied.txt"
+check_client_output "downlf ~S1/copy/renamed.c" "downloaded successfully"
+check_files_match "sent_copied.txt" "renamed.c"
+check_client_output "removef ~S1/copy/copied.txt" "ERROR"
+
+echo -e "\n\033[1;34m=== TEST 26: Batch Upload and Removal ===\033[0m"
+# One request per command; the missing path is reported and not counted ------------------------------------------------------------------------
+for ext in c pdf txt zip; do
+    echo "This is a batch $ext file" > "$SCRIPT_DIR/batch.$ext"
+done
+check_client_output "muploadf ~S1/batch/ batch.c batch.pdf batch.txt batch.zip" "Uploaded 4 of 4 files"
+printf '~S1/batch/batch.%s\n' c pdf txt zip missing > "$SCRIPT_DIR/batch_list.txt"
+check_client_output "mremovef @batch_list.txt" "Removed 4 of 5 files"
+
+echo -e "\n\033[1;34m=== TEST 27: File Name Search ===\033[0m"
+# findf matches names on every server --------------------------------------------------------------------------------------------------------
+echo "This is a report PDF file" > "$SCRIPT_DIR/report_2025.pdf"
+echo "This is a report TXT file" > "$SCRIPT_DIR/report_2025.txt"
+echo "This is a summary TXT file" > "$SCRIPT_DIR/summary_2025.txt"
+check_client_output "uploadf report_2025.pdf ~S1/search/" "SUCCESS"
+check_client_output "uploadf report_2025.txt ~S1/search/" "SUCCESS"
+check_client_output "uploadf summary_2025.txt ~S1/search/" "SUCCESS"
+check_client_output "findf report_* ~S1/search" "2 file(s) found"
+
+echo -e "\n\033[1;34m=== TEST 28: Content Search ===\033[0m"
+# grepf searches the .c files on S1 and the .txt files on S3 ------------------------------------------------------------------------------------
+echo "the needle is on this line" > "$SCRIPT_DIR/haystack.txt"
+echo "// the needle is in this comment" > "$SCRIPT_DIR/haystack.c"
+check_client_output "uploadf haystack.txt ~S1/grep/" "SUCCESS"
+check_client_output "uploadf haystack.c ~S1/grep/" "SUCCESS"
+check_client_output "grepf needle ~S1/grep" "2 matching line(s)"
+check_client_output "grepf -E ^the.needle ~S1/grep" "grep/haystack.txt:1:the needle is on this line"
+
+echo -e "\n\033[1;34m=== TEST 29: Line Ranges ===\033[0m"
+# A file of more than 1 MB gets a line offset index on S3 -----------------------------------------------------------------------------------------
+seq 1 200000 > "$SCRIPT_DIR/lines.txt"
+check_client_output "uploadf lines.txt ~S1/lines/" "SUCCESS"
+check_client_output "readlines ~S1/lines/lines.txt 150000 2" "150001"
+if [ ! -f ~/S3/lines/.lines.txt.lidx ]; then
+    echo "Error: S3 did not index lines.txt"
+    exit 1
+fi
+
+echo -e "\n\033[1;34m=== TEST 30: ZIP Members ===\033[0m"
+# zipget transfers and inflates a single member ----------------------------------------------------------------------------------------------------
+if command -v zip >/dev/null; then
+    seq 1 1000 > "$SCRIPT_DIR/member.txt"
+    (cd "$SCRIPT_DIR" && rm -f members.zip && zip -q members.zip member.txt)
+    mv "$SCRIPT_DIR/member.txt" "$SCRIPT_DIR/sent_member.txt"
+    check_client_output "uploadf members.zip ~S1/zip/" "SUCCESS"
+    check_client_output "zipls ~S1/zip/members.zip" "1 member(s)"
+    check_client_output "zipget ~S1/zip/members.zip member.txt" "extracted"
+    check_files_match "sent_member.txt" "member.txt"
+else
+    echo "zip is not installed, skipping"
+fi
+
+echo -e "\n\033[1;34m=== TEST 31: PDF Info and Byte Ranges ===\033[0m"
+# pdfinfo is answered from S2's index; pdfrange fetches part of the file ---------------------------------------------------------------------------
+printf '%%PDF-1.4\n1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n3 0 obj\n<< /Type /Page /Parent 2 0 R >>\nendobj\n4 0 obj\n<< /Title (DFS test) >>\nendobj\ntrailer\n<< /Root 1 0 R /Info 4 0 R >>\n%%%%EOF\n' > "$SCRIPT_DIR/info.pdf"
+check_client_output "uploadf info.pdf ~S1/pdf/" "SUCCESS"
+check_client_output "pdfinfo ~S1/pdf/info.pdf" "Pages: 1"
+check_client_output "pdfinfo ~S1/pdf/info.pdf" "Title: DFS test"
+mv "$SCRIPT_DIR/info.pdf" "$SCRIPT_DIR/sent_info.pdf"
+check_client_output "pdfrange ~S1/pdf/info.pdf 0 8" "Received bytes 0-7"
+if [ "$(head -c 8 "$SCRIPT_DIR/info.pdf")" != "%PDF-1.4" ]; then
+    echo "Error: pdfrange did not write the first 8 bytes of info.pdf"
+    exit 1
+fi
+
+echo -e "\n\033[1;34m=== TEST 32: Metadata Journal Across a Restart ===\033[0m"
+# S3 reloads its table from the snapshot and journal instead of walking the tree -------------------------------------------------------------------
+if [ ! -f ~/S3/.dfs_meta.log ]; then
+    echo "Error: S3 has no metadata journal"
+    exit 1
+fi
+start_server 4309 "S3"
+S3_PID=$!
+check_client_output "findf lines.txt ~S1/lines" "1 file(s) found"
+check_client_output "readlines ~S1/lines/lines.txt 199999 1" "199999"
+
+echo -e "\n\033[1;34m=== TEST 33: Files Changed Outside the DFS ===\033[0m"
+# S2's watcher adds a file copied in by hand to the table and archives, and drops it once deleted -------------------------------------------------
+mkdir -p ~/S2/watched
+echo "This PDF file was copied into S2 by hand" > ~/S2/watched/byhand.pdf
+sleep 1
+check_client_output "downltar .pdf" "downloaded successfully"
+if ! tar -tf "$SCRIPT_DIR/pdfiles.tar" | grep -q "watched/byhand.pdf"; then
+    echo "Error: pdfiles.tar does not contain watched/byhand.pdf"
+    exit 1
+fi
+rm ~/S2/watched/byhand.pdf
+sleep 1
+check_client_output "downltar .pdf" "downloaded successfully"
+if tar -tf "$SCRIPT_DIR/pdfiles.tar" | grep -q "watched/byhand.pdf"; then
+    echo "Error: pdfiles.tar still contains watched/byhand.pdf"
+    exit 1
+fi
+
+echo -e "\n\033[1;34m=== TEST 34: Small-file Packing ===\033[0m"
+# With DFS_PACK_MAX set, small .c and .txt uploads go into segment files -----------------------------------------------------------------------------
+DFS_PACK_MAX=4K start_server 4307 "S1"
+S1_PID=$!
+DFS_PACK_MAX=4K start_server 4309 "S3"
+S3_PID=$!
+echo "This is a packed C file" > "$SCRIPT_DIR/packed.c"
+echo "This is a packed TXT file" > "$SCRIPT_DIR/packed.txt"
+check_client_output "uploadf packed.c ~S1/packed/" "SUCCESS"
+check_client_output "uploadf packed.txt ~S1/packed/" "SUCCESS"
+if [ -f ~/S1/packed/packed.c ] || [ -f ~/S3/packed/packed.txt ]; then
+    echo "Error: a small file was stored on its own instead of packed"
+    exit 1
+fi
+mv "$SCRIPT_DIR/packed.c" "$SCRIPT_DIR/sent_packed.c"
+mv "$SCRIPT_DIR/packed.txt" "$SCRIPT_DIR/sent_packed.txt"
+check_client_output "downlf ~S1/packed/packed.c" "downloaded successfully"
+check_files_match "sent_packed.c" "packed.c"
+check_client_output "downlf ~S1/packed/packed.txt" "downloaded successfully"
+check_files_match "sent_packed.txt" "packed.txt"
+check_client_output "readlines ~S1/packed/packed.txt 1 1" "This is a packed TXT file"
+
 # Cleanup
 echo -e "\n\033[1;34m=== Cleaning up... ===\033[0m"
 kill_existing_servers
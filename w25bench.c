@@ -0,0 +1,577 @@
+// Distributed File System - Load Generator (w25bench.c)
+// Drives S1 with many concurrent clients speaking the same protocol as w25clients
+// and reports throughput and latency percentiles per operation.
+// Compile: gcc w25bench.c dfs_stats.c dfs_net.c -o w25bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> // for close(), fork()
+#include <sys/types.h>
+#include <sys/socket.h> // for socket()
+#include <netinet/in.h>
+#include <arpa/inet.h> // for inet_pton()
+#include <sys/wait.h> // for waitpid()
+#include <signal.h> // for signal()
+#include "dfs_stats.h" // latency histograms shared by all workers
+#include "dfs_net.h" // socket options, same as the client
+
+#define PORT 4307 // S1 server port
+#define BUFFER_SIZE 1024 // Buffer size for commands and replies
+#define IO_SIZE (64 * 1024) // Chunk size for file bodies
+#define MAX_CLASSES 16 // Entries in a mix or size list
+#define MAX_TYPES 4
+#define MAX_FILES 4096 // Uploaded files each worker remembers for downloads and removals
+
+// One weighted choice from the -m or -s lists
+struct weighted
+{
+    long value; // Operation or file size
+    int weight;
+};
+
+// Benchmark settings
+struct bench_config
+{
+    const char *host;
+    int port;
+    int clients;
+    int duration; // Seconds, 0 = until every worker has done ops_per_client
+    long ops_per_client; // 0 = until the duration is over
+    int preload; // Files each worker uploads before the clock starts
+    int json; // Report as one JSON object
+    const char *root; // ~S1 directory the benchmark works in
+    const char *mix_spec;
+    const char *size_spec;
+    struct weighted mix[MAX_CLASSES];
+    int mix_count;
+    struct weighted sizes[MAX_CLASSES];
+    int size_count;
+    const char *types[MAX_TYPES];
+    int type_count;
+    long max_size;
+};
+
+// A file a worker has uploaded
+struct bench_file
+{
+    char path[192];
+    long size;
+};
+
+// Function prototypes
+int parse_weights(const char *spec, struct weighted *out, int is_sizes);
+int parse_types(char *spec, struct bench_config *cfg);
+long parse_size(const char *text);
+long pick_weighted(struct weighted *list, int count, unsigned long long *rng);
+unsigned long long next_random(unsigned long long *rng);
+void run_worker(struct bench_config *cfg, int worker, int ready_fd, int go_fd);
+int connect_to_s1(struct bench_config *cfg);
+int send_command(int fd, const char *command);
+int read_reply(int fd, char *reply, size_t size);
+int do_upload(struct bench_config *cfg, const char *path, const char *dest, long size, const char *payload);
+int do_download(struct bench_config *cfg, const char *command, long *received);
+int do_simple(struct bench_config *cfg, const char *command, const char *expect);
+void print_report(struct bench_config *cfg, double elapsed);
+void usage(const char *prog);
+
+// Main function parses the options, forks the workers and prints the report
+int main(int argc, char *argv[])
+{
+    struct bench_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.host = "127.0.0.1";
+    cfg.port = PORT;
+    cfg.clients = 8;
+    cfg.duration = 10;
+    cfg.preload = 4;
+    cfg.root = "~S1/bench";
+    cfg.mix_spec = "uploadf=30,downlf=50,removef=5,dispfnames=10,downltar=5";
+    cfg.size_spec = "1k=40,64k=40,1m=15,8m=5";
+    char type_spec[64] = ".c,.pdf,.txt,.zip";
+
+    int opt;
+    int duration_set = 0;
+    while ((opt = getopt(argc, argv, "H:p:c:d:n:P:m:s:t:r:jh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'H': cfg.host = optarg; break;
+            case 'p': cfg.port = atoi(optarg); break;
+            case 'c': cfg.clients = atoi(optarg); break;
+            case 'd': cfg.duration = atoi(optarg); duration_set = 1; break;
+            case 'n': cfg.ops_per_client = atol(optarg); break;
+            case 'P': cfg.preload = atoi(optarg); break;
+            case 'm': cfg.mix_spec = optarg; break;
+            case 's': cfg.size_spec = optarg; break;
+            case 't': snprintf(type_spec, sizeof(type_spec), "%s", optarg); break;
+            case 'r': cfg.root = optarg; break;
+            case 'j': cfg.json = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (cfg.ops_per_client > 0 && !duration_set)
+    {
+        cfg.duration = 0; // -n alone runs a fixed amount of work
+    }
+
+    cfg.mix_count = parse_weights(cfg.mix_spec, cfg.mix, 0);
+    cfg.size_count = parse_weights(cfg.size_spec, cfg.sizes, 1);
+    if (cfg.clients < 1 || cfg.mix_count <= 0 || cfg.size_count <= 0 || parse_types(type_spec, &cfg) <= 0 ||
+        strncmp(cfg.root, "~S1", 3) != 0 || (cfg.duration <= 0 && cfg.ops_per_client <= 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    for (int i = 0; i < cfg.size_count; i++)
+    {
+        if (cfg.sizes[i].value > cfg.max_size)
+        {
+            cfg.max_size = cfg.sizes[i].value;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN); // A server closing early shows up as a failed operation
+    stats_init("w25bench");
+
+    // Workers report when their preload is done and wait for the parent to close go_pipe
+    int ready_pipe[2], go_pipe[2];
+    if (pipe(ready_pipe) < 0 || pipe(go_pipe) < 0)
+    {
+        perror("ERROR creating pipes");
+        return 1;
+    }
+    for (int i = 0; i < cfg.clients; i++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("ERROR on fork");
+            return 1;
+        }
+        if (pid == 0)
+        {
+            close(ready_pipe[0]);
+            close(go_pipe[1]);
+            run_worker(&cfg, i, ready_pipe[1], go_pipe[0]);
+            exit(0);
+        }
+    }
+    close(ready_pipe[1]);
+    close(go_pipe[0]);
+
+    char byte;
+    for (int i = 0; i < cfg.clients; i++)
+    {
+        if (read(ready_pipe[0], &byte, 1) != 1)
+        {
+            break; // A worker died during preload; run with the rest
+        }
+    }
+
+    uint64_t start_us = stats_now_us();
+    close(go_pipe[1]);
+    while (wait(NULL) > 0);
+    double elapsed = (stats_now_us() - start_us) / 1e6;
+
+    print_report(&cfg, elapsed);
+    return 0;
+}
+
+// Function to run one simulated client until the duration or operation budget is used up
+void run_worker(struct bench_config *cfg, int worker, int ready_fd, int go_fd)
+{
+    unsigned long long rng = ((unsigned long long)getpid() << 32) ^ stats_now_us();
+    struct bench_file *files = calloc(MAX_FILES, sizeof(struct bench_file));
+    char *payload = malloc(cfg->max_size > 0 ? cfg->max_size : 1);
+    if (files == NULL || payload == NULL)
+    {
+        perror("ERROR allocating worker buffers");
+        exit(1);
+    }
+    for (long i = 0; i < cfg->max_size; i++)
+    {
+        payload[i] = (char)next_random(&rng);
+    }
+
+    char dest[128];
+    snprintf(dest, sizeof(dest), "%s/w%d/", cfg->root, worker);
+    int file_count = 0;
+    long sequence = 0;
+
+    // Function to upload a new file and remember it
+    int upload_new(void)
+    {
+        const char *type = cfg->types[next_random(&rng) % cfg->type_count];
+        long size = pick_weighted(cfg->sizes, cfg->size_count, &rng);
+        char name[64];
+        snprintf(name, sizeof(name), "b%d_%ld%s", worker, sequence++, type);
+        int ok = do_upload(cfg, name, dest, size, payload);
+        if (ok)
+        {
+            stats_add_bytes(0, size + sizeof(off_t));
+            int slot = (file_count < MAX_FILES) ? file_count++ : (int)(next_random(&rng) % MAX_FILES);
+            snprintf(files[slot].path, sizeof(files[slot].path), "%s%s", dest, name);
+            files[slot].size = size;
+        }
+        return ok;
+    }
+
+    for (int i = 0; i < cfg->preload; i++)
+    {
+        upload_new();
+    }
+
+    // Wait for the starting signal so every worker begins measuring together
+    char byte = 1;
+    write(ready_fd, &byte, 1);
+    read(go_fd, &byte, 1);
+
+    uint64_t deadline = (cfg->duration > 0) ? stats_now_us() + (uint64_t)cfg->duration * 1000000 : 0;
+    char command[BUFFER_SIZE];
+    for (long done = 0; cfg->ops_per_client == 0 || done < cfg->ops_per_client; done++)
+    {
+        if (deadline != 0 && stats_now_us() >= deadline)
+        {
+            break;
+        }
+
+        int op = (int)pick_weighted(cfg->mix, cfg->mix_count, &rng);
+        if ((op == STAT_DOWNLF || op == STAT_REMOVEF) && file_count == 0)
+        {
+            op = STAT_UPLOADF; // Nothing to read or delete yet
+        }
+
+        uint64_t op_start = stats_now_us();
+        int ok = 0;
+        if (op == STAT_UPLOADF)
+        {
+            ok = upload_new();
+        }
+        else if (op == STAT_DOWNLF)
+        {
+            int pick = (int)(next_random(&rng) % file_count);
+            long received = 0;
+            snprintf(command, sizeof(command), "downlf %s", files[pick].path);
+            ok = do_download(cfg, command, &received) && received == files[pick].size;
+            stats_add_bytes(received + sizeof(off_t), 0);
+        }
+        else if (op == STAT_REMOVEF)
+        {
+            int pick = (int)(next_random(&rng) % file_count);
+            snprintf(command, sizeof(command), "removef %s", files[pick].path);
+            ok = do_simple(cfg, command, "SUCCESS");
+            files[pick] = files[--file_count];
+        }
+        else if (op == STAT_DOWNLTAR)
+        {
+            long received = 0;
+            snprintf(command, sizeof(command), "downltar %s", cfg->types[next_random(&rng) % cfg->type_count]);
+            ok = do_download(cfg, command, &received);
+            stats_add_bytes(received + sizeof(off_t), 0);
+        }
+        else
+        {
+            snprintf(command, sizeof(command), "dispfnames %s/", cfg->root);
+            ok = do_simple(cfg, command, NULL);
+        }
+        stats_record(op, stats_now_us() - op_start, ok);
+    }
+    free(files);
+    free(payload);
+}
+
+// Function to upload size bytes of payload as dest/path
+// Returns 1 when S1 reports success.
+int do_upload(struct bench_config *cfg, const char *path, const char *dest, long size, const char *payload)
+{
+    int sockfd = connect_to_s1(cfg);
+    if (sockfd < 0)
+    {
+        return 0;
+    }
+
+    char command[BUFFER_SIZE];
+    char reply[BUFFER_SIZE];
+    snprintf(command, sizeof(command), "uploadf %s %s", path, dest);
+    off_t file_size = size;
+    int ok = send_command(sockfd, command) == 0 &&
+             net_read_reply(sockfd, reply, 5) == 0 && memcmp(reply, "READY", 5) == 0;
+    if (ok)
+    {
+        // Same framing as the client: size header and body under one cork
+        net_cork(sockfd);
+        ok = net_write_full(sockfd, &file_size, sizeof(off_t)) == 0 && net_write_full(sockfd, payload, size) == 0;
+        net_uncork(sockfd);
+    }
+    ok = ok && read_reply(sockfd, reply, sizeof(reply)) == 0 && strncmp(reply, "SUCCESS", 7) == 0;
+    close(sockfd);
+    return ok;
+}
+
+// Function to run a command answered with a size header and a body (downlf, downltar)
+// The body is read and discarded. Returns 1 when the whole body arrived.
+int do_download(struct bench_config *cfg, const char *command, long *received)
+{
+    *received = 0;
+    int sockfd = connect_to_s1(cfg);
+    if (sockfd < 0)
+    {
+        return 0;
+    }
+
+    off_t size;
+    if (send_command(sockfd, command) < 0 || net_read_reply(sockfd, &size, sizeof(off_t)) < 0 ||
+        memcmp(&size, "ERROR", 5) == 0)
+    {
+        close(sockfd);
+        return 0;
+    }
+
+    static char body[IO_SIZE];
+    off_t remaining = size;
+    while (remaining > 0)
+    {
+        ssize_t n = net_read_some(sockfd, body, (remaining < IO_SIZE) ? remaining : IO_SIZE);
+        if (n <= 0)
+        {
+            break;
+        }
+        remaining -= n;
+        *received += n;
+    }
+    close(sockfd);
+    return remaining == 0;
+}
+
+// Function to run a command answered with a text reply (removef, dispfnames)
+// Returns 1 when the reply starts with expect, or is not an error when expect is NULL.
+int do_simple(struct bench_config *cfg, const char *command, const char *expect)
+{
+    int sockfd = connect_to_s1(cfg);
+    if (sockfd < 0)
+    {
+        return 0;
+    }
+
+    char reply[BUFFER_SIZE];
+    int ok = send_command(sockfd, command) == 0 && read_reply(sockfd, reply, sizeof(reply)) == 0;
+    if (ok)
+    {
+        ok = (expect != NULL) ? strncmp(reply, expect, strlen(expect)) == 0 : strncmp(reply, "ERROR", 5) != 0;
+    }
+    stats_add_bytes(strlen(reply), 0);
+    close(sockfd);
+    return ok;
+}
+
+// Function to open a new connection to S1; every command uses its own connection
+int connect_to_s1(struct bench_config *cfg)
+{
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0)
+    {
+        return -1;
+    }
+    net_tune_socket(sockfd);
+
+    struct sockaddr_in serv_addr;
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(cfg->port);
+    if (inet_pton(AF_INET, cfg->host, &serv_addr.sin_addr) != 1 ||
+        connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
+    {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// Function to send a command in a single write so S1 reads it in one piece
+// Commands are not framed, so they must never go through the segmenting net_write_full().
+int send_command(int fd, const char *command)
+{
+    size_t len = strlen(command);
+    return (write(fd, command, len) == (ssize_t)len) ? 0 : -1;
+}
+
+// Function to read a text reply until S1 closes the connection
+int read_reply(int fd, char *reply, size_t size)
+{
+    size_t len = 0;
+    ssize_t n;
+    reply[0] = '\0';
+    while (len < size - 1 && net_wait_reply(fd) == 0 && (n = net_read_some(fd, reply + len, size - 1 - len)) > 0)
+    {
+        len += n;
+    }
+    reply[len] = '\0';
+    return (len > 0) ? 0 : -1;
+}
+
+// Function to parse "name=weight,..." for operations or "size=weight,..." for file sizes
+// Returns the number of entries, or -1 on a malformed list.
+int parse_weights(const char *spec, struct weighted *out, int is_sizes)
+{
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", spec);
+    int count = 0;
+    char *save;
+    for (char *item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        char *eq = strchr(item, '=');
+        if (eq == NULL || count == MAX_CLASSES)
+        {
+            return -1;
+        }
+        *eq = '\0';
+        long value = is_sizes ? parse_size(item) : stats_op_from_command(item);
+        if (value < 0 || (!is_sizes && value == STAT_OTHER) || atoi(eq + 1) <= 0)
+        {
+            fprintf(stderr, "Invalid entry '%s'\n", item);
+            return -1;
+        }
+        out[count].value = value;
+        out[count].weight = atoi(eq + 1);
+        count++;
+    }
+    return count;
+}
+
+// Function to parse the comma separated file types for uploads and downltar
+int parse_types(char *spec, struct bench_config *cfg)
+{
+    static char types[64];
+    snprintf(types, sizeof(types), "%s", spec);
+    char *save;
+    for (char *item = strtok_r(types, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        if (cfg->type_count == MAX_TYPES || (strcmp(item, ".c") != 0 && strcmp(item, ".pdf") != 0 &&
+            strcmp(item, ".txt") != 0 && strcmp(item, ".zip") != 0))
+        {
+            return -1;
+        }
+        cfg->types[cfg->type_count++] = item;
+    }
+    return cfg->type_count;
+}
+
+// Function to parse a size such as 512, 4k, 16m or 1g
+long parse_size(const char *text)
+{
+    char *end;
+    long value = strtol(text, &end, 10);
+    switch (*end)
+    {
+        case 'k': case 'K': value <<= 10; break;
+        case 'm': case 'M': value <<= 20; break;
+        case 'g': case 'G': value <<= 30; break;
+        case '\0': break;
+        default: return -1;
+    }
+    return value;
+}
+
+// Function to draw one value from a weighted list
+long pick_weighted(struct weighted *list, int count, unsigned long long *rng)
+{
+    int total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        total += list[i].weight;
+    }
+    int r = (int)(next_random(rng) % total);
+    for (int i = 0; i < count; i++)
+    {
+        if (r < list[i].weight)
+        {
+            return list[i].value;
+        }
+        r -= list[i].weight;
+    }
+    return list[count - 1].value;
+}
+
+// Function to advance a worker's xorshift64* generator
+unsigned long long next_random(unsigned long long *rng)
+{
+    unsigned long long x = *rng ? *rng : 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *rng = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+// Function to print throughput and latency percentiles, as a table or one JSON object
+// Bytes are counted from the client's side: "in" was received from S1, "out" was sent to it.
+void print_report(struct bench_config *cfg, double elapsed)
+{
+    uint64_t total_ops = 0, total_errors = 0, total_in = 0, total_out = 0;
+    for (int op = 0; op < STAT_OP_COUNT; op++)
+    {
+        uint64_t count, errors, in, out;
+        stats_totals(op, &count, &errors, &in, &out);
+        total_ops += count;
+        total_errors += errors;
+        total_in += in;
+        total_out += out;
+    }
+    if (elapsed <= 0)
+    {
+        elapsed = 1e-6;
+    }
+
+    if (!cfg->json)
+    {
+        static char table[16 * 1024];
+        stats_format(table, sizeof(table), 0);
+        printf("w25bench: %d clients, %.2f s, mix %s, sizes %s\n\n%s\n",
+               cfg->clients, elapsed, cfg->mix_spec, cfg->size_spec, table);
+        printf("throughput: %.1f ops/s, %llu errors, received %.2f MB/s, sent %.2f MB/s\n",
+               total_ops / elapsed, (unsigned long long)total_errors,
+               total_in / elapsed / (1 << 20), total_out / elapsed / (1 << 20));
+        return;
+    }
+
+    printf("{\"clients\":%d,\"elapsed_s\":%.3f,\"mix\":\"%s\",\"sizes\":\"%s\",",
+           cfg->clients, elapsed, cfg->mix_spec, cfg->size_spec);
+    printf("\"ops_per_s\":%.2f,\"errors\":%llu,\"received_bytes_per_s\":%.0f,\"sent_bytes_per_s\":%.0f,\"ops\":{",
+           total_ops / elapsed, (unsigned long long)total_errors, total_in / elapsed, total_out / elapsed);
+    int first = 1;
+    for (int op = 0; op < STAT_OP_COUNT; op++)
+    {
+        uint64_t count, errors, in, out;
+        stats_totals(op, &count, &errors, &in, &out);
+        if (count == 0)
+        {
+            continue;
+        }
+        printf("%s\"%s\":{\"count\":%llu,\"errors\":%llu,\"ops_per_s\":%.2f,\"p50_us\":%llu,\"p99_us\":%llu,\"p999_us\":%llu}",
+               first ? "" : ",", stats_op_name(op), (unsigned long long)count, (unsigned long long)errors,
+               count / elapsed, (unsigned long long)stats_percentile(op, 0.50),
+               (unsigned long long)stats_percentile(op, 0.99), (unsigned long long)stats_percentile(op, 0.999));
+        first = 0;
+    }
+    printf("}}\n");
+}
+
+// Function to print the command line options
+void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -H host        S1 address (default 127.0.0.1)\n"
+            "  -p port        S1 port (default %d)\n"
+            "  -c clients     concurrent clients (default 8)\n"
+            "  -d seconds     run time (default 10)\n"
+            "  -n ops         operations per client instead of a run time\n"
+            "  -P files       files each client uploads before measuring (default 4)\n"
+            "  -m mix         operation weights (default uploadf=30,downlf=50,removef=5,dispfnames=10,downltar=5)\n"
+            "  -s sizes       upload size weights (default 1k=40,64k=40,1m=15,8m=5)\n"
+            "  -t types       upload and downltar file types (default .c,.pdf,.txt,.zip)\n"
+            "  -r path        ~S1 directory to work in (default ~S1/bench)\n"
+            "  -j             print the report as one JSON object\n",
+            prog, PORT);
+}
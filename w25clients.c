@@ -1,563 +1,1640 @@
-// Distributed File System - Client Implementation (w25clients.c)
-
-#include <stdio.h> 
-#include <stdlib.h>
-#include <string.h> 
-#include <unistd.h> // for close()
-#include <sys/types.h>
-#include <sys/socket.h> // for socket()
-#include <netinet/in.h>
-#include <netdb.h> // for gethostbyname()
-#include <arpa/inet.h> // for inet_ntoa()
-#include <sys/stat.h>
-#include <fcntl.h> // for open()
-#include <libgen.h> // for basename()
-#include <errno.h> // for errno
-
-#define PORT 4307 // S1 server port
-#define BUFFER_SIZE 1024 // Buffer size for file transfer
-#define MAX_PATH_LEN 1024 // Maximum path length
-
-// Function prototypes
-void error(const char *msg); // Error handling function
-int connect_to_server(); // Function to connect to the server
-void handle_uploadf(int sockfd, char *filename, char *dest_path); // Function to handle file upload
-void handle_downlf(int sockfd, char *filename);
-void handle_removef(int sockfd, char *filename);
-void handle_downltar(int sockfd, char *filetype);
-void handle_dispfnames(int sockfd, char *pathname);
-int send_file(int sockfd, char *filename);
-int receive_file(int sockfd, char *filename);
-
-int main() {
-    int sockfd;
-    char buffer[BUFFER_SIZE]; // Buffer for user input
-    
-    printf("Distributed File System Client\n");
-    printf("Available commands:\n");
-    printf("  uploadf <filename> <destination_path> (example: uploadf test1.txt ~S1/folder1/)\n");
-    printf("  downlf <filename> (example: downlf ~S1/folder1/test1.txt)\n");
-    printf("  removef <filename> (example: removef ~S1/folder1/test1.txt)\n");
-    printf("  downltar <filetype> (example: downltar .txt)\n");
-    printf("  dispfnames <pathname> (example: dispfnames ~S1/)\n");
-    printf("  exit\n\n");
-    
-    while (1) 
-    {
-        printf("w25clients$ ");
-        bzero(buffer, BUFFER_SIZE); 
-        fgets(buffer, BUFFER_SIZE - 1, stdin);
-        
-        // Remove newline
-        buffer[strcspn(buffer, "\n")] = 0;
-        
-        // Ignore empty commands
-        if (strlen(buffer) == 0) 
-        {
-            continue;
-        }
-        
-        // Check for exit command
-        if (strcmp(buffer, "exit") == 0) 
-        {
-            break;
-        }
-        
-        // Connect to server
-        sockfd = connect_to_server();
-        if (sockfd < 0) 
-        {
-            printf("Failed to connect to server\n");
-            continue;
-        }
-        
-        // Parse command
-        char *cmd = strtok(buffer, " ");
-        
-        // task1 uplodf
-		if (strcmp(cmd, "uploadf") == 0) 
-        {
-            char *filename = strtok(NULL, " ");
-            char *dest_path = strtok(NULL, " ");
-            if (filename == NULL || dest_path == NULL) 
-            {
-                printf("Invalid command format. Usage: uploadf <filename> <destination_path>\n"); // Example: uploadf test1.txt ~S1/folder1/
-                close(sockfd);
-                continue;
-            }
-            handle_uploadf(sockfd, filename, dest_path); // Upload file
-        } 
-
-        // task 2 downlf
-		else if (strcmp(cmd, "downlf") == 0) 
-        {
-            char *filename = strtok(NULL, " ");
-            if (filename == NULL) 
-            {
-                printf("Invalid command format. Usage: downlf <filename>\n");
-                close(sockfd);
-                continue;
-            }
-            handle_downlf(sockfd, filename);
-        }
-		// task 3 removef
-        else if (strcmp(cmd, "removef") == 0) 
-        {
-            char *filename = strtok(NULL, " ");
-            if (filename == NULL) 
-            {
-                printf("Invalid command format. Usage: removef <filename>\n");
-                close(sockfd);
-                continue;
-            }
-            handle_removef(sockfd, filename);
-        } 
-		// task 4 downltar
-        else if (strcmp(cmd, "downltar") == 0) 
-        {
-            char *filetype = strtok(NULL, " ");
-            if (filetype == NULL) 
-            {
-                printf("Invalid command format. Usage: downltar <filetype>\n");
-                close(sockfd);
-                continue;
-            }
-            handle_downltar(sockfd, filetype);
-        }
-
-		// task 5 dispfnames
-        else if (strcmp(cmd, "dispfnames") == 0)
-        {
-            char *pathname = strtok(NULL, " ");
-            if (pathname == NULL) 
-            {
-                printf("Invalid command format. Usage: dispfnames <pathname>\n");
-                close(sockfd);
-                continue;
-            }
-            handle_dispfnames(sockfd, pathname);
-        } 
-        else 
-        {
-            printf("Unknown command: %s\n", cmd);
-        }
-        
-        close(sockfd); // Close the socket after each command
-    }
-    
-    return 0;
-}
-
-int connect_to_server() // Function to connect to the server
-{
-    int sockfd; // Socket file descriptor
-    struct sockaddr_in serv_addr; // Server address structure
-    struct hostent *server; // Host information structure
-    
-    sockfd = socket(AF_INET, SOCK_STREAM, 0); // Create socket
-    if (sockfd < 0) 
-    {
-        error("ERROR opening socket"); // Socket creation failed
-        return -1;
-    }
-    
-    // Get server address
-    server = gethostbyname("localhost");
-    if (server == NULL) 
-    {
-        fprintf(stderr, "ERROR, no such host\n"); // Host resolution failed
-        return -1;
-    }
-    
-    // Initialize server address structure
-    bzero((char *) &serv_addr, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET; // Address family
-    bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length); // Copy host address
-    serv_addr.sin_port = htons(PORT); // Port number
-    
-    // Connect to server
-    if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
-    {
-        error("ERROR connecting");
-        return -1;
-    }
-    
-    return sockfd; // Return the socket file descriptor
-}
-
-// Error handling function
-void handle_uploadf(int sockfd, char *filename, char *dest_path) 
-{
-    // Verify file exists
-    struct stat st;
-    if (stat(filename, &st) != 0) 
-    {
-        printf("ERROR: File '%s' not found\n", filename);
-        return;
-    }
-    
-    // Check if destination path starts with ~S1/
-    if (strncmp(dest_path, "~S1/", 4) != 0) 
-    {
-        printf("ERROR: Destination path must start with ~S1/\n");
-        return;
-    }
-    
-    // Check file extension
-    char *ext = strrchr(filename, '.');
-    if (ext == NULL) 
-    {
-        printf("ERROR: File has no extension\n");
-        return;
-    }
-    
-    // Check if file type is supported
-    if (strcmp(ext, ".c") != 0 && strcmp(ext, ".pdf") != 0 && strcmp(ext, ".txt") != 0 && strcmp(ext, ".zip") != 0) 
-    {
-        printf("ERROR: Unsupported file type. Only .c, .pdf, .txt, .zip allowed\n");
-        return;
-    }
-    
-    // Send command to server
-    char command[BUFFER_SIZE];
-    snprintf(command, BUFFER_SIZE, "uploadf %s %s", filename, dest_path);
-    if (write(sockfd, command, strlen(command)) < 0) 
-    {
-        error("ERROR writing to socket");
-        return;
-    }
-    
-    // Wait for server response
-    char response[BUFFER_SIZE];
-    bzero(response, BUFFER_SIZE);
-    if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
-    {
-        error("ERROR reading from socket");
-        return;
-    }
-    
-    // Check server response
-    if (strcmp(response, "READY") == 0) 
-    {
-        // Server is ready to receive file
-        if (send_file(sockfd, filename) == 0) 
-        {
-            // Wait for final response
-            bzero(response, BUFFER_SIZE);
-            if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
-            {
-                error("ERROR reading from socket");
-                return;
-            }
-            printf("%s\n", response);
-        }
-    } 
-    else 
-    {
-        printf("%s\n", response);
-    }
-}
-
-// Error handling function
-void handle_downlf(int sockfd, char *filename) 
-{
-    // Check if filename starts with ~S1/
-    if (strncmp(filename, "~S1/", 4) != 0) 
-    {
-        printf("ERROR: Filename must start with ~S1/\n");
-        return;
-    }
-    
-    // Check file extension
-    char *ext = strrchr(filename, '.');
-    if (ext == NULL) 
-    {
-        printf("ERROR: File has no extension\n");
-        return;
-    }
-    
-    // Check if file type is supported
-    if (strcmp(ext, ".c") != 0 && strcmp(ext, ".pdf") != 0 && 
-        strcmp(ext, ".txt") != 0 && strcmp(ext, ".zip") != 0) 
-        {
-        printf("ERROR: Unsupported file type. Only .c, .pdf, .txt, .zip allowed\n");
-        return;
-    }
-    
-    // Send command to server
-    char command[BUFFER_SIZE];
-    snprintf(command, BUFFER_SIZE, "downlf %s", filename);
-    if (write(sockfd, command, strlen(command)) < 0) 
-    {
-        error("ERROR writing to socket");
-        return;
-    }
-    
-    // Get the base name for saving locally
-    char *base_name = basename(filename);
-    
-    // Receive file from server
-    if (receive_file(sockfd, base_name) == 0) 
-    {
-        printf("File '%s' downloaded successfully\n", base_name);
-    }
-}
-
-// Error handling function
-void handle_removef(int sockfd, char *filename) 
-{
-    // Check if filename starts with ~S1/
-    if (strncmp(filename, "~S1/", 4) != 0) 
-    {
-        printf("ERROR: Filename must start with ~S1/\n");
-        return;
-    }
-    
-    // Check file extension
-    char *ext = strrchr(filename, '.');
-    if (ext == NULL) {
-        printf("ERROR: File has no extension\n");
-        return;
-    }
-    
-    // Check if file type is supported
-    if (strcmp(ext, ".c") != 0 && strcmp(ext, ".pdf") != 0 && strcmp(ext, ".txt") != 0 && strcmp(ext, ".zip") != 0)
-    {
-        printf("ERROR: Unsupported file type. Only .c, .pdf, .txt, .zip allowed\n");
-        return;
-    }
-    
-    // Send command to server
-    char command[BUFFER_SIZE];
-    snprintf(command, BUFFER_SIZE, "removef %s", filename);
-    if (write(sockfd, command, strlen(command)) < 0) 
-    {
-        error("ERROR writing to socket");
-        return;
-    }
-    
-    // Get server response
-    char response[BUFFER_SIZE];
-    bzero(response, BUFFER_SIZE);
-    if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
-    {
-        error("ERROR reading from socket");
-        return;
-    }
-    
-    printf("%s\n", response);
-}
-
-// Error handling function
-void handle_downltar(int sockfd, char *filetype) 
-{
-    // Check file type
-    if (strcmp(filetype, ".c") != 0 && strcmp(filetype, ".pdf") != 0 && strcmp(filetype, ".txt") != 0) 
-    {
-        printf("ERROR: Unsupported file type for tar. Only .c, .pdf, .txt allowed\n");
-        return;
-    }
-    
-    // Determine output filename
-    char output_file[50];
-    if (strcmp(filetype, ".c") == 0) 
-    {
-        strcpy(output_file, "cfiles.tar");
-    } 
-    else if (strcmp(filetype, ".pdf") == 0) 
-    {
-        strcpy(output_file, "pdfiles.tar");
-    } else 
-    {
-        strcpy(output_file, "txtfiles.tar");
-    }
-    
-    // Send command to server
-    char command[BUFFER_SIZE];
-    snprintf(command, BUFFER_SIZE, "downltar %s", filetype);
-    if (write(sockfd, command, strlen(command)) < 0) 
-    {
-        error("ERROR writing to socket");
-        return;
-    }
-    
-    // Receive tar file from server
-    if (receive_file(sockfd, output_file) == 0) 
-    {
-        printf("Tar file '%s' downloaded successfully\n", output_file);
-    }
-}
-
-// Error handling function
-void handle_dispfnames(int sockfd, char *pathname) 
-{
-    // Check if pathname starts with ~S1/
-    if (strncmp(pathname, "~S1/", 4) != 0) 
-    {
-        printf("ERROR: Pathname must start with ~S1/\n");
-        return;
-    }
-    
-    // Send command to server
-    char command[BUFFER_SIZE];
-    snprintf(command, BUFFER_SIZE, "dispfnames %s", pathname);
-    if (write(sockfd, command, strlen(command)) < 0) 
-    {
-        error("ERROR writing to socket");
-        return;
-    }
-    
-    // Get server response
-    char response[BUFFER_SIZE];
-    bzero(response, BUFFER_SIZE);
-    if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
-    {
-        error("ERROR reading from socket");
-        return;
-    }
-    
-    printf("Files in %s:\n%s", pathname, response);
-}
-
-// Function to send a file to the server
-int send_file(int sockfd, char *filename) 
-{
-    int fd;
-    char buffer[BUFFER_SIZE];
-    ssize_t n;
-    
-    // Open file
-    fd = open(filename, O_RDONLY);
-    if (fd < 0) 
-    {
-        printf("ERROR: Failed to open file '%s'\n", filename);
-        return -1;
-    }
-    
-    // Get file size
-    struct stat st;
-    if (fstat(fd, &st) < 0) 
-    {
-        printf("ERROR: Failed to get file size\n");
-        close(fd);
-        return -1;
-    }
-    
-    // Send file size
-    if (write(sockfd, &st.st_size, sizeof(off_t)) < 0) 
-    {
-        error("ERROR writing file size to socket");
-        close(fd);
-        return -1;
-    }
-    
-    // Send file data
-    off_t remaining = st.st_size;
-    while (remaining > 0) 
-    {
-        n = read(fd, buffer, BUFFER_SIZE);
-        if (n <= 0) // Error or end of file
-        {
-            printf("ERROR: Failed to read from file\n");
-            close(fd);
-            return -1;
-        }
-        // Send data to server
-        if (write(sockfd, buffer, n) < 0) 
-        {
-            error("ERROR writing to socket");
-            close(fd);
-            return -1;
-        }
-        
-        remaining -= n;
-    }
-    
-    close(fd);
-    return 0;
-}
-// Function to receive a file from the server
-int receive_file(int sockfd, char *filename) 
-{
-    int fd;
-    char buffer[BUFFER_SIZE];
-    ssize_t n;
-
-    // Peek into the socket to check if response starts with "ERROR"
-    char peek_buf[6] = {0}; // 5 + null terminator
-    n = recv(sockfd, peek_buf, 5, MSG_PEEK);  // Look at first 5 bytes without removing them from buffer
-
-    // Check for error in peeking
-    if (n <= 0) 
-    {
-        printf("ERROR: Failed to read from socket\n");
-        return -1;
-    }
-
-    // Check if the response starts with "ERROR"
-    if (strncmp(peek_buf, "ERROR", 5) == 0) 
-    {
-        // Read full error message now
-        char error_msg[BUFFER_SIZE] = {0};
-        read(sockfd, error_msg, BUFFER_SIZE - 1);
-        printf("%s\n", error_msg);
-        return -1;
-    }
-
-    // Read file size
-    off_t file_size;
-    if (read(sockfd, &file_size, sizeof(off_t)) != sizeof(off_t)) 
-    {
-        printf("ERROR: Failed to read file size\n");
-        return -1;
-    }
-
-    // Check if file size is valid
-    if (file_size <= 0) 
-    {
-        printf("ERROR: Invalid file size received: %ld\n", (long)file_size);
-        return -1;
-    }
-
-    // Create file
-    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0) {
-        printf("ERROR: Failed to create file '%s'\n", filename);
-        return -1;
-    }
-
-    // Receive file data
-    off_t remaining = file_size;
-    while (remaining > 0) 
-    {
-        // Read data from socket
-        n = read(sockfd, buffer, (remaining < BUFFER_SIZE) ? remaining : BUFFER_SIZE);
-        if (n <= 0) 
-        {
-            printf("ERROR: File transfer failed\n");
-            close(fd);
-            unlink(filename);  // Delete partially written file
-            return -1;
-        }
-
-        // Write data to file
-        if (write(fd, buffer, n) < 0) 
-        {
-            printf("ERROR: Failed to write to file\n");
-            close(fd);
-            unlink(filename);
-            return -1;
-        }
-
-        remaining -= n; // Update remaining bytes
-    }
-
-    close(fd); // Close the file
-    return 0; // Success
-}
-
-// Error handling function
-void error(const char *msg) 
-{
-    perror(msg);
+// Distributed File System - Client Implementation (w25clients.c)
+
+#define _GNU_SOURCE // for fallocate() and O_DIRECT
+#include <stdio.h> 
+#include <stdlib.h>
+#include <string.h> 
+#include <unistd.h> // for close()
+#include <sys/types.h>
+#include <sys/socket.h> // for socket()
+#include <netinet/in.h>
+#include <netdb.h> // for gethostbyname()
+#include <arpa/inet.h> // for inet_ntoa()
+#include <sys/stat.h>
+#include <fcntl.h> // for open()
+#include <libgen.h> // for basename()
+#include <errno.h> // for errno
+#include <time.h> // for clock_gettime()
+#include <signal.h> // for signal()
+#include <sys/wait.h> // for waitpid()
+#include "dfs_net.h" // for transfer buffer sizes and socket options
+
+#define PORT 4307 // S1 server port
+#define BUFFER_SIZE 1024 // Buffer size for file transfer
+#define MAX_PATH_LEN 1024 // Maximum path length
+#define TRACE_FILE "trace.json" // Where the trace command saves its output
+
+unsigned long long request_id = 0; // Id of the current command, sent ahead of it for tracing
+
+// Function prototypes
+void error(const char *msg); // Error handling function
+int connect_to_server(); // Function to connect to the server
+void handle_uploadf(int sockfd, char *filename, char *dest_path); // Function to handle file upload
+void handle_downlf(int sockfd, char *filename);
+void handle_readlines(int sockfd, char *filename, char *start, char *count);
+void handle_zipls(int sockfd, char *filename);
+void handle_zipget(int sockfd, char *filename, char *member);
+void handle_pdfinfo(int sockfd, char *filename);
+void handle_pdfrange(int sockfd, char *filename, char *range);
+int inflate_member(int sockfd, int out_fd, off_t length, unsigned long crc, unsigned long long size);
+void handle_removef(int sockfd, char *filename);
+void handle_copyf(int sockfd, char *cmd, char *src, char *dst);
+void handle_mremovef(int sockfd, char **paths, size_t count);
+void handle_muploadf(int sockfd, char *dest_path, char **files, size_t count);
+char **collect_names(char *first, size_t *count);
+void free_names(char **names, size_t count);
+void print_batch_status(char **names, size_t count, const char *status, const char *verb);
+void handle_downltar(int sockfd, char *filetype, char *codec, char *level);
+void handle_dispfnames(int sockfd, char *pathname);
+void handle_findf(int sockfd, char *pattern, char *pathname);
+void handle_grepf(int sockfd, char *pattern, char *pathname, int regex);
+void handle_stats(int sockfd, char *format);
+void handle_cachestats(int sockfd);
+void handle_trace(int sockfd, char *id);
+void new_request_id(void);
+int send_command(int sockfd, const char *command);
+int send_file(int sockfd, char *filename);
+int receive_file(int sockfd, char *filename);
+
+int main() {
+    int sockfd;
+    char buffer[BUFFER_SIZE]; // Buffer for user input
+    
+    printf("Distributed File System Client\n");
+    printf("Available commands:\n");
+    printf("  uploadf <filename> <destination_path> (example: uploadf test1.txt ~S1/folder1/)\n");
+    printf("  downlf <filename> (example: downlf ~S1/folder1/test1.txt)\n");
+    printf("  readlines <filename> <start> <count> (example: readlines ~S1/logs/app.txt 1000 20)\n");
+    printf("  zipls <filename> (example: zipls ~S1/folder1/backup.zip)\n");
+    printf("  zipget <filename> <member> (example: zipget ~S1/folder1/backup.zip docs/notes.txt)\n");
+    printf("  pdfinfo <filename> (example: pdfinfo ~S1/folder1/report.pdf)\n");
+    printf("  pdfrange <filename> <offset> <length>|first (example: pdfrange ~S1/folder1/report.pdf first)\n");
+    printf("  removef <filename> (example: removef ~S1/folder1/test1.txt)\n");
+    printf("  mremovef <filename>... | @listfile (example: mremovef ~S1/folder1/a.txt ~S1/folder1/b.c)\n");
+    printf("  muploadf <destination_path> <filename>... | @listfile (example: muploadf ~S1/folder1/ a.c b.pdf)\n");
+    printf("  copyf <filename> <destination> (example: copyf ~S1/folder1/test1.txt ~S1/folder2/)\n");
+    printf("  movef <filename> <destination> (example: movef ~S1/folder1/test1.txt ~S1/folder1/notes.txt)\n");
+    printf("  downltar <filetype> [gzip|zstd [level]] (example: downltar .txt zstd 3)\n");
+    printf("  downltar all [pathname] (example: downltar all ~S1/folder1)\n");
+    printf("  dispfnames <pathname> (example: dispfnames ~S1/)\n");
+    printf("  findf <glob|substring> [pathname] (example: findf 'report*.pdf' ~S1/folder1)\n");
+    printf("  grepf [-E] <text|regex> [pathname] (example: grepf -E '^#include' ~S1/folder1)\n");
+    printf("  stats [prom] (example: stats prom)\n");
+    printf("  cachestats (example: cachestats)\n");
+    printf("  trace [request_id] (example: trace 3f2a9c01d4e5b677)\n");
+    printf("  exit\n\n");
+    
+    while (1) 
+    {
+        printf("w25clients$ ");
+        bzero(buffer, BUFFER_SIZE); 
+        fgets(buffer, BUFFER_SIZE - 1, stdin);
+        
+        // Remove newline
+        buffer[strcspn(buffer, "\n")] = 0;
+        
+        // Ignore empty commands
+        if (strlen(buffer) == 0) 
+        {
+            continue;
+        }
+        
+        // Check for exit command
+        if (strcmp(buffer, "exit") == 0) 
+        {
+            break;
+        }
+        
+        // Connect to server
+        sockfd = connect_to_server();
+        if (sockfd < 0) 
+        {
+            printf("Failed to connect to server\n");
+            continue;
+        }
+        
+        // Tag everything this command causes on the servers with one id
+        new_request_id();
+        if (getenv("DFS_TRACE") != NULL) 
+        {
+            printf("Request ID: %016llx\n", request_id);
+        }
+        
+        // Parse command
+        char *cmd = strtok(buffer, " ");
+        
+        // task1 uplodf
+		if (strcmp(cmd, "uploadf") == 0) 
+        {
+            char *filename = strtok(NULL, " ");
+            char *dest_path = strtok(NULL, " ");
+            if (filename == NULL || dest_path == NULL) 
+            {
+                printf("Invalid command format. Usage: uploadf <filename> <destination_path>\n"); // Example: uploadf test1.txt ~S1/folder1/
+                close(sockfd);
+                continue;
+            }
+            handle_uploadf(sockfd, filename, dest_path); // Upload file
+        } 
+
+        // task 2 downlf
+		else if (strcmp(cmd, "downlf") == 0) 
+        {
+            char *filename = strtok(NULL, " ");
+            if (filename == NULL) 
+            {
+                printf("Invalid command format. Usage: downlf <filename>\n");
+                close(sockfd);
+                continue;
+            }
+            handle_downlf(sockfd, filename);
+        }
+        // Range of lines of a TXT file
+        else if (strcmp(cmd, "readlines") == 0) 
+        {
+            char *filename = strtok(NULL, " ");
+            char *start = strtok(NULL, " ");
+            char *count = strtok(NULL, " ");
+            if (filename == NULL || start == NULL || count == NULL) 
+            {
+                printf("Invalid command format. Usage: readlines <filename> <start> <count>\n");
+                close(sockfd);
+                continue;
+            }
+            handle_readlines(sockfd, filename, start, count);
+        }
+        // Members of a ZIP archive
+        else if (strcmp(cmd, "zipls") == 0) 
+        {
+            char *filename = strtok(NULL, " ");
+            if (filename == NULL) 
+            {
+                printf("Invalid command format. Usage: zipls <filename>\n");
+                close(sockfd);
+                continue;
+            }
+            handle_zipls(sockfd, filename);
+        }
+        else if (strcmp(cmd, "zipget") == 0) 
+        {
+            char *filename = strtok(NULL, " ");
+            char *member = strtok(NULL, ""); // The rest of the line, so names may contain spaces
+            if (filename == NULL || member == NULL) 
+            {
+                printf("Invalid command format. Usage: zipget <filename> <member>\n");
+                close(sockfd);
+                continue;
+            }
+            handle_zipget(sockfd, filename, member);
+        }
+        // Metadata and byte ranges of a PDF
+        else if (strcmp(cmd, "pdfinfo") == 0) 
+        {
+            char *filename = strtok(NULL, " ");
+            if (filename == NULL) 
+            {
+                printf("Invalid command format. Usage: pdfinfo <filename>\n");
+                close(sockfd);
+                continue;
+            }
+            handle_pdfinfo(sockfd, filename);
+        }
+        else if (strcmp(cmd, "pdfrange") == 0) 
+        {
+            char *filename = strtok(NULL, " ");
+            char *range = strtok(NULL, "");
+            if (filename == NULL || range == NULL) 
+            {
+                printf("Invalid command format. Usage: pdfrange <filename> <offset> <length>|first\n");
+                close(sockfd);
+                continue;
+            }
+            handle_pdfrange(sockfd, filename, range);
+        }
+		// task 3 removef
+        else if (strcmp(cmd, "removef") == 0) 
+        {
+            char *filename = strtok(NULL, " ");
+            if (filename == NULL) 
+            {
+                printf("Invalid command format. Usage: removef <filename>\n");
+                close(sockfd);
+                continue;
+            }
+            handle_removef(sockfd, filename);
+        } 
+        // Batch removal: many paths, or "@file" naming a file with one path per line
+        else if (strcmp(cmd, "mremovef") == 0) 
+        {
+            size_t count = 0;
+            char **paths = collect_names(strtok(NULL, " "), &count);
+            if (paths == NULL || count == 0) 
+            {
+                printf("Invalid command format. Usage: mremovef <filename>... | @listfile\n");
+                free_names(paths, count);
+                close(sockfd);
+                continue;
+            }
+            handle_mremovef(sockfd, paths, count);
+            free_names(paths, count);
+        } 
+        // Batch upload of many local files into one destination directory
+        else if (strcmp(cmd, "muploadf") == 0) 
+        {
+            char *dest_path = strtok(NULL, " ");
+            size_t count = 0;
+            char **files = (dest_path != NULL) ? collect_names(strtok(NULL, " "), &count) : NULL;
+            if (files == NULL || count == 0) 
+            {
+                printf("Invalid command format. Usage: muploadf <destination_path> <filename>... | @listfile\n");
+                free_names(files, count);
+                close(sockfd);
+                continue;
+            }
+            handle_muploadf(sockfd, dest_path, files, count);
+            free_names(files, count);
+        } 
+        // Server-side copy or move; the file is not transferred to the client
+        else if (strcmp(cmd, "copyf") == 0 || strcmp(cmd, "movef") == 0) 
+        {
+            char *src = strtok(NULL, " ");
+            char *dst = strtok(NULL, " ");
+            if (src == NULL || dst == NULL) 
+            {
+                printf("Invalid command format. Usage: %s <filename> <destination>\n", cmd);
+                close(sockfd);
+                continue;
+            }
+            handle_copyf(sockfd, cmd, src, dst);
+        } 
+		// task 4 downltar
+        else if (strcmp(cmd, "downltar") == 0) 
+        {
+            char *filetype = strtok(NULL, " ");
+            if (filetype == NULL) 
+            {
+                printf("Invalid command format. Usage: downltar <filetype> [gzip|zstd [level]]\n");
+                close(sockfd);
+                continue;
+            }
+            char *codec = strtok(NULL, " "); // Optional compression codec
+            char *level = strtok(NULL, " "); // Optional compression level
+            handle_downltar(sockfd, filetype, codec, level);
+        }
+
+		// task 5 dispfnames
+        else if (strcmp(cmd, "dispfnames") == 0)
+        {
+            char *pathname = strtok(NULL, " ");
+            if (pathname == NULL) 
+            {
+                printf("Invalid command format. Usage: dispfnames <pathname>\n");
+                close(sockfd);
+                continue;
+            }
+            handle_dispfnames(sockfd, pathname);
+        } 
+        // File name search across all servers
+        else if (strcmp(cmd, "findf") == 0)
+        {
+            char *pattern = strtok(NULL, " ");
+            if (pattern == NULL) 
+            {
+                printf("Invalid command format. Usage: findf <glob|substring> [pathname]\n");
+                close(sockfd);
+                continue;
+            }
+            handle_findf(sockfd, pattern, strtok(NULL, " "));
+        } 
+        // Content search of the .c and .txt files
+        else if (strcmp(cmd, "grepf") == 0)
+        {
+            char *pattern = strtok(NULL, " ");
+            int regex = (pattern != NULL && strcmp(pattern, "-E") == 0);
+            if (regex) 
+            {
+                pattern = strtok(NULL, " ");
+            }
+            if (pattern == NULL) 
+            {
+                printf("Invalid command format. Usage: grepf [-E] <text|regex> [pathname]\n");
+                close(sockfd);
+                continue;
+            }
+            handle_grepf(sockfd, pattern, strtok(NULL, " "), regex);
+        } 
+        // Per-operation latency statistics of all servers
+        else if (strcmp(cmd, "stats") == 0)
+        {
+            handle_stats(sockfd, strtok(NULL, " "));
+        } 
+        // Hit rates of S1's download cache and lookup filters
+        else if (strcmp(cmd, "cachestats") == 0)
+        {
+            handle_cachestats(sockfd);
+        } 
+        // Span timings of recent requests as Chrome trace JSON
+        else if (strcmp(cmd, "trace") == 0)
+        {
+            handle_trace(sockfd, strtok(NULL, " "));
+        } 
+        else 
+        {
+            printf("Unknown command: %s\n", cmd);
+        }
+        
+        close(sockfd); // Close the socket after each command
+    }
+    
+    return 0;
+}
+
+int connect_to_server() // Function to connect to the server
+{
+    int sockfd; // Socket file descriptor
+    struct sockaddr_in serv_addr; // Server address structure
+    struct hostent *server; // Host information structure
+    
+    sockfd = socket(AF_INET, SOCK_STREAM, 0); // Create socket
+    if (sockfd < 0) 
+    {
+        error("ERROR opening socket"); // Socket creation failed
+        return -1;
+    }
+    
+    net_tune_socket(sockfd); // Buffer sizes and TCP_NODELAY from the environment
+    
+    // Get server address
+    server = gethostbyname("localhost");
+    if (server == NULL) 
+    {
+        fprintf(stderr, "ERROR, no such host\n"); // Host resolution failed
+        return -1;
+    }
+    
+    // Initialize server address structure
+    bzero((char *) &serv_addr, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET; // Address family
+    bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length); // Copy host address
+    serv_addr.sin_port = htons(PORT); // Port number
+    
+    // Connect to server
+    if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
+    {
+        error("ERROR connecting");
+        return -1;
+    }
+    
+    return sockfd; // Return the socket file descriptor
+}
+
+// Error handling function
+void handle_uploadf(int sockfd, char *filename, char *dest_path) 
+{
+    // Verify file exists
+    struct stat st;
+    if (stat(filename, &st) != 0) 
+    {
+        printf("ERROR: File '%s' not found\n", filename);
+        return;
+    }
+    
+    // Check if destination path starts with ~S1/
+    if (strncmp(dest_path, "~S1/", 4) != 0) 
+    {
+        printf("ERROR: Destination path must start with ~S1/\n");
+        return;
+    }
+    
+    // Check file extension
+    char *ext = strrchr(filename, '.');
+    if (ext == NULL) 
+    {
+        printf("ERROR: File has no extension\n");
+        return;
+    }
+    
+    // Check if file type is supported
+    if (strcmp(ext, ".c") != 0 && strcmp(ext, ".pdf") != 0 && strcmp(ext, ".txt") != 0 && strcmp(ext, ".zip") != 0) 
+    {
+        printf("ERROR: Unsupported file type. Only .c, .pdf, .txt, .zip allowed\n");
+        return;
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "uploadf %s %s", filename, dest_path);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // Wait for server response: exactly "READY", or an error message
+    char response[BUFFER_SIZE];
+    bzero(response, BUFFER_SIZE);
+    if (net_read_reply(sockfd, response, 5) < 0) 
+    {
+        error("ERROR reading from socket");
+        return;
+    }
+    
+    // Check server response
+    if (strcmp(response, "READY") == 0) 
+    {
+        // Server is ready to receive file
+        if (send_file(sockfd, filename) == 0) 
+        {
+            // Wait for final response
+            bzero(response, BUFFER_SIZE);
+            if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
+            {
+                error("ERROR reading from socket");
+                return;
+            }
+            printf("%s\n", response);
+        }
+    } 
+    else 
+    {
+        read(sockfd, response + 5, BUFFER_SIZE - 6);
+        printf("%s\n", response);
+    }
+}
+
+// Error handling function
+void handle_downlf(int sockfd, char *filename) 
+{
+    // Check if filename starts with ~S1/
+    if (strncmp(filename, "~S1/", 4) != 0) 
+    {
+        printf("ERROR: Filename must start with ~S1/\n");
+        return;
+    }
+    
+    // Check file extension
+    char *ext = strrchr(filename, '.');
+    if (ext == NULL) 
+    {
+        printf("ERROR: File has no extension\n");
+        return;
+    }
+    
+    // Check if file type is supported
+    if (strcmp(ext, ".c") != 0 && strcmp(ext, ".pdf") != 0 && 
+        strcmp(ext, ".txt") != 0 && strcmp(ext, ".zip") != 0) 
+        {
+        printf("ERROR: Unsupported file type. Only .c, .pdf, .txt, .zip allowed\n");
+        return;
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "downlf %s", filename);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // Get the base name for saving locally
+    char *base_name = basename(filename);
+    
+    // Receive file from server
+    if (receive_file(sockfd, base_name) == 0) 
+    {
+        printf("File '%s' downloaded successfully\n", base_name);
+    }
+}
+
+// Function to print a range of lines of a TXT file
+// Lines start at 1; a range running past the end of the file stops there.
+void handle_readlines(int sockfd, char *filename, char *start, char *count) 
+{
+    char *ext = strrchr(filename, '.');
+    if (strncmp(filename, "~S1/", 4) != 0 || ext == NULL || strcmp(ext, ".txt") != 0) 
+    {
+        printf("ERROR: readlines only reads ~S1/ TXT files\n");
+        return;
+    }
+    char *end;
+    if (strtoull(start, &end, 10) == 0 || *end != '\0' || strtoull(count, &end, 10) == 0 || *end != '\0') 
+    {
+        printf("ERROR: Start and count must be positive numbers\n");
+        return;
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "readlines %s %s %s", filename, start, count);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // The reply starts with the length of the range or with an error message
+    off_t length;
+    if (net_read_reply(sockfd, &length, sizeof(off_t)) < 0) 
+    {
+        printf("ERROR: Failed to read from socket\n");
+        return;
+    }
+    char response[BUFFER_SIZE];
+    ssize_t n;
+    if (memcmp(&length, "ERROR", 5) == 0) 
+    {
+        fwrite(&length, 1, sizeof(off_t), stdout);
+        while ((n = net_read_some(sockfd, response, sizeof(response))) > 0) 
+        {
+            fwrite(response, 1, n, stdout);
+        }
+        printf("\n");
+        return;
+    }
+    
+    // Copy the lines to the terminal as they arrive
+    off_t remaining = length;
+    char last = '\n';
+    while (remaining > 0 && (n = net_read_some(sockfd, response, ((size_t)remaining < sizeof(response)) ? (size_t)remaining : sizeof(response))) > 0) 
+    {
+        fwrite(response, 1, n, stdout);
+        last = response[n - 1];
+        remaining -= n;
+    }
+    if (last != '\n') 
+    {
+        printf("\n"); // The file's last line has no newline
+    }
+    if (remaining > 0) 
+    {
+        printf("ERROR: Connection closed before the last line\n");
+    }
+    fflush(stdout);
+}
+
+// Function to list the members of a ZIP archive stored in S4
+// Prints "<size> <compressed size> <method> <name>" per member as the lines arrive.
+void handle_zipls(int sockfd, char *filename) 
+{
+    char *ext = strrchr(filename, '.');
+    if (strncmp(filename, "~S1/", 4) != 0 || ext == NULL || strcmp(ext, ".zip") != 0) 
+    {
+        printf("ERROR: zipls only reads ~S1/ ZIP files\n");
+        return;
+    }
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "zipls %s", filename);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    char response[BUFFER_SIZE];
+    long members = 0;
+    ssize_t n;
+    int first = 1;
+    while (net_wait_reply(sockfd) == 0 && (n = net_read_some(sockfd, response, sizeof(response))) > 0) 
+    {
+        if (first && n >= 5 && memcmp(response, "ERROR", 5) == 0) 
+        {
+            fwrite(response, 1, n, stdout);
+            printf("\n");
+            return;
+        }
+        first = 0;
+        fwrite(response, 1, n, stdout);
+        for (ssize_t i = 0; i < n; i++) 
+        {
+            members += (response[i] == '\n');
+        }
+    }
+    if (n < 0) 
+    {
+        error("ERROR reading from socket");
+    }
+    printf("%ld member(s)\n", members);
+}
+
+// Function to extract one member of a ZIP archive stored in S4 into the current directory
+// Only the member's own bytes are transferred. Stored members are written as they are;
+// deflated ones are wrapped in a gzip header and trailer and decompressed by gzip, which
+// also checks the CRC-32 from the archive.
+void handle_zipget(int sockfd, char *filename, char *member) 
+{
+    char *ext = strrchr(filename, '.');
+    if (strncmp(filename, "~S1/", 4) != 0 || ext == NULL || strcmp(ext, ".zip") != 0) 
+    {
+        printf("ERROR: zipget only reads ~S1/ ZIP files\n");
+        return;
+    }
+    char *base_name = strrchr(member, '/');
+    base_name = (base_name != NULL) ? base_name + 1 : member;
+    if (*base_name == '\0') 
+    {
+        printf("ERROR: Member is a directory\n");
+        return;
+    }
+    
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "zipget %s %s", filename, member);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // "<method> <crc32> <size>", or an error message in its place
+    size_t meta_len;
+    char *meta = net_read_frame(sockfd, 256, &meta_len);
+    if (meta == NULL) 
+    {
+        printf("ERROR: Failed to read from socket\n");
+        return;
+    }
+    if (meta_len == NET_FRAME_ERROR) 
+    {
+        printf("%s\n", meta);
+        free(meta);
+        return;
+    }
+    unsigned int method;
+    unsigned long crc;
+    unsigned long long size;
+    int fields = sscanf(meta, "%u %lx %llu", &method, &crc, &size);
+    free(meta);
+    off_t length;
+    if (fields != 3 || net_read_full(sockfd, &length, sizeof(off_t)) < 0) 
+    {
+        printf("ERROR: Invalid reply from server\n");
+        return;
+    }
+    
+    int fd = open(base_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) 
+    {
+        error("ERROR creating file");
+        return;
+    }
+    int rc = (method == 0) ? net_recvfile(sockfd, fd, length, 0) : inflate_member(sockfd, fd, length, crc, size);
+    close(fd);
+    if (rc < 0) 
+    {
+        unlink(base_name);
+        printf("ERROR: Failed to extract '%s'\n", member);
+        return;
+    }
+    printf("Member '%s' extracted to '%s' (%llu bytes)\n", member, base_name, size);
+}
+
+// Function to show the page count, title and linearization of a PDF stored in S2
+// S2 answers from its PDF index, so the document is not downloaded.
+void handle_pdfinfo(int sockfd, char *filename) 
+{
+    char *ext = strrchr(filename, '.');
+    if (strncmp(filename, "~S1/", 4) != 0 || ext == NULL || strcmp(ext, ".pdf") != 0) 
+    {
+        printf("ERROR: pdfinfo only reads ~S1/ PDF files\n");
+        return;
+    }
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "pdfinfo %s", filename);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    char response[BUFFER_SIZE];
+    ssize_t n;
+    int first = 1;
+    while (net_wait_reply(sockfd) == 0 && (n = net_read_some(sockfd, response, sizeof(response))) > 0) 
+    {
+        fwrite(response, 1, n, stdout);
+        if (first && n >= 5 && memcmp(response, "ERROR", 5) == 0) 
+        {
+            printf("\n");
+            return;
+        }
+        first = 0;
+    }
+    if (n < 0) 
+    {
+        error("ERROR reading from socket");
+    }
+}
+
+// Function to download part of a PDF stored in S2 into the current directory
+// The bytes are written at their own offset in the local file, which is not truncated, so
+// "first" followed by the remaining range builds up the whole document.
+void handle_pdfrange(int sockfd, char *filename, char *range) 
+{
+    char *ext = strrchr(filename, '.');
+    if (strncmp(filename, "~S1/", 4) != 0 || ext == NULL || strcmp(ext, ".pdf") != 0) 
+    {
+        printf("ERROR: pdfrange only reads ~S1/ PDF files\n");
+        return;
+    }
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "pdfrange %s %s", filename, range);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // "<offset> <file size>", or an error message in its place
+    size_t meta_len;
+    char *meta = net_read_frame(sockfd, 256, &meta_len);
+    if (meta == NULL) 
+    {
+        printf("ERROR: Failed to read from socket\n");
+        return;
+    }
+    if (meta_len == NET_FRAME_ERROR) 
+    {
+        printf("%s\n", meta);
+        free(meta);
+        return;
+    }
+    unsigned long long offset;
+    unsigned long long size;
+    int fields = sscanf(meta, "%llu %llu", &offset, &size);
+    free(meta);
+    off_t length;
+    if (fields != 2 || net_read_full(sockfd, &length, sizeof(off_t)) < 0) 
+    {
+        printf("ERROR: Invalid reply from server\n");
+        return;
+    }
+    
+    char *base_name = basename(filename);
+    int fd = open(base_name, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) 
+    {
+        error("ERROR creating file");
+        return;
+    }
+    int rc = (lseek(fd, offset, SEEK_SET) < 0) ? -1 : net_recvfile(sockfd, fd, length, 0);
+    close(fd);
+    if (rc < 0) 
+    {
+        printf("ERROR: Failed to receive byte range of '%s'\n", base_name);
+        return;
+    }
+    printf("Received bytes %llu-%llu of '%s' (%llu bytes in total)\n", offset, 
+           offset + length - 1, base_name, size);
+}
+
+// Function to decompress a deflated member arriving on sockfd into out_fd
+// Raw deflate data plus a gzip header and trailer is a gzip stream, so the gzip tool can
+// inflate it and verify crc and size. Returns 0 on success and -1 on failure.
+int inflate_member(int sockfd, int out_fd, off_t length, unsigned long crc, unsigned long long size) 
+{
+    int pipefd[2];
+    if (pipe(pipefd) < 0) 
+    {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) 
+    {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+    if (pid == 0) 
+    {
+        dup2(pipefd[0], STDIN_FILENO);
+        dup2(out_fd, STDOUT_FILENO);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        execlp("gzip", "gzip", "-dc", (char *)NULL);
+        _exit(127);
+    }
+    close(pipefd[0]);
+    
+    // A gzip that gives up early must not kill the client with SIGPIPE
+    void (*old_handler)(int) = signal(SIGPIPE, SIG_IGN);
+    const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+    unsigned char trailer[8];
+    for (int i = 0; i < 4; i++) 
+    {
+        trailer[i] = (crc >> (8 * i)) & 0xff;
+        trailer[4 + i] = (size >> (8 * i)) & 0xff; // Size modulo 2^32
+    }
+    int rc = net_write_full(pipefd[1], header, sizeof(header));
+    char buffer[BUFFER_SIZE * 16];
+    off_t remaining = length;
+    while (rc == 0 && remaining > 0) 
+    {
+        ssize_t n = net_read_some(sockfd, buffer, ((size_t)remaining < sizeof(buffer)) ? (size_t)remaining : sizeof(buffer));
+        if (n <= 0) 
+        {
+            rc = -1;
+            break;
+        }
+        rc = net_write_full(pipefd[1], buffer, n);
+        remaining -= n;
+    }
+    if (rc == 0) 
+    {
+        rc = net_write_full(pipefd[1], trailer, sizeof(trailer));
+    }
+    close(pipefd[1]);
+    
+    int status;
+    waitpid(pid, &status, 0);
+    signal(SIGPIPE, old_handler);
+    return (rc == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+// Error handling function
+void handle_removef(int sockfd, char *filename) 
+{
+    // Check if filename starts with ~S1/
+    if (strncmp(filename, "~S1/", 4) != 0) 
+    {
+        printf("ERROR: Filename must start with ~S1/\n");
+        return;
+    }
+    
+    // Check file extension
+    char *ext = strrchr(filename, '.');
+    if (ext == NULL) {
+        printf("ERROR: File has no extension\n");
+        return;
+    }
+    
+    // Check if file type is supported
+    if (strcmp(ext, ".c") != 0 && strcmp(ext, ".pdf") != 0 && strcmp(ext, ".txt") != 0 && strcmp(ext, ".zip") != 0)
+    {
+        printf("ERROR: Unsupported file type. Only .c, .pdf, .txt, .zip allowed\n");
+        return;
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "removef %s", filename);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // Get server response
+    char response[BUFFER_SIZE];
+    bzero(response, BUFFER_SIZE);
+    if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
+    {
+        error("ERROR reading from socket");
+        return;
+    }
+    
+    printf("%s\n", response);
+}
+
+// Function to gather the names of a batch command
+// first is the first argument: "@file" reads one name per line from that file, otherwise
+// it and the rest of the command line are the names. Returns a new array, or NULL.
+char **collect_names(char *first, size_t *count) 
+{
+    *count = 0;
+    if (first == NULL) 
+    {
+        return NULL;
+    }
+    
+    size_t cap = 64;
+    char **names = malloc(cap * sizeof(char *));
+    if (names == NULL) 
+    {
+        return NULL;
+    }
+    
+    FILE *list = NULL;
+    if (first[0] == '@') 
+    {
+        list = fopen(first + 1, "r");
+        if (list == NULL) 
+        {
+            printf("ERROR: Cannot open list file '%s'\n", first + 1);
+            free(names);
+            return NULL;
+        }
+    }
+    
+    char line[MAX_PATH_LEN];
+    char *name = first;
+    while (1) 
+    {
+        if (list != NULL) 
+        {
+            if (fgets(line, sizeof(line), list) == NULL) 
+            {
+                break;
+            }
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '\0') 
+            {
+                continue;
+            }
+            name = line;
+        }
+        else if (name == NULL) 
+        {
+            break;
+        }
+        
+        if (*count == cap) 
+        {
+            char **grown = realloc(names, cap * 2 * sizeof(char *));
+            if (grown == NULL) 
+            {
+                break;
+            }
+            names = grown;
+            cap *= 2;
+        }
+        names[(*count)++] = strdup(name);
+        
+        if (list == NULL) 
+        {
+            name = strtok(NULL, " ");
+        }
+    }
+    
+    if (list != NULL) 
+    {
+        fclose(list);
+    }
+    return names;
+}
+
+// Function to free the names returned by collect_names
+void free_names(char **names, size_t count) 
+{
+    if (names == NULL) 
+    {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) 
+    {
+        free(names[i]);
+    }
+    free(names);
+}
+
+// Function to print the outcome of a batch command from its status vector
+// Only the names that failed are listed, with the reason.
+void print_batch_status(char **names, size_t count, const char *status, const char *verb) 
+{
+    size_t ok = 0;
+    for (size_t i = 0; i < count; i++) 
+    {
+        if (status[i] == NET_BATCH_OK) 
+        {
+            ok++;
+            continue;
+        }
+        const char *reason = "failed";
+        if (status[i] == NET_BATCH_NOT_FOUND) 
+        {
+            reason = "not found";
+        } 
+        else if (status[i] == NET_BATCH_UNSUPPORTED) 
+        {
+            reason = "unsupported file type or path";
+        }
+        printf("%s: %s\n", names[i], reason);
+    }
+    printf("%s %zu of %zu files\n", verb, ok, count);
+}
+
+// Function to remove many files in one request
+// The paths go to S1 as one frame; S1 answers with one status character per path.
+void handle_mremovef(int sockfd, char **paths, size_t count) 
+{
+    // Join the paths into one newline-separated list
+    size_t list_len = 0;
+    for (size_t i = 0; i < count; i++) 
+    {
+        list_len += strlen(paths[i]) + 1;
+    }
+    char *list = malloc(list_len + 1);
+    if (list == NULL) 
+    {
+        printf("ERROR: Out of memory\n");
+        return;
+    }
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) 
+    {
+        pos += sprintf(list + pos, "%s\n", paths[i]);
+    }
+    
+    // Send command to server and wait for "READY"
+    char response[BUFFER_SIZE];
+    bzero(response, BUFFER_SIZE);
+    if (send_command(sockfd, "mremovef") < 0 || net_read_reply(sockfd, response, 5) < 0) 
+    {
+        error("ERROR talking to server");
+        free(list);
+        return;
+    }
+    if (strcmp(response, "READY") != 0) 
+    {
+        read(sockfd, response + 5, BUFFER_SIZE - 6);
+        printf("%s\n", response);
+        free(list);
+        return;
+    }
+    
+    size_t status_len = 0;
+    char *status = NULL;
+    if (net_write_frame(sockfd, list, list_len) == 0) 
+    {
+        status = net_read_frame(sockfd, count, &status_len);
+    }
+    free(list);
+    if (status == NULL || (status_len != count && status_len != NET_FRAME_ERROR)) 
+    {
+        printf("ERROR: No status received from server\n");
+    } 
+    else if (status_len == NET_FRAME_ERROR) 
+    {
+        printf("%s\n", status);
+    } 
+    else 
+    {
+        print_batch_status(paths, count, status, "Removed");
+    }
+    free(status);
+}
+
+// Function to upload many files into one directory in one request
+// S1 receives the names as one frame and then each file as a size header and body.
+void handle_muploadf(int sockfd, char *dest_path, char **files, size_t count) 
+{
+    if (strncmp(dest_path, "~S1/", 4) != 0) 
+    {
+        printf("ERROR: Destination path must start with ~S1/\n");
+        return;
+    }
+    
+    // Only send files that exist and have a supported type
+    size_t list_size = 1;
+    for (size_t i = 0; i < count; i++) 
+    {
+        list_size += strlen(files[i]) + 1;
+    }
+    char **sent = malloc(count * sizeof(char *));
+    char *list = malloc(list_size);
+    if (sent == NULL || list == NULL) 
+    {
+        printf("ERROR: Out of memory\n");
+        free(sent);
+        free(list);
+        return;
+    }
+    size_t sent_count = 0;
+    size_t list_len = 0;
+    for (size_t i = 0; i < count; i++) 
+    {
+        struct stat st;
+        char *ext = strrchr(files[i], '.');
+        if (stat(files[i], &st) < 0 || !S_ISREG(st.st_mode)) 
+        {
+            printf("%s: cannot read file, skipped\n", files[i]);
+            continue;
+        }
+        if (ext == NULL || (strcmp(ext, ".c") != 0 && strcmp(ext, ".pdf") != 0 && 
+                            strcmp(ext, ".txt") != 0 && strcmp(ext, ".zip") != 0)) 
+        {
+            printf("%s: unsupported file type, skipped\n", files[i]);
+            continue;
+        }
+        char *slash = strrchr(files[i], '/');
+        list_len += sprintf(list + list_len, "%s\n", (slash != NULL) ? slash + 1 : files[i]);
+        sent[sent_count++] = files[i];
+    }
+    if (sent_count == 0) 
+    {
+        free(sent);
+        free(list);
+        return;
+    }
+    
+    // Send command to server and wait for "READY"
+    char command[BUFFER_SIZE];
+    char response[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "muploadf %s", dest_path);
+    bzero(response, BUFFER_SIZE);
+    if (send_command(sockfd, command) < 0 || net_read_reply(sockfd, response, 5) < 0) 
+    {
+        error("ERROR talking to server");
+        free(sent);
+        free(list);
+        return;
+    }
+    if (strcmp(response, "READY") != 0) 
+    {
+        read(sockfd, response + 5, BUFFER_SIZE - 6);
+        printf("%s\n", response);
+        free(sent);
+        free(list);
+        return;
+    }
+    
+    // Names first, then every file back to back on the same connection
+    int rc = net_write_frame(sockfd, list, list_len);
+    for (size_t i = 0; i < sent_count && rc == 0; i++) 
+    {
+        rc = send_file(sockfd, sent[i]);
+    }
+    free(list);
+    
+    size_t status_len = 0;
+    char *status = (rc == 0) ? net_read_frame(sockfd, sent_count, &status_len) : NULL;
+    if (status == NULL || (status_len != sent_count && status_len != NET_FRAME_ERROR)) 
+    {
+        printf("ERROR: No status received from server\n");
+    } 
+    else if (status_len == NET_FRAME_ERROR) 
+    {
+        printf("%s\n", status);
+    } 
+    else 
+    {
+        print_batch_status(sent, sent_count, status, "Uploaded");
+    }
+    free(status);
+    free(sent);
+}
+
+// Function to ask S1 to copy or move a file on the servers (cmd is "copyf" or "movef")
+// A destination ending in '/' keeps the file name.
+void handle_copyf(int sockfd, char *cmd, char *src, char *dst) 
+{
+    if (strncmp(src, "~S1/", 4) != 0 || strncmp(dst, "~S1/", 4) != 0) 
+    {
+        printf("ERROR: Filenames must start with ~S1/\n");
+        return;
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "%s %s %s", cmd, src, dst);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // Get server response
+    char response[BUFFER_SIZE];
+    bzero(response, BUFFER_SIZE);
+    if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
+    {
+        error("ERROR reading from socket");
+        return;
+    }
+    
+    printf("%s\n", response);
+}
+
+// Error handling function
+void handle_downltar(int sockfd, char *filetype, char *codec, char *level) 
+{
+    // "all" archives every file type below a path (given in place of the codec)
+    if (strcmp(filetype, "all") == 0) 
+    {
+        char *pathname = (codec != NULL) ? codec : "~S1";
+        if (strncmp(pathname, "~S1", 3) != 0) 
+        {
+            printf("ERROR: Pathname must start with ~S1\n");
+            return;
+        }
+        
+        char command[BUFFER_SIZE];
+        snprintf(command, BUFFER_SIZE, "downltar all %s", pathname);
+        if (send_command(sockfd, command) < 0) 
+        {
+            error("ERROR writing to socket");
+            return;
+        }
+        if (receive_file(sockfd, "allfiles.tar") == 0) 
+        {
+            printf("Tar file 'allfiles.tar' downloaded successfully\n");
+        }
+        return;
+    }
+    
+    // Check file type
+    if (strcmp(filetype, ".c") != 0 && strcmp(filetype, ".pdf") != 0 && strcmp(filetype, ".txt") != 0 && strcmp(filetype, ".zip") != 0) 
+    {
+        printf("ERROR: Unsupported file type for tar. Only .c, .pdf, .txt, .zip allowed\n");
+        return;
+    }
+    
+    // Check compression codec
+    if (codec != NULL && strcmp(codec, "gzip") != 0 && strcmp(codec, "zstd") != 0) 
+    {
+        printf("ERROR: Unsupported compression codec. Only gzip, zstd allowed\n");
+        return;
+    }
+    
+    // Determine output filename
+    char output_file[50];
+    if (strcmp(filetype, ".c") == 0) 
+    {
+        strcpy(output_file, "cfiles.tar");
+    } 
+    else if (strcmp(filetype, ".pdf") == 0) 
+    {
+        strcpy(output_file, "pdfiles.tar");
+    } 
+    else if (strcmp(filetype, ".zip") == 0) 
+    {
+        strcpy(output_file, "zipfiles.tar");
+    } else 
+    {
+        strcpy(output_file, "txtfiles.tar");
+    }
+    if (codec != NULL) 
+    {
+        strcat(output_file, (strcmp(codec, "gzip") == 0) ? ".gz" : ".zst");
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    if (codec != NULL) 
+    {
+        snprintf(command, BUFFER_SIZE, "downltar %s %s %d", filetype, codec, (level != NULL) ? atoi(level) : 0);
+    } 
+    else 
+    {
+        snprintf(command, BUFFER_SIZE, "downltar %s", filetype);
+    }
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // Receive tar file from server
+    if (receive_file(sockfd, output_file) == 0) 
+    {
+        printf("Tar file '%s' downloaded successfully\n", output_file);
+    }
+}
+
+// Error handling function
+void handle_dispfnames(int sockfd, char *pathname) 
+{
+    // Check if pathname starts with ~S1/
+    if (strncmp(pathname, "~S1/", 4) != 0) 
+    {
+        printf("ERROR: Pathname must start with ~S1/\n");
+        return;
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "dispfnames %s", pathname);
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // Get server response
+    char response[BUFFER_SIZE];
+    bzero(response, BUFFER_SIZE);
+    if (read(sockfd, response, BUFFER_SIZE - 1) < 0) 
+    {
+        error("ERROR reading from socket");
+        return;
+    }
+    
+    printf("Files in %s:\n%s", pathname, response);
+}
+
+// Function to search all servers for files by name
+// A pattern with *, ? or [ is a glob, anything else a substring; with a '/' it is matched
+// against the path below pathname instead of the file name. Matches stream in until S1
+// closes the connection.
+void handle_findf(int sockfd, char *pattern, char *pathname) 
+{
+    if (pathname != NULL && strncmp(pathname, "~S1", 3) != 0) 
+    {
+        printf("ERROR: Pathname must start with ~S1\n");
+        return;
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "findf %s %s", pattern, (pathname != NULL) ? pathname : "~S1");
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // Print matches as they arrive and count the lines
+    char response[BUFFER_SIZE];
+    long matches = 0;
+    ssize_t n;
+    int first = 1;
+    while (net_wait_reply(sockfd) == 0 && (n = net_read_some(sockfd, response, sizeof(response))) > 0) 
+    {
+        if (first && n >= 5 && memcmp(response, "ERROR", 5) == 0) 
+        {
+            fwrite(response, 1, n, stdout);
+            printf("\n");
+            return;
+        }
+        first = 0;
+        fwrite(response, 1, n, stdout);
+        for (ssize_t i = 0; i < n; i++) 
+        {
+            matches += (response[i] == '\n');
+        }
+    }
+    if (n < 0) 
+    {
+        error("ERROR reading from socket");
+    }
+    printf("%ld file(s) found\n", matches);
+}
+
+// Function to search the contents of the .c and .txt files
+// The pattern is plain text, or a POSIX extended regex with -E. Matching lines arrive as
+// "path:line number:text" until S1 closes the connection.
+void handle_grepf(int sockfd, char *pattern, char *pathname, int regex) 
+{
+    if (pathname != NULL && strncmp(pathname, "~S1", 3) != 0) 
+    {
+        printf("ERROR: Pathname must start with ~S1\n");
+        return;
+    }
+    
+    // Send command to server
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "grepf %s%s %s", regex ? "-E " : "", pattern, (pathname != NULL) ? pathname : "~S1");
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    // Print matching lines as they arrive and count them
+    char response[BUFFER_SIZE];
+    long matches = 0;
+    ssize_t n;
+    int first = 1;
+    while (net_wait_reply(sockfd) == 0 && (n = net_read_some(sockfd, response, sizeof(response))) > 0) 
+    {
+        if (first && n >= 5 && memcmp(response, "ERROR", 5) == 0) 
+        {
+            fwrite(response, 1, n, stdout);
+            printf("\n");
+            return;
+        }
+        first = 0;
+        fwrite(response, 1, n, stdout);
+        for (ssize_t i = 0; i < n; i++) 
+        {
+            matches += (response[i] == '\n');
+        }
+    }
+    if (n < 0) 
+    {
+        error("ERROR reading from socket");
+    }
+    printf("%ld matching line(s)\n", matches);
+}
+
+// Function to print latency statistics of S1-S4
+// "stats prom" prints them in Prometheus text format. The report ends when S1 closes the connection.
+void handle_stats(int sockfd, char *format) 
+{
+    const char *command = (format != NULL && strcmp(format, "prom") == 0) ? "stats prom" : "stats";
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    char response[BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(sockfd, response, sizeof(response))) > 0) 
+    {
+        fwrite(response, 1, n, stdout);
+    }
+    fflush(stdout);
+}
+
+// Function to print the hit rates of S1's download cache and its not-found lookup filters
+void handle_cachestats(int sockfd) 
+{
+    if (send_command(sockfd, "cachestats") < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    char response[BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(sockfd, response, sizeof(response))) > 0) 
+    {
+        fwrite(response, 1, n, stdout);
+    }
+    fflush(stdout);
+}
+
+// Function to save recorded spans of all servers to trace.json
+// The file can be opened in chrome://tracing or Perfetto. Given a request id, only that request is kept.
+void handle_trace(int sockfd, char *id) 
+{
+    char command[BUFFER_SIZE];
+    snprintf(command, BUFFER_SIZE, "trace %s", (id != NULL) ? id : "0");
+    if (send_command(sockfd, command) < 0) 
+    {
+        error("ERROR writing to socket");
+        return;
+    }
+    
+    int fd = open(TRACE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) 
+    {
+        perror("ERROR creating trace file");
+        return;
+    }
+    
+    char buffer[BUFFER_SIZE];
+    ssize_t n;
+    long total = 0;
+    while ((n = read(sockfd, buffer, sizeof(buffer))) > 0) 
+    {
+        write(fd, buffer, n);
+        total += n;
+    }
+    close(fd);
+    printf("Trace saved to %s (%ld bytes)\n", TRACE_FILE, total);
+}
+
+// Function to pick a fresh random id for the next command
+void new_request_id(void) 
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    unsigned long long x = ((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec) ^ ((unsigned long long)getpid() << 40);
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    request_id = x ^ (x >> 31);
+}
+
+// Function to send a command to S1 prefixed with the current request id
+// The command goes out in a single write so S1 reads it in one piece.
+int send_command(int sockfd, const char *command) 
+{
+    char tagged[BUFFER_SIZE + 32];
+    int len = snprintf(tagged, sizeof(tagged), "@%016llx %s", request_id, command);
+    return (write(sockfd, tagged, len) == len) ? 0 : -1;
+}
+
+// Function to send a file to the server
+int send_file(int sockfd, char *filename) 
+{
+    int fd;
+    
+    // Open file
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) 
+    {
+        printf("ERROR: Failed to open file '%s'\n", filename);
+        return -1;
+    }
+    
+    // Get file size
+    struct stat st;
+    if (fstat(fd, &st) < 0) 
+    {
+        printf("ERROR: Failed to get file size\n");
+        close(fd);
+        return -1;
+    }
+    
+    // Send file size; the socket stays corked so it goes out with the first data
+    net_cork(sockfd);
+    if (net_write_full(sockfd, &st.st_size, sizeof(off_t)) < 0) 
+    {
+        error("ERROR writing file size to socket");
+        net_uncork(sockfd);
+        close(fd);
+        return -1;
+    }
+    
+    // Send file data straight from the page cache
+    int rc = net_sendfile(sockfd, fd, st.st_size);
+    if (rc < 0) 
+    {
+        printf("ERROR: Failed to send file data\n");
+    }
+    
+    net_uncork(sockfd);
+    close(fd);
+    return rc;
+}
+
+// Function to receive a file from the server
+int receive_file(int sockfd, char *filename) 
+{
+    int fd;
+    ssize_t n;
+
+    // The reply starts with either the file size or an "ERROR: ..." message.
+    // Read the first 5 bytes to tell them apart, then the rest of the size.
+    off_t file_size;
+    char *header = (char *)&file_size;
+    if (net_read_reply(sockfd, header, 5) < 0) 
+    {
+        printf("ERROR: Failed to read from socket\n");
+        return -1;
+    }
+
+    // Check if the response starts with "ERROR"
+    if (memcmp(header, "ERROR", 5) == 0) 
+    {
+        // Read the rest of the error message; the server closes the connection after it
+        char error_msg[BUFFER_SIZE] = "ERROR";
+        size_t len = 5;
+        while (len < BUFFER_SIZE - 1 && (n = net_read_some(sockfd, error_msg + len, BUFFER_SIZE - 1 - len)) > 0) 
+        {
+            len += n;
+        }
+        error_msg[len] = '\0';
+        printf("%s\n", error_msg);
+        return -1;
+    }
+
+    // Read the rest of the file size
+    if (net_read_full(sockfd, header + 5, sizeof(off_t) - 5) < 0) 
+    {
+        printf("ERROR: Failed to read file size\n");
+        return -1;
+    }
+
+    // Check if file size is valid
+    if (file_size <= 0) 
+    {
+        printf("ERROR: Invalid file size received: %ld\n", (long)file_size);
+        return -1;
+    }
+
+    // Create file; very large downloads can bypass the page cache with O_DIRECT,
+    // which falls back to normal writes on file systems that do not support it
+    int direct = net_use_direct_io(file_size);
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | (direct ? O_DIRECT : 0), 0644);
+    if (fd < 0 && direct) 
+    {
+        direct = 0;
+        fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) {
+        printf("ERROR: Failed to create file '%s'\n", filename);
+        return -1;
+    }
+
+    // Reserve the whole file up front so it is laid out contiguously
+    // and a full disk is reported before any data is transferred
+    if (fallocate(fd, 0, 0, file_size) < 0 && errno != EOPNOTSUPP) 
+    {
+        printf("ERROR: Not enough space for '%s'\n", filename);
+        close(fd);
+        unlink(filename);
+        return -1;
+    }
+
+    // Receive file data
+    if (net_recvfile(sockfd, fd, file_size, direct) < 0) 
+    {
+        printf("ERROR: File transfer failed\n");
+        close(fd);
+        unlink(filename);  // Delete partially written file
+        return -1;
+    }
+
+    close(fd); // Close the file
+    return 0; // Success
+}
+
+// Error handling function
+void error(const char *msg) 
+{
+    perror(msg);
 }
\ No newline at end of file